@@ -0,0 +1,107 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+// Square region of chunks represented by a single chunk quadtree node
+struct FMQCChunkRegion
+{
+    // Region min chunk coordinate and chunk dimension
+    FIntPoint Min;
+    int32 Size;
+
+    // Whether all region chunk voxels share the same state
+    bool bUniform;
+    uint8 State;
+};
+
+// Sparse quadtree index of chunk voxel state uniformity.
+//
+// The tree spans the chunk grid rounded up to a power of two dimension.
+// Regions where all chunks are uniform with the same voxel state are
+// collapsed into a single leaf node, only non-uniform regions are
+// subdivided down to single chunk leaves. Padding chunks outside the
+// map are treated as uniform empty state chunks.
+class MARCHINGSQUARESCOMPLEX_API FMQCChunkQuadtree
+{
+private:
+
+    struct FNode
+    {
+        // Index of the first of four contiguous child nodes,
+        // INDEX_NONE on leaf nodes
+        int32 Children;
+        uint8 State;
+        bool bUniform;
+    };
+
+    // Child quadrants are ordered min-x min-y, max-x min-y,
+    // min-x max-y, max-x max-y
+    TArray<FNode> Nodes;
+    TArray<int32> FreeChildren;
+
+    int32 Resolution;
+    int32 Extent;
+
+    int32 AllocateChildren(uint8 State);
+    bool TryCollapse(int32 NodeIndex);
+
+public:
+
+    FMQCChunkQuadtree();
+
+    // Resets the tree to a single uniform empty state region
+    void Reset(int32 InResolution);
+
+    // Updates chunk uniformity, splits and collapses nodes along the chunk path
+    void SetChunkState(int32 ChunkX, int32 ChunkY, bool bUniform, uint8 State);
+
+    // Finds the leaf region containing the chunk
+    FMQCChunkRegion FindRegion(int32 ChunkX, int32 ChunkY) const;
+
+    // Appends leaf regions overlapping inclusive chunk bounds
+    void GetRegions(TArray<FMQCChunkRegion>& OutRegions, const FIntPoint& ChunkMin, const FIntPoint& ChunkMax) const;
+
+    int32 GetLeafCount() const;
+
+    FORCEINLINE int32 GetResolution() const
+    {
+        return Resolution;
+    }
+
+    FORCEINLINE int32 GetNodeCount() const
+    {
+        return Nodes.Num() - FreeChildren.Num()*4;
+    }
+
+    FORCEINLINE SIZE_T GetAllocatedSize() const
+    {
+        return Nodes.GetAllocatedSize() + FreeChildren.GetAllocatedSize();
+    }
+};
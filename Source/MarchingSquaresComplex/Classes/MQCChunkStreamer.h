@@ -0,0 +1,210 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+
+class FMQCMap;
+class FMQCGridChunk;
+
+// Pages sparse map chunk voxels in and out of memory around focus points.
+//
+// Chunks within the streaming radius of any focus point are kept resident.
+// Once resident chunk memory exceeds the memory budget, least recently used
+// resident chunks outside the streaming radius are written to the local
+// chunk store and evicted. Stored chunks entering the streaming radius are
+// loaded asynchronously and made resident on tick. Chunks edited while
+// evicted are restored synchronously before the edit.
+//
+// Unnamed chunk stores only hold chunks of the current session and are
+// deleted on reset. Named stores persist across sessions, maps initialized
+// with an existing named store resume its stored chunks if the store chunk
+// layout matches the map, mismatching stores are cleared.
+class MARCHINGSQUARESCOMPLEX_API FMQCChunkStreamer
+{
+private:
+
+    // Store status is known without file system lookups, chunks are
+    // stored once evicted or flushed, or if found in a resumed store
+    enum class EStoreStatus : uint8
+    {
+        SS_NONE,
+        SS_STORED
+    };
+
+    struct FChunkEntry
+    {
+        uint64 LastAccess = 0;
+        uint32 FocusSerial = 0;
+        EStoreStatus StoreStatus = EStoreStatus::SS_NONE;
+        bool bResident = false;
+    };
+
+    typedef TSharedPtr<TArray<uint8>, ESPMode::ThreadSafe> FChunkDataPtr;
+
+    // Written chunk data is kept until the write completes
+    // so that chunks can be restored before the write finishes
+    struct FPendingWrite
+    {
+        FChunkDataPtr Data;
+        TFuture<bool> Result;
+    };
+
+    FMQCMap& Map;
+
+    TArray<FChunkEntry> ChunkEntries;
+    TArray<int32> ResidentChunks;
+    TArray<FVector2D> FocusPoints;
+    TMap<int32, TFuture<FChunkDataPtr>> PendingLoads;
+    TMap<int32, FPendingWrite> PendingWrites;
+    TArray<int32> LoadedChunks;
+    FString StoreDirectory;
+
+    // Chunk layout key written to stored chunks and the store manifest
+    uint32 StoreKey;
+    bool bSessionStore;
+
+    uint64 AccessClock;
+    uint32 FocusSerial;
+    SIZE_T ResidentMemory;
+    int32 EvictedCount;
+
+    FString GetChunkPath(int32 ChunkIndex) const;
+    FString GetManifestPath() const;
+    uint32 GetLayoutKey() const;
+    void OpenStore();
+    void ResumeStore();
+    void WriteManifest();
+    bool IsChunkStored(int32 ChunkIndex) const;
+    void TouchFocusChunks();
+    void RequestLoad(int32 ChunkIndex);
+    void CompleteLoads();
+    void CompleteWrites(bool bWait);
+    void WaitForPendingWrite(int32 ChunkIndex);
+    void EnforceMemoryBudget();
+    void StoreChunk(int32 ChunkIndex, FMQCGridChunk& Chunk);
+    bool ReadChunkData(FMQCGridChunk& Chunk, const TArray<uint8>& Data) const;
+
+public:
+
+    static const uint32 StoreMagic;
+    static const int32 StoreVersion;
+
+    // Streaming radius around focus points in voxels
+    float StreamingRadius = 0.f;
+
+    // Resident chunk memory budget in bytes, zero or less disables eviction
+    int64 MemoryBudget = 0;
+
+    // Keep evicted chunk meshes resident, evicted chunk meshes are
+    // cleared and regenerated from reloaded voxels otherwise
+    bool bKeepEvictedMeshes = false;
+
+    // Maximum concurrent async chunk loads
+    int32 MaxPendingLoads = 8;
+
+    FMQCChunkStreamer(FMQCMap& InMap);
+    ~FMQCChunkStreamer();
+
+    // Waits for pending store I/O and resets chunk residency. Empty store
+    // directory uses the project saved directory, empty store id opens a
+    // new session store. Named stores of mismatching layout are cleared.
+    void Reset(const FString& InStoreDirectory = FString(), const FString& InStoreId = FString());
+
+    void SetFocusPoints(const TArray<FVector2D>& InFocusPoints);
+
+    FORCEINLINE const TArray<FVector2D>& GetFocusPoints() const
+    {
+        return FocusPoints;
+    }
+
+    // Completes async loads, loads stored chunks around focus points and
+    // evicts least recently used chunks over the memory budget. Returns the
+    // number of chunks made resident from the chunk store.
+    int32 Tick();
+
+    // Chunks made resident from the chunk store on the last tick
+    FORCEINLINE const TArray<int32>& GetLoadedChunks() const
+    {
+        return LoadedChunks;
+    }
+
+    // Called by the map once chunk voxels are allocated,
+    // restores stored chunk voxels and marks the chunk resident
+    void RestoreChunk(int32 ChunkIndex, FMQCGridChunk& Chunk);
+
+    // Marks chunk as recently used
+    void TouchChunk(int32 ChunkIndex);
+
+    // Writes resident chunk voxels to the chunk store and releases them
+    bool EvictChunk(int32 ChunkIndex);
+
+    // Writes resident chunk voxels to the chunk store without evicting them
+    void FlushResidentChunks();
+
+    // Deletes all stored chunks of the store
+    void ClearStore();
+
+    FORCEINLINE int32 GetResidentCount() const
+    {
+        return ResidentChunks.Num();
+    }
+
+    // Resident chunk memory as of the last tick
+    FORCEINLINE SIZE_T GetResidentMemory() const
+    {
+        return ResidentMemory;
+    }
+
+    FORCEINLINE int32 GetPendingLoadCount() const
+    {
+        return PendingLoads.Num();
+    }
+
+    FORCEINLINE int32 GetPendingWriteCount() const
+    {
+        return PendingWrites.Num();
+    }
+
+    // Number of chunks evicted since reset
+    FORCEINLINE int32 GetEvictedCount() const
+    {
+        return EvictedCount;
+    }
+
+    FORCEINLINE bool IsChunkResident(int32 ChunkIndex) const
+    {
+        return ChunkEntries.IsValidIndex(ChunkIndex) && ChunkEntries[ChunkIndex].bResident;
+    }
+
+    FORCEINLINE const FString& GetStoreDirectory() const
+    {
+        return StoreDirectory;
+    }
+};
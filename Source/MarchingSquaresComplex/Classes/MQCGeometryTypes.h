@@ -50,6 +50,214 @@ struct FMQCEdgeSyncData
 
 typedef TArray<FVector2D> FMQCEdgePointList;
 
+// Read-only view of a single chunk edge point list.
+// References surface point indices and either mesh section positions
+// or compact surface positions directly, valid until the owning chunk
+// is re-triangulated or reset, or its compact geometry is expanded.
+struct FMQCEdgePointView
+{
+    TArrayView<const uint32> Indices;
+    TArrayView<const FVector> Positions;
+    TArrayView<const FVector2D> CompactPositions;
+
+    FMQCEdgePointView() = default;
+
+    FMQCEdgePointView(TArrayView<const uint32> InIndices, TArrayView<const FVector> InPositions)
+        : Indices(InIndices)
+        , Positions(InPositions)
+    {
+    }
+
+    FMQCEdgePointView(TArrayView<const uint32> InIndices, TArrayView<const FVector2D> InCompactPositions)
+        : Indices(InIndices)
+        , CompactPositions(InCompactPositions)
+    {
+    }
+
+    FORCEINLINE int32 Num() const
+    {
+        return Indices.Num();
+    }
+
+    FORCEINLINE bool IsEmpty() const
+    {
+        return Indices.Num() < 1;
+    }
+
+    FORCEINLINE FVector2D GetPoint(int32 i) const
+    {
+        return (CompactPositions.Num() > 0)
+            ? CompactPositions[Indices[i]]
+            : FVector2D(Positions[Indices[i]]);
+    }
+
+    FORCEINLINE FVector2D operator[](int32 i) const
+    {
+        return GetPoint(i);
+    }
+
+    template<typename FPointFunc>
+    FORCEINLINE void ForEachPoint(FPointFunc&& Func, int32 StartIndex = 0) const
+    {
+        for (int32 i=StartIndex; i<Indices.Num(); ++i)
+        {
+            Func(GetPoint(i));
+        }
+    }
+};
+
+// Read-only view of a connected map edge point list spanning multiple chunks.
+// Consecutive chunk views share their connection point, which is only
+// visited once when iterating points.
+struct FMQCConnectedEdgePointView
+{
+    TArray<FMQCEdgePointView, TInlineAllocator<8>> Views;
+
+    FORCEINLINE void Reset()
+    {
+        Views.Reset();
+    }
+
+    FORCEINLINE int32 Num() const
+    {
+        int32 PointCount = 0;
+
+        for (const FMQCEdgePointView& View : Views)
+        {
+            PointCount += View.Num();
+        }
+
+        // Exclude shared connection points
+        return FMath::Max(0, PointCount - FMath::Max(0, Views.Num()-1));
+    }
+
+    template<typename FPointFunc>
+    FORCEINLINE void ForEachPoint(FPointFunc&& Func) const
+    {
+        for (int32 i=0; i<Views.Num(); ++i)
+        {
+            Views[i].ForEachPoint(Func, (i>0) ? 1 : 0);
+        }
+    }
+};
+
+// Allocated memory in bytes per category
+struct FMQCMemoryUsage
+{
+    SIZE_T Objects = 0;
+    SIZE_T Voxels = 0;
+    SIZE_T LODVoxels = 0;
+    SIZE_T TriangulationCache = 0;
+    SIZE_T VertexMap = 0;
+    SIZE_T EdgeLists = 0;
+    SIZE_T EdgeSegmentTree = 0;
+    SIZE_T MeshSections = 0;
+    SIZE_T CompactGeometry = 0;
+    SIZE_T QuadFilters = 0;
+    SIZE_T Materials = 0;
+    SIZE_T MaterialSectionMap = 0;
+    SIZE_T MaterialIndexMap = 0;
+    SIZE_T EdgeSync = 0;
+
+    FORCEINLINE SIZE_T GetTotal() const
+    {
+        return Objects
+            + Voxels
+            + LODVoxels
+            + TriangulationCache
+            + VertexMap
+            + EdgeLists
+            + EdgeSegmentTree
+            + MeshSections
+            + CompactGeometry
+            + QuadFilters
+            + Materials
+            + MaterialSectionMap
+            + MaterialIndexMap
+            + EdgeSync;
+    }
+
+    FORCEINLINE FMQCMemoryUsage& operator+=(const FMQCMemoryUsage& Other)
+    {
+        Objects += Other.Objects;
+        Voxels += Other.Voxels;
+        LODVoxels += Other.LODVoxels;
+        TriangulationCache += Other.TriangulationCache;
+        VertexMap += Other.VertexMap;
+        EdgeLists += Other.EdgeLists;
+        EdgeSegmentTree += Other.EdgeSegmentTree;
+        MeshSections += Other.MeshSections;
+        CompactGeometry += Other.CompactGeometry;
+        QuadFilters += Other.QuadFilters;
+        Materials += Other.Materials;
+        MaterialSectionMap += Other.MaterialSectionMap;
+        MaterialIndexMap += Other.MaterialIndexMap;
+        EdgeSync += Other.EdgeSync;
+        return *this;
+    }
+
+    FORCEINLINE FString ToString() const
+    {
+        return FString::Printf(
+            TEXT("Total: %llu, Objects: %llu, Voxels: %llu, LODVoxels: %llu, TriangulationCache: %llu, VertexMap: %llu, ")
+            TEXT("EdgeLists: %llu, EdgeSegmentTree: %llu, MeshSections: %llu, CompactGeometry: %llu, QuadFilters: %llu, ")
+            TEXT("Materials: %llu, MaterialSectionMap: %llu, MaterialIndexMap: %llu, EdgeSync: %llu"),
+            (uint64) GetTotal(),
+            (uint64) Objects,
+            (uint64) Voxels,
+            (uint64) LODVoxels,
+            (uint64) TriangulationCache,
+            (uint64) VertexMap,
+            (uint64) EdgeLists,
+            (uint64) EdgeSegmentTree,
+            (uint64) MeshSections,
+            (uint64) CompactGeometry,
+            (uint64) QuadFilters,
+            (uint64) Materials,
+            (uint64) MaterialSectionMap,
+            (uint64) MaterialIndexMap,
+            (uint64) EdgeSync
+            );
+    }
+};
+
+// Idle chunk compression stats, decompression stats are
+// accumulated since chunk configuration
+struct FMQCCompressionStats
+{
+    int32 CompressedChunks = 0;
+    SIZE_T UncompressedSize = 0;
+    SIZE_T CompressedSize = 0;
+    int32 DecompressionCount = 0;
+    double DecompressionTime = 0.0;
+    double MaxDecompressionTime = 0.0;
+
+    FORCEINLINE float GetCompressionRatio() const
+    {
+        return CompressedSize > 0 ? static_cast<float>(UncompressedSize) / CompressedSize : 1.f;
+    }
+
+    FORCEINLINE double GetAverageDecompressionTime() const
+    {
+        return DecompressionCount > 0 ? DecompressionTime / DecompressionCount : 0.0;
+    }
+
+    FORCEINLINE FString ToString() const
+    {
+        return FString::Printf(
+            TEXT("CompressedChunks: %d, UncompressedSize: %llu, CompressedSize: %llu, Ratio: %.2f, ")
+            TEXT("Decompressions: %d, AvgDecompressionMs: %.3f, MaxDecompressionMs: %.3f"),
+            CompressedChunks,
+            (uint64) UncompressedSize,
+            (uint64) CompressedSize,
+            GetCompressionRatio(),
+            DecompressionCount,
+            GetAverageDecompressionTime() * 1000.0,
+            MaxDecompressionTime * 1000.0
+            );
+    }
+};
+
 USTRUCT(BlueprintType)
 struct FMQCEdgePointData
 {
@@ -58,3 +266,85 @@ struct FMQCEdgePointData
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     TArray<FVector2D> Points;
 };
+
+USTRUCT(BlueprintType)
+struct FMQCRaycastHit
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bHit = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FVector2D Location = FVector2D::ZeroVector;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FVector2D Normal = FVector2D::ZeroVector;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    float Distance = 0.f;
+
+    // Voxel state on the far side of the hit contour
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    uint8 State = 0;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 ChunkIndex = -1;
+};
+
+USTRUCT(BlueprintType)
+struct FMQCEdgeSegment
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FVector2D Point0 = FVector2D::ZeroVector;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FVector2D Point1 = FVector2D::ZeroVector;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 ChunkIndex = -1;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 EdgeListIndex = -1;
+};
+
+USTRUCT(BlueprintType)
+struct FMQCEdgeQueryResult
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bFound = false;
+
+    // Closest point on the found edge segment
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FVector2D Location = FVector2D::ZeroVector;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    float Distance = 0.f;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    FMQCEdgeSegment Segment;
+};
+
+// Chunk surface whose geometry changed after triangulation
+
+USTRUCT(BlueprintType)
+struct FMQCGeometryChange
+{
+    GENERATED_BODY()
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 ChunkIndex = -1;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 StateIndex = -1;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bSurfaceChanged = false;
+
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bExtrudeChanged = false;
+};
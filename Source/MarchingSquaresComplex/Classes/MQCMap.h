@@ -28,43 +28,157 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "HAL/CriticalSection.h"
 
 #include "Mesh/PMUMeshTypes.h"
 #include "Mesh/Simplifier/PMUMeshSimplifierOptions.h"
 
+#include "MQCVoxel.h"
 #include "MQCVoxelTypes.h"
 #include "MQCGeometryTypes.h"
 #include "MQCMaterial.h"
+#include "MQCStencilRecorder.h"
+#include "MQCTriangulationScheduler.h"
+#include "MQCChunkQuadtree.h"
+#include "MQCChunkStreamer.h"
 #include "MQCMap.generated.h"
 
 class FMQCGridChunk;
+class FMQCCell;
+class FMQCSnapshotEpochs;
+struct FMQCVoxel;
 class UPMUMeshComponent;
 
+DECLARE_MULTICAST_DELEGATE_OneParam(FMQCGeometryChangedEvent, const TArray<FMQCGeometryChange>&);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMQCGeometryChangedSignature, const TArray<FMQCGeometryChange>&, Changes);
+DECLARE_MULTICAST_DELEGATE_OneParam(FMQCEdgeDataReadyEvent, int32);
+DECLARE_DYNAMIC_MULTICAST_DELEGATE_OneParam(FMQCEdgeDataReadySignature, int32, StateIndex);
+
 class MARCHINGSQUARESCOMPLEX_API FMQCMap
 {
 private:
 
     typedef TArray<FMQCEdgeSyncData> FEdgeSyncList;
     typedef TArray<FEdgeSyncList> FStateEdgeSyncList;
+    typedef TSharedRef<TPromise<void>, ESPMode::ThreadSafe> FEdgeDataPromiseRef;
+
+    struct FVoxelQuery
+    {
+        int32 QueryIndex;
+        int32 VoxelIndex;
+    };
 
     int32 VoxelResolution;
     int32 ChunkResolution;
+    int32 ClusterResolution;
     float MaxFeatureAngle;
     float MaxParallelAngle;
     float ExtrusionHeight;
     EMQCMaterialType MaterialType;
+    bool bHaloVoxels;
+    bool bScheduleEditedChunks;
+    bool bVoxelSnapshots;
+    bool bSparseChunks;
+    bool bStreamChunks;
+    FString StreamingStoreDirectory;
+    FString StreamingStoreId;
+    bool bCompressIdleChunks;
+    bool bReleaseIdleChunkMeshes;
+    float IdleChunkSeconds;
+    int32 MaxChunksCompressedPerTick;
     TArray<FMQCSurfaceState> SurfaceStates;
 
-    TArray<FMQCGridChunk*> Chunks;
+    // Chunk objects are allocated in pages, fixed size chunk quadtree
+    // leaves of ChunkPageResolution^2 chunks ordered by chunk Z-order
+    // (Morton) code. Only the chunk objects are paged, chunk voxel and
+    // surface data remain separate heap allocations. Dense maps create all
+    // pages on initialization. Sparse maps create a page once any of its
+    // chunks is first allocated, chunks without a page read as empty.
+    // ChunkPages maps row-major page index to its published page and
+    // ChunkOrder lists row-major indices of created chunks in Z-order.
+    TArray<TAtomic<FMQCGridChunk*>> ChunkPages;
+    TArray<int32> ChunkOrder;
+    int32 ChunkPageResolution;
+    int32 ChunkPageDimension;
     TArray<FStateEdgeSyncList> EdgeSyncGroups;
 
+    // Chunk voxel state uniformity index, updated on the editing thread
+    // after voxel state edits. Queries that may run concurrently with
+    // edits read the index under a shared lock.
+    FMQCChunkQuadtree ChunkTree;
+    mutable FRWLock ChunkTreeLock;
+
+    // Empty voxel block shared by unallocated sparse chunks
+    TArray<FMQCVoxel> EmptyVoxels;
+
     bool bRequireFinalizeAsync = false;
 
+    FMQCGeometryChangedEvent GeometryChangedEvent;
+
+    // Edge data futures per state index of the last async triangulation,
+    // fulfilled once all chunks are triangulated and state edge data
+    // is resolved
+    TArray<TSharedFuture<void>> EdgeDataFutures;
+    FMQCEdgeDataReadyEvent EdgeDataReadyEvent;
+
+    // Fulfilled once edge data ready events of the last async
+    // triangulation have been broadcast
+    TSharedFuture<void> EdgeDataBroadcastFuture;
+
+    // Chunks with released geometry read since the last scheduler tick
+    TQueue<int32, EQueueMode::Mpsc> GeometryRestoreQueue;
+
+    // Optional stencil operation recorder, not owned by the map
+    FMQCStencilRecorder* Recorder = nullptr;
+
+    // Memory usage last reported to memory stats
+    FMQCMemoryUsage ReportedMemoryUsage;
+
+    FMQCTriangulationScheduler Scheduler;
+    FMQCChunkStreamer Streamer;
+
+    // Scheduled chunks completed since the last edge data resolution
+    int32 ScheduledCompletedCount = 0;
+
+    // Chunk pool index of the last chunk visited by idle chunk compression
+    int32 CompressionCursor = 0;
+
+    // Voxel snapshot reclamation, valid if voxel snapshots are enabled
+    TUniquePtr<FMQCSnapshotEpochs> SnapshotEpochs;
+
     void InitializeSettings(const FMQCMapConfig& MapConfig);
-    void InitializeChunk(int32 i, int32 x, int32 y);
+    void GetChunkConfig(FMQCChunkConfig& OutConfig, int32 ChunkX, int32 ChunkY) const;
     void InitializeChunks();
-    void ResolveChunkEdgeData();
+    void CreateChunkPage(int32 PageX, int32 PageY);
+    void LinkChunkNeighbours(int32 ChunkX, int32 ChunkY);
+    FMQCGridChunk& CreateChunk(int32 ChunkX, int32 ChunkY);
+    void AllocateChunk(int32 ChunkX, int32 ChunkY);
+    void MarkChunkAccessed(int32 ChunkIndex) const;
+    void UpdateChunkLODSeams(int32 ChunkX, int32 ChunkY);
+    int32 GetChunkLODByCoord(int32 ChunkX, int32 ChunkY) const;
     void ResolveChunkEdgeData(int32 StateIndex);
+    void ResolveChunkEdgeDataAsync(const TArray<FEdgeDataPromiseRef>& Promises, const FEdgeDataPromiseRef& BroadcastPromise);
+    void WaitForEdgeResolution();
+    bool IsEdgeResolutionComplete() const;
+    void BroadcastGeometryChanges();
+    void UpdateMemoryStats();
+
+    void GenerateVoxelQueries(TArray<FVoxelQuery>& OutQueries, TArray<int32>& OutBinOffsets, const TArray<FIntPoint>& Positions) const;
+
+    template<typename FVoxelFunc>
+    void ForEachVoxelQuery(const TArray<FIntPoint>& Positions, bool bParallel, FVoxelFunc&& VoxelFunc) const;
+
+    // Reads published voxels, callers hold a snapshot read scope
+    const FMQCVoxel& GetVoxel(int32 X, int32 Y) const;
+    void GetCell(FMQCCell& OutCell, int32 X, int32 Y) const;
+    void InitializeCell(FMQCCell& OutCell) const;
+    void GetChunkIndices(TArray<int32>& OutChunkIndices, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax) const;
+    void GetContourChunkIndices(TArray<int32>& OutChunkIndices, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax) const;
+
+    static uint32 GetMortonCode(uint32 X, uint32 Y);
+    static bool ClipRay(const FVector2D& Origin, const FVector2D& Direction, const FVector2D& BoundsMin, const FVector2D& BoundsMax, float& MinTime, float& MaxTime);
+    static float GetRayExitTime(const FVector2D& Origin, const FVector2D& Direction, const FVector2D& BoundsMin, const FVector2D& BoundsMax);
 
 public:
 
@@ -117,31 +231,246 @@ public:
     void TriangulateAsync();
     void WaitForAsyncTask();
     void FinalizeAsync();
+    void ResolveChunkEdgeData();
     void ResetChunkStates(const TArray<int32>& ChunkIndices);
     void ResetAllChunkStates();
 
+    // Scheduled Triangulation
+
+    FORCEINLINE FMQCTriangulationScheduler& GetScheduler()
+    {
+        return Scheduler;
+    }
+
+    FORCEINLINE const FMQCTriangulationScheduler& GetScheduler() const
+    {
+        return Scheduler;
+    }
+
+    FORCEINLINE bool IsScheduleEditedChunks() const
+    {
+        return bScheduleEditedChunks;
+    }
+
+    // Processes scheduled chunks within the time budget, resolves edge data
+    // and broadcasts geometry changes of completed chunks. Edge resolution
+    // reads all chunk surfaces and only runs once no scheduled chunk is in
+    // flight, further dispatch is held until then. Edge resolution is not
+    // included in the budget. Returns the number of chunks with resolved
+    // and broadcasted geometry.
+    int32 TickScheduledTriangulation(float BudgetMs);
+
+    // Broadcasts chunk surfaces with changed geometry after triangulation
+    FORCEINLINE FMQCGeometryChangedEvent& OnGeometryChanged()
+    {
+        return GeometryChangedEvent;
+    }
+
+    // Broadcasts each state index in state order once edge data of all
+    // states of an async triangulation is resolved. Broadcast from the
+    // worker thread resolving the last state, never concurrently.
+    FORCEINLINE FMQCEdgeDataReadyEvent& OnEdgeDataReady()
+    {
+        return EdgeDataReadyEvent;
+    }
+
+    // Future of state edge data resolution of the last async triangulation,
+    // invalid if no async triangulation has been dispatched
+    TSharedFuture<void> GetEdgeDataFuture(int32 StateIndex) const;
+
+    // Recording
+
+    FORCEINLINE FMQCStencilRecorder* GetRecorder() const
+    {
+        return Recorder;
+    }
+
+    FORCEINLINE void SetRecorder(FMQCStencilRecorder* InRecorder)
+    {
+        Recorder = InRecorder;
+    }
+
+    // Memory
+
+    void GetMemoryUsage(FMQCMemoryUsage& OutUsage) const;
+    SIZE_T GetAllocatedSize() const;
+    void DumpMemoryUsage(FOutputDevice& Ar, int32 TopChunkCount) const;
+
     // Chunk
 
+    // Chunk index validity and chunk count of the map chunk layout,
+    // chunk objects of sparse maps are only created once allocated
     bool HasChunk(int32 ChunkIndex) const;
     int32 GetChunkCount() const;
     int32 GetChunkIndex(int32 ChunkX, int32 ChunkY) const;
     int32 GetChunkIndexByPoint(int32 X, int32 Y) const;
+    FIntPoint GetChunkOffset(int32 ChunkIndex) const;
+
+    // Chunk object, null if the chunk object has not been created
+    const FMQCGridChunk* FindChunk(int32 ChunkIndex) const;
+    FMQCGridChunk* FindChunk(int32 ChunkIndex);
+
+    // Chunk object, the chunk object must have been created
     const FMQCGridChunk& GetChunk(int32 ChunkIndex) const;
     FMQCGridChunk& GetChunk(int32 ChunkIndex);
+
+    // Created chunk objects within voxel bounds
     void GetChunks(TArray<FMQCGridChunk*>& OutChunks, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax);
 
+    // Chunk to be edited. Sparse chunk voxels are allocated along with
+    // neighbour chunks sharing the chunk border cells.
+    FMQCGridChunk& GetChunkForEdit(int32 ChunkIndex);
+
+    // Updates chunk index uniformity of chunks with edited voxel states
+    void UpdateChunkRegions(const TArray<int32>& ChunkIndices);
+
+    // Chunk index leaf regions overlapping voxel bounds
+    void GetChunkRegions(TArray<FMQCChunkRegion>& OutRegions, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax) const;
+
+    int32 GetAllocatedChunkCount() const;
+
+    // Chunk index, only safe to be read on the editing thread
+    FORCEINLINE const FMQCChunkQuadtree& GetChunkTree() const
+    {
+        return ChunkTree;
+    }
+
+    FORCEINLINE bool IsSparseChunks() const
+    {
+        return bSparseChunks;
+    }
+
+    FORCEINLINE bool IsHaloVoxels() const
+    {
+        return bHaloVoxels;
+    }
+
+    // Streaming
+
+    FORCEINLINE FMQCChunkStreamer& GetStreamer()
+    {
+        return Streamer;
+    }
+
+    FORCEINLINE const FMQCChunkStreamer& GetStreamer() const
+    {
+        return Streamer;
+    }
+
+    FORCEINLINE bool IsStreamChunks() const
+    {
+        return bStreamChunks;
+    }
+
+    // Ticks chunk streaming and requests scheduled triangulation of chunks
+    // made resident from the chunk store. Broadcasts cleared geometry of
+    // evicted chunks. Returns the number of chunks made resident.
+    int32 TickStreaming();
+
+    // Allocates sparse chunk voxels, restoring stored voxels of streamed chunks
+    void MakeChunkResident(int32 ChunkIndex);
+
+    // Unlinks chunk from its neighbours and releases chunk voxels,
+    // used by the streamer to evict stored chunks
+    void ReleaseChunk(int32 ChunkIndex, bool bReleaseGeometry);
+
+    // Releases compact geometry of published expanded chunk sections,
+    // called on the editing thread. Skipped while async triangulation or
+    // edge data resolution may still read compact positions.
+    void ReleaseExpandedCompactGeometry(int32 ChunkIndex);
+
+    // Compression
+
+    FORCEINLINE bool IsCompressIdleChunks() const
+    {
+        return bCompressIdleChunks;
+    }
+
+    // Compresses voxels of chunks idle for longer than the idle time,
+    // called on the editing thread. Compressed voxels and released mesh
+    // buffers are restored on access. Returns the number of compressed chunks.
+    int32 TickChunkCompression();
+
+    void GetCompressionStats(FMQCCompressionStats& OutStats) const;
+
+    // Row-major chunk indices of created chunk objects in Z-order
+    // traversal order, map-wide passes only visit created chunks
+    FORCEINLINE const TArray<int32>& GetChunkTraversalOrder() const
+    {
+        return ChunkOrder;
+    }
+
+    // Cluster
+
+    FORCEINLINE int32 GetClusterResolution() const
+    {
+        return ClusterResolution;
+    }
+
+    FORCEINLINE int32 GetClusterDimension() const
+    {
+        return FMath::DivideAndRoundUp(ChunkResolution, ClusterResolution);
+    }
+
+    FORCEINLINE int32 GetClusterCount() const
+    {
+        return GetClusterDimension() * GetClusterDimension();
+    }
+
+    int32 GetClusterIndex(int32 ChunkIndex) const;
+    void GetClusterChunkIndices(TArray<int32>& OutChunkIndices, int32 ClusterIndex) const;
+
+    // LOD
+
+    int32 GetMaxLODLevel() const;
+    int32 GetChunkLOD(int32 ChunkIndex) const;
+    void SetChunkLOD(int32 ChunkIndex, int32 LODLevel);
+    void SetChunkLODs(const TArray<int32>& LODLevels);
+
     // Geometry
 
     void AddGeometry(const TArray<FVector2D>& Points, const TArray<int32>& Indices, int32 ChunkIndex, int32 StateIndex, bool bExtrudeGeometry);
     void AddQuadFilter(const FIntPoint& Point, int32 StateIndex, bool bExtrudeGeometry);
     int32 GetEdgePointListCount(int32 StateIndex) const;
-    void GetEdgePoints(TArray<FMQCEdgePointList>& OutPointList, int32 StateIndex) const;
-    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex) const;
-    void GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex) const;
+    void GetEdgePoints(TArray<FMQCEdgePointList>& OutPointList, int32 StateIndex, bool bSimplified = false) const;
+    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified = false) const;
+    void GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex, bool bSimplified = false) const;
+
+    // Geometry Views
+
+    const FPMUMeshSection* GetSurfaceSection(int32 ChunkIndex, int32 StateIndex) const;
+    const FPMUMeshSection* GetExtrudeSection(int32 ChunkIndex, int32 StateIndex) const;
+    bool GetEdgePointView(FMQCConnectedEdgePointView& OutView, int32 StateIndex, int32 EdgeListIndex, bool bSimplified = false) const;
+    int32 GetEdgePointViewsByChunkSurface(TArray<FMQCEdgePointView>& OutViews, int32 ChunkIndex, int32 StateIndex, bool bSimplified = false) const;
 
     // Material
 
     FMQCMaterial GetVoxelMaterial(const FIntPoint& Position) const;
+    uint8 GetVoxelState(const FIntPoint& Position) const;
+    void GetVoxelMaterials(TArray<FMQCMaterial>& OutMaterials, const TArray<FIntPoint>& Positions, bool bParallel = false) const;
+    void GetVoxelStates(TArray<uint8>& OutStates, const TArray<FIntPoint>& Positions, bool bParallel = false) const;
+
+    // Raycast
+
+    bool Raycast(FMQCRaycastHit& OutHit, const FVector2D& Start, const FVector2D& End) const;
+    void Raycasts(TArray<FMQCRaycastHit>& OutHits, const TArray<FVector2D>& Starts, const TArray<FVector2D>& Ends, bool bParallel = false) const;
+
+    FORCEINLINE bool HasLineOfSight(const FVector2D& Start, const FVector2D& End) const
+    {
+        FMQCRaycastHit Hit;
+        return ! Raycast(Hit, Start, End);
+    }
+
+    // Edge Query
+
+    bool FindNearestEdge(FMQCEdgeQueryResult& OutResult, const FVector2D& Point, int32 StateIndex, float MaxDistance = -1.f) const;
+    void FindEdgesWithinRadius(TArray<FMQCEdgeSegment>& OutSegments, const FVector2D& Center, float Radius, int32 StateIndex) const;
+    uint8 GetStateAt(const FVector2D& Point) const;
+
+    FORCEINLINE bool IsPointInState(const FVector2D& Point, int32 StateIndex) const
+    {
+        return GetStateAt(Point) == StateIndex;
+    }
 };
 
 UCLASS(BlueprintType, Blueprintable)
@@ -150,12 +479,26 @@ class MARCHINGSQUARESCOMPLEX_API UMQCMapRef : public UObject
     GENERATED_BODY()
 
     FMQCMap VoxelMap;
+    TUniquePtr<FMQCStencilRecorder> StencilRecorder;
+
+    void BroadcastGeometryChanges(const TArray<FMQCGeometryChange>& Changes);
+    void BroadcastEdgeDataReady(int32 StateIndex);
 
 public:
 
     UPROPERTY(EditAnywhere, Category="Map Settings")
     FMQCMapConfig MapConfig;
 
+    UPROPERTY(BlueprintAssignable)
+    FMQCGeometryChangedSignature OnGeometryChanged;
+
+    // Broadcast on the game thread once state edge data
+    // of an async triangulation is resolved
+    UPROPERTY(BlueprintAssignable)
+    FMQCEdgeDataReadySignature OnEdgeDataReady;
+
+    virtual void GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize) override;
+
     FORCEINLINE FMQCMap& GetMap()
     {
         return VoxelMap;
@@ -200,6 +543,85 @@ public:
     UFUNCTION(BlueprintCallable)
     void ResetAllChunkStates();
 
+    // Recording
+
+    // Starts recording stencil edits and triangulation calls applied to
+    // this map. Recorded streams include the map voxels at recording start
+    // and are replayed on a fresh map. Returns false if recording could
+    // not be started.
+    UFUNCTION(BlueprintCallable)
+    bool StartStencilRecording();
+
+    // Stops recording and writes the recorded stream to file
+    UFUNCTION(BlueprintCallable)
+    bool StopStencilRecording(const FString& Filename);
+
+    UFUNCTION(BlueprintCallable)
+    bool IsStencilRecording() const;
+
+    // Scheduled Triangulation
+
+    // Sets focus points used to prioritize scheduled chunks,
+    // chunks nearest to any focus point are processed first
+    UFUNCTION(BlueprintCallable)
+    void SetTriangulationFocusPoints(const TArray<FVector2D>& FocusPoints);
+
+    UFUNCTION(BlueprintCallable)
+    void RequestChunkTriangulation(const TArray<int32>& ChunkIndices);
+
+    UFUNCTION(BlueprintCallable)
+    void RequestChunkTriangulationWithPriority(int32 ChunkIndex, float Priority);
+
+    UFUNCTION(BlueprintCallable)
+    void CancelChunkTriangulation(const TArray<int32>& ChunkIndices);
+
+    UFUNCTION(BlueprintCallable)
+    void CancelAllChunkTriangulation();
+
+    UFUNCTION(BlueprintCallable)
+    int32 TickScheduledTriangulation(float BudgetMs);
+
+    UFUNCTION(BlueprintCallable)
+    bool HasScheduledTriangulation() const;
+
+    // Streaming
+
+    // Sets focus points around which streamed chunks are kept resident
+    UFUNCTION(BlueprintCallable)
+    void SetStreamingFocusPoints(const TArray<FVector2D>& FocusPoints);
+
+    // Ticks chunk streaming, chunks made resident are triangulated by
+    // ticking scheduled triangulation. Returns the number of loaded chunks.
+    UFUNCTION(BlueprintCallable)
+    int32 TickStreaming();
+
+    // Writes resident streamed chunks to the chunk store
+    UFUNCTION(BlueprintCallable)
+    void FlushStreamedChunks();
+
+    UFUNCTION(BlueprintCallable)
+    int32 GetResidentChunkCount() const;
+
+    UFUNCTION(BlueprintCallable)
+    int32 GetEvictedChunkCount() const;
+
+    // Compression
+
+    // Compresses idle chunk voxels, returns the number of compressed chunks
+    UFUNCTION(BlueprintCallable)
+    int32 TickChunkCompression();
+
+    UFUNCTION(BlueprintCallable)
+    int32 GetCompressedChunkCount() const;
+
+    // Uncompressed to compressed voxel size ratio of compressed chunks
+    UFUNCTION(BlueprintCallable)
+    float GetChunkCompressionRatio() const;
+
+    // Average chunk voxel decompression time in milliseconds
+    UFUNCTION(BlueprintCallable)
+    float GetAverageChunkDecompressionTime() const;
+
     // Dimension
 
     UFUNCTION(BlueprintCallable)
@@ -237,6 +659,20 @@ public:
     UFUNCTION(BlueprintCallable)
     FVector GetChunkPosition(int32 ChunkIndex) const;
 
+    // LOD
+
+    UFUNCTION(BlueprintCallable)
+    int32 GetMaxLODLevel() const;
+
+    UFUNCTION(BlueprintCallable)
+    int32 GetChunkLOD(int32 ChunkIndex) const;
+
+    UFUNCTION(BlueprintCallable)
+    void SetChunkLOD(int32 ChunkIndex, int32 LODLevel);
+
+    UFUNCTION(BlueprintCallable)
+    void SetChunkLODs(const TArray<int32>& LODLevels);
+
     // Geometry
 
     UFUNCTION(BlueprintCallable)
@@ -246,10 +682,10 @@ public:
     FPMUMeshSectionRef GetExtrudeSection(int32 ChunkIndex, int32 StateIndex);
 
     UFUNCTION(BlueprintCallable)
-    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex);
+    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified = false);
 
     UFUNCTION(BlueprintCallable)
-    void GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex);
+    void GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex, bool bSimplified = false);
 
     UFUNCTION(BlueprintCallable)
     FORCEINLINE_DEBUGGABLE int32 GetEdgePointListCount(int32 StateIndex) const;
@@ -266,6 +702,58 @@ public:
     // Material Query
 
     FORCEINLINE_DEBUGGABLE FMQCMaterial GetVoxelMaterial(const FIntPoint& Position) const;
+    FORCEINLINE_DEBUGGABLE void GetVoxelMaterials(TArray<FMQCMaterial>& OutMaterials, const TArray<FIntPoint>& Positions, bool bParallel = false) const;
+
+    UFUNCTION(BlueprintCallable)
+    FORCEINLINE_DEBUGGABLE uint8 GetVoxelState(const FIntPoint& Position) const;
+
+    UFUNCTION(BlueprintCallable)
+    void GetVoxelStates(TArray<uint8>& OutStates, const TArray<FIntPoint>& Positions, bool bParallel = false) const;
+
+    // Raycast
+
+    UFUNCTION(BlueprintCallable)
+    bool Raycast(FMQCRaycastHit& OutHit, FVector2D Start, FVector2D End) const;
+
+    UFUNCTION(BlueprintCallable)
+    void Raycasts(TArray<FMQCRaycastHit>& OutHits, const TArray<FVector2D>& Starts, const TArray<FVector2D>& Ends, bool bParallel = false) const;
+
+    UFUNCTION(BlueprintCallable)
+    bool HasLineOfSight(FVector2D Start, FVector2D End) const;
+
+    // Edge Query
+
+    UFUNCTION(BlueprintCallable)
+    bool FindNearestEdge(FMQCEdgeQueryResult& OutResult, FVector2D Point, int32 StateIndex, float MaxDistance = -1.f) const;
+
+    UFUNCTION(BlueprintCallable)
+    void FindEdgesWithinRadius(TArray<FMQCEdgeSegment>& OutSegments, FVector2D Center, float Radius, int32 StateIndex) const;
+
+    UFUNCTION(BlueprintCallable)
+    uint8 GetStateAt(FVector2D Point) const;
+
+    UFUNCTION(BlueprintCallable)
+    bool IsPointInState(FVector2D Point, int32 StateIndex) const;
+};
+
+// Merged mesh section of a chunk cluster, stores vertex and index
+// sub-ranges (offset, count) and bounds of each cluster chunk within the section
+struct FMQCMeshCluster
+{
+    FPMUMeshSection Section;
+    TArray<int32> ChunkIndices;
+    TArray<FIntPoint> VertexRanges;
+    TArray<FIntPoint> IndexRanges;
+    TArray<FBox> ChunkBounds;
+    int32 SectionIndex = -1;
+};
+
+// Mesh section published from a chunk section. The mesh section references
+// the chunk section, chunk geometry changes update the mesh section in place.
+struct FMQCChunkMeshSection
+{
+    const FPMUMeshSection* SourceSection = nullptr;
+    int32 SectionIndex = -1;
 };
 
 UCLASS(BlueprintType)
@@ -291,18 +779,89 @@ protected:
     UPROPERTY()
     TArray<UPMUMeshComponent*> SurfaceMeshComponents;
 
+    // Surface meshes (mesh index, state index) with geometry
+    // changed since the last normal calculation and simplification
+    TSet<FIntPoint> NormalDirtySurfaces;
+    TSet<FIntPoint> SimplifyDirtySurfaces;
+
+    // State index of published surface mesh sections,
+    // mapped by (mesh index, section index)
+    TMap<FIntPoint, int32> SurfaceSectionStates;
+
+    // Per task normal accumulation buffers, reused across calls
+    TArray<TArray<FVector>> NormalScratchBuffers;
+
+    // Chunk surfaces (chunk index, state index) mapped to the serial
+    // of their last geometry change, and surface meshes (state index,
+    // material key) mapped to the change serial consumed by their last
+    // generation. Changes are consumed per generated surface mesh.
+    TMap<FIntPoint, uint32> ChangedSurfaces;
+    TMap<FIntPoint, uint32> ConsumedSurfaceChanges;
+    uint32 GeometryChangeSerial = 0;
+
+    // Surface meshes pending render state update, reset
+    // once pending render state updates are flushed
+    TSet<int32> RenderDirtyMeshes;
+
+    // Clustered mesh sections, mapped by (cluster index, state index, material key)
+    TIndirectArray<FMQCMeshCluster> MeshClusters;
+    TMap<FIntVector, int32> MeshClusterMap;
+
+    // Published chunk mesh sections, mapped by (chunk index, state index, material key)
+    TMap<FIntVector, FMQCChunkMeshSection> ChunkMeshSections;
+
+    void OnMapGeometryChanged(const TArray<FMQCGeometryChange>& Changes);
+    void MarkRenderStateDirty(int32 MeshIndex);
+    uint32 ConsumeSurfaceChanges(int32 StateIndex, int32 MaterialKey);
+    bool HasSurfaceChanged(int32 ChunkIndex, int32 StateIndex, uint32 LastChangeSerial) const;
+    static int32 GetMaterialKey(const FMQCMaterialBlend& MaterialBlend);
+
+    // -- Mesh Clusters
+
+    bool IsClusterMode() const;
+    int32 GetSurfaceMeshCount() const;
+    FBox2D GetSurfaceMeshBounds(int32 MeshIndex) const;
+    FMQCMeshCluster& GetOrAddMeshCluster(int32 ClusterIndex, int32 StateIndex, int32 MaterialKey);
+
+    void GenerateClusterMesh(
+        TFunctionRef<const FPMUMeshSection*(int32)> GetChunkSection,
+        int32 StateIndex,
+        int32 MaterialKey,
+        UMaterialInterface* Material,
+        bool bChangedOnly,
+        uint32 LastChangeSerial
+        );
+
+    static void RebuildMeshCluster(FMQCMeshCluster& Cluster, TFunctionRef<const FPMUMeshSection*(int32)> GetChunkSection);
+    static bool UpdateMeshClusterRange(FMQCMeshCluster& Cluster, int32 ChunkSlot, const FPMUMeshSection* SourceSection);
+
     void InitializeMeshComponents(TArray<UPMUMeshComponent*>& MeshComponents);
     UPMUMeshComponent* GetOrAddMeshComponent(TArray<UPMUMeshComponent*>& MeshComponents, int32 MeshIndex);
     UPMUMeshComponent* GetSurfaceMesh(int32 MeshIndex);
 
+    void RegisterSurfaceSection(int32 MeshIndex, int32 SectionIndex, int32 StateIndex);
+    void PublishChunkSection(UPMUMeshComponent* Mesh, int32 ChunkIndex, int32 StateIndex, int32 MaterialKey, FPMUMeshSection* SourceSection, UMaterialInterface* Material);
+    void MarkSurfaceGeometryDirty(int32 MeshIndex, int32 StateIndex);
+    void GetSurfaceSectionRefs(TArray<FPMUMeshSectionRef>& OutSectionRefs, TArray<FIntPoint>& OutSectionIds, int32 StateIndex, const TSet<FIntPoint>* SurfaceFilter);
+    static void CalculateSectionNormal(FPMUMeshSection& Section, TArray<FVector>& Normals);
+    static void AppendSectionVertex(FPMUMeshSection& Dst, const FPMUMeshSection& Src, int32 VertexIndex);
+    static bool SimplifySectionInterior(FPMUMeshSection& Section, const FBox2D& Bounds, const FPMUMeshSimplifierOptions& Options);
+
 public:
 
     UPROPERTY(EditAnywhere, Category="Map Settings")
     FMQCMapConfig MapConfig;
 
+    // Calculate normals of surfaces with changed geometry after mesh generation
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Mesh Settings")
+    bool bAutoCalculateMeshNormal = false;
+
     AMQCMap();
     ~AMQCMap();
 
+    virtual void Tick(float DeltaSeconds) override;
+    virtual bool ShouldTickIfViewportsOnly() const override;
+
     UFUNCTION(BlueprintCallable)
     void Initialize();
 
@@ -323,8 +882,18 @@ public:
     UFUNCTION(BlueprintCallable)
     void Triangulate(bool bAsync = false, bool bWaitForAsyncToFinish = false);
 
+    // Ticks map scheduled triangulation within the time budget and
+    // generates changed chunk meshes. Returns the number of completed chunks.
+    UFUNCTION(BlueprintCallable)
+    int32 TickScheduledTriangulation(float BudgetMs, bool bGenerateMesh = true);
+
+    // Ticks map chunk streaming and regenerates meshes cleared
+    // by chunk eviction. Returns the number of loaded chunks.
     UFUNCTION(BlueprintCallable)
-    void GenerateMapMesh();
+    int32 TickStreaming(bool bGenerateMesh = true);
+
+    UFUNCTION(BlueprintCallable)
+    void GenerateMapMesh(bool bChangedOnly = true);
 
     UFUNCTION(BlueprintCallable)
     void GenerateMaterialMesh(
@@ -333,9 +902,15 @@ public:
         uint8 MaterialIndex1,
         uint8 MaterialIndex2,
         bool bUseTripleIndex,
-        UMaterialInterface* Material
+        UMaterialInterface* Material,
+        bool bChangedOnly = true
         );
 
+    // Updates render state of all surface meshes with pending updates,
+    // called automatically once per frame while updates are pending
+    UFUNCTION(BlueprintCallable)
+    void FlushRenderStateUpdates();
+
     UFUNCTION(BlueprintCallable)
     void ApplyHeightMap(
         int32 StateIndex,
@@ -345,22 +920,22 @@ public:
         );
 
     UFUNCTION(BlueprintCallable)
-    void CalculateMeshNormal(int32 StateIndex);
+    void CalculateMeshNormal(int32 StateIndex, bool bDirtyOnly = false);
 
     UFUNCTION(BlueprintCallable)
-    void SimplifyMesh(int32 StateIndex, FPMUMeshSimplifierOptions Options);
+    void SimplifyMesh(int32 StateIndex, FPMUMeshSimplifierOptions Options, bool bDirtyOnly = false);
 };
 
 // Inlines
 
 FORCEINLINE bool FMQCMap::HasChunk(int32 ChunkIndex) const
 {
-    return Chunks.IsValidIndex(ChunkIndex);
+    return ChunkIndex >= 0 && ChunkIndex < GetChunkCount();
 }
 
 FORCEINLINE int32 FMQCMap::GetChunkCount() const
 {
-    return Chunks.Num();
+    return (ChunkPages.Num() > 0) ? ChunkResolution * ChunkResolution : 0;
 }
 
 FORCEINLINE int32 FMQCMap::GetChunkIndex(int32 ChunkX, int32 ChunkY) const
@@ -373,14 +948,60 @@ FORCEINLINE int32 FMQCMap::GetChunkIndexByPoint(int32 X, int32 Y) const
     return (X/VoxelResolution) + (Y/VoxelResolution) * ChunkResolution;
 }
 
+FORCEINLINE FIntPoint FMQCMap::GetChunkOffset(int32 ChunkIndex) const
+{
+    return FIntPoint(ChunkIndex % ChunkResolution, ChunkIndex / ChunkResolution) * VoxelResolution;
+}
+
+FORCEINLINE const FMQCGridChunk* FMQCMap::FindChunk(int32 ChunkIndex) const
+{
+    if (! HasChunk(ChunkIndex))
+    {
+        return nullptr;
+    }
+
+    const uint32 ChunkX = ChunkIndex % ChunkResolution;
+    const uint32 ChunkY = ChunkIndex / ChunkResolution;
+    const uint32 PageMask = ChunkPageResolution-1;
+    const int32 PageIndex = (ChunkX / ChunkPageResolution) + (ChunkY / ChunkPageResolution) * ChunkPageDimension;
+
+    const FMQCGridChunk* Page = ChunkPages[PageIndex].Load();
+
+    if (! Page)
+    {
+        return nullptr;
+    }
+
+    // Page slot is the Z-order code of page local chunk coordinates,
+    // pages are at most 8 chunks wide
+
+    auto SpreadBits = [](uint32 V)
+    {
+        V = (V | (V << 2)) & 0x33;
+        V = (V | (V << 1)) & 0x55;
+        return V;
+    };
+
+    return &Page[SpreadBits(ChunkX & PageMask) | (SpreadBits(ChunkY & PageMask) << 1)];
+}
+
+FORCEINLINE FMQCGridChunk* FMQCMap::FindChunk(int32 ChunkIndex)
+{
+    return const_cast<FMQCGridChunk*>(static_cast<const FMQCMap&>(*this).FindChunk(ChunkIndex));
+}
+
 FORCEINLINE const FMQCGridChunk& FMQCMap::GetChunk(int32 ChunkIndex) const
 {
-    return *Chunks[ChunkIndex];
+    const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+    check(Chunk);
+    return *Chunk;
 }
 
 FORCEINLINE FMQCGridChunk& FMQCMap::GetChunk(int32 ChunkIndex)
 {
-    return *Chunks[ChunkIndex];
+    FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+    check(Chunk);
+    return *Chunk;
 }
 
 FORCEINLINE void FMQCMap::GetChunks(TArray<FMQCGridChunk*>& OutChunks, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax)
@@ -394,10 +1015,20 @@ FORCEINLINE void FMQCMap::GetChunks(TArray<FMQCGridChunk*>& OutChunks, const FIn
     for (int32 y=ChunkMinY; y<=ChunkMaxY; ++y)
     for (int32 x=ChunkMinX; x<=ChunkMaxX; ++x)
     {
-        OutChunks.Emplace(Chunks[GetChunkIndex(x, y)]);
+        if (FMQCGridChunk* Chunk = FindChunk(GetChunkIndex(x, y)))
+        {
+            OutChunks.Emplace(Chunk);
+        }
     }
 }
 
+FORCEINLINE int32 FMQCMap::GetClusterIndex(int32 ChunkIndex) const
+{
+    const int32 ChunkX = ChunkIndex % ChunkResolution;
+    const int32 ChunkY = ChunkIndex / ChunkResolution;
+    return (ChunkX/ClusterResolution) + (ChunkY/ClusterResolution) * GetClusterDimension();
+}
+
 // UMQCMapRef Blueprint Inlines
 
 FORCEINLINE_DEBUGGABLE bool UMQCMapRef::IsInitialized() const
@@ -495,6 +1126,23 @@ FORCEINLINE_DEBUGGABLE FMQCMaterial UMQCMapRef::GetVoxelMaterial(const FIntPoint
         : FMQCMaterial(ForceInitToZero);
 }
 
+FORCEINLINE_DEBUGGABLE void UMQCMapRef::GetVoxelMaterials(TArray<FMQCMaterial>& OutMaterials, const TArray<FIntPoint>& Positions, bool bParallel) const
+{
+    if (IsInitialized())
+    {
+        VoxelMap.GetVoxelMaterials(OutMaterials, Positions, bParallel);
+    }
+    else
+    {
+        OutMaterials.Init(FMQCMaterial(ForceInitToZero), Positions.Num());
+    }
+}
+
+FORCEINLINE_DEBUGGABLE uint8 UMQCMapRef::GetVoxelState(const FIntPoint& Position) const
+{
+    return IsInitialized() ? VoxelMap.GetVoxelState(Position) : 0;
+}
+
 // AMQCMap Blueprint Inlines
 
 FORCEINLINE_DEBUGGABLE UMQCMapRef* AMQCMap::K2_GetMap() const
@@ -36,6 +36,15 @@
 class FMQCGridChunk;
 class FMQCMap;
 
+enum class EMQCStencilType : uint8
+{
+    ST_NONE,
+    ST_SQUARE,
+    ST_CIRCLE,
+    ST_BOX,
+    ST_TRI
+};
+
 class MARCHINGSQUARESCOMPLEX_API FMQCStencil
 {
 protected:
@@ -89,6 +98,15 @@ public:
 
     virtual void Initialize(const FMQCMap& VoxelMap);
 
+    // Stencil type and settings used to record and replay stencil edits
+
+    virtual EMQCStencilType GetType() const
+    {
+        return EMQCStencilType::ST_NONE;
+    }
+
+    virtual void SerializeSettings(FArchive& Ar);
+
     FORCEINLINE int32 GetFillType() const
     {
         return fillType;
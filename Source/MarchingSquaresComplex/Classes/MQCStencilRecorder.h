@@ -0,0 +1,143 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Serialization/MemoryWriter.h"
+#include "MQCVoxelTypes.h"
+
+class FMQCMap;
+class FMQCStencil;
+enum class EMQCStencilType : uint8;
+
+enum class EMQCStencilOpType : uint8
+{
+    OP_EDIT_MAP,
+    OP_EDIT_MATERIAL,
+    OP_TRIANGULATE,
+    OP_TRIANGULATE_ASYNC,
+    OP_RESET_CHUNK_STATES,
+    OP_RESET_ALL_CHUNK_STATES,
+    OP_END
+};
+
+// Records stencil edits and triangulation calls applied to a voxel map
+// into a compact binary stream. The stream starts with the map config and
+// the chunk voxels at recording start, and ends with a checksum of the
+// resulting map meshes. Replaying the stream against a fresh map restores
+// the recorded voxels and is expected to produce the same checksum.
+//
+// Stream layout:
+//   Header: Magic, Version, FMQCMapConfig, chunk count,
+//           per chunk allocation flag and voxels of allocated chunks
+//   Op:     EMQCStencilOpType, Time (seconds since start), op payload
+//   End:    OP_END, Time, mesh checksum
+//
+// Recording is expected to happen on the game thread.
+class MARCHINGSQUARESCOMPLEX_API FMQCStencilRecorder
+{
+    TArray<uint8> Data;
+    FMemoryWriter Writer;
+    double StartTime;
+    int32 OpCount;
+    bool bRecording;
+
+    void WriteOpHeader(EMQCStencilOpType OpType);
+    void RecordEdit(EMQCStencilOpType OpType, FMQCStencil& Stencil, const FVector2D& Center);
+
+public:
+
+    static const uint32 StreamMagic;
+    static const int32 StreamVersion;
+
+    FMQCStencilRecorder();
+
+    // Starts recording from the current map voxels. Fails if chunks
+    // have been evicted by the chunk streamer, their voxels are not resident.
+    bool Start(const FMQCMapConfig& MapConfig, FMQCMap& Map);
+    void Stop(FMQCMap& Map);
+
+    FORCEINLINE bool IsRecording() const
+    {
+        return bRecording;
+    }
+
+    FORCEINLINE int32 GetOpCount() const
+    {
+        return OpCount;
+    }
+
+    FORCEINLINE const TArray<uint8>& GetData() const
+    {
+        return Data;
+    }
+
+    bool SaveToFile(const FString& Filename) const;
+
+    void RecordEditMap(FMQCStencil& Stencil, const FVector2D& Center);
+    void RecordEditMaterial(FMQCStencil& Stencil, const FVector2D& Center);
+    void RecordTriangulate(bool bAsync);
+    void RecordResetChunkStates(const TArray<int32>& ChunkIndices);
+    void RecordResetAllChunkStates();
+};
+
+struct FMQCStencilReplayResult
+{
+    int32 EditCount = 0;
+    int32 TriangulateCount = 0;
+    double RecordedSeconds = 0.0;
+    double ReplaySeconds = 0.0;
+    double TriangulateSeconds = 0.0;
+    uint32 RecordedChecksum = 0;
+    uint32 ReplayChecksum = 0;
+    bool bValidStream = false;
+
+    FORCEINLINE bool IsChecksumMatch() const
+    {
+        return bValidStream && RecordedChecksum == ReplayChecksum;
+    }
+
+    FString ToString() const;
+};
+
+// Plays back recorded stencil streams against a fresh map
+class MARCHINGSQUARESCOMPLEX_API FMQCStencilReplay
+{
+public:
+
+    static TUniquePtr<FMQCStencil> CreateStencil(EMQCStencilType StencilType);
+
+    // Replays a recorded stream, at full speed or with original op timing.
+    // The replay map is initialized with the recorded map config and
+    // triangulated from the recorded voxels before ops are replayed.
+    static bool Replay(FMQCMap& Map, const TArray<uint8>& Data, FMQCStencilReplayResult& OutResult, bool bOriginalTiming = false);
+    static bool ReplayFile(const FString& Filename, FMQCStencilReplayResult& OutResult, bool bOriginalTiming = false);
+
+    // Checksum of all chunk surface and extrude mesh sections
+    static uint32 GetMeshChecksum(const FMQCMap& Map);
+};
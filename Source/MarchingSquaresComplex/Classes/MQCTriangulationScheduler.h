@@ -0,0 +1,156 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+class FMQCMap;
+
+// Time-sliced chunk triangulation scheduler.
+//
+// Dirty chunks are queued with a priority, by default the distance from
+// the chunk center to the nearest focus point, and processed lowest
+// priority value first within a per-tick millisecond budget. Requests for
+// a chunk already queued only update its priority, requests for a chunk
+// already in flight are deferred until the running triangulation
+// completes. Cancelled requests are dropped from the queue, a chunk
+// triangulation already in flight can not be cancelled.
+class MARCHINGSQUARESCOMPLEX_API FMQCTriangulationScheduler
+{
+private:
+
+    enum class EChunkStatus : uint8
+    {
+        CS_IDLE,
+        CS_QUEUED,
+        CS_IN_FLIGHT,
+        CS_IN_FLIGHT_REQUEUED
+    };
+
+    struct FChunkState
+    {
+        EChunkStatus Status = EChunkStatus::CS_IDLE;
+        bool bExplicitPriority = false;
+        float Priority = 0.f;
+        uint32 Serial = 0;
+    };
+
+    // Queue entries are invalidated by chunk state serial changes
+    // instead of being removed from the heap
+    struct FQueueEntry
+    {
+        float Priority;
+        int32 ChunkIndex;
+        uint32 Serial;
+
+        FORCEINLINE bool operator<(const FQueueEntry& Other) const
+        {
+            return Priority < Other.Priority;
+        }
+    };
+
+    FMQCMap& Map;
+
+    TArray<FChunkState> ChunkStates;
+    TArray<FQueueEntry> Queue;
+    TArray<int32> InFlightChunks;
+    TArray<FVector2D> FocusPoints;
+
+    int32 QueuedCount;
+    double AverageChunkTimeMs;
+
+    float GetFocusPriority(int32 ChunkIndex) const;
+    void Enqueue(int32 ChunkIndex, float Priority, bool bExplicitPriority);
+    bool Dequeue(int32& OutChunkIndex);
+    void RebuildQueue();
+    void UpdateAverageChunkTime(double ChunkTimeMs);
+    int32 CollectCompletedChunks();
+
+public:
+
+    // Dispatch scheduled chunks as async tasks instead of triangulating
+    // them on the calling thread, the tick budget then bounds the
+    // estimated task time dispatched per tick
+    bool bAsync = false;
+
+    // Maximum number of chunks in flight on async dispatch,
+    // zero or less uses the task graph worker thread count
+    int32 MaxChunksInFlight = 0;
+
+    FMQCTriangulationScheduler(FMQCMap& InMap);
+
+    void Reset();
+
+    void SetFocusPoints(const TArray<FVector2D>& InFocusPoints);
+
+    FORCEINLINE const TArray<FVector2D>& GetFocusPoints() const
+    {
+        return FocusPoints;
+    }
+
+    void RequestChunk(int32 ChunkIndex);
+    void RequestChunk(int32 ChunkIndex, float Priority);
+    void RequestChunks(const TArray<int32>& ChunkIndices);
+
+    // Requests edited chunks and their lower neighbour chunks,
+    // which triangulate cells sharing the edited chunk border voxels
+    void RequestEditedChunks(const TArray<int32>& ChunkIndices);
+
+    void CancelChunk(int32 ChunkIndex);
+    void CancelAll();
+
+    // Processes queued chunks within the specified time budget. If dispatch
+    // is disabled, only completed in-flight chunks are collected.
+    // Returns the number of chunks completed since the last tick.
+    int32 Tick(float BudgetMs, bool bDispatch = true);
+
+    FORCEINLINE int32 GetQueuedCount() const
+    {
+        return QueuedCount;
+    }
+
+    FORCEINLINE int32 GetInFlightCount() const
+    {
+        return InFlightChunks.Num();
+    }
+
+    FORCEINLINE bool HasPendingWork() const
+    {
+        return QueuedCount > 0 || InFlightChunks.Num() > 0;
+    }
+
+    FORCEINLINE bool IsChunkScheduled(int32 ChunkIndex) const
+    {
+        return ChunkStates.IsValidIndex(ChunkIndex) && ChunkStates[ChunkIndex].Status != EChunkStatus::CS_IDLE;
+    }
+
+    FORCEINLINE double GetAverageChunkTimeMs() const
+    {
+        return AverageChunkTimeMs;
+    }
+};
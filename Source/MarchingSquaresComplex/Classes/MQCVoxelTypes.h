@@ -28,6 +28,8 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Containers/Queue.h"
 #include "MQCMaterial.h"
 #include "MQCVoxelTypes.generated.h"
 
@@ -44,6 +46,28 @@ struct MARCHINGSQUARESCOMPLEX_API FMQCSurfaceState
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     bool bRemapEdgeUVs = false;
+
+    // Generate extrude section as side walls from edge point lists
+    // instead of duplicating the surface, requires extrusion generation
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bExtrudeWalls = false;
+
+    // Generate inversed surface at extrusion height on wall extrusion
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bExtrudeBackFace = false;
+
+    // Generate simplified edge point lists, requires extrusion generation
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bGenerateSimplifiedEdges = false;
+
+    // Maximum distance of removed edge points to the simplified edge
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin="0"))
+    float SimplifiedEdgeTolerance = .25f;
+
+    // Store finalized geometry as 2D positions and colors (with 16-bit
+    // indices when possible), full mesh sections are expanded on access
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bCompactVertexFormat = false;
 };
 
 struct FMQCSurfaceConfig
@@ -55,9 +79,17 @@ struct FMQCSurfaceConfig
     bool bGenerateExtrusion;
     bool bExtrusionSurface;
     bool bRemapEdgeUVs;
+    bool bExtrudeWalls;
+    bool bExtrudeBackFace;
+    bool bGenerateSimplifiedEdges;
+    float SimplifiedEdgeTolerance;
+    bool bCompactVertexFormat;
     EMQCMaterialType MaterialType;
 };
 
+class FMQCSnapshotEpochs;
+struct FMQCVoxel;
+
 struct FMQCChunkConfig
 {
     FIntPoint Position;
@@ -67,6 +99,21 @@ struct FMQCChunkConfig
     float MaxParallelAngle;
     float ExtrusionHeight;
     EMQCMaterialType MaterialType;
+    bool bHaloVoxels;
+    FMQCSnapshotEpochs* SnapshotEpochs;
+
+    // Map edge data resolution futures, edge data resolution reads
+    // chunk surfaces and must complete before chunk triangulation
+    const TArray<TSharedFuture<void>>* EdgeDataFutures;
+
+    // Map queue of chunk indices whose released geometry was read,
+    // drained and retriangulated on the editing thread
+    TQueue<int32, EQueueMode::Mpsc>* GeometryRestoreQueue;
+
+    // Shared empty voxel block read by sparse chunks until their voxels are
+    // allocated, voxels are allocated on configure if not specified
+    const FMQCVoxel* EmptyVoxels;
+
     TArray<FMQCSurfaceState> States;
 };
 
@@ -81,6 +128,28 @@ struct MARCHINGSQUARESCOMPLEX_API FMQCMapConfig
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     int32 ChunkResolution = 2;
 
+    // Number of chunks along each axis grouped into a single mesh cluster,
+    // values above one merge chunk meshes into clustered mesh components
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    int32 ClusterResolution = 1;
+
+    // Store a one voxel halo of neighbour voxels on each chunk, refreshed
+    // before crossings and triangulation, so chunk border cells are processed
+    // by the same loops as interior cells
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bHaloVoxels = false;
+
+    // Publish an immutable voxel snapshot after each chunk edit pass, voxel
+    // state, material, raycast and point queries read published snapshots
+    // without waiting on async chunk tasks
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bVoxelSnapshots = false;
+
+    // Allocate chunk voxels on first edit instead of on initialization,
+    // unedited chunks read a shared empty voxel block
+    UPROPERTY(EditAnywhere, BlueprintReadWrite)
+    bool bSparseChunks = false;
+
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     float MaxFeatureAngle = 135.f;
 
@@ -95,4 +164,72 @@ struct MARCHINGSQUARESCOMPLEX_API FMQCMapConfig
 
     UPROPERTY(EditAnywhere, BlueprintReadWrite)
     TArray<FMQCSurfaceState> States;
+
+    // Request scheduled triangulation of chunks edited by stencils,
+    // scheduled chunks are processed by ticking the triangulation scheduler
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Scheduled Triangulation")
+    bool bScheduleEditedChunks = false;
+
+    // Dispatch scheduled chunk triangulation as async tasks
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Scheduled Triangulation")
+    bool bAsyncScheduledTriangulation = false;
+
+    // Maximum scheduled chunks in flight on async dispatch,
+    // zero uses the task graph worker thread count
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Scheduled Triangulation", meta=(ClampMin="0", UIMin="0"))
+    int32 MaxScheduledChunksInFlight = 0;
+
+    // Page sparse chunks in and out of memory around streaming focus
+    // points, implies sparse chunks. Chunks made resident from the chunk
+    // store are triangulated through the triangulation scheduler.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming")
+    bool bStreamChunks = false;
+
+    // Radius around streaming focus points in voxels
+    // within which chunks are kept resident
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming", meta=(ClampMin="0", UIMin="0"))
+    float StreamingRadius = 256.f;
+
+    // Resident chunk memory budget in megabytes, zero disables eviction
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming", meta=(ClampMin="0", UIMin="0"))
+    float StreamingMemoryBudgetMB = 256.f;
+
+    // Keep evicted chunk meshes resident instead of clearing them
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming")
+    bool bKeepEvictedMeshes = false;
+
+    // Maximum concurrent async chunk loads
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming", meta=(ClampMin="1", UIMin="1"))
+    int32 MaxPendingChunkLoads = 8;
+
+    // Chunk store directory, empty uses the project saved directory
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming")
+    FString StreamingStoreDirectory;
+
+    // Chunk store name within the store directory. Named stores persist
+    // across sessions and are resumed by maps of matching chunk layout,
+    // empty keeps stored chunks of the current session only.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Streaming")
+    FString StreamingStoreId;
+
+    // Compress voxels of chunks not edited or queried within the idle
+    // time, compressed voxels are decompressed on first access.
+    // Implies voxel snapshots, queries never read released working voxels.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Compression")
+    bool bCompressIdleChunks = false;
+
+    // Time in seconds since the last chunk access after which a chunk is idle
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Compression", meta=(ClampMin="0", UIMin="0"))
+    float IdleChunkSeconds = 30.f;
+
+    // Release mesh buffers of compressed chunks. Released buffers read by
+    // mesh or edge point queries are regenerated by the next scheduled
+    // triangulation tick and reported as geometry changes. Mesh components
+    // keep their own copy of released geometry.
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Compression")
+    bool bReleaseIdleChunkMeshes = false;
+
+    // Maximum chunks compressed per compression tick
+    UPROPERTY(EditAnywhere, BlueprintReadWrite, Category="Compression", meta=(ClampMin="1", UIMin="1"))
+    int32 MaxChunksCompressedPerTick = 8;
 };
@@ -31,8 +31,68 @@
 #include "MQCVoxel.h"
 #include "MQCFeaturePoint.h"
 
+struct FMQCCellSegment
+{
+    FVector2D Point0;
+    FVector2D Point1;
+
+    // Voxel corners separated by the segment
+    FVector2D Corner0;
+    FVector2D Corner1;
+    uint8 State0;
+    uint8 State1;
+};
+
+typedef TArray<FMQCCellSegment, TInlineAllocator<8>> FMQCCellSegmentList;
+
 class FMQCCell
 {
+private:
+
+    struct FCrossing
+    {
+        FVector2D Point;
+        const FMQCVoxel* Corner0;
+        const FMQCVoxel* Corner1;
+        bool bExists;
+    };
+
+    FORCEINLINE static void AddSegment(FMQCCellSegmentList& OutSegments, const FVector2D& Point0, const FVector2D& Point1, const FCrossing& Crossing)
+    {
+        FMQCCellSegment Segment;
+        Segment.Point0 = Point0;
+        Segment.Point1 = Point1;
+        Segment.Corner0 = Crossing.Corner0->GetPosition();
+        Segment.Corner1 = Crossing.Corner1->GetPosition();
+        Segment.State0 = Crossing.Corner0->voxelState;
+        Segment.State1 = Crossing.Corner1->voxelState;
+        OutSegments.Emplace(Segment);
+    }
+
+    FORCEINLINE static void AddContour(FMQCCellSegmentList& OutSegments, const FCrossing& Crossing0, const FMQCFeaturePoint& f, const FCrossing& Crossing1)
+    {
+        if (f.exists)
+        {
+            AddSegment(OutSegments, Crossing0.Point, f.position, Crossing0);
+            AddSegment(OutSegments, f.position, Crossing1.Point, Crossing1);
+        }
+        else
+        {
+            AddSegment(OutSegments, Crossing0.Point, Crossing1.Point, Crossing0);
+        }
+    }
+
+    FORCEINLINE static void AddJoinedContour(FMQCCellSegmentList& OutSegments, const FCrossing* Crossings, const FMQCFeaturePoint& f)
+    {
+        for (int32 i=0; i<4; ++i)
+        {
+            if (Crossings[i].bExists)
+            {
+                AddSegment(OutSegments, Crossings[i].Point, f.position, Crossings[i]);
+            }
+        }
+    }
+
 public:
 
     FMQCVoxel a;
@@ -141,7 +201,7 @@ public:
         return f;
     }
 
-    bool HasConnectionAD(const FMQCFeaturePoint& fA, const FMQCFeaturePoint& fD)
+    bool HasConnectionAD(const FMQCFeaturePoint& fA, const FMQCFeaturePoint& fD) const
     {
         bool flip = (a.voxelState < b.voxelState) == (a.voxelState < c.voxelState);
         if (IsParallel(a.NormalX.ToFVector2D(), a.NormalY.ToFVector2D(), flip) ||
@@ -177,7 +237,7 @@ public:
         return (a.pointState == a.voxelState) && (a.pointState == d.voxelState);
     }
     
-    bool HasConnectionBC(const FMQCFeaturePoint& fB, const FMQCFeaturePoint& fC)
+    bool HasConnectionBC(const FMQCFeaturePoint& fB, const FMQCFeaturePoint& fC) const
     {
         bool flip = (b.voxelState < a.voxelState) == (b.voxelState < d.voxelState);
         if (IsParallel(a.NormalX.ToFVector2D(), b.NormalY.ToFVector2D(), flip) ||
@@ -213,22 +273,22 @@ public:
         return (a.pointState == b.voxelState) && (a.pointState == c.voxelState);
     }
 
-    FORCEINLINE bool IsInsideABD(const FVector2D& point)
+    FORCEINLINE bool IsInsideABD(const FVector2D& point) const
     {
         return IsBelowLine(point, a.GetPosition(), d.GetPosition());
     }
     
-    FORCEINLINE bool IsInsideACD(const FVector2D& point)
+    FORCEINLINE bool IsInsideACD(const FVector2D& point) const
     {
         return IsBelowLine(point, d.GetPosition(), a.GetPosition());
     }
 
-    FORCEINLINE bool IsInsideABC(const FVector2D& point)
+    FORCEINLINE bool IsInsideABC(const FVector2D& point) const
     {
         return IsBelowLine(point, c.GetPosition(), b.GetPosition());
     }
 
-    FORCEINLINE bool IsInsideBCD(const FVector2D& point)
+    FORCEINLINE bool IsInsideBCD(const FVector2D& point) const
     {
         return IsBelowLine(point, b.GetPosition(), c.GetPosition());
     }
@@ -314,4 +374,202 @@ public:
 
         return Material;
     }
+
+    void GetContourSegments(FMQCCellSegmentList& OutSegments) const;
+    bool IntersectContour(const FVector2D& Origin, const FVector2D& Direction, float MinTime, float MaxTime, float& OutTime, FVector2D& OutNormal, uint8& OutState) const;
 };
+
+// Generate contour segments separating voxel states within the cell.
+// Mirrors the feature point selection of FMQCGridChunk::TriangulateCell().
+inline void FMQCCell::GetContourSegments(FMQCCellSegmentList& OutSegments) const
+{
+    // Crossing order: south, east, north, west
+
+    FCrossing Crossings[4];
+    Crossings[0] = { a.GetXEdgePoint(), &a, &b, a.voxelState != b.voxelState };
+    Crossings[1] = { b.GetYEdgePoint(), &b, &d, b.voxelState != d.voxelState };
+    Crossings[2] = { c.GetXEdgePoint(), &c, &d, c.voxelState != d.voxelState };
+    Crossings[3] = { a.GetYEdgePoint(), &a, &c, a.voxelState != c.voxelState };
+
+    const FCrossing& S(Crossings[0]);
+    const FCrossing& E(Crossings[1]);
+    const FCrossing& N(Crossings[2]);
+    const FCrossing& W(Crossings[3]);
+
+    const int32 CrossingCount = S.bExists + E.bExists + N.bExists + W.bExists;
+
+    if (CrossingCount == 2)
+    {
+        if (N.bExists && E.bExists) AddContour(OutSegments, N, GetFeatureNE(), E);
+        else
+        if (W.bExists && N.bExists) AddContour(OutSegments, W, GetFeatureNW(), N);
+        else
+        if (S.bExists && E.bExists) AddContour(OutSegments, S, GetFeatureSE(), E);
+        else
+        if (S.bExists && W.bExists) AddContour(OutSegments, S, GetFeatureSW(), W);
+        else
+        if (W.bExists && E.bExists) AddContour(OutSegments, W, GetFeatureEW(), E);
+        else
+        if (S.bExists && N.bExists) AddContour(OutSegments, S, GetFeatureNS(), N);
+    }
+    else
+    if (CrossingCount == 3)
+    {
+        FMQCFeaturePoint f;
+
+        if (! S.bExists) f = GetFeatureNEW();
+        else
+        if (! W.bExists) f = GetFeatureNSE();
+        else
+        if (! E.bExists) f = GetFeatureNSW();
+        else
+        f = GetFeatureSEW();
+
+        AddJoinedContour(OutSegments, Crossings, f);
+    }
+    else
+    if (CrossingCount == 4)
+    {
+        FMQCFeaturePoint fA(GetFeatureSW());
+        FMQCFeaturePoint fB(GetFeatureSE());
+        FMQCFeaturePoint fC(GetFeatureNW());
+        FMQCFeaturePoint fD(GetFeatureNE());
+
+        bool bSeparateAD = false;
+        bool bSeparateBC = false;
+        bool bJoined = false;
+
+        // 0110
+        if (a.voxelState == d.voxelState && b.voxelState == c.voxelState)
+        {
+            if (HasConnectionAD(fA, fD))
+            {
+                fB.exists &= IsInsideABD(fB.position);
+                fC.exists &= IsInsideACD(fC.position);
+                bSeparateBC = true;
+            }
+            else if (HasConnectionBC(fB, fC))
+            {
+                fA.exists &= IsInsideABC(fA.position);
+                fD.exists &= IsInsideBCD(fD.position);
+                bSeparateAD = true;
+            }
+            else if (a.IsFilled() && b.IsFilled())
+            {
+                bJoined = true;
+            }
+            else
+            {
+                bSeparateAD = a.IsFilled();
+                bSeparateBC = b.IsFilled();
+            }
+        }
+        // 0112
+        else if (b.voxelState == c.voxelState)
+        {
+            if (HasConnectionBC(fB, fC))
+            {
+                fA.exists &= IsInsideABC(fA.position);
+                fD.exists &= IsInsideBCD(fD.position);
+                bSeparateAD = true;
+            }
+            else
+            {
+                bJoined = b.IsFilled() || HasConnectionAD(fA, fD);
+                bSeparateAD = ! bJoined;
+            }
+        }
+        // 0120
+        else if (a.voxelState == d.voxelState)
+        {
+            if (HasConnectionAD(fA, fD))
+            {
+                fB.exists &= IsInsideABD(fB.position);
+                fC.exists &= IsInsideACD(fC.position);
+                bSeparateBC = true;
+            }
+            else
+            {
+                bJoined = a.IsFilled() || HasConnectionBC(fB, fC);
+                bSeparateBC = ! bJoined;
+            }
+        }
+        // 0123
+        else
+        {
+            bJoined = true;
+        }
+
+        if (bJoined)
+        {
+            AddJoinedContour(OutSegments, Crossings, GetFeatureAverage(fA, fB, fC, fD));
+        }
+
+        if (bSeparateAD)
+        {
+            AddContour(OutSegments, S, fA, W);
+            AddContour(OutSegments, N, fD, E);
+        }
+
+        if (bSeparateBC)
+        {
+            AddContour(OutSegments, S, fB, E);
+            AddContour(OutSegments, W, fC, N);
+        }
+    }
+}
+
+// Find the first contour segment crossed by a ray within the cell.
+// Output state is the voxel state on the far side of the crossed segment.
+inline bool FMQCCell::IntersectContour(const FVector2D& Origin, const FVector2D& Direction, float MinTime, float MaxTime, float& OutTime, FVector2D& OutNormal, uint8& OutState) const
+{
+    FMQCCellSegmentList Segments;
+    GetContourSegments(Segments);
+
+    bool bHasHit = false;
+    float HitTime = MaxTime;
+
+    for (const FMQCCellSegment& Segment : Segments)
+    {
+        const FVector2D SegmentDir = Segment.Point1 - Segment.Point0;
+        const float Denom = FVector2D::CrossProduct(Direction, SegmentDir);
+
+        // Parallel segment, skip
+        if (FMath::IsNearlyZero(Denom))
+        {
+            continue;
+        }
+
+        const FVector2D ToSegment = Segment.Point0 - Origin;
+        const float t = FVector2D::CrossProduct(ToSegment, SegmentDir) / Denom;
+        const float u = FVector2D::CrossProduct(ToSegment, Direction) / Denom;
+
+        if (t < MinTime || t > HitTime || u < 0.f || u > 1.f)
+        {
+            continue;
+        }
+
+        // Find which side of the segment the ray is entering
+
+        const float RaySide = FVector2D::CrossProduct(SegmentDir, Direction);
+        const float CornerSide = FVector2D::CrossProduct(SegmentDir, Segment.Corner0-Segment.Point0);
+        const bool bEnterCorner0 = (RaySide > 0.f) == (CornerSide > 0.f);
+
+        FVector2D Normal(-SegmentDir.Y, SegmentDir.X);
+        Normal.Normalize();
+
+        if (FVector2D::DotProduct(Normal, Direction) > 0.f)
+        {
+            Normal = -Normal;
+        }
+
+        HitTime = t;
+        OutTime = t;
+        OutNormal = Normal;
+        OutState = bEnterCorner0 ? Segment.State0 : Segment.State1;
+        bHasHit = true;
+    }
+
+    return bHasHit;
+}
+
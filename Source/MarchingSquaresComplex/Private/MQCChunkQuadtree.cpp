@@ -0,0 +1,257 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "MQCChunkQuadtree.h"
+
+FMQCChunkQuadtree::FMQCChunkQuadtree()
+    : Resolution(0)
+    , Extent(0)
+{
+}
+
+void FMQCChunkQuadtree::Reset(int32 InResolution)
+{
+    Resolution = FMath::Max(InResolution, 0);
+    Extent = Resolution > 0 ? FMath::RoundUpToPowerOfTwo(Resolution) : 0;
+
+    Nodes.Reset();
+    FreeChildren.Reset();
+
+    // Root node
+    Nodes.Emplace(FNode { INDEX_NONE, 0, true });
+}
+
+int32 FMQCChunkQuadtree::AllocateChildren(uint8 State)
+{
+    int32 ChildIndex;
+
+    if (FreeChildren.Num() > 0)
+    {
+        ChildIndex = FreeChildren.Pop(false);
+    }
+    else
+    {
+        ChildIndex = Nodes.Num();
+        Nodes.AddUninitialized(4);
+    }
+
+    // Children inherit the uniform state of the split node
+    for (int32 i=0; i<4; ++i)
+    {
+        Nodes[ChildIndex+i] = FNode { INDEX_NONE, State, true };
+    }
+
+    return ChildIndex;
+}
+
+bool FMQCChunkQuadtree::TryCollapse(int32 NodeIndex)
+{
+    FNode& Node(Nodes[NodeIndex]);
+    check(Node.Children != INDEX_NONE);
+
+    const int32 ChildIndex = Node.Children;
+    const uint8 State = Nodes[ChildIndex].State;
+
+    for (int32 i=0; i<4; ++i)
+    {
+        const FNode& Child(Nodes[ChildIndex+i]);
+
+        if (Child.Children != INDEX_NONE || ! Child.bUniform || Child.State != State)
+        {
+            return false;
+        }
+    }
+
+    Node.Children = INDEX_NONE;
+    Node.State = State;
+    Node.bUniform = true;
+
+    FreeChildren.Emplace(ChildIndex);
+
+    return true;
+}
+
+void FMQCChunkQuadtree::SetChunkState(int32 ChunkX, int32 ChunkY, bool bUniform, uint8 State)
+{
+    if (ChunkX < 0 || ChunkY < 0 || ChunkX >= Resolution || ChunkY >= Resolution)
+    {
+        return;
+    }
+
+    // Tree depth is bounded by 32-bit chunk coordinates
+    int32 Path[32];
+    int32 Depth = 0;
+
+    int32 NodeIndex = 0;
+    int32 Size = Extent;
+    int32 NodeX = 0;
+    int32 NodeY = 0;
+
+    // Descend to the chunk leaf, splitting collapsed nodes
+
+    while (Size > 1)
+    {
+        if (Nodes[NodeIndex].Children == INDEX_NONE)
+        {
+            // Collapsed region already matches, no update required
+            if (bUniform && Nodes[NodeIndex].State == State)
+            {
+                return;
+            }
+
+            const int32 ChildIndex = AllocateChildren(Nodes[NodeIndex].State);
+            Nodes[NodeIndex].Children = ChildIndex;
+            Nodes[NodeIndex].bUniform = false;
+        }
+
+        Path[Depth++] = NodeIndex;
+        Size >>= 1;
+
+        int32 Quadrant = 0;
+
+        if (ChunkX >= NodeX+Size)
+        {
+            NodeX += Size;
+            Quadrant |= 1;
+        }
+
+        if (ChunkY >= NodeY+Size)
+        {
+            NodeY += Size;
+            Quadrant |= 2;
+        }
+
+        NodeIndex = Nodes[NodeIndex].Children + Quadrant;
+    }
+
+    FNode& Leaf(Nodes[NodeIndex]);
+    Leaf.bUniform = bUniform;
+    Leaf.State = State;
+
+    // Collapse parent nodes with matching uniform children
+
+    while (Depth > 0 && TryCollapse(Path[--Depth]))
+    {
+    }
+}
+
+FMQCChunkRegion FMQCChunkQuadtree::FindRegion(int32 ChunkX, int32 ChunkY) const
+{
+    int32 NodeIndex = 0;
+    int32 Size = Extent;
+    FIntPoint NodeMin(0, 0);
+
+    if (Nodes.Num() < 1)
+    {
+        return FMQCChunkRegion { NodeMin, 0, true, 0 };
+    }
+
+    while (Nodes[NodeIndex].Children != INDEX_NONE)
+    {
+        Size >>= 1;
+
+        int32 Quadrant = 0;
+
+        if (ChunkX >= NodeMin.X+Size)
+        {
+            NodeMin.X += Size;
+            Quadrant |= 1;
+        }
+
+        if (ChunkY >= NodeMin.Y+Size)
+        {
+            NodeMin.Y += Size;
+            Quadrant |= 2;
+        }
+
+        NodeIndex = Nodes[NodeIndex].Children + Quadrant;
+    }
+
+    const FNode& Leaf(Nodes[NodeIndex]);
+    return FMQCChunkRegion { NodeMin, Size, Leaf.bUniform, Leaf.State };
+}
+
+void FMQCChunkQuadtree::GetRegions(TArray<FMQCChunkRegion>& OutRegions, const FIntPoint& ChunkMin, const FIntPoint& ChunkMax) const
+{
+    const FIntPoint QueryMin(FMath::Max(ChunkMin.X, 0), FMath::Max(ChunkMin.Y, 0));
+    const FIntPoint QueryMax(FMath::Min(ChunkMax.X, Resolution-1), FMath::Min(ChunkMax.Y, Resolution-1));
+
+    if (Nodes.Num() < 1 || QueryMin.X > QueryMax.X || QueryMin.Y > QueryMax.Y)
+    {
+        return;
+    }
+
+    struct FStackEntry
+    {
+        int32 NodeIndex;
+        int32 Size;
+        FIntPoint Min;
+    };
+
+    TArray<FStackEntry, TInlineAllocator<64>> Stack;
+    Stack.Emplace(FStackEntry { 0, Extent, FIntPoint(0, 0) });
+
+    while (Stack.Num() > 0)
+    {
+        const FStackEntry Entry(Stack.Pop(false));
+        const FNode& Node(Nodes[Entry.NodeIndex]);
+
+        // Skip nodes outside query bounds
+        if (Entry.Min.X > QueryMax.X ||
+            Entry.Min.Y > QueryMax.Y ||
+            Entry.Min.X+Entry.Size <= QueryMin.X ||
+            Entry.Min.Y+Entry.Size <= QueryMin.Y)
+        {
+            continue;
+        }
+
+        if (Node.Children == INDEX_NONE)
+        {
+            OutRegions.Emplace(FMQCChunkRegion { Entry.Min, Entry.Size, Node.bUniform, Node.State });
+            continue;
+        }
+
+        const int32 ChildSize = Entry.Size >> 1;
+
+        // Push in reverse quadrant order to visit min quadrants first
+        for (int32 i=3; i>=0; --i)
+        {
+            const FIntPoint ChildMin(
+                Entry.Min.X + ((i & 1) ? ChildSize : 0),
+                Entry.Min.Y + ((i & 2) ? ChildSize : 0)
+                );
+            Stack.Emplace(FStackEntry { Node.Children+i, ChildSize, ChildMin });
+        }
+    }
+}
+
+int32 FMQCChunkQuadtree::GetLeafCount() const
+{
+    // Every internal node has four children
+    const int32 NodeCount = GetNodeCount();
+    return NodeCount > 0 ? (NodeCount - (NodeCount-1)/4) : 0;
+}
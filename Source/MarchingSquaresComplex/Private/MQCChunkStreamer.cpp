@@ -0,0 +1,604 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "MQCChunkStreamer.h"
+#include "Async/Async.h"
+#include "HAL/FileManager.h"
+#include "Misc/Crc.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Guid.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+#include "MarchingSquaresComplex.h"
+#include "MQCMap.h"
+#include "MQCGridChunk.h"
+
+const uint32 FMQCChunkStreamer::StoreMagic = 0x4343514D; // MQCC
+const int32 FMQCChunkStreamer::StoreVersion = 2;
+
+FMQCChunkStreamer::FMQCChunkStreamer(FMQCMap& InMap)
+    : Map(InMap)
+    , StoreKey(0)
+    , bSessionStore(false)
+    , AccessClock(0)
+    , FocusSerial(0)
+    , ResidentMemory(0)
+    , EvictedCount(0)
+{
+}
+
+FMQCChunkStreamer::~FMQCChunkStreamer()
+{
+    // Pending I/O tasks only reference their own data
+    for (TPair<int32, TFuture<FChunkDataPtr>>& PendingLoad : PendingLoads)
+    {
+        PendingLoad.Value.Wait();
+    }
+
+    CompleteWrites(true);
+
+    if (bSessionStore)
+    {
+        IFileManager::Get().DeleteDirectory(*StoreDirectory, false, true);
+    }
+}
+
+void FMQCChunkStreamer::Reset(const FString& InStoreDirectory, const FString& InStoreId)
+{
+    for (TPair<int32, TFuture<FChunkDataPtr>>& PendingLoad : PendingLoads)
+    {
+        PendingLoad.Value.Wait();
+    }
+
+    CompleteWrites(true);
+
+    // Session stores are never resumed
+    if (bSessionStore)
+    {
+        IFileManager::Get().DeleteDirectory(*StoreDirectory, false, true);
+    }
+
+    PendingLoads.Reset();
+    ResidentChunks.Reset();
+    LoadedChunks.Reset();
+
+    ChunkEntries.Reset();
+    ChunkEntries.SetNum(Map.GetChunkCount());
+
+    const FString BaseDirectory(InStoreDirectory.IsEmpty()
+        ? FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("MQCChunkStore"))
+        : InStoreDirectory);
+
+    bSessionStore = InStoreId.IsEmpty();
+
+    StoreDirectory = FPaths::Combine(
+        BaseDirectory,
+        bSessionStore
+            ? FString::Printf(TEXT("Session_%s"), *FGuid::NewGuid().ToString())
+            : InStoreId
+        );
+
+    StoreKey = GetLayoutKey();
+
+    AccessClock = 0;
+    FocusSerial = 0;
+    ResidentMemory = 0;
+    EvictedCount = 0;
+
+    if (! bSessionStore && ChunkEntries.Num() > 0)
+    {
+        OpenStore();
+    }
+}
+
+void FMQCChunkStreamer::SetFocusPoints(const TArray<FVector2D>& InFocusPoints)
+{
+    FocusPoints = InFocusPoints;
+}
+
+FString FMQCChunkStreamer::GetChunkPath(int32 ChunkIndex) const
+{
+    return FPaths::Combine(StoreDirectory, FString::Printf(TEXT("Chunk_%d.mqcc"), ChunkIndex));
+}
+
+FString FMQCChunkStreamer::GetManifestPath() const
+{
+    return FPaths::Combine(StoreDirectory, TEXT("Store.mqcm"));
+}
+
+uint32 FMQCChunkStreamer::GetLayoutKey() const
+{
+    // Stored voxels are only valid for maps of matching chunk layout
+    const int32 Layout[] = {
+        Map.GetChunkResolution(),
+        Map.GetVoxelResolution(),
+        Map.IsHaloVoxels() ? 1 : 0,
+        Map.GetStateCount()
+        };
+
+    return FCrc::MemCrc32(Layout, sizeof(Layout));
+}
+
+void FMQCChunkStreamer::OpenStore()
+{
+    TArray<uint8> Data;
+
+    uint32 Magic = 0;
+    int32 Version = 0;
+    uint32 Key = 0;
+
+    if (FFileHelper::LoadFileToArray(Data, *GetManifestPath(), FILEREAD_Silent))
+    {
+        FMemoryReader Reader(Data);
+
+        Reader << Magic;
+        Reader << Version;
+        Reader << Key;
+    }
+
+    if (Magic == StoreMagic && Version == StoreVersion && Key == StoreKey)
+    {
+        ResumeStore();
+        return;
+    }
+
+    // Stored chunks of another version or chunk layout can not be resumed
+
+    if (IFileManager::Get().DirectoryExists(*StoreDirectory))
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCChunkStreamer::OpenStore() - Clearing mismatching chunk store %s"), *StoreDirectory);
+        IFileManager::Get().DeleteDirectory(*StoreDirectory, false, true);
+    }
+
+    WriteManifest();
+}
+
+void FMQCChunkStreamer::ResumeStore()
+{
+    // Resolve stored chunks with a single directory listing
+
+    TArray<FString> ChunkFiles;
+    IFileManager::Get().FindFiles(ChunkFiles, *StoreDirectory, TEXT("mqcc"));
+
+    for (const FString& ChunkFile : ChunkFiles)
+    {
+        const FString ChunkName(FPaths::GetBaseFilename(ChunkFile));
+
+        if (! ChunkName.StartsWith(TEXT("Chunk_")))
+        {
+            continue;
+        }
+
+        const int32 ChunkIndex = FCString::Atoi(*ChunkName.RightChop(6));
+
+        if (ChunkEntries.IsValidIndex(ChunkIndex))
+        {
+            ChunkEntries[ChunkIndex].StoreStatus = EStoreStatus::SS_STORED;
+        }
+    }
+}
+
+void FMQCChunkStreamer::WriteManifest()
+{
+    TArray<uint8> Data;
+    FMemoryWriter Writer(Data);
+
+    uint32 Magic = StoreMagic;
+    int32 Version = StoreVersion;
+    uint32 Key = StoreKey;
+
+    Writer << Magic;
+    Writer << Version;
+    Writer << Key;
+
+    if (! FFileHelper::SaveArrayToFile(Data, *GetManifestPath()))
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCChunkStreamer::WriteManifest() - Failed to write chunk store manifest %s"), *GetManifestPath());
+    }
+}
+
+bool FMQCChunkStreamer::IsChunkStored(int32 ChunkIndex) const
+{
+    return ChunkEntries[ChunkIndex].StoreStatus == EStoreStatus::SS_STORED;
+}
+
+int32 FMQCChunkStreamer::Tick()
+{
+    LoadedChunks.Reset();
+
+    if (ChunkEntries.Num() < 1)
+    {
+        return 0;
+    }
+
+    CompleteWrites(false);
+    CompleteLoads();
+    TouchFocusChunks();
+    EnforceMemoryBudget();
+
+    return LoadedChunks.Num();
+}
+
+void FMQCChunkStreamer::TouchChunk(int32 ChunkIndex)
+{
+    if (ChunkEntries.IsValidIndex(ChunkIndex))
+    {
+        ChunkEntries[ChunkIndex].LastAccess = ++AccessClock;
+    }
+}
+
+void FMQCChunkStreamer::TouchFocusChunks()
+{
+    ++FocusSerial;
+
+    if (StreamingRadius <= 0.f)
+    {
+        return;
+    }
+
+    const int32 VoxelResolution = Map.GetVoxelResolution();
+    const int32 ChunkResolution = Map.GetChunkResolution();
+    const float RadiusSq = FMath::Square(StreamingRadius);
+
+    for (const FVector2D& Point : FocusPoints)
+    {
+        const int32 ChunkMinX = FMath::Max(FMath::FloorToInt((Point.X-StreamingRadius) / VoxelResolution), 0);
+        const int32 ChunkMinY = FMath::Max(FMath::FloorToInt((Point.Y-StreamingRadius) / VoxelResolution), 0);
+        const int32 ChunkMaxX = FMath::Min(FMath::FloorToInt((Point.X+StreamingRadius) / VoxelResolution), ChunkResolution-1);
+        const int32 ChunkMaxY = FMath::Min(FMath::FloorToInt((Point.Y+StreamingRadius) / VoxelResolution), ChunkResolution-1);
+
+        for (int32 y=ChunkMinY; y<=ChunkMaxY; ++y)
+        for (int32 x=ChunkMinX; x<=ChunkMaxX; ++x)
+        {
+            const FBox2D ChunkBounds(
+                FVector2D(x, y) * VoxelResolution,
+                FVector2D(x+1, y+1) * VoxelResolution
+                );
+
+            if (ChunkBounds.ComputeSquaredDistanceToPoint(Point) > RadiusSq)
+            {
+                continue;
+            }
+
+            const int32 ChunkIndex = Map.GetChunkIndex(x, y);
+            FChunkEntry& Entry(ChunkEntries[ChunkIndex]);
+
+            Entry.FocusSerial = FocusSerial;
+            Entry.LastAccess = ++AccessClock;
+
+            if (! Entry.bResident)
+            {
+                RequestLoad(ChunkIndex);
+            }
+        }
+    }
+}
+
+void FMQCChunkStreamer::RequestLoad(int32 ChunkIndex)
+{
+    if (PendingLoads.Contains(ChunkIndex))
+    {
+        return;
+    }
+
+    // Chunk data of pending writes is still in memory, restore immediately
+    if (PendingWrites.Contains(ChunkIndex))
+    {
+        Map.MakeChunkResident(ChunkIndex);
+        LoadedChunks.Emplace(ChunkIndex);
+        return;
+    }
+
+    if (PendingLoads.Num() >= MaxPendingLoads || ! IsChunkStored(ChunkIndex))
+    {
+        return;
+    }
+
+    const FString Path(GetChunkPath(ChunkIndex));
+
+    PendingLoads.Emplace(ChunkIndex, Async(
+        EAsyncExecution::ThreadPool,
+        [Path]()
+        {
+            FChunkDataPtr Data(MakeShared<TArray<uint8>, ESPMode::ThreadSafe>());
+
+            if (! FFileHelper::LoadFileToArray(*Data, *Path, FILEREAD_Silent))
+            {
+                Data.Reset();
+            }
+
+            return Data;
+        } ) );
+}
+
+void FMQCChunkStreamer::CompleteLoads()
+{
+    TArray<int32> CompletedChunks;
+
+    for (const TPair<int32, TFuture<FChunkDataPtr>>& PendingLoad : PendingLoads)
+    {
+        if (PendingLoad.Value.IsReady())
+        {
+            CompletedChunks.Emplace(PendingLoad.Key);
+        }
+    }
+
+    // Allocated chunks consume their pending load on restore
+
+    for (int32 ChunkIndex : CompletedChunks)
+    {
+        Map.MakeChunkResident(ChunkIndex);
+        LoadedChunks.Emplace(ChunkIndex);
+    }
+}
+
+void FMQCChunkStreamer::CompleteWrites(bool bWait)
+{
+    for (auto It = PendingWrites.CreateIterator(); It; ++It)
+    {
+        FPendingWrite& PendingWrite(It.Value());
+
+        if (bWait)
+        {
+            PendingWrite.Result.Wait();
+        }
+
+        if (PendingWrite.Result.IsReady())
+        {
+            if (! PendingWrite.Result.Get())
+            {
+                UE_LOG(LogMQC, Warning, TEXT("FMQCChunkStreamer::CompleteWrites() - Failed to write chunk %d"), It.Key());
+
+                if (ChunkEntries.IsValidIndex(It.Key()))
+                {
+                    ChunkEntries[It.Key()].StoreStatus = EStoreStatus::SS_NONE;
+                }
+            }
+
+            It.RemoveCurrent();
+        }
+    }
+}
+
+void FMQCChunkStreamer::WaitForPendingWrite(int32 ChunkIndex)
+{
+    if (FPendingWrite* PendingWrite = PendingWrites.Find(ChunkIndex))
+    {
+        PendingWrite->Result.Wait();
+        PendingWrites.Remove(ChunkIndex);
+    }
+}
+
+void FMQCChunkStreamer::EnforceMemoryBudget()
+{
+    ResidentMemory = 0;
+
+    for (int32 ChunkIndex : ResidentChunks)
+    {
+        ResidentMemory += Map.GetChunk(ChunkIndex).GetAllocatedSize();
+    }
+
+    if (MemoryBudget <= 0 || ResidentMemory <= static_cast<SIZE_T>(MemoryBudget))
+    {
+        return;
+    }
+
+    // Evict least recently used chunks outside the streaming radius
+
+    TArray<int32> Candidates;
+
+    for (int32 ChunkIndex : ResidentChunks)
+    {
+        if (ChunkEntries[ChunkIndex].FocusSerial != FocusSerial)
+        {
+            Candidates.Emplace(ChunkIndex);
+        }
+    }
+
+    Candidates.Sort([this](int32 A, int32 B)
+    {
+        return ChunkEntries[A].LastAccess < ChunkEntries[B].LastAccess;
+    } );
+
+    for (int32 ChunkIndex : Candidates)
+    {
+        if (ResidentMemory <= static_cast<SIZE_T>(MemoryBudget))
+        {
+            break;
+        }
+
+        const SIZE_T ChunkMemory = Map.GetChunk(ChunkIndex).GetAllocatedSize();
+
+        if (EvictChunk(ChunkIndex))
+        {
+            ResidentMemory -= FMath::Min(ResidentMemory, ChunkMemory);
+        }
+    }
+}
+
+void FMQCChunkStreamer::StoreChunk(int32 ChunkIndex, FMQCGridChunk& Chunk)
+{
+    // Writes of the same chunk must not overlap
+    WaitForPendingWrite(ChunkIndex);
+
+    FChunkDataPtr Data(MakeShared<TArray<uint8>, ESPMode::ThreadSafe>());
+
+    FMemoryWriter Writer(*Data);
+
+    uint32 Magic = StoreMagic;
+    int32 Version = StoreVersion;
+    uint32 Key = StoreKey;
+
+    Writer << Magic;
+    Writer << Version;
+    Writer << Key;
+
+    Chunk.SerializeVoxels(Writer);
+
+    const FString Path(GetChunkPath(ChunkIndex));
+
+    FPendingWrite PendingWrite;
+    PendingWrite.Data = Data;
+    PendingWrite.Result = Async(
+        EAsyncExecution::ThreadPool,
+        [Data, Path]()
+        {
+            return FFileHelper::SaveArrayToFile(*Data, *Path);
+        } );
+
+    PendingWrites.Emplace(ChunkIndex, MoveTemp(PendingWrite));
+    ChunkEntries[ChunkIndex].StoreStatus = EStoreStatus::SS_STORED;
+}
+
+bool FMQCChunkStreamer::ReadChunkData(FMQCGridChunk& Chunk, const TArray<uint8>& Data) const
+{
+    FMemoryReader Reader(Data);
+
+    uint32 Magic = 0;
+    int32 Version = 0;
+    uint32 Key = 0;
+
+    Reader << Magic;
+    Reader << Version;
+    Reader << Key;
+
+    if (Magic != StoreMagic || Version != StoreVersion || Key != StoreKey)
+    {
+        return false;
+    }
+
+    Chunk.SerializeVoxels(Reader);
+
+    return ! Reader.IsError();
+}
+
+void FMQCChunkStreamer::RestoreChunk(int32 ChunkIndex, FMQCGridChunk& Chunk)
+{
+    if (! ChunkEntries.IsValidIndex(ChunkIndex))
+    {
+        return;
+    }
+
+    FChunkEntry& Entry(ChunkEntries[ChunkIndex]);
+    FChunkDataPtr Data;
+
+    // Pending writes hold the most recent chunk data
+
+    if (FPendingWrite* PendingWrite = PendingWrites.Find(ChunkIndex))
+    {
+        Data = PendingWrite->Data;
+    }
+    else
+    if (TFuture<FChunkDataPtr>* PendingLoad = PendingLoads.Find(ChunkIndex))
+    {
+        Data = PendingLoad->Get();
+        PendingLoads.Remove(ChunkIndex);
+    }
+    else
+    if (IsChunkStored(ChunkIndex))
+    {
+        // Stored chunk edited before its async load was requested, load
+        // synchronously. Chunks never stored skip the store entirely.
+
+        Data = MakeShared<TArray<uint8>, ESPMode::ThreadSafe>();
+
+        if (! FFileHelper::LoadFileToArray(*Data, *GetChunkPath(ChunkIndex), FILEREAD_Silent))
+        {
+            Data.Reset();
+        }
+    }
+
+    if (Entry.StoreStatus == EStoreStatus::SS_STORED && ! Data.IsValid())
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCChunkStreamer::RestoreChunk() - Failed to load chunk %d"), ChunkIndex);
+    }
+
+    if (Data.IsValid() && ! ReadChunkData(Chunk, *Data))
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCChunkStreamer::RestoreChunk() - Invalid stored chunk %d"), ChunkIndex);
+        Chunk.ResetVoxels();
+    }
+
+    if (! Entry.bResident)
+    {
+        Entry.bResident = true;
+        ResidentChunks.Emplace(ChunkIndex);
+    }
+
+    TouchChunk(ChunkIndex);
+}
+
+bool FMQCChunkStreamer::EvictChunk(int32 ChunkIndex)
+{
+    if (! IsChunkResident(ChunkIndex))
+    {
+        return false;
+    }
+
+    StoreChunk(ChunkIndex, Map.GetChunk(ChunkIndex));
+    Map.ReleaseChunk(ChunkIndex, ! bKeepEvictedMeshes);
+
+    ChunkEntries[ChunkIndex].bResident = false;
+    ResidentChunks.RemoveSwap(ChunkIndex);
+    ++EvictedCount;
+
+    return true;
+}
+
+void FMQCChunkStreamer::FlushResidentChunks()
+{
+    for (int32 ChunkIndex : ResidentChunks)
+    {
+        StoreChunk(ChunkIndex, Map.GetChunk(ChunkIndex));
+    }
+}
+
+void FMQCChunkStreamer::ClearStore()
+{
+    for (TPair<int32, TFuture<FChunkDataPtr>>& PendingLoad : PendingLoads)
+    {
+        PendingLoad.Value.Wait();
+    }
+
+    PendingLoads.Reset();
+    CompleteWrites(true);
+
+    IFileManager::Get().DeleteDirectory(*StoreDirectory, false, true);
+
+    // Evicted chunks are cleared along with the store
+    for (FChunkEntry& Entry : ChunkEntries)
+    {
+        Entry.StoreStatus = EStoreStatus::SS_NONE;
+    }
+
+    if (! bSessionStore)
+    {
+        WriteManifest();
+    }
+}
@@ -0,0 +1,214 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "MQCEdgeSegmentTree.h"
+
+void FMQCEdgeSegmentTree::Reset()
+{
+    Nodes.Reset();
+    Segments.Reset();
+}
+
+void FMQCEdgeSegmentTree::Build(TArray<FSegment>& InSegments)
+{
+    Reset();
+
+    if (InSegments.Num() < 1)
+    {
+        return;
+    }
+
+    Segments = MoveTemp(InSegments);
+
+    // A binary tree with leaf size N has at most 2*(Count/N)+1 nodes
+    Nodes.Reserve(2 * (Segments.Num()/MaxLeafSegments + 1));
+
+    BuildNode(0, Segments.Num());
+
+    Nodes.Shrink();
+}
+
+int32 FMQCEdgeSegmentTree::BuildNode(int32 SegmentStart, int32 SegmentCount)
+{
+    const int32 NodeIndex = Nodes.AddUninitialized(1);
+    const int32 SegmentEnd = SegmentStart+SegmentCount;
+
+    // Calculate node bounds and centroid bounds
+
+    FBox2D Bounds(ForceInitToZero);
+    FBox2D CentroidBounds(ForceInitToZero);
+
+    for (int32 i=SegmentStart; i<SegmentEnd; ++i)
+    {
+        const FSegment& Segment(Segments[i]);
+        Bounds += Segment.Point0;
+        Bounds += Segment.Point1;
+        CentroidBounds += (Segment.Point0+Segment.Point1) * .5f;
+    }
+
+    Nodes[NodeIndex].Bounds = Bounds;
+
+    // Create leaf node
+
+    if (SegmentCount <= MaxLeafSegments)
+    {
+        Nodes[NodeIndex].Offset = SegmentStart;
+        Nodes[NodeIndex].SegmentCount = SegmentCount;
+        return NodeIndex;
+    }
+
+    // Split segments at the median centroid of the longest axis
+
+    const FVector2D Extent = CentroidBounds.GetSize();
+    const int32 Axis = (Extent.X >= Extent.Y) ? 0 : 1;
+    const int32 SplitCount = SegmentCount/2;
+
+    Sort(
+        Segments.GetData()+SegmentStart,
+        SegmentCount,
+        [Axis](const FSegment& A, const FSegment& B)
+        {
+            return (A.Point0[Axis]+A.Point1[Axis]) < (B.Point0[Axis]+B.Point1[Axis]);
+        } );
+
+    // Build child nodes, first child immediately follows the parent node
+
+    BuildNode(SegmentStart, SplitCount);
+    const int32 SecondChild = BuildNode(SegmentStart+SplitCount, SegmentCount-SplitCount);
+
+    Nodes[NodeIndex].Offset = SecondChild;
+    Nodes[NodeIndex].SegmentCount = 0;
+
+    return NodeIndex;
+}
+
+bool FMQCEdgeSegmentTree::FindNearest(FMQCEdgeSegmentNearest& OutNearest, const FVector2D& Point, float MaxDistanceSq) const
+{
+    if (Nodes.Num() < 1)
+    {
+        return false;
+    }
+
+    TArray<int32, TInlineAllocator<64>> NodeStack;
+    NodeStack.Emplace(0);
+
+    float BestDistanceSq = MaxDistanceSq;
+    bool bFound = false;
+
+    while (NodeStack.Num() > 0)
+    {
+        const int32 NodeIndex = NodeStack.Pop(false);
+        const FNode& Node(Nodes[NodeIndex]);
+
+        if (GetBoundsDistanceSq(Node.Bounds, Point) >= BestDistanceSq)
+        {
+            continue;
+        }
+
+        if (Node.IsLeaf())
+        {
+            for (int32 i=Node.Offset; i<Node.Offset+Node.SegmentCount; ++i)
+            {
+                const FVector2D Closest = GetClosestPoint(Segments[i], Point);
+                const float DistanceSq = FVector2D::DistSquared(Closest, Point);
+
+                if (DistanceSq < BestDistanceSq)
+                {
+                    BestDistanceSq = DistanceSq;
+                    OutNearest.SegmentIndex = i;
+                    OutNearest.DistanceSq = DistanceSq;
+                    OutNearest.Location = Closest;
+                    bFound = true;
+                }
+            }
+        }
+        else
+        {
+            const int32 ChildA = NodeIndex+1;
+            const int32 ChildB = Node.Offset;
+
+            const float DistanceA = GetBoundsDistanceSq(Nodes[ChildA].Bounds, Point);
+            const float DistanceB = GetBoundsDistanceSq(Nodes[ChildB].Bounds, Point);
+
+            // Push farther child first to visit the nearer child first
+            if (DistanceA < DistanceB)
+            {
+                NodeStack.Emplace(ChildB);
+                NodeStack.Emplace(ChildA);
+            }
+            else
+            {
+                NodeStack.Emplace(ChildA);
+                NodeStack.Emplace(ChildB);
+            }
+        }
+    }
+
+    return bFound;
+}
+
+void FMQCEdgeSegmentTree::FindWithinRadius(TArray<int32>& OutSegmentIndices, const FVector2D& Center, float Radius) const
+{
+    if (Nodes.Num() < 1)
+    {
+        return;
+    }
+
+    const float RadiusSq = Radius*Radius;
+
+    TArray<int32, TInlineAllocator<64>> NodeStack;
+    NodeStack.Emplace(0);
+
+    while (NodeStack.Num() > 0)
+    {
+        const int32 NodeIndex = NodeStack.Pop(false);
+        const FNode& Node(Nodes[NodeIndex]);
+
+        if (GetBoundsDistanceSq(Node.Bounds, Center) > RadiusSq)
+        {
+            continue;
+        }
+
+        if (Node.IsLeaf())
+        {
+            for (int32 i=Node.Offset; i<Node.Offset+Node.SegmentCount; ++i)
+            {
+                const FVector2D Closest = GetClosestPoint(Segments[i], Center);
+
+                if (FVector2D::DistSquared(Closest, Center) <= RadiusSq)
+                {
+                    OutSegmentIndices.Emplace(i);
+                }
+            }
+        }
+        else
+        {
+            NodeStack.Emplace(Node.Offset);
+            NodeStack.Emplace(NodeIndex+1);
+        }
+    }
+}
@@ -0,0 +1,137 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+struct FMQCEdgeSegmentNearest
+{
+    int32 SegmentIndex;
+    float DistanceSq;
+    FVector2D Location;
+};
+
+// Bounding volume hierarchy over 2D contour segments.
+// Segments are reordered on build so that each leaf references a
+// contiguous segment range.
+class FMQCEdgeSegmentTree
+{
+public:
+
+    struct FSegment
+    {
+        FVector2D Point0;
+        FVector2D Point1;
+        int32 EdgeListIndex;
+    };
+
+private:
+
+    enum { MaxLeafSegments = 4 };
+
+    struct FNode
+    {
+        FBox2D Bounds;
+
+        // Leaf node: first segment index, internal node: second child index.
+        // First child of an internal node always immediately follows its parent.
+        int32 Offset;
+        int32 SegmentCount;
+
+        FORCEINLINE bool IsLeaf() const
+        {
+            return SegmentCount > 0;
+        }
+    };
+
+    TArray<FNode> Nodes;
+    TArray<FSegment> Segments;
+
+    int32 BuildNode(int32 SegmentStart, int32 SegmentCount);
+
+    FORCEINLINE static float GetBoundsDistanceSq(const FBox2D& Bounds, const FVector2D& Point);
+    FORCEINLINE static FVector2D GetClosestPoint(const FSegment& Segment, const FVector2D& Point);
+
+public:
+
+    void Build(TArray<FSegment>& InSegments);
+    void Reset();
+
+    FORCEINLINE bool IsEmpty() const
+    {
+        return Segments.Num() == 0;
+    }
+
+    FORCEINLINE int32 GetSegmentCount() const
+    {
+        return Segments.Num();
+    }
+
+    FORCEINLINE SIZE_T GetAllocatedSize() const
+    {
+        return Nodes.GetAllocatedSize() + Segments.GetAllocatedSize();
+    }
+
+    FORCEINLINE const FSegment& GetSegment(int32 SegmentIndex) const
+    {
+        return Segments[SegmentIndex];
+    }
+
+    FORCEINLINE FBox2D GetBounds() const
+    {
+        return Nodes.Num() > 0 ? Nodes[0].Bounds : FBox2D(ForceInitToZero);
+    }
+
+    // Find nearest segment to a point within the specified squared distance.
+    // OutNearest is only written when a closer segment is found.
+    bool FindNearest(FMQCEdgeSegmentNearest& OutNearest, const FVector2D& Point, float MaxDistanceSq) const;
+
+    // Find segments that intersect the specified circle.
+    void FindWithinRadius(TArray<int32>& OutSegmentIndices, const FVector2D& Center, float Radius) const;
+};
+
+FORCEINLINE float FMQCEdgeSegmentTree::GetBoundsDistanceSq(const FBox2D& Bounds, const FVector2D& Point)
+{
+    const float dx = FMath::Max3(Bounds.Min.X-Point.X, 0.f, Point.X-Bounds.Max.X);
+    const float dy = FMath::Max3(Bounds.Min.Y-Point.Y, 0.f, Point.Y-Bounds.Max.Y);
+    return dx*dx + dy*dy;
+}
+
+FORCEINLINE FVector2D FMQCEdgeSegmentTree::GetClosestPoint(const FSegment& Segment, const FVector2D& Point)
+{
+    const FVector2D SegmentDir = Segment.Point1 - Segment.Point0;
+    const float LengthSq = SegmentDir.SizeSquared();
+
+    if (LengthSq < SMALL_NUMBER)
+    {
+        return Segment.Point0;
+    }
+
+    const float t = FMath::Clamp(FVector2D::DotProduct(Point-Segment.Point0, SegmentDir) / LengthSq, 0.f, 1.f);
+    return Segment.Point0 + SegmentDir*t;
+}
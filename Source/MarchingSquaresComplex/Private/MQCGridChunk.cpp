@@ -26,27 +26,67 @@
 // 
 
 #include "MQCGridChunk.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/Compression.h"
+#include "Misc/ScopeLock.h"
 #include "MQCGridSurface.h"
 #include "MQCStencil.h"
+#include "MarchingSquaresComplex.h"
 
 FMQCGridChunk::FMQCGridChunk()
-    : xNeighbor(nullptr)
+    : bUniformState(true)
+    , UniformState(0)
+    , LODLevel(0)
+    , LODSeamMinX(0)
+    , LODSeamMinY(0)
+    , LODSeamMaxX(0)
+    , LODSeamMaxY(0)
+    , EmptyVoxels(nullptr)
+    , VoxelStride(0)
+    , bHaloVoxels(false)
+    , xNeighbor(nullptr)
     , yNeighbor(nullptr)
     , xyNeighbor(nullptr)
+    , LastTriangulationTime(0.0)
+    , PublishedSnapshot(nullptr)
+    , SnapshotEpochs(nullptr)
+    , SnapshotVersion(0)
+    , SnapshotDirtyMinY(MAX_int32)
+    , SnapshotDirtyMaxY(-1)
+    , EdgeDataFutures(nullptr)
+    , bCompressed(false)
+    , bGeometryReleased(false)
+    , GeometryRestoreQueue(nullptr)
+    , bGeometryRestoreRequested(false)
+    , LastAccessCycles(0)
+    , DecompressionCount(0)
+    , DecompressionTime(0.0)
+    , MaxDecompressionTime(0.0)
 {
 }
 
 FMQCGridChunk::~FMQCGridChunk()
 {
     WaitForAsyncTask();
+
+    // Readers are not expected to outlive chunks
+    delete PublishedSnapshot.Exchange(nullptr);
 }
 
 void FMQCGridChunk::Configure(const FMQCChunkConfig& Config)
 {
+    MQC_LLM_SCOPE();
+
     Position = Config.Position;
     MapSize = Config.MapSize;
     VoxelResolution = Config.VoxelResolution;
     MaterialType = Config.MaterialType;
+    bHaloVoxels = Config.bHaloVoxels;
+    SnapshotEpochs = Config.SnapshotEpochs;
+    EdgeDataFutures = Config.EdgeDataFutures;
+    GeometryRestoreQueue = Config.GeometryRestoreQueue;
+    EmptyVoxels = Config.EmptyVoxels;
+    VoxelStride = bHaloVoxels ? VoxelResolution+1 : VoxelResolution;
 
     BoundsMin = Position;
     BoundsMax = Position+FIntPoint(VoxelResolution, VoxelResolution);
@@ -54,15 +94,75 @@ void FMQCGridChunk::Configure(const FMQCChunkConfig& Config)
     Cell.sharpFeatureLimit = FMath::Cos(FMath::DegreesToRadians(Config.MaxFeatureAngle));
     Cell.parallelLimit     = FMath::Cos(FMath::DegreesToRadians(Config.MaxParallelAngle));
 
-    Voxels.SetNumZeroed(VoxelResolution * VoxelResolution);
+    Voxels.Empty();
+    CompressedVoxels.Empty();
+    bCompressed.Store(false);
+    bGeometryReleased = false;
+    bGeometryRestoreRequested = false;
+
+    DecompressionCount = 0;
+    DecompressionTime = 0.0;
+    MaxDecompressionTime = 0.0;
+    MarkAccessed();
+
+    bUniformState = true;
+    UniformState = 0;
+
+    LODLevel = 0;
+    LODSeamMinX = 0;
+    LODSeamMinY = 0;
+    LODSeamMaxX = 0;
+    LODSeamMaxY = 0;
+    LODVoxels.Empty();
+
+    Surfaces.Empty();
+    SurfaceConfigs.Empty();
+    StateHistogram.Empty();
+    SurfaceStateMask.Empty();
+    ActiveSurfaces.Empty();
+
+    // Sparse chunk surfaces and voxels are allocated on first edit
+    if (! EmptyVoxels)
+    {
+        CreateSurfaces(Config);
+        AllocateVoxels();
+    }
+}
+
+void FMQCGridChunk::AllocateSurfaces(const FMQCChunkConfig& Config)
+{
+    if (SurfaceConfigs.Num() > 0)
+    {
+        return;
+    }
+
+    MQC_LLM_SCOPE();
+
+    WaitForAsyncTask();
+
+    CreateSurfaces(Config);
+}
+
+void FMQCGridChunk::AllocateVoxels()
+{
+    if (IsAllocated())
+    {
+        return;
+    }
+
+    MQC_LLM_SCOPE();
+
+    WaitForAsyncTask();
+
+    Voxels.SetNumZeroed(VoxelStride * VoxelStride);
     
-    for (int32 y=0, i=0; y<VoxelResolution; y++)
-    for (int32 x=0     ; x<VoxelResolution; x++, i++)
+    for (int32 y=0, i=0; y<VoxelStride; y++)
+    for (int32 x=0     ; x<VoxelStride; x++, i++)
     {
         Voxels[i].Set(x, y);
     }
 
-    CreateSurfaces(Config);
+    PublishSnapshot();
 }
 
 void FMQCGridChunk::CreateSurfaces(const FMQCChunkConfig& GridConfig)
@@ -71,6 +171,9 @@ void FMQCGridChunk::CreateSurfaces(const FMQCChunkConfig& GridConfig)
 
     const int32 StateCount = 1 + GridConfig.States.Num();
 
+    Surfaces.Reset(StateCount);
+    SurfaceConfigs.Reset(StateCount);
+
     for (int32 i=0; i<StateCount; ++i)
     {
         FMQCSurfaceConfig Config;
@@ -88,454 +191,1836 @@ void FMQCGridChunk::CreateSurfaces(const FMQCChunkConfig& GridConfig)
             Config.bGenerateExtrusion = State.bGenerateExtrusion;
             Config.bExtrusionSurface  = State.bExtrusionSurface;
             Config.bRemapEdgeUVs = State.bRemapEdgeUVs;
+            Config.bExtrudeWalls = State.bExtrudeWalls;
+            Config.bExtrudeBackFace = State.bExtrudeBackFace;
+            Config.bGenerateSimplifiedEdges = State.bGenerateSimplifiedEdges;
+            Config.SimplifiedEdgeTolerance  = State.SimplifiedEdgeTolerance;
+            Config.bCompactVertexFormat = State.bCompactVertexFormat;
         }
         else
         {
             Config.bGenerateExtrusion = false;
             Config.bExtrusionSurface  = false;
             Config.bRemapEdgeUVs = false;
+            Config.bExtrudeWalls = false;
+            Config.bExtrudeBackFace = false;
+            Config.bGenerateSimplifiedEdges = false;
+            Config.SimplifiedEdgeTolerance  = 0.f;
+            Config.bCompactVertexFormat = false;
         }
 
-        Surfaces.Add(new FMQCGridSurface(Config));
+        SurfaceConfigs.Emplace(Config);
     }
+
+    // Only the empty state surface is allocated up front,
+    // other surfaces are allocated once their state is present
+
+    Surfaces.SetNum(StateCount);
+    Surfaces[0] = MakeUnique<FMQCGridSurface>(SurfaceConfigs[0]);
+
+    SurfaceStateMask.Init(false, StateCount);
+
+    StateHistogram.SetNumZeroed(StateCount);
+    StateHistogram[0] = VoxelResolution * VoxelResolution;
 }
 
-void FMQCGridChunk::ResetVoxels()
+FMQCGridSurface& FMQCGridChunk::GetOrCreateSurface(int32 StateIndex)
 {
-    WaitForAsyncTask();
+    check(Surfaces.IsValidIndex(StateIndex));
 
-    for (FMQCVoxel& voxel : Voxels)
+    TUniquePtr<FMQCGridSurface>& Surface(Surfaces[StateIndex]);
+
+    if (! Surface.IsValid())
     {
-        voxel.Init();
+        Surface = MakeUnique<FMQCGridSurface>(SurfaceConfigs[StateIndex]);
+        SurfaceStateMask[StateIndex] = true;
     }
-}
 
-void FMQCGridChunk::SetNeighbourX(const FMQCGridChunk* InNeighbour)
-{
-    xNeighbor = InNeighbour;
+    return *Surface;
 }
 
-void FMQCGridChunk::SetNeighbourY(const FMQCGridChunk* InNeighbour)
+FMQCGridSurface& FMQCGridChunk::GetOrCreateSurfaceSync(int32 StateIndex)
 {
-    yNeighbor = InNeighbour;
-}
+    // Allocation must not race an outstanding triangulation task
+    if (! IsSurfaceAllocated(StateIndex))
+    {
+        WaitForAsyncTask();
+    }
 
-void FMQCGridChunk::SetNeighbourXY(const FMQCGridChunk* InNeighbour)
-{
-    xyNeighbor = InNeighbour;
+    return GetOrCreateSurface(StateIndex);
 }
 
-FPMUMeshSection* FMQCGridChunk::GetSurfaceSection(int32 StateIndex)
+void FMQCGridChunk::ResetVoxels()
 {
-    return HasSurface(StateIndex)
-        ? &Surfaces[StateIndex].GetSurfaceSection()
-        : nullptr;
-}
+    WaitForAsyncTask();
+    DecompressVoxels();
 
-FPMUMeshSection* FMQCGridChunk::GetExtrudeSection(int32 StateIndex)
-{
-    return HasSurface(StateIndex)
-        ? &Surfaces[StateIndex].GetExtrudeSection()
-        : nullptr;
+    // Unallocated chunks are empty
+    if (Voxels.Num() < 1)
+    {
+        return;
+    }
+
+    for (FMQCVoxel& voxel : Voxels)
+    {
+        voxel.Init();
+    }
+
+    bUniformState = true;
+    UniformState = 0;
+
+    FMemory::Memzero(StateHistogram.GetData(), StateHistogram.Num() * StateHistogram.GetTypeSize());
+    StateHistogram[0] = VoxelResolution * VoxelResolution;
+
+    MarkSnapshotRows(0, VoxelStride-1);
+    PublishSnapshot();
 }
 
-FPMUMeshSection* FMQCGridChunk::GetSurfaceMaterialSection(int32 StateIndex, const FMQCMaterialBlend& Material)
+void FMQCGridChunk::ReleaseVoxels(bool bReleaseGeometry)
 {
-    FPMUMeshSection* Section = nullptr;
+    WaitForAsyncTask();
 
-    if (HasSurface(StateIndex))
+    if (bReleaseGeometry)
+    {
+        // Cleared surfaces are reported as geometry changes
+
+        for (int32 i=1; i<Surfaces.Num(); ++i)
+        {
+            if (Surfaces[i].IsValid())
+            {
+                Surfaces[i]->Initialize();
+                Surfaces[i]->Finalize();
+            }
+
+            SurfaceStateMask[i] = false;
+        }
+    }
+    else
     {
-        Section = Surfaces[StateIndex].GetSurfaceMaterialSection(Material);
+        // Kept geometry can not be regenerated once voxels are released
+        RestoreGeometry();
     }
 
-    return Section;
+    {
+        FScopeLock ScopeLock(&CompressionLock);
+
+        Voxels.Empty();
+        LODVoxels.Empty();
+        CompressedVoxels.Empty();
+        bCompressed.Store(false);
+        bGeometryReleased = false;
+        bGeometryRestoreRequested = false;
+    }
+
+    bUniformState = true;
+    UniformState = 0;
+
+    FMemory::Memzero(StateHistogram.GetData(), StateHistogram.Num() * StateHistogram.GetTypeSize());
+    StateHistogram[0] = VoxelResolution * VoxelResolution;
+
+    // Readers of the released snapshot keep it alive until their read scope ends
+    if (SnapshotEpochs)
+    {
+        SnapshotEpochs->Retire(PublishedSnapshot.Exchange(nullptr));
+    }
 }
 
-FPMUMeshSection* FMQCGridChunk::GetExtrudeMaterialSection(int32 StateIndex, const FMQCMaterialBlend& Material)
+void FMQCGridChunk::SerializeVoxels(FArchive& Ar)
 {
-    FPMUMeshSection* Section = nullptr;
+    WaitForAsyncTask();
+    DecompressVoxels();
 
-    if (HasSurface(StateIndex))
+    int32 VoxelCount = Voxels.Num();
+    Ar << VoxelCount;
+
+    if (Ar.IsLoading())
     {
-        Section = Surfaces[StateIndex].GetExtrudeMaterialSection(Material);
+        if (VoxelCount != VoxelStride*VoxelStride)
+        {
+            Ar.SetError();
+            return;
+        }
+
+        Voxels.SetNumUninitialized(VoxelCount);
     }
 
-    return Section;
+    // Voxels are stored in native memory layout
+    Ar.Serialize(Voxels.GetData(), VoxelCount * Voxels.GetTypeSize());
+
+    if (Ar.IsLoading())
+    {
+        UpdateStateOccupancy();
+        MarkSnapshotRows(0, VoxelStride-1);
+        PublishSnapshot();
+    }
 }
 
-int32 FMQCGridChunk::AppendEdgeSyncData(TArray<FMQCEdgeSyncData>& OutSyncData, int32 StateIndex) const
+bool FMQCGridChunk::CompressVoxels(bool bReleaseGeometry)
 {
-    if (HasSurface(StateIndex))
+    WaitForAsyncTask();
+
+    // Lock-free voxel readers only hold published snapshots, working
+    // voxels are only released with a snapshot epoch manager
+    if (! SnapshotEpochs || bCompressed.Load() || Voxels.Num() < 1)
     {
-        int32 StartIndex = OutSyncData.Num();
-        Surfaces[StateIndex].AppendEdgeSyncData(OutSyncData);
-        return StartIndex;
+        return false;
     }
-    else
+
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_CompressChunk);
+    MQC_LLM_SCOPE();
+
+    const int32 VoxelSize = Voxels.GetTypeSize();
+    const int32 RawSize = Voxels.Num() * VoxelSize;
+    const uint8* RawData = reinterpret_cast<const uint8*>(Voxels.GetData());
+
+    // Delta filter voxel bytes against the previous voxel. Neighbouring
+    // voxels mostly differ by position only, filtered voxels compress to
+    // long runs of repeated bytes.
+
+    TArray<uint8> DeltaData;
+    DeltaData.SetNumUninitialized(RawSize);
+
+    FMemory::Memcpy(DeltaData.GetData(), RawData, VoxelSize);
+
+    for (int32 i=VoxelSize; i<RawSize; ++i)
     {
-        return -1;
+        DeltaData[i] = RawData[i] - RawData[i-VoxelSize];
     }
-}
 
-void FMQCGridChunk::GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList, int32 StateIndex) const
-{
-    if (HasSurface(StateIndex))
+    int32 CompressedSize = FCompression::CompressMemoryBound(NAME_LZ4, RawSize);
+
+    TArray<uint8> CompressedData;
+    CompressedData.SetNumUninitialized(CompressedSize);
+
+    // Keep raw voxels if compression fails or does not reduce voxel size
+
+    if (! FCompression::CompressMemory(NAME_LZ4, CompressedData.GetData(), CompressedSize, DeltaData.GetData(), RawSize) ||
+        CompressedSize >= RawSize)
     {
-        Surfaces[StateIndex].GetEdgePoints(OutPointList);
+        return false;
     }
-}
 
-void FMQCGridChunk::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex) const
-{
-    if (HasSurface(StateIndex))
+    CompressedData.SetNum(CompressedSize, false);
+    CompressedData.Shrink();
+
+    FScopeLock ScopeLock(&CompressionLock);
+
+    // Compressed voxels are complete before the chunk reads as
+    // compressed, working voxels are released afterwards
+    CompressedVoxels = MoveTemp(CompressedData);
+    bCompressed.Store(true);
+    Voxels.Empty();
+    LODVoxels.Empty();
+
+    // Readers of the retired snapshot keep it alive until their read scope
+    // ends, later reads decompress and read the republished snapshot
+
+    if (SnapshotEpochs)
     {
-        Surfaces[StateIndex].GetEdgePoints(OutPoints, EdgeListIndex);
+        SnapshotEpochs->Retire(PublishedSnapshot.Exchange(nullptr));
     }
-}
 
-void FMQCGridChunk::AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex) const
-{
-    if (HasSurface(StateIndex))
+    // Geometry hash and change flags are kept, regenerated geometry
+    // of unchanged voxels is not reported as a geometry change
+
+    if (bReleaseGeometry && ! bGeometryReleased)
     {
-        Surfaces[StateIndex].AppendConnectedEdgePoints(OutPoints, EdgeListIndex);
+        for (int32 i=1; i<Surfaces.Num(); ++i)
+        {
+            if (Surfaces[i].IsValid())
+            {
+                Surfaces[i]->ReleaseMeshData();
+            }
+        }
+
+        bGeometryReleased = true;
     }
+
+    return true;
 }
 
-void FMQCGridChunk::GetMaterialSet(TSet<FMQCMaterialBlend>& MaterialSet) const
+void FMQCGridChunk::DecompressVoxels() const
 {
-    for (int32 StateIndex=1; StateIndex<Surfaces.Num(); StateIndex++)
+    if (! bCompressed.Load())
     {
-        Surfaces[StateIndex].GetMaterialSet(MaterialSet);
+        return;
     }
-}
 
-void FMQCGridChunk::AddQuadFilter(const FIntPoint& Point, int32 StateIndex, bool bExtrudeGeometry)
-{
-    check((Point.X-Position.X) >= 0);
-    check((Point.Y-Position.Y) >= 0);
-    check((Point.X-Position.X) < VoxelResolution);
-    check((Point.Y-Position.Y) < VoxelResolution);
+    FScopeLock ScopeLock(&CompressionLock);
 
-    if (StateIndex > 0 && HasSurface(StateIndex))
+    // Decompressed by a concurrent reader
+    if (! bCompressed.Load())
     {
-        Surfaces[StateIndex].AddQuadFilter(Point, bExtrudeGeometry);
+        return;
     }
-}
 
-uint32 FMQCGridChunk::AddVertex(const FVector2D& Point, const FMQCMaterial& Material, int32 StateIndex, bool bExtrudeGeometry)
-{
-    return (StateIndex > 0 && HasSurface(StateIndex))
-        ? Surfaces[StateIndex].AddVertexMapped(Point, Material)
-        : ~0U;
-}
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_DecompressChunk);
+    MQC_LLM_SCOPE();
+    INC_DWORD_STAT(STAT_MQC_ChunksDecompressed);
 
-void FMQCGridChunk::AddFace(int32 a, int32 b, int32 c, int32 StateIndex, bool bExtrudeGeometry)
-{
-    if (StateIndex > 0 && HasSurface(StateIndex))
+    const double StartTime = FPlatformTime::Seconds();
+
+    // Compressed voxels are owned by the chunk, decompression only
+    // restores the working voxel representation
+
+    FMQCGridChunk& MutableThis(const_cast<FMQCGridChunk&>(*this));
+    TArray<FMQCVoxel>& OutVoxels(MutableThis.Voxels);
+
+    const int32 VoxelCount = VoxelStride * VoxelStride;
+    const int32 VoxelSize = OutVoxels.GetTypeSize();
+    const int32 RawSize = VoxelCount * VoxelSize;
+
+    TArray<uint8> DeltaData;
+    DeltaData.SetNumUninitialized(RawSize);
+
+    verify(FCompression::UncompressMemory(
+        NAME_LZ4,
+        DeltaData.GetData(),
+        RawSize,
+        CompressedVoxels.GetData(),
+        CompressedVoxels.Num()
+        ));
+
+    // Reverse delta filter
+
+    OutVoxels.SetNumUninitialized(VoxelCount);
+    uint8* RawData = reinterpret_cast<uint8*>(OutVoxels.GetData());
+
+    FMemory::Memcpy(RawData, DeltaData.GetData(), VoxelSize);
+
+    for (int32 i=VoxelSize; i<RawSize; ++i)
     {
-        Surfaces[StateIndex].AddFace(a, b, c);
+        RawData[i] = DeltaData[i] + RawData[i-VoxelSize];
     }
-}
 
-// Public Triangulation Interface
+    MutableThis.CompressedVoxels.Empty();
+    MutableThis.PublishSnapshot();
 
-void FMQCGridChunk::Triangulate()
-{
-    WaitForAsyncTask();
-    TriangulateInternal();
+    const double Duration = FPlatformTime::Seconds() - StartTime;
+
+    MutableThis.DecompressionCount++;
+    MutableThis.DecompressionTime += Duration;
+    MutableThis.MaxDecompressionTime = FMath::Max(MaxDecompressionTime, Duration);
+
+    MarkAccessed();
+
+    // Voxels are complete before the chunk reads as decompressed
+    MutableThis.bCompressed.Store(false);
 }
 
-void FMQCGridChunk::SetStates(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+const FMQCVoxelSnapshot* FMQCGridChunk::ResolvePublishedSnapshot() const
 {
-    WaitForAsyncTask();
-    SetStatesInternal(Stencil, X0, X1, Y0, Y1);
+    // Compression retires and decompression republishes the snapshot under
+    // the compression lock, a compressed chunk is decompressed here. Chunks
+    // still without a snapshot are unallocated or released.
+
+    FScopeLock ScopeLock(&CompressionLock);
+
+    DecompressVoxels();
+
+    return PublishedSnapshot.Load();
 }
 
-void FMQCGridChunk::SetCrossings(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::DecompressLinkedVoxels() const
 {
-    WaitForAsyncTask();
-    SetCrossingsInternal(Stencil, X0, X1, Y0, Y1);
+    // Chunk and linked neighbour voxels are read directly by
+    // crossing updates, halo refresh and triangulation
+
+    DecompressVoxels();
+
+    if (xNeighbor)
+    {
+        xNeighbor->DecompressVoxels();
+    }
+
+    if (yNeighbor)
+    {
+        yNeighbor->DecompressVoxels();
+    }
+
+    if (xyNeighbor)
+    {
+        xyNeighbor->DecompressVoxels();
+    }
 }
 
-void FMQCGridChunk::SetMaterials(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::RestoreGeometry()
 {
-    WaitForAsyncTask();
-    SetMaterialsInternal(Stencil, X0, X1, Y0, Y1);
+    // Released geometry is regenerated from chunk voxels, geometry
+    // hashes are unchanged unless voxels changed since release
+
+    if (bGeometryReleased)
+    {
+        Triangulate();
+    }
 }
 
-void FMQCGridChunk::TriangulateAsync()
+void FMQCGridChunk::ReleaseExpandedCompactGeometry()
 {
-    EnqueueTask([this](){ TriangulateInternal(); });
+    for (int32 i=1; i<Surfaces.Num(); ++i)
+    {
+        if (Surfaces[i].IsValid())
+        {
+            Surfaces[i]->ReleaseExpandedCompactGeometry();
+        }
+    }
 }
 
-void FMQCGridChunk::SetStatesAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::RequestGeometryRestore() const
 {
-    // Invalid stencil fill type, abort
-    if (! HasSurface(Stencil.GetFillType()))
+    if (! bGeometryReleased || ! GeometryRestoreQueue)
     {
         return;
     }
 
-    struct FTaskParam
+    // Queue once until restored
+    if (! bGeometryRestoreRequested.Exchange(true))
     {
-        const FMQCStencil* Stencil;
-        int32 X0;
-        int32 X1;
-        int32 Y0;
-        int32 Y1;
-    };
-    FTaskParam Param = { &Stencil, X0, X1, Y0, Y1 };
+        const int32 ChunkResolution = MapSize / VoxelResolution;
+        const int32 ChunkX = Position.X / VoxelResolution;
+        const int32 ChunkY = Position.Y / VoxelResolution;
 
-    EnqueueTask(
-        [this, Param]()
-        {
-            SetStatesInternal(
-                *Param.Stencil,
-                Param.X0,
-                Param.X1,
-                Param.Y0,
-                Param.Y1
-                );
-        } );
+        GeometryRestoreQueue->Enqueue(ChunkX + ChunkY*ChunkResolution);
+    }
 }
 
-void FMQCGridChunk::SetCrossingsAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::GetCompressionStats(FMQCCompressionStats& OutStats) const
 {
-    // Invalid stencil fill type, abort
-    if (! HasSurface(Stencil.GetFillType()))
+    FScopeLock ScopeLock(&CompressionLock);
+
+    if (bCompressed.Load())
     {
-        return;
+        OutStats.CompressedChunks++;
+        OutStats.UncompressedSize += VoxelStride * VoxelStride * sizeof(FMQCVoxel);
+        OutStats.CompressedSize += CompressedVoxels.Num();
     }
 
-    struct FTaskParam
+    OutStats.DecompressionCount += DecompressionCount;
+    OutStats.DecompressionTime += DecompressionTime;
+    OutStats.MaxDecompressionTime = FMath::Max(OutStats.MaxDecompressionTime, MaxDecompressionTime);
+}
+
+void FMQCGridChunk::UpdateStateOccupancy()
+{
+    check(Voxels.Num() > 0);
+
+    FMemory::Memzero(StateHistogram.GetData(), StateHistogram.Num() * StateHistogram.GetTypeSize());
+
+    for (int32 y=0; y<VoxelResolution; y++)
     {
-        const FMQCStencil* Stencil;
-        int32 X0;
-        int32 X1;
-        int32 Y0;
-        int32 Y1;
-    };
-    FTaskParam Param = { &Stencil, X0, X1, Y0, Y1 };
+        int32 i = y*VoxelStride;
+
+        for (int32 x=0; x<VoxelResolution; x++, i++)
+        {
+            check(StateHistogram.IsValidIndex(Voxels[i].voxelState));
+            ++StateHistogram[Voxels[i].voxelState];
+        }
+    }
+
+}
+
+void FMQCGridChunk::UpdateUniformState()
+{
+    // State histogram is final once outstanding edits are complete
+    WaitForAsyncTask();
+
+    if (Voxels.Num() < 1)
+    {
+        // Compressed voxels keep the uniform state of their last edit
+        if (! bCompressed.Load())
+        {
+            bUniformState = true;
+            UniformState = 0;
+        }
+        return;
+    }
+
+    const uint8 State = Voxels[0].voxelState;
+
+    bUniformState = StateHistogram[State] == (VoxelResolution * VoxelResolution);
+    UniformState = State;
+}
+
+void FMQCGridChunk::AllocateActiveSurfaces()
+{
+    // Surfaces are allocated on the calling thread before triangulation
+    // is dispatched, triangulation tasks only read the surface array.
+    // Border voxel states of neighbour chunks are a subset of the
+    // neighbour state histograms.
+
+    const FMQCGridChunk* LinkedChunks[] = { this, xNeighbor, yNeighbor, xyNeighbor };
+
+    for (int32 i=1; i<Surfaces.Num(); ++i)
+    {
+        if (Surfaces[i].IsValid())
+        {
+            continue;
+        }
+
+        for (const FMQCGridChunk* Chunk : LinkedChunks)
+        {
+            if (Chunk && Chunk->GetStateVoxelCount(i) > 0)
+            {
+                GetOrCreateSurface(i);
+                break;
+            }
+        }
+    }
+}
+
+void FMQCGridChunk::UpdateActiveSurfaces()
+{
+    const int32 StateCount = Surfaces.Num();
+
+    TBitArray<> StateMask(false, StateCount);
+
+    for (int32 i=1; i<StateCount; ++i)
+    {
+        StateMask[i] = StateHistogram[i] > 0;
+    }
+
+    // Chunk border cells also triangulate neighbour border voxels
+
+    if (xNeighbor)
+    {
+        for (int32 y=0; y<VoxelResolution; y++)
+        {
+            StateMask[xNeighbor->Voxels[y*VoxelStride].voxelState] = true;
+        }
+    }
+
+    if (yNeighbor)
+    {
+        for (int32 x=0; x<VoxelResolution; x++)
+        {
+            StateMask[yNeighbor->Voxels[x].voxelState] = true;
+        }
+    }
+
+    if (xyNeighbor)
+    {
+        StateMask[xyNeighbor->Voxels[0].voxelState] = true;
+    }
+
+    // Surfaces of absent states are skipped, surfaces of states that
+    // were present on the previous pass are included once to clear them
+
+    ActiveSurfaces.Reset();
+
+    for (int32 i=1; i<StateCount; ++i)
+    {
+        if (StateMask[i] || SurfaceStateMask[i])
+        {
+            check(Surfaces[i].IsValid());
+            ActiveSurfaces.Emplace(Surfaces[i].Get());
+        }
+
+        SurfaceStateMask[i] = StateMask[i];
+    }
+}
+
+int32 FMQCGridChunk::GetMaxLODLevel(int32 InVoxelResolution)
+{
+    int32 MaxLODLevel = 0;
+
+    // Each LOD level requires an evenly divisible step
+    // and at least two cells per chunk axis
+
+    while ((InVoxelResolution % (2 << MaxLODLevel)) == 0 &&
+           (InVoxelResolution >> (MaxLODLevel+1)) >= 2)
+    {
+        ++MaxLODLevel;
+    }
+
+    return MaxLODLevel;
+}
+
+void FMQCGridChunk::SetLOD(int32 InLODLevel, int32 SeamMinX, int32 SeamMinY, int32 SeamMaxX, int32 SeamMaxY)
+{
+    WaitForAsyncTask();
+
+    const int32 MaxLODLevel = GetMaxLODLevel();
+
+    LODLevel = FMath::Clamp(InLODLevel, 0, MaxLODLevel);
+    LODSeamMinX = FMath::Clamp(SeamMinX, LODLevel, MaxLODLevel);
+    LODSeamMinY = FMath::Clamp(SeamMinY, LODLevel, MaxLODLevel);
+    LODSeamMaxX = FMath::Clamp(SeamMaxX, LODLevel, MaxLODLevel);
+    LODSeamMaxY = FMath::Clamp(SeamMaxY, LODLevel, MaxLODLevel);
+
+    if (! RequiresLODTriangulation())
+    {
+        LODVoxels.Empty();
+    }
+}
+
+void FMQCGridChunk::SetNeighbourX(const FMQCGridChunk* InNeighbour)
+{
+    xNeighbor = InNeighbour;
+}
+
+void FMQCGridChunk::SetNeighbourY(const FMQCGridChunk* InNeighbour)
+{
+    yNeighbor = InNeighbour;
+}
+
+void FMQCGridChunk::SetNeighbourXY(const FMQCGridChunk* InNeighbour)
+{
+    xyNeighbor = InNeighbour;
+}
+
+FPMUMeshSection* FMQCGridChunk::GetSurfaceSection(int32 StateIndex)
+{
+    RequestGeometryRestore();
+
+    return HasSurface(StateIndex)
+        ? &GetSurface(StateIndex).GetSurfaceSection()
+        : nullptr;
+}
+
+FPMUMeshSection* FMQCGridChunk::GetExtrudeSection(int32 StateIndex)
+{
+    RequestGeometryRestore();
+
+    return HasSurface(StateIndex)
+        ? &GetSurface(StateIndex).GetExtrudeSection()
+        : nullptr;
+}
+
+const FPMUMeshSection* FMQCGridChunk::GetSurfaceSection(int32 StateIndex) const
+{
+    RequestGeometryRestore();
+
+    return HasSurface(StateIndex)
+        ? &GetSurface(StateIndex).GetSurfaceSection()
+        : nullptr;
+}
+
+const FPMUMeshSection* FMQCGridChunk::GetExtrudeSection(int32 StateIndex) const
+{
+    RequestGeometryRestore();
+
+    return HasSurface(StateIndex)
+        ? &GetSurface(StateIndex).GetExtrudeSection()
+        : nullptr;
+}
+
+FPMUMeshSection* FMQCGridChunk::GetSurfaceMaterialSection(int32 StateIndex, const FMQCMaterialBlend& Material)
+{
+    RequestGeometryRestore();
+
+    FPMUMeshSection* Section = nullptr;
+
+    if (HasSurface(StateIndex))
+    {
+        Section = GetSurface(StateIndex).GetSurfaceMaterialSection(Material);
+    }
+
+    return Section;
+}
+
+FPMUMeshSection* FMQCGridChunk::GetExtrudeMaterialSection(int32 StateIndex, const FMQCMaterialBlend& Material)
+{
+    RequestGeometryRestore();
+
+    FPMUMeshSection* Section = nullptr;
+
+    if (HasSurface(StateIndex))
+    {
+        Section = GetSurface(StateIndex).GetExtrudeMaterialSection(Material);
+    }
+
+    return Section;
+}
+
+int32 FMQCGridChunk::AppendEdgeSyncData(TArray<FMQCEdgeSyncData>& OutSyncData, int32 StateIndex) const
+{
+    if (HasSurface(StateIndex))
+    {
+        int32 StartIndex = OutSyncData.Num();
+        GetSurface(StateIndex).AppendEdgeSyncData(OutSyncData);
+        return StartIndex;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+int32 FMQCGridChunk::AppendGeometryChanges(TArray<FMQCGeometryChange>& OutChanges, int32 ChunkIndex)
+{
+    const int32 StartIndex = OutChanges.Num();
+
+    for (int32 i=1; i<Surfaces.Num(); ++i)
+    {
+        if (! Surfaces[i].IsValid())
+        {
+            continue;
+        }
+
+        FMQCGridSurface& Surface(*Surfaces[i]);
+
+        if (Surface.HasSurfaceGeometryChange() || Surface.HasExtrudeGeometryChange())
+        {
+            FMQCGeometryChange Change;
+            Change.ChunkIndex = ChunkIndex;
+            Change.StateIndex = i;
+            Change.bSurfaceChanged = Surface.HasSurfaceGeometryChange();
+            Change.bExtrudeChanged = Surface.HasExtrudeGeometryChange();
+            OutChanges.Emplace(Change);
+
+            Surface.ResetGeometryChange();
+        }
+    }
+
+    return OutChanges.Num()-StartIndex;
+}
+
+void FMQCGridChunk::GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList, int32 StateIndex, bool bSimplified) const
+{
+    RequestGeometryRestore();
+
+    if (HasSurface(StateIndex))
+    {
+        GetSurface(StateIndex).GetEdgePoints(OutPointList, bSimplified);
+    }
+}
+
+void FMQCGridChunk::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified) const
+{
+    RequestGeometryRestore();
+
+    if (HasSurface(StateIndex))
+    {
+        GetSurface(StateIndex).GetEdgePoints(OutPoints, EdgeListIndex, bSimplified);
+    }
+}
+
+void FMQCGridChunk::AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified) const
+{
+    RequestGeometryRestore();
+
+    if (HasSurface(StateIndex))
+    {
+        GetSurface(StateIndex).AppendConnectedEdgePoints(OutPoints, EdgeListIndex, bSimplified);
+    }
+}
+
+FMQCEdgePointView FMQCGridChunk::GetEdgePointView(int32 StateIndex, int32 EdgeListIndex, bool bSimplified) const
+{
+    RequestGeometryRestore();
+
+    return HasSurface(StateIndex)
+        ? GetSurface(StateIndex).GetEdgePointView(EdgeListIndex, bSimplified)
+        : FMQCEdgePointView();
+}
+
+int32 FMQCGridChunk::GetEdgePointListCount(int32 StateIndex, bool bSimplified) const
+{
+    return HasSurface(StateIndex)
+        ? GetSurface(StateIndex).GetEdgePointListCount(bSimplified)
+        : 0;
+}
+
+const FMQCEdgeSegmentTree* FMQCGridChunk::GetEdgeSegmentTree(int32 StateIndex) const
+{
+    return HasSurface(StateIndex)
+        ? &GetSurface(StateIndex).GetEdgeSegmentTree()
+        : nullptr;
+}
+
+void FMQCGridChunk::GetMaterialSet(TSet<FMQCMaterialBlend>& MaterialSet) const
+{
+    RequestGeometryRestore();
+
+    for (int32 StateIndex=1; StateIndex<Surfaces.Num(); StateIndex++)
+    {
+        if (Surfaces[StateIndex].IsValid())
+        {
+            Surfaces[StateIndex]->GetMaterialSet(MaterialSet);
+        }
+    }
+}
+
+void FMQCGridChunk::GetMemoryUsage(FMQCMemoryUsage& OutUsage) const
+{
+    OutUsage.Objects += sizeof(FMQCGridChunk);
+    OutUsage.Objects += Surfaces.GetAllocatedSize();
+    OutUsage.Objects += SurfaceConfigs.GetAllocatedSize();
+    OutUsage.Objects += StateHistogram.GetAllocatedSize();
+    OutUsage.Objects += SurfaceStateMask.GetAllocatedSize();
+    OutUsage.Objects += ActiveSurfaces.GetAllocatedSize();
+
+    {
+        // Compressed voxels may be decompressed by a concurrent reader
+        FScopeLock ScopeLock(&CompressionLock);
+        OutUsage.Voxels += Voxels.GetAllocatedSize();
+        OutUsage.Voxels += CompressedVoxels.GetAllocatedSize();
+    }
+
+    if (const FMQCVoxelSnapshot* Snapshot = PublishedSnapshot.Load())
+    {
+        OutUsage.Voxels += Snapshot->GetAllocatedSize();
+    }
+    OutUsage.LODVoxels += LODVoxels.GetAllocatedSize();
+
+    for (const TUniquePtr<FMQCGridSurface>& Surface : Surfaces)
+    {
+        if (Surface.IsValid())
+        {
+            Surface->GetMemoryUsage(OutUsage);
+        }
+    }
+}
+
+SIZE_T FMQCGridChunk::GetAllocatedSize() const
+{
+    FMQCMemoryUsage Usage;
+    GetMemoryUsage(Usage);
+    return Usage.GetTotal();
+}
+
+void FMQCGridChunk::AddQuadFilter(const FIntPoint& Point, int32 StateIndex, bool bExtrudeGeometry)
+{
+    check((Point.X-Position.X) >= 0);
+    check((Point.Y-Position.Y) >= 0);
+    check((Point.X-Position.X) < VoxelResolution);
+    check((Point.Y-Position.Y) < VoxelResolution);
+
+    if (StateIndex > 0 && HasSurface(StateIndex))
+    {
+        RestoreGeometry();
+
+        FMQCGridSurface& Surface(GetOrCreateSurfaceSync(StateIndex));
+        Surface.ReleaseCompactGeometry();
+        Surface.AddQuadFilter(Point, bExtrudeGeometry);
+    }
+}
+
+uint32 FMQCGridChunk::AddVertex(const FVector2D& Point, const FMQCMaterial& Material, int32 StateIndex, bool bExtrudeGeometry)
+{
+    if (StateIndex > 0 && HasSurface(StateIndex))
+    {
+        RestoreGeometry();
+
+        FMQCGridSurface& Surface(GetOrCreateSurfaceSync(StateIndex));
+        Surface.ReleaseCompactGeometry();
+        return Surface.AddVertexMapped(Point, Material);
+    }
+
+    return ~0U;
+}
+
+void FMQCGridChunk::AddFace(int32 a, int32 b, int32 c, int32 StateIndex, bool bExtrudeGeometry)
+{
+    if (StateIndex > 0 && HasSurface(StateIndex))
+    {
+        RestoreGeometry();
+
+        FMQCGridSurface& Surface(GetOrCreateSurfaceSync(StateIndex));
+        Surface.ReleaseCompactGeometry();
+        Surface.AddFace(a, b, c);
+    }
+}
+
+// Public Triangulation Interface
+
+void FMQCGridChunk::Triangulate()
+{
+    WaitForAsyncTask();
+    WaitForEdgeResolution();
+    AllocateActiveSurfaces();
+    TriangulateInternal();
+}
+
+void FMQCGridChunk::SetStates(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    WaitForAsyncTask();
+    SetStatesInternal(Stencil, X0, X1, Y0, Y1);
+}
+
+void FMQCGridChunk::SetCrossings(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    WaitForAsyncTask();
+    SetCrossingsInternal(Stencil, X0, X1, Y0, Y1);
+    PublishSnapshot();
+}
+
+void FMQCGridChunk::SetMaterials(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    WaitForAsyncTask();
+    SetMaterialsInternal(Stencil, X0, X1, Y0, Y1);
+    PublishSnapshot();
+}
+
+void FMQCGridChunk::TriangulateAsync()
+{
+    WaitForAsyncTask();
+    WaitForEdgeResolution();
+    AllocateActiveSurfaces();
+    EnqueueTask([this](){ TriangulateInternal(); });
+}
+
+void FMQCGridChunk::TriangulateAsync(const TFunction<void()>& OnTriangulated)
+{
+    WaitForAsyncTask();
+    WaitForEdgeResolution();
+    AllocateActiveSurfaces();
+    EnqueueTask([this, OnTriangulated](){ TriangulateInternal(); OnTriangulated(); });
+}
+
+void FMQCGridChunk::SetStatesAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    // Invalid stencil fill type, abort
+    if (! HasSurface(Stencil.GetFillType()))
+    {
+        return;
+    }
+
+    struct FTaskParam
+    {
+        const FMQCStencil* Stencil;
+        int32 X0;
+        int32 X1;
+        int32 Y0;
+        int32 Y1;
+    };
+    FTaskParam Param = { &Stencil, X0, X1, Y0, Y1 };
+
+    EnqueueTask(
+        [this, Param]()
+        {
+            SetStatesInternal(
+                *Param.Stencil,
+                Param.X0,
+                Param.X1,
+                Param.Y0,
+                Param.Y1
+                );
+        } );
+}
+
+void FMQCGridChunk::SetCrossingsAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    // Invalid stencil fill type, abort
+    if (! HasSurface(Stencil.GetFillType()))
+    {
+        return;
+    }
+
+    struct FTaskParam
+    {
+        const FMQCStencil* Stencil;
+        int32 X0;
+        int32 X1;
+        int32 Y0;
+        int32 Y1;
+    };
+    FTaskParam Param = { &Stencil, X0, X1, Y0, Y1 };
+
+    EnqueueTask(
+        [this, Param]()
+        {
+            SetCrossingsInternal(*Param.Stencil, Param.X0, Param.X1, Param.Y0, Param.Y1);
+            PublishSnapshot();
+        } );
+}
+
+void FMQCGridChunk::SetMaterialsAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    // Invalid stencil fill type, abort
+    if (! HasSurface(Stencil.GetFillType()))
+    {
+        return;
+    }
+
+    struct FTaskParam
+    {
+        const FMQCStencil* Stencil;
+        int32 X0;
+        int32 X1;
+        int32 Y0;
+        int32 Y1;
+    };
+    FTaskParam Param = { &Stencil, X0, X1, Y0, Y1 };
+
+    EnqueueTask(
+        [this, Param]()
+        {
+            SetMaterialsInternal(*Param.Stencil, Param.X0, Param.X1, Param.Y0, Param.Y1);
+            PublishSnapshot();
+        } );
+}
+
+// -- Internal Triangulation Interface
+
+void FMQCGridChunk::TriangulateInternal()
+{
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_TriangulateChunk);
+    MQC_LLM_SCOPE();
+    INC_DWORD_STAT(STAT_MQC_ChunksTriangulated);
+
+    const double StartTime = FPlatformTime::Seconds();
+
+    MarkAccessed();
+
+    // Unallocated chunks only border empty or unallocated chunks,
+    // which have no geometry to triangulate
+    if (! IsAllocated())
+    {
+        LastTriangulationTime = 0.0;
+        bGeometryReleased = false;
+        return;
+    }
+
+    DecompressLinkedVoxels();
+
+    if (bHaloVoxels)
+    {
+        RefreshHaloVoxels();
+    }
+
+    if (RequiresLODTriangulation())
+    {
+        TriangulateLOD();
+    }
+    else
+    {
+        TriangulateGrid();
+    }
+
+    // Released geometry is regenerated by triangulation. Readers of
+    // released geometry re-read geometry reported as changed.
+
+    if (bGeometryRestoreRequested.Exchange(false))
+    {
+        for (const TUniquePtr<FMQCGridSurface>& Surface : Surfaces)
+        {
+            if (Surface.IsValid())
+            {
+                Surface->MarkGeometryChanged();
+            }
+        }
+    }
+
+    bGeometryReleased = false;
+
+    LastTriangulationTime = FPlatformTime::Seconds() - StartTime;
+}
+
+void FMQCGridChunk::TriangulateGrid()
+{
+    const int32 CellsX = xNeighbor ? VoxelResolution : VoxelResolution-1;
+    const int32 CellsY = yNeighbor ? VoxelResolution : VoxelResolution-1;
+    INC_DWORD_STAT_BY(STAT_MQC_CellsTriangulated, CellsX*CellsY);
+
+    UpdateActiveSurfaces();
+
+    for (FMQCGridSurface* Surface : ActiveSurfaces)
+    {
+        Surface->SetLODTransform(1, FIntPoint(MAX_int32, MAX_int32));
+        Surface->Initialize();
+    }
+
+    if (bHaloVoxels)
+    {
+        TriangulateHaloCellRows();
+    }
+    else
+    {
+        FillFirstRowCache();
+        TriangulateCellRows();
+
+        if (yNeighbor)
+        {
+            TriangulateGapRow();
+        }
+    }
+
+    for (FMQCGridSurface* Surface : ActiveSurfaces)
+    {
+        Surface->Finalize();
+    }
+}
+
+void FMQCGridChunk::SetStatesInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    // Invalid stencil fill type, abort
+    if (! HasSurface(Stencil.GetFillType()))
+    {
+        return;
+    }
+
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_SetStates);
+    INC_DWORD_STAT(STAT_MQC_ChunksEdited);
+
+    // Sparse chunks are allocated by the map before edits
+    check(IsAllocated());
+
+    DecompressVoxels();
+    MarkAccessed();
+
+    for (int32 y=Y0; y<=Y1; y++)
+    {
+        int32 i = y*VoxelStride + X0;
+
+        for (int32 x=X0; x<=X1; x++, i++)
+        {
+            Stencil.ApplyVoxel(Voxels[i], Position);
+        }
+    }
+
+    // Edited states are published along with their crossings
+    MarkSnapshotRows(Y0, Y1);
+
+    UpdateStateOccupancy();
+}
+
+void FMQCGridChunk::SetCrossingsInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    // Invalid stencil fill type, abort
+    if (! HasSurface(Stencil.GetFillType()))
+    {
+        return;
+    }
+
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_SetCrossings);
+
+    DecompressLinkedVoxels();
+
+    // Crossings are set from the row preceding the edited rows
+    MarkSnapshotRows(FMath::Max(Y0-1, 0), Y1);
+
+    if (bHaloVoxels)
+    {
+        SetCrossingsHaloInternal(Stencil, X0, X1, Y0, Y1);
+        return;
+    }
+
+    bool bIncludeLastRowY = false;
+    bool bCrossGapX = false;
+    bool bCrossGapY = false;
+    
+    if (X0 > 0)
+    {
+        X0 -= 1;
+    }
+
+    if (X1 == VoxelResolution - 1)
+    {
+        X1 -= 1;
+        bCrossGapX = xNeighbor != nullptr;
+    }
+
+    if (Y0 > 0)
+    {
+        Y0 -= 1;
+    }
+
+    if (Y1 == VoxelResolution - 1)
+    {
+        Y1 -= 1;
+        bIncludeLastRowY = true;
+        bCrossGapY = yNeighbor != nullptr;
+    }
+
+    FMQCVoxel* a;
+    FMQCVoxel* b;
+
+    for (int32 y = Y0; y <= Y1; y++)
+    {
+        int32 i = y * VoxelResolution + X0;
+        b = &Voxels[i];
+
+        for (int32 x = X0; x <= X1; x++, i++)
+        {
+            a = b;
+            b = &Voxels[i + 1];
+            Stencil.SetCrossingX(*a, *b, Position);
+            Stencil.SetCrossingY(*a, Voxels[i + VoxelResolution], Position);
+        }
+
+        Stencil.SetCrossingY(*b, Voxels[i + VoxelResolution], Position);
+
+        if (bCrossGapX)
+        {
+            check(xNeighbor);
+            const int32 neighborIndex = y * VoxelResolution;
+            if (xNeighbor->Voxels.IsValidIndex(neighborIndex))
+            {
+                dummyX.BecomeXDummyOf(xNeighbor->Voxels[neighborIndex], VoxelResolution);
+                Stencil.SetCrossingX(*b, dummyX, Position);
+            }
+        }
+    }
+
+    if (bIncludeLastRowY)
+    {
+        int32 i = Voxels.Num() - VoxelResolution + X0;
+        b = &Voxels[i];
+
+        for (int32 x = X0; x <= X1; x++, i++)
+        {
+            a = b;
+            b = &Voxels[i + 1];
+            Stencil.SetCrossingX(*a, *b, Position);
+
+            if (bCrossGapY)
+            {
+                check(yNeighbor);
+                check(yNeighbor->Voxels.IsValidIndex(x));
+                dummyY.BecomeYDummyOf(yNeighbor->Voxels[x], VoxelResolution);
+                Stencil.SetCrossingY(*a, dummyY, Position);
+            }
+        }
+
+        if (bCrossGapY)
+        {
+            check(yNeighbor);
+            const int32 neighborIndex = X1 + 1;
+            if (yNeighbor->Voxels.IsValidIndex(neighborIndex))
+            {
+                dummyY.BecomeYDummyOf(yNeighbor->Voxels[neighborIndex], VoxelResolution);
+                Stencil.SetCrossingY(*b, dummyY, Position);
+            }
+        }
+
+        if (bCrossGapX)
+        {
+            check(xNeighbor);
+            const int32 neighborIndex = Voxels.Num() - VoxelResolution;
+            if (xNeighbor->Voxels.IsValidIndex(neighborIndex))
+            {
+                dummyX.BecomeXDummyOf(xNeighbor->Voxels[neighborIndex], VoxelResolution);
+                Stencil.SetCrossingX(*b, dummyX, Position);
+            }
+        }
+    }
+}
+
+void FMQCGridChunk::SetMaterialsInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    // Invalid stencil fill type, abort
+    if (! HasSurface(Stencil.GetFillType()))
+    {
+        return;
+    }
+
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_SetMaterials);
+    INC_DWORD_STAT(STAT_MQC_ChunksEdited);
+
+    DecompressVoxels();
+    MarkAccessed();
+
+    for (int32 y=Y0; y<=Y1; y++)
+    {
+        int32 i = y*VoxelStride + X0;
+
+        for (int32 x=X0; x<=X1; x++, i++)
+        {
+            Stencil.ApplyMaterial(Voxels[i], Position);
+        }
+    }
+
+    MarkSnapshotRows(Y0, Y1);
+}
+
+void FMQCGridChunk::SetCrossingsHaloInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+{
+    check(bHaloVoxels);
+
+    // Neighbour states are final at this point, pull them into the halo
+    RefreshHaloVoxels();
+
+    // Crossings only reach into the halo if the neighbour exists
+
+    const int32 LimitX = xNeighbor ? VoxelResolution-1 : VoxelResolution-2;
+    const int32 LimitY = yNeighbor ? VoxelResolution-1 : VoxelResolution-2;
+
+    X0 = FMath::Max(X0-1, 0);
+    Y0 = FMath::Max(Y0-1, 0);
+
+    const int32 CrossX1 = FMath::Min(X1, LimitX);
+    const int32 CrossY1 = FMath::Min(Y1, LimitY);
+
+    for (int32 y=Y0; y<=Y1; y++)
+    {
+        int32 i = y*VoxelStride + X0;
+
+        for (int32 x=X0; x<=CrossX1; x++, i++)
+        {
+            Stencil.SetCrossingX(Voxels[i], Voxels[i + 1], Position);
+        }
+    }
+
+    for (int32 y=Y0; y<=CrossY1; y++)
+    {
+        int32 i = y*VoxelStride + X0;
+
+        for (int32 x=X0; x<=X1; x++, i++)
+        {
+            Stencil.SetCrossingY(Voxels[i], Voxels[i + VoxelStride], Position);
+        }
+    }
+}
+
+void FMQCGridChunk::RefreshHaloVoxels()
+{
+    check(bHaloVoxels);
+
+    // Copy neighbour border voxels into the halo column and row,
+    // neighbours share the same voxel stride
+
+    const int32 HaloIndex = VoxelResolution;
+
+    if (xNeighbor)
+    {
+        for (int32 y=0; y<VoxelResolution; y++)
+        {
+            Voxels[HaloIndex + y*VoxelStride].BecomeXDummyOf(xNeighbor->Voxels[y*VoxelStride], VoxelResolution);
+        }
+    }
+
+    if (yNeighbor)
+    {
+        for (int32 x=0; x<VoxelResolution; x++)
+        {
+            Voxels[x + HaloIndex*VoxelStride].BecomeYDummyOf(yNeighbor->Voxels[x], VoxelResolution);
+        }
+    }
+
+    if (xyNeighbor)
+    {
+        Voxels[HaloIndex + HaloIndex*VoxelStride].BecomeXYDummyOf(xyNeighbor->Voxels[0], VoxelResolution);
+    }
+}
+
+void FMQCGridChunk::PublishSnapshot()
+{
+    // Unallocated chunks are read from the shared empty voxel block,
+    // compressed chunks publish once decompressed
+    if (! SnapshotEpochs || Voxels.Num() < 1)
+    {
+        return;
+    }
+
+    // Published snapshots are replaced by the editing thread, or by
+    // decompression under the compression lock while no edit runs
+    const FMQCVoxelSnapshot* Previous = PublishedSnapshot.Load();
+
+    // Unchanged voxels, abort
+    if (Previous && SnapshotDirtyMaxY < SnapshotDirtyMinY)
+    {
+        return;
+    }
+
+    const int32 BlockRows = FMQCVoxelSnapshot::BlockRows;
+    const int32 BlockSize = BlockRows * VoxelStride;
+    const int32 BlockCount = (VoxelStride + BlockRows - 1) / BlockRows;
+
+    // Without a previous snapshot all blocks are copied
+
+    const int32 DirtyBlockMin = Previous ? SnapshotDirtyMinY / BlockRows : 0;
+    const int32 DirtyBlockMax = Previous ? SnapshotDirtyMaxY / BlockRows : BlockCount-1;
+
+    FMQCVoxelSnapshot* Snapshot = new FMQCVoxelSnapshot;
+    Snapshot->BlockSize = BlockSize;
+    Snapshot->Blocks.Reserve(BlockCount);
+
+    for (int32 BlockIndex=0; BlockIndex<BlockCount; ++BlockIndex)
+    {
+        if (BlockIndex < DirtyBlockMin || BlockIndex > DirtyBlockMax)
+        {
+            check(Previous);
+            Snapshot->Blocks.Emplace(Previous->Blocks[BlockIndex]);
+            continue;
+        }
+
+        const int32 BlockStart = BlockIndex * BlockSize;
+        const int32 BlockVoxelCount = FMath::Min(BlockSize, Voxels.Num()-BlockStart);
+
+        Snapshot->Blocks.Emplace(MakeShared<TArray<FMQCVoxel>, ESPMode::ThreadSafe>(Voxels.GetData()+BlockStart, BlockVoxelCount));
+    }
+
+    Snapshot->Version = ++SnapshotVersion;
+
+    SnapshotDirtyMinY = MAX_int32;
+    SnapshotDirtyMaxY = -1;
+
+    // Readers that loaded the replaced snapshot keep it alive
+    // until their read scope ends
+
+    SnapshotEpochs->Retire(PublishedSnapshot.Exchange(Snapshot));
+}
+
+void FMQCGridChunk::WaitForEdgeResolution() const
+{
+    if (EdgeDataFutures)
+    {
+        for (const TSharedFuture<void>& Future : *EdgeDataFutures)
+        {
+            if (Future.IsValid())
+            {
+                Future.Wait();
+            }
+        }
+    }
+}
+
+void FMQCGridChunk::EnqueueTask(const TFunction<void()>& Task)
+{
+    // Wait for any outstanding async task and map edge data
+    // resolution, which may read chunk surfaces
+    WaitForAsyncTask();
+    WaitForEdgeResolution();
+
+    // Create task promise
+    TPromise<void>* TaskPromise;
+    TaskPromise = new TPromise<void>([TaskPromise](){ delete TaskPromise; });
+
+    // Assign task future
+    OutstandingTask = TaskPromise->GetFuture();
+
+    // Dispatch task when ready
+    TGraphTask<FAsyncTask>::CreateTask().ConstructAndDispatchWhenReady(
+        Task,
+        *TaskPromise
+        );
+}
+
+// -- LOD Triangulation Functions
+
+void FMQCGridChunk::TriangulateLOD()
+{
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_TriangulateLOD);
+
+    const int32 Step = 1 << LODLevel;
+
+    // Generate LOD voxel lattice positions.
+    // Chunk gap cells are included in the LOD grid.
+
+    TArray<int32> LatticeX;
+    TArray<int32> LatticeY;
+
+    GenerateLODLattice(LatticeX, Step, xNeighbor != nullptr);
+    GenerateLODLattice(LatticeY, Step, yNeighbor != nullptr);
+
+    const int32 GridX = LatticeX.Num();
+    const int32 GridY = LatticeY.Num();
+
+    GenerateLODVoxels(LatticeX, LatticeY);
+
+    // Last cell is narrower if it ends on the last chunk voxel
+
+    FIntPoint BorderCell(MAX_int32, MAX_int32);
+
+    if (! xNeighbor && Step > 1)
+    {
+        BorderCell.X = GridX-2;
+    }
+
+    if (! yNeighbor && Step > 1)
+    {
+        BorderCell.Y = GridY-2;
+    }
+
+    UpdateActiveSurfaces();
+
+    for (FMQCGridSurface* Surface : ActiveSurfaces)
+    {
+        Surface->SetLODTransform(Step, BorderCell);
+        Surface->Initialize();
+    }
+
+    INC_DWORD_STAT_BY(STAT_MQC_CellsTriangulated, (GridX-1)*(GridY-1));
+
+    TriangulateLODGrid(GridX, GridY);
+
+    for (FMQCGridSurface* Surface : ActiveSurfaces)
+    {
+        Surface->Finalize();
+    }
+}
+
+void FMQCGridChunk::TriangulateLODGrid(int32 GridX, int32 GridY)
+{
+    check(LODVoxels.Num() == GridX*GridY);
+    check(GridX <= VoxelResolution+1);
+    check(GridY <= VoxelResolution+1);
+
+    // Fill first row cache
+
+    CacheFirstCorner(LODVoxels[0]);
+
+    for (int32 x=0; x<GridX-1; x++)
+    {
+        CacheNextEdgeAndCorner(x, LODVoxels[x], LODVoxels[x + 1]);
+    }
+
+    // Triangulate cell rows
+
+    for (int32 y=0; y<GridY-1; y++)
+    {
+        int32 i = y * GridX;
+
+        SwapRowCaches();
+        CacheFirstCorner(LODVoxels[i + GridX]);
+        CacheNextMiddleEdge(LODVoxels[i], LODVoxels[i + GridX]);
 
-    EnqueueTask(
-        [this, Param]()
+        for (int32 x=0; x<GridX-1; x++, i++)
         {
-            SetCrossingsInternal(*Param.Stencil, Param.X0, Param.X1, Param.Y0, Param.Y1);
-        } );
+            const FMQCVoxel&
+                a(LODVoxels[i]),
+                b(LODVoxels[i + 1]),
+                c(LODVoxels[i + GridX]),
+                d(LODVoxels[i + GridX + 1]);
+            CacheNextEdgeAndCorner(x, c, d);
+            CacheNextMiddleEdge(b, d);
+            TriangulateCell(x, a, b, c, d);
+        }
+    }
 }
 
-void FMQCGridChunk::SetMaterialsAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::GenerateLODVoxels(const TArray<int32>& LatticeX, const TArray<int32>& LatticeY)
 {
-    // Invalid stencil fill type, abort
-    if (! HasSurface(Stencil.GetFillType()))
+    const int32 GridX = LatticeX.Num();
+    const int32 GridY = LatticeY.Num();
+
+    LODVoxels.SetNumUninitialized(GridX * GridY, false);
+
+    // Downsample voxel states and materials. Interior lattice points take
+    // the majority state of the source voxels closest to them, chunk border
+    // points are point sampled to match neighbour chunk samples.
+
+    for (int32 y=0, i=0; y<GridY; y++)
+    for (int32 x=0     ; x<GridX; x++, i++)
     {
-        return;
+        const int32 PX = LatticeX[x];
+        const int32 PY = LatticeY[y];
+
+        FMQCVoxel& Voxel(LODVoxels[i]);
+        Voxel.Set(x, y);
+
+        const FMQCVoxel* SourcePtr = &GetLODSourceVoxel(PX, PY);
+
+        if (x > 0 && x < GridX-1 && y > 0 && y < GridY-1)
+        {
+            const int32 X0 = (LatticeX[x-1] + PX + 1) / 2;
+            const int32 X1 = FMath::Min((PX + LatticeX[x+1] - 1) / 2, VoxelResolution-1);
+            const int32 Y0 = (LatticeY[y-1] + PY + 1) / 2;
+            const int32 Y1 = FMath::Min((PY + LatticeY[y+1] - 1) / 2, VoxelResolution-1);
+
+            SourcePtr = &GetLODMajorityVoxel(X0, X1, Y0, Y1, *SourcePtr);
+        }
+
+        const FMQCVoxel& Source(*SourcePtr);
+        Voxel.voxelState = Source.voxelState;
+        Voxel.pointState = Source.pointState;
+        Voxel.Material = Source.Material;
+
+        // Conform voxels on chunk borders shared with a lower detail neighbour
+
+        if (PX == 0 && LODSeamMinX > LODLevel)
+        {
+            ConformLODSeamVoxel(Voxel, PX, PY, 1 << LODSeamMinX, false);
+        }
+        else
+        if (PX == VoxelResolution && LODSeamMaxX > LODLevel)
+        {
+            ConformLODSeamVoxel(Voxel, PX, PY, 1 << LODSeamMaxX, false);
+        }
+
+        if (PY == 0 && LODSeamMinY > LODLevel)
+        {
+            ConformLODSeamVoxel(Voxel, PX, PY, 1 << LODSeamMinY, true);
+        }
+        else
+        if (PY == VoxelResolution && LODSeamMaxY > LODLevel)
+        {
+            ConformLODSeamVoxel(Voxel, PX, PY, 1 << LODSeamMaxY, true);
+        }
     }
 
-    struct FTaskParam
+    // Re-derive voxel edge crossings from source voxels
+
+    for (int32 y=0, i=0; y<GridY; y++)
+    for (int32 x=0     ; x<GridX; x++, i++)
     {
-        const FMQCStencil* Stencil;
-        int32 X0;
-        int32 X1;
-        int32 Y0;
-        int32 Y1;
-    };
-    FTaskParam Param = { &Stencil, X0, X1, Y0, Y1 };
+        const int32 PX = LatticeX[x];
+        const int32 PY = LatticeY[y];
 
-    EnqueueTask(
-        [this, Param]()
+        FMQCVoxel& Voxel(LODVoxels[i]);
+
+        if (x < GridX-1)
         {
-            SetMaterialsInternal(*Param.Stencil, Param.X0, Param.X1, Param.Y0, Param.Y1);
-        } );
-}
+            SetLODEdge(Voxel, LODVoxels[i + 1], PX, PY, LatticeX[x + 1]-PX, true);
+        }
 
-// -- Internal Triangulation Interface
+        if (y < GridY-1)
+        {
+            SetLODEdge(Voxel, LODVoxels[i + GridX], PX, PY, LatticeY[y + 1]-PY, false);
+        }
+    }
+}
 
-void FMQCGridChunk::TriangulateInternal()
+void FMQCGridChunk::GenerateLODLattice(TArray<int32>& OutLattice, int32 Step, bool bHasNeighbour) const
 {
-    for (int32 i=1; i<Surfaces.Num(); i++)
+    OutLattice.Reset(VoxelResolution/Step + 2);
+
+    for (int32 p=0; p<VoxelResolution; p+=Step)
     {
-        Surfaces[i].Initialize();
+        OutLattice.Emplace(p);
     }
 
-    FillFirstRowCache();
-    TriangulateCellRows();
+    // Include neighbour chunk first voxel to cover gap cells,
+    // otherwise end the lattice on the last chunk voxel
 
-    if (yNeighbor)
+    if (bHasNeighbour)
     {
-        TriangulateGapRow();
+        OutLattice.Emplace(VoxelResolution);
     }
-
-    for (int32 i=1; i<Surfaces.Num(); i++)
+    else
+    if (OutLattice.Last() != VoxelResolution-1)
     {
-        Surfaces[i].Finalize();
+        OutLattice.Emplace(VoxelResolution-1);
     }
 }
 
-void FMQCGridChunk::SetStatesInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::GetLODSpan(int32& OutSpanMin, int32& OutSpanMax, int32 Point, int32 Step, bool bHasNeighbour) const
 {
-    // Invalid stencil fill type, abort
-    if (! HasSurface(Stencil.GetFillType()))
+    const int32 LatticeEnd = bHasNeighbour ? VoxelResolution : VoxelResolution-1;
+
+    OutSpanMin = FMath::Min((Point / Step) * Step, LatticeEnd);
+    OutSpanMax = FMath::Min(OutSpanMin + Step, LatticeEnd);
+}
+
+void FMQCGridChunk::ConformLODSeamVoxel(FMQCVoxel& OutVoxel, int32 X, int32 Y, int32 SeamStep, bool bAxisX) const
+{
+    const int32 Point = bAxisX ? X : Y;
+    const bool bHasNeighbour = bAxisX ? (xNeighbor != nullptr) : (yNeighbor != nullptr);
+
+    int32 SpanMin, SpanMax;
+    GetLODSpan(SpanMin, SpanMax, Point, SeamStep, bHasNeighbour);
+
+    // Voxel is also sampled by the lower detail neighbour, no conform required
+    if (Point == SpanMin || Point == SpanMax)
     {
         return;
     }
 
-    for (int32 y=Y0; y<=Y1; y++)
+    const FMQCVoxel& VoxelMin(bAxisX ? GetLODSourceVoxel(SpanMin, Y) : GetLODSourceVoxel(X, SpanMin));
+    const FMQCVoxel& VoxelMax(bAxisX ? GetLODSourceVoxel(SpanMax, Y) : GetLODSourceVoxel(X, SpanMax));
+
+    const FMQCVoxel* Source = &VoxelMin;
+
+    // Assign state from the side of the lower detail span crossing
+
+    if (VoxelMin.voxelState != VoxelMax.voxelState)
     {
-        int32 i = y*VoxelResolution + X0;
+        const int32 Length = SpanMax-SpanMin;
 
-        for (int32 x=X0; x<=X1; x++, i++)
+        float Crossing;
+        FMQCPointNormal Normal;
+
+        if (! FindLODCrossing(Crossing, Normal, bAxisX ? SpanMin : X, bAxisX ? Y : SpanMin, Length, bAxisX))
         {
-            Stencil.ApplyVoxel(Voxels[i], Position);
+            Crossing = Length * .5f;
+        }
+
+        if (Point >= (SpanMin+Crossing))
+        {
+            Source = &VoxelMax;
         }
     }
+
+    OutVoxel.voxelState = Source->voxelState;
+    OutVoxel.pointState = Source->pointState;
+    OutVoxel.Material = Source->Material;
 }
 
-void FMQCGridChunk::SetCrossingsInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
+void FMQCGridChunk::SetLODEdge(FMQCVoxel& VoxelMin, const FMQCVoxel& VoxelMax, int32 X, int32 Y, int32 Length, bool bAxisX) const
 {
-    // Invalid stencil fill type, abort
-    if (! HasSurface(Stencil.GetFillType()))
+    check(Length > 0);
+
+    if (VoxelMin.voxelState == VoxelMax.voxelState)
     {
+        if (bAxisX)
+        {
+            VoxelMin.InvalidateEdgeX();
+        }
+        else
+        {
+            VoxelMin.InvalidateEdgeY();
+        }
         return;
     }
 
-    bool bIncludeLastRowY = false;
-    bool bCrossGapX = false;
-    bool bCrossGapY = false;
-    
-    if (X0 > 0)
+    // Find crossing source span, edges on chunk borders
+    // shared with a lower detail neighbour use the neighbour span
+
+    int32 SeamLOD = LODLevel;
+
+    if (bAxisX)
     {
-        X0 -= 1;
+        SeamLOD = (Y == 0) ? LODSeamMinY : ((Y == VoxelResolution) ? LODSeamMaxY : LODLevel);
     }
-
-    if (X1 == VoxelResolution - 1)
+    else
     {
-        X1 -= 1;
-        bCrossGapX = xNeighbor != nullptr;
+        SeamLOD = (X == 0) ? LODSeamMinX : ((X == VoxelResolution) ? LODSeamMaxX : LODLevel);
     }
 
-    if (Y0 > 0)
+    const int32 Point = bAxisX ? X : Y;
+
+    int32 SpanMin = Point;
+    int32 SpanMax = Point + Length;
+
+    if (SeamLOD > LODLevel)
     {
-        Y0 -= 1;
+        const bool bHasNeighbour = bAxisX ? (xNeighbor != nullptr) : (yNeighbor != nullptr);
+        GetLODSpan(SpanMin, SpanMax, Point, 1 << SeamLOD, bHasNeighbour);
     }
 
-    if (Y1 == VoxelResolution - 1)
+    const int32 SpanLength = SpanMax-SpanMin;
+
+    float Crossing;
+    FMQCPointNormal Normal;
+
+    if (FindLODCrossing(Crossing, Normal, bAxisX ? SpanMin : X, bAxisX ? Y : SpanMin, SpanLength, bAxisX))
     {
-        Y1 -= 1;
-        bIncludeLastRowY = true;
-        bCrossGapY = yNeighbor != nullptr;
+        Crossing += SpanMin;
+    }
+    else
+    {
+        Crossing = SpanMin + SpanLength * .5f;
+        Normal = bAxisX ? FVector2D(1.f, 0.f) : FVector2D(0.f, 1.f);
     }
 
-    FMQCVoxel* a;
-    FMQCVoxel* b;
+    const float Alpha = (Crossing-Point) / Length;
 
-    for (int32 y = Y0; y <= Y1; y++)
+    if (bAxisX)
     {
-        int32 i = y * VoxelResolution + X0;
-        b = &Voxels[i];
+        VoxelMin.EdgeX = FMQCVoxel::EncodeEdge(Alpha);
+        VoxelMin.NormalX = Normal;
+        FMQCStencil::ValidateNormalX(VoxelMin, VoxelMax);
+    }
+    else
+    {
+        VoxelMin.EdgeY = FMQCVoxel::EncodeEdge(Alpha);
+        VoxelMin.NormalY = Normal;
+        FMQCStencil::ValidateNormalY(VoxelMin, VoxelMax);
+    }
+}
 
-        for (int32 x = X0; x <= X1; x++, i++)
-        {
-            a = b;
-            b = &Voxels[i + 1];
-            Stencil.SetCrossingX(*a, *b, Position);
-            Stencil.SetCrossingY(*a, Voxels[i + VoxelResolution], Position);
-        }
+bool FMQCGridChunk::FindLODCrossing(float& OutCrossing, FMQCPointNormal& OutNormal, int32 X, int32 Y, int32 Length, bool bAxisX) const
+{
+    // Find first source voxel state transition along the span
 
-        Stencil.SetCrossingY(*b, Voxels[i + VoxelResolution], Position);
+    for (int32 i=0; i<Length; ++i)
+    {
+        const FMQCVoxel& Voxel0(bAxisX ? GetLODSourceVoxel(X+i  , Y) : GetLODSourceVoxel(X, Y+i  ));
+        const FMQCVoxel& Voxel1(bAxisX ? GetLODSourceVoxel(X+i+1, Y) : GetLODSourceVoxel(X, Y+i+1));
 
-        if (bCrossGapX)
+        if (Voxel0.voxelState != Voxel1.voxelState)
         {
-            check(xNeighbor);
-            const int32 neighborIndex = y * VoxelResolution;
-            if (xNeighbor->Voxels.IsValidIndex(neighborIndex))
+            if (bAxisX)
             {
-                dummyX.BecomeXDummyOf(xNeighbor->Voxels[neighborIndex], VoxelResolution);
-                Stencil.SetCrossingX(*b, dummyX, Position);
+                OutCrossing = i + (Voxel0.HasValidEdgeX() ? Voxel0.GetXEdge() : .5f);
+                OutNormal = Voxel0.NormalX;
             }
+            else
+            {
+                OutCrossing = i + (Voxel0.HasValidEdgeY() ? Voxel0.GetYEdge() : .5f);
+                OutNormal = Voxel0.NormalY;
+            }
+
+            return true;
         }
     }
 
-    if (bIncludeLastRowY)
+    return false;
+}
+
+const FMQCVoxel& FMQCGridChunk::GetLODSourceVoxel(int32 X, int32 Y) const
+{
+    check(X >= 0 && X <= VoxelResolution);
+    check(Y >= 0 && Y <= VoxelResolution);
+
+    // Halo voxels are refreshed before LOD triangulation
+    if (bHaloVoxels)
     {
-        int32 i = Voxels.Num() - VoxelResolution + X0;
-        b = &Voxels[i];
+        return Voxels[X + Y*VoxelStride];
+    }
 
-        for (int32 x = X0; x <= X1; x++, i++)
+    if (X < VoxelResolution)
+    {
+        if (Y < VoxelResolution)
         {
-            a = b;
-            b = &Voxels[i + 1];
-            Stencil.SetCrossingX(*a, *b, Position);
-
-            if (bCrossGapY)
-            {
-                check(yNeighbor);
-                check(yNeighbor->Voxels.IsValidIndex(x));
-                dummyY.BecomeYDummyOf(yNeighbor->Voxels[x], VoxelResolution);
-                Stencil.SetCrossingY(*a, dummyY, Position);
-            }
+            return Voxels[X + Y*VoxelStride];
         }
 
-        if (bCrossGapY)
+        check(yNeighbor != nullptr);
+        return yNeighbor->Voxels[X];
+    }
+
+    if (Y < VoxelResolution)
+    {
+        check(xNeighbor != nullptr);
+        return xNeighbor->Voxels[Y*VoxelStride];
+    }
+
+    check(xyNeighbor != nullptr);
+    return xyNeighbor->Voxels[0];
+}
+
+const FMQCVoxel& FMQCGridChunk::GetLODMajorityVoxel(int32 X0, int32 X1, int32 Y0, int32 Y1, const FMQCVoxel& Centre) const
+{
+    TArray<int32, TInlineAllocator<16>> StateCounts;
+    StateCounts.SetNumZeroed(Surfaces.Num());
+
+    for (int32 y=Y0; y<=Y1; y++)
+    for (int32 x=X0; x<=X1; x++)
+    {
+        const uint8 State = Voxels[x + y*VoxelStride].voxelState;
+
+        if (StateCounts.IsValidIndex(State))
         {
-            check(yNeighbor);
-            const int32 neighborIndex = X1 + 1;
-            if (yNeighbor->Voxels.IsValidIndex(neighborIndex))
-            {
-                dummyY.BecomeYDummyOf(yNeighbor->Voxels[neighborIndex], VoxelResolution);
-                Stencil.SetCrossingY(*b, dummyY, Position);
-            }
+            ++StateCounts[State];
         }
+    }
 
-        if (bCrossGapX)
+    // Ties keep the centre voxel state, then prefer higher state indices
+    // so thin filled features are not dropped in favour of empty space
+
+    int32 MajorityState = Centre.voxelState;
+    int32 MajorityCount = StateCounts.IsValidIndex(MajorityState) ? StateCounts[MajorityState] : 0;
+
+    for (int32 State=StateCounts.Num()-1; State>=0; --State)
+    {
+        if (StateCounts[State] > MajorityCount)
         {
-            check(xNeighbor);
-            const int32 neighborIndex = Voxels.Num() - VoxelResolution;
-            if (xNeighbor->Voxels.IsValidIndex(neighborIndex))
-            {
-                dummyX.BecomeXDummyOf(xNeighbor->Voxels[neighborIndex], VoxelResolution);
-                Stencil.SetCrossingX(*b, dummyX, Position);
-            }
+            MajorityState = State;
+            MajorityCount = StateCounts[State];
         }
     }
-}
 
-void FMQCGridChunk::SetMaterialsInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1)
-{
-    // Invalid stencil fill type, abort
-    if (! HasSurface(Stencil.GetFillType()))
+    if (MajorityState == Centre.voxelState)
     {
-        return;
+        return Centre;
     }
 
+    // Use the first footprint voxel of the majority state as material source
+
     for (int32 y=Y0; y<=Y1; y++)
+    for (int32 x=X0; x<=X1; x++)
     {
-        int32 i = y*VoxelResolution + X0;
+        const FMQCVoxel& Voxel(Voxels[x + y*VoxelStride]);
 
-        for (int32 x=X0; x<=X1; x++, i++)
+        if (Voxel.voxelState == MajorityState)
         {
-            Stencil.ApplyMaterial(Voxels[i], Position);
+            return Voxel;
         }
     }
-}
-
-void FMQCGridChunk::EnqueueTask(const TFunction<void()>& Task)
-{
-    // Wait for any outstanding async task
-    WaitForAsyncTask();
-
-    // Create task promise
-    TPromise<void>* TaskPromise;
-    TaskPromise = new TPromise<void>([TaskPromise](){ delete TaskPromise; });
-
-    // Assign task future
-    OutstandingTask = TaskPromise->GetFuture();
 
-    // Dispatch task when ready
-    TGraphTask<FAsyncTask>::CreateTask().ConstructAndDispatchWhenReady(
-        Task,
-        *TaskPromise
-        );
+    return Centre;
 }
 
 // -- Geometry Cache Functions
@@ -559,9 +2044,9 @@ void FMQCGridChunk::FillFirstRowCache()
 
 void FMQCGridChunk::SwapRowCaches()
 {
-    for (int32 i=1; i<Surfaces.Num(); i++)
+    for (FMQCGridSurface* Surface : ActiveSurfaces)
     {
-        Surfaces[i].PrepareCacheForNextRow();
+        Surface->PrepareCacheForNextRow();
     }
 }
 
@@ -570,14 +2055,14 @@ void FMQCGridChunk::CacheFirstCorner(const FMQCVoxel& voxel)
     if (voxel.IsFilled())
     {
         check(Surfaces.IsValidIndex(voxel.voxelState));
-        Surfaces[voxel.voxelState].CacheFirstCorner(voxel);
+        Surfaces[voxel.voxelState]->CacheFirstCorner(voxel);
     }
 }
 
 void FMQCGridChunk::CacheNextEdgeAndCorner(int32 i, const FMQCVoxel& xMin, const FMQCVoxel& xMax)
 {
-    FMQCGridSurface& SurfaceMin(Surfaces[xMin.voxelState]);
-    FMQCGridSurface& SurfaceMax(Surfaces[xMax.voxelState]);
+    FMQCGridSurface& SurfaceMin(*Surfaces[xMin.voxelState]);
+    FMQCGridSurface& SurfaceMax(*Surfaces[xMax.voxelState]);
 
     const FMQCMaterial& MaterialMin(xMin.Material);
     const FMQCMaterial& MaterialMax(xMax.Material);
@@ -619,14 +2104,14 @@ void FMQCGridChunk::CacheNextEdgeAndCorner(int32 i, const FMQCVoxel& xMin, const
 
 void FMQCGridChunk::CacheNextMiddleEdge(const FMQCVoxel& yMin, const FMQCVoxel& yMax)
 {
-    for (int32 r=1; r<Surfaces.Num(); r++)
+    for (FMQCGridSurface* Surface : ActiveSurfaces)
     {
-        Surfaces[r].PrepareCacheForNextCell();
+        Surface->PrepareCacheForNextCell();
     }
     if (yMin.voxelState != yMax.voxelState)
     {
-        FMQCGridSurface& SurfaceMin(Surfaces[yMin.voxelState]);
-        FMQCGridSurface& SurfaceMax(Surfaces[yMax.voxelState]);
+        FMQCGridSurface& SurfaceMin(*Surfaces[yMin.voxelState]);
+        FMQCGridSurface& SurfaceMax(*Surfaces[yMax.voxelState]);
 
         const FMQCMaterial& MaterialMin(yMin.Material);
         const FMQCMaterial& MaterialMax(yMax.Material);
@@ -657,6 +2142,8 @@ void FMQCGridChunk::CacheNextMiddleEdge(const FMQCVoxel& yMin, const FMQCVoxel&
 
 void FMQCGridChunk::TriangulateCellRows()
 {
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_TriangulateCellRows);
+
     int32 cells = VoxelResolution - 1;
     for (int32 i=0, y=0; y<cells; y++, i++)
     {
@@ -685,6 +2172,8 @@ void FMQCGridChunk::TriangulateCellRows()
 
 void FMQCGridChunk::TriangulateGapRow()
 {
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_TriangulateGapRow);
+
     check(yNeighbor != nullptr);
 
     dummyY.BecomeYDummyOf(yNeighbor->Voxels[0], VoxelResolution);
@@ -748,6 +2237,50 @@ void FMQCGridChunk::TriangulateGapCell(int32 i)
         );
 }
 
+void FMQCGridChunk::TriangulateHaloCellRows()
+{
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_TriangulateCellRows);
+
+    check(bHaloVoxels);
+
+    // Cell counts include halo cells where neighbours exist
+
+    const int32 CellsX = xNeighbor ? VoxelResolution : VoxelResolution-1;
+    const int32 CellsY = yNeighbor ? VoxelResolution : VoxelResolution-1;
+
+    // Fill first row cache
+
+    CacheFirstCorner(Voxels[0]);
+
+    for (int32 x=0; x<CellsX; x++)
+    {
+        CacheNextEdgeAndCorner(x, Voxels[x], Voxels[x + 1]);
+    }
+
+    // Triangulate cell rows
+
+    for (int32 y=0; y<CellsY; y++)
+    {
+        int32 i = y*VoxelStride;
+
+        SwapRowCaches();
+        CacheFirstCorner(Voxels[i + VoxelStride]);
+        CacheNextMiddleEdge(Voxels[i], Voxels[i + VoxelStride]);
+
+        for (int32 x=0; x<CellsX; x++, i++)
+        {
+            const FMQCVoxel&
+                a(Voxels[i]),
+                b(Voxels[i + 1]),
+                c(Voxels[i + VoxelStride]),
+                d(Voxels[i + VoxelStride + 1]);
+            CacheNextEdgeAndCorner(x, c, d);
+            CacheNextMiddleEdge(b, d);
+            TriangulateCell(x, a, b, c, d);
+        }
+    }
+}
+
 void FMQCGridChunk::TriangulateCell(int32 i, const FMQCVoxel& a, const FMQCVoxel& b, const FMQCVoxel& c, const FMQCVoxel& d)
 {
     Cell.i = i;
@@ -1023,7 +2556,7 @@ void FMQCGridChunk::FillA(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillA(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillA(Cell, f);
     }
 }
 
@@ -1031,7 +2564,7 @@ void FMQCGridChunk::FillB(const FMQCFeaturePoint& f)
 {
     if (Cell.b.IsFilled())
     {
-        Surfaces[Cell.b.voxelState].FillB(Cell, f);
+        Surfaces[Cell.b.voxelState]->FillB(Cell, f);
     }
 }
 
@@ -1039,7 +2572,7 @@ void FMQCGridChunk::FillC(const FMQCFeaturePoint& f)
 {
     if (Cell.c.IsFilled())
     {
-        Surfaces[Cell.c.voxelState].FillC(Cell, f);
+        Surfaces[Cell.c.voxelState]->FillC(Cell, f);
     }
 }
 
@@ -1047,7 +2580,7 @@ void FMQCGridChunk::FillD(const FMQCFeaturePoint& f)
 {
     if (Cell.d.IsFilled())
     {
-        Surfaces[Cell.d.voxelState].FillD(Cell, f);
+        Surfaces[Cell.d.voxelState]->FillD(Cell, f);
     }
 }
 
@@ -1055,7 +2588,7 @@ void FMQCGridChunk::FillABC(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillABC(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillABC(Cell, f);
     }
 }
 
@@ -1063,7 +2596,7 @@ void FMQCGridChunk::FillABD(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillABD(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillABD(Cell, f);
     }
 }
 
@@ -1071,7 +2604,7 @@ void FMQCGridChunk::FillACD(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillACD(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillACD(Cell, f);
     }
 }
 
@@ -1079,7 +2612,7 @@ void FMQCGridChunk::FillBCD(const FMQCFeaturePoint& f)
 {
     if (Cell.b.IsFilled())
     {
-        Surfaces[Cell.b.voxelState].FillBCD(Cell, f);
+        Surfaces[Cell.b.voxelState]->FillBCD(Cell, f);
     }
 }
 
@@ -1087,7 +2620,7 @@ void FMQCGridChunk::FillAB(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillAB(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillAB(Cell, f);
     }
 }
 
@@ -1095,7 +2628,7 @@ void FMQCGridChunk::FillAC(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillAC(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillAC(Cell, f);
     }
 }
 
@@ -1103,7 +2636,7 @@ void FMQCGridChunk::FillBD(const FMQCFeaturePoint& f)
 {
     if (Cell.b.IsFilled())
     {
-        Surfaces[Cell.b.voxelState].FillBD(Cell, f);
+        Surfaces[Cell.b.voxelState]->FillBD(Cell, f);
     }
 }
 
@@ -1111,7 +2644,7 @@ void FMQCGridChunk::FillCD(const FMQCFeaturePoint& f)
 {
     if (Cell.c.IsFilled())
     {
-        Surfaces[Cell.c.voxelState].FillCD(Cell, f);
+        Surfaces[Cell.c.voxelState]->FillCD(Cell, f);
     }
 }
 
@@ -1119,7 +2652,7 @@ void FMQCGridChunk::FillADToB(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillADToB(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillADToB(Cell, f);
     }
 }
 
@@ -1127,7 +2660,7 @@ void FMQCGridChunk::FillADToC(const FMQCFeaturePoint& f)
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillADToC(Cell, f);
+        Surfaces[Cell.a.voxelState]->FillADToC(Cell, f);
     }
 }
 
@@ -1135,7 +2668,7 @@ void FMQCGridChunk::FillBCToA(const FMQCFeaturePoint& f)
 {
     if (Cell.b.IsFilled())
     {
-        Surfaces[Cell.b.voxelState].FillBCToA(Cell, f);
+        Surfaces[Cell.b.voxelState]->FillBCToA(Cell, f);
     }
 }
 
@@ -1143,7 +2676,7 @@ void FMQCGridChunk::FillBCToD(const FMQCFeaturePoint& f)
 {
     if (Cell.b.IsFilled())
     {
-        Surfaces[Cell.b.voxelState].FillBCToD(Cell, f);
+        Surfaces[Cell.b.voxelState]->FillBCToD(Cell, f);
     }
 }
 
@@ -1151,7 +2684,7 @@ void FMQCGridChunk::FillABCD()
 {
     if (Cell.a.IsFilled())
     {
-        Surfaces[Cell.a.voxelState].FillABCD(Cell);
+        Surfaces[Cell.a.voxelState]->FillABCD(Cell);
     }
 }
 
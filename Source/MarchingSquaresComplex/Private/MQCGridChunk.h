@@ -34,9 +34,11 @@
 #include "MQCFeaturePoint.h"
 #include "MQCVoxelTypes.h"
 #include "MQCGeometryTypes.h"
+#include "MQCVoxelSnapshot.h"
 
 class FMQCGridSurface;
 class FMQCStencil;
+class FMQCEdgeSegmentTree;
 
 class FMQCGridChunk
 {
@@ -73,9 +75,16 @@ private:
 
     TFuture<void> OutstandingTask;
 
-    TIndirectArray<FMQCGridSurface> Surfaces;
+    // Surfaces are allocated on first use, the empty state surface at
+    // index zero is always allocated and stands in for absent surfaces.
+    // Surface arrays are empty until sparse chunks are allocated.
+    TArray<TUniquePtr<FMQCGridSurface>> Surfaces;
+    TArray<FMQCSurfaceConfig> SurfaceConfigs;
     TArray<FMQCVoxel> Voxels;
 
+    // Shared empty voxel block read until voxels are allocated
+    const FMQCVoxel* EmptyVoxels;
+
     FIntPoint Position;
     FIntPoint BoundsMin;
     FIntPoint BoundsMax;
@@ -84,16 +93,95 @@ private:
     int32 VoxelResolution;
     EMQCMaterialType MaterialType;
 
+    // Voxel row stride, voxel resolution plus one if the chunk
+    // stores a halo of neighbour voxels on its max x and max y border
+    int32 VoxelStride;
+    bool bHaloVoxels;
+
+    bool bUniformState;
+    uint8 UniformState;
+
+    // Voxel count per state and states triangulated on the last pass
+    TArray<int32> StateHistogram;
+    TBitArray<> SurfaceStateMask;
+    TArray<FMQCGridSurface*> ActiveSurfaces;
+
+    // LOD level and LOD level of shared chunk borders,
+    // border level is the maximum of this and the neighbour chunk level
+    int32 LODLevel;
+    int32 LODSeamMinX;
+    int32 LODSeamMinY;
+    int32 LODSeamMaxX;
+    int32 LODSeamMaxY;
+    TArray<FMQCVoxel> LODVoxels;
+
     const FMQCGridChunk* xNeighbor;
     const FMQCGridChunk* yNeighbor;
     const FMQCGridChunk* xyNeighbor;
 
+    // Duration of the last triangulation in seconds
+    double LastTriangulationTime;
+
+    // Immutable voxel copy published after each complete edit for
+    // lock-free voxel queries, only maintained with a snapshot epoch
+    // manager. Voxel rows edited since the last publish are republished,
+    // halo voxels are only published along with their rows.
+    TAtomic<FMQCVoxelSnapshot*> PublishedSnapshot;
+    FMQCSnapshotEpochs* SnapshotEpochs;
+    uint64 SnapshotVersion;
+    int32 SnapshotDirtyMinY;
+    int32 SnapshotDirtyMaxY;
+
+    // Map edge data resolution futures, not owned by the chunk
+    const TArray<TSharedFuture<void>>* EdgeDataFutures;
+
+    // Delta filtered and compressed voxels of an idle chunk, decompressed
+    // on first voxel read. Released surface mesh buffers are regenerated
+    // by editing thread triangulation once read.
+    //
+    // Compression state only changes under the compression lock. The
+    // compressed flag is set before working voxels are released and
+    // cleared once working voxels are complete, lock-free readers load
+    // the flag before reading working voxels. TAtomic only offers relaxed
+    // or sequentially consistent ordering, the flag uses the latter which
+    // subsumes the required acquire and release pairing.
+    TArray<uint8> CompressedVoxels;
+    TAtomic<bool> bCompressed;
+    TAtomic<bool> bGeometryReleased;
+
+    // Released geometry reads queue the chunk once for restoration
+    // on the editing thread, not owned by the chunk
+    TQueue<int32, EQueueMode::Mpsc>* GeometryRestoreQueue;
+    mutable TAtomic<bool> bGeometryRestoreRequested;
+    mutable FCriticalSection CompressionLock;
+    mutable TAtomic<uint64> LastAccessCycles;
+
+    // Decompression count and durations in seconds
+    int32 DecompressionCount;
+    double DecompressionTime;
+    double MaxDecompressionTime;
+
     FMQCCell Cell;
     FMQCVoxel dummyX;
     FMQCVoxel dummyY;
     FMQCVoxel dummyT;
 
     void CreateSurfaces(const FMQCChunkConfig& Config);
+    void UpdateStateOccupancy();
+    void AllocateActiveSurfaces();
+    void UpdateActiveSurfaces();
+    FMQCGridSurface& GetOrCreateSurface(int32 StateIndex);
+    FMQCGridSurface& GetOrCreateSurfaceSync(int32 StateIndex);
+
+    FORCEINLINE FMQCGridSurface& GetSurface(int32 StateIndex)
+    {
+        return Surfaces[StateIndex] ? *Surfaces[StateIndex] : *Surfaces[0];
+    }
+
+    FORCEINLINE const FMQCGridSurface& GetSurface(int32 StateIndex) const
+    {
+        return Surfaces[StateIndex] ? *Surfaces[StateIndex] : *Surfaces[0];
+    }
 
     // -- Internal Triangulation Interface
 
@@ -101,8 +189,43 @@ private:
     void SetStatesInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
     void SetCrossingsInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
     void SetMaterialsInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
+    void SetCrossingsHaloInternal(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
+    void RefreshHaloVoxels();
+    void PublishSnapshot();
+    const FMQCVoxelSnapshot* ResolvePublishedSnapshot() const;
+    void DecompressLinkedVoxels() const;
+
+    FORCEINLINE void MarkSnapshotRows(int32 MinY, int32 MaxY)
+    {
+        SnapshotDirtyMinY = FMath::Min(SnapshotDirtyMinY, MinY);
+        SnapshotDirtyMaxY = FMath::Max(SnapshotDirtyMaxY, MaxY);
+    }
+
+    void WaitForEdgeResolution() const;
     void EnqueueTask(const TFunction<void()>& Task);
 
+    // -- LOD Triangulation Functions
+
+    FORCEINLINE bool RequiresLODTriangulation() const
+    {
+        return LODLevel > 0
+            || LODSeamMinX > 0
+            || LODSeamMinY > 0
+            || LODSeamMaxX > 0
+            || LODSeamMaxY > 0;
+    }
+
+    void TriangulateLOD();
+    void TriangulateLODGrid(int32 GridX, int32 GridY);
+    void GenerateLODVoxels(const TArray<int32>& LatticeX, const TArray<int32>& LatticeY);
+    void GenerateLODLattice(TArray<int32>& OutLattice, int32 Step, bool bHasNeighbour) const;
+    void GetLODSpan(int32& OutSpanMin, int32& OutSpanMax, int32 Point, int32 Step, bool bHasNeighbour) const;
+    void ConformLODSeamVoxel(FMQCVoxel& OutVoxel, int32 X, int32 Y, int32 SeamStep, bool bAxisX) const;
+    void SetLODEdge(FMQCVoxel& VoxelMin, const FMQCVoxel& VoxelMax, int32 X, int32 Y, int32 Length, bool bAxisX) const;
+    bool FindLODCrossing(float& OutCrossing, FMQCPointNormal& OutNormal, int32 X, int32 Y, int32 Length, bool bAxisX) const;
+    const FMQCVoxel& GetLODSourceVoxel(int32 X, int32 Y) const;
+    const FMQCVoxel& GetLODMajorityVoxel(int32 X0, int32 X1, int32 Y0, int32 Y1, const FMQCVoxel& Centre) const;
+
     // -- Geometry Cache Functions
 
     void FillFirstRowCache();
@@ -113,9 +236,11 @@ private:
 
     // -- Triangulation Functions
     
+    void TriangulateGrid();
     void TriangulateCellRows();
     void TriangulateGapRow();
     void TriangulateGapCell(int32 i);
+    void TriangulateHaloCellRows();
     void TriangulateCell(int32 i, const FMQCVoxel& a, const FMQCVoxel& b, const FMQCVoxel& c, const FMQCVoxel& d);
 
     void Triangulate0000();
@@ -166,8 +291,78 @@ public:
     ~FMQCGridChunk();
 
     void Configure(const FMQCChunkConfig& Config);
+
+    // Creates surface configs, the empty state surface and the state
+    // histogram. Sparse chunks defer surface creation until allocated.
+    void AllocateSurfaces(const FMQCChunkConfig& Config);
+
+    void AllocateVoxels();
     void ResetVoxels();
 
+    // Releases allocated voxels, the chunk reads as an unallocated
+    // sparse chunk afterwards. Surface geometry is cleared if specified.
+    void ReleaseVoxels(bool bReleaseGeometry);
+
+    // Serializes allocated voxels, loaded voxels must match the chunk
+    // voxel layout and are published once loaded
+    void SerializeVoxels(FArchive& Ar);
+
+    // Whether chunk voxels are allocated, unallocated chunks are
+    // uniform empty state chunks reading the shared empty voxel block.
+    // Compressed voxels are allocated.
+    FORCEINLINE bool IsAllocated() const
+    {
+        return bCompressed.Load() || Voxels.Num() > 0;
+    }
+
+    // Compresses allocated voxels and releases surface mesh buffers if
+    // specified. Returns false if voxels are unallocated, already
+    // compressed or do not compress below their raw size.
+    bool CompressVoxels(bool bReleaseGeometry);
+
+    // Decompresses compressed voxels, safe to be called concurrently.
+    // Decompression is logically const, voxel reads decompress on demand.
+    void DecompressVoxels() const;
+
+    // Regenerates released surface mesh buffers, only called on the
+    // editing thread. Regenerated geometry is not reported as changed.
+    void RestoreGeometry();
+
+    // Releases compact geometry duplicated by expanded mesh sections,
+    // only called on the editing thread once the chunk async task and
+    // map edge data resolution are complete
+    void ReleaseExpandedCompactGeometry();
+
+    // Queues released geometry for restoration by the map on the editing
+    // thread, safe to be called concurrently. Geometry reads return the
+    // released state until restored, restored geometry is then reported
+    // as changed.
+    void RequestGeometryRestore() const;
+
+    FORCEINLINE bool IsCompressed() const
+    {
+        return bCompressed.Load();
+    }
+
+    FORCEINLINE bool IsGeometryReleased() const
+    {
+        return bGeometryReleased;
+    }
+
+    // Marks chunk as accessed by an edit or query
+    FORCEINLINE void MarkAccessed() const
+    {
+        LastAccessCycles = FPlatformTime::Cycles64();
+    }
+
+    FORCEINLINE double GetIdleTime(uint64 Cycles) const
+    {
+        const uint64 AccessCycles = LastAccessCycles;
+        return Cycles > AccessCycles ? FPlatformTime::ToSeconds64(Cycles - AccessCycles) : 0.0;
+    }
+
+    void GetCompressionStats(FMQCCompressionStats& OutStats) const;
+
     void SetNeighbourX(const FMQCGridChunk* InNeighbour);
     void SetNeighbourY(const FMQCGridChunk* InNeighbour);
     void SetNeighbourXY(const FMQCGridChunk* InNeighbour);
@@ -192,11 +387,59 @@ public:
         return VoxelResolution;
     }
 
+    FORCEINLINE bool HasHaloVoxels() const
+    {
+        return bHaloVoxels;
+    }
+
+    // -- LOD
+
+    static int32 GetMaxLODLevel(int32 InVoxelResolution);
+    void SetLOD(int32 InLODLevel, int32 SeamMinX, int32 SeamMinY, int32 SeamMaxX, int32 SeamMaxY);
+
+    FORCEINLINE int32 GetLODLevel() const
+    {
+        return LODLevel;
+    }
+
+    FORCEINLINE int32 GetMaxLODLevel() const
+    {
+        return GetMaxLODLevel(VoxelResolution);
+    }
+
+    // Updates the uniform state flag from the state histogram on the
+    // editing thread, waits for outstanding edits. Uniform state is not
+    // written by edit tasks, readers never race an async edit.
+    void UpdateUniformState();
+
+    // Whether all chunk voxels share the same state, valid after
+    // the last uniform state update on the editing thread
+    FORCEINLINE bool IsUniformState() const
+    {
+        return bUniformState;
+    }
+
+    FORCEINLINE uint8 GetUniformState() const
+    {
+        return UniformState;
+    }
+
+    // Whether the state is configured, surface may not be allocated yet
     FORCEINLINE bool HasSurface(int32 StateIndex) const
     {
         return Surfaces.IsValidIndex(StateIndex);
     }
 
+    FORCEINLINE bool IsSurfaceAllocated(int32 StateIndex) const
+    {
+        return Surfaces.IsValidIndex(StateIndex) && Surfaces[StateIndex].IsValid();
+    }
+
+    FORCEINLINE int32 GetStateVoxelCount(int32 StateIndex) const
+    {
+        return StateHistogram.IsValidIndex(StateIndex) ? StateHistogram[StateIndex] : 0;
+    }
+
     FORCEINLINE void WaitForAsyncTask()
     {
         if (OutstandingTask.IsValid())
@@ -205,18 +448,58 @@ public:
         }
     }
 
+    FORCEINLINE bool IsAsyncTaskComplete() const
+    {
+        return ! OutstandingTask.IsValid() || OutstandingTask.IsReady();
+    }
+
+    FORCEINLINE double GetLastTriangulationTime() const
+    {
+        return LastTriangulationTime;
+    }
+
+    FORCEINLINE bool HasVoxelSnapshots() const
+    {
+        return SnapshotEpochs != nullptr;
+    }
+
+    FORCEINLINE uint64 GetSnapshotVersion() const
+    {
+        return SnapshotVersion;
+    }
+
     FPMUMeshSection* GetSurfaceSection(int32 StateIndex);
     FPMUMeshSection* GetExtrudeSection(int32 StateIndex);
     FPMUMeshSection* GetSurfaceMaterialSection(int32 StateIndex, const FMQCMaterialBlend& Material);
     FPMUMeshSection* GetExtrudeMaterialSection(int32 StateIndex, const FMQCMaterialBlend& Material);
+    const FPMUMeshSection* GetSurfaceSection(int32 StateIndex) const;
+    const FPMUMeshSection* GetExtrudeSection(int32 StateIndex) const;
 
     int32 AppendEdgeSyncData(TArray<FMQCEdgeSyncData>& OutSyncData, int32 StateIndex) const;
-    void GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList, int32 StateIndex) const;
-    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex) const;
-    void AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex) const;
+    int32 AppendGeometryChanges(TArray<FMQCGeometryChange>& OutChanges, int32 ChunkIndex);
+    void GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList, int32 StateIndex, bool bSimplified = false) const;
+    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified = false) const;
+    void AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified = false) const;
+    FMQCEdgePointView GetEdgePointView(int32 StateIndex, int32 EdgeListIndex, bool bSimplified = false) const;
+    int32 GetEdgePointListCount(int32 StateIndex, bool bSimplified = false) const;
+    const FMQCEdgeSegmentTree* GetEdgeSegmentTree(int32 StateIndex) const;
 
     void GetMaterialSet(TSet<FMQCMaterialBlend>& MaterialSet) const;
+    void GetMemoryUsage(FMQCMemoryUsage& OutUsage) const;
+    SIZE_T GetAllocatedSize() const;
+    FORCEINLINE int32 GetVoxelIndex(int32 X, int32 Y) const;
+    FORCEINLINE const FMQCVoxel* GetVoxelData() const;
+    FORCEINLINE const FMQCVoxel& GetVoxel(int32 VoxelIndex) const;
+
+    // Published voxel reads, safe to be called concurrently with async edits
+    // within a snapshot read scope. Reads working voxels without snapshots,
+    // chunks without a published snapshot read the shared empty voxel block.
+    // Bulk readers load the published snapshot once and read through it.
+    FORCEINLINE const FMQCVoxelSnapshot* GetPublishedSnapshot() const;
+    FORCEINLINE const FMQCVoxel& GetPublishedVoxel(const FMQCVoxelSnapshot* Snapshot, int32 VoxelIndex) const;
+    FORCEINLINE const FMQCVoxel& GetPublishedVoxel(int32 VoxelIndex) const;
     FORCEINLINE FMQCMaterial GetVoxelMaterial(int32 X, int32 Y) const;
+    FORCEINLINE uint8 GetVoxelState(int32 X, int32 Y) const;
 
     void AddQuadFilter(const FIntPoint& Point, int32 StateIndex, bool bExtrudeGeometry);
     uint32 AddVertex(const FVector2D& Point, const FMQCMaterial& Material, int32 StateIndex, bool bExtrudeGeometry);
@@ -230,12 +513,13 @@ public:
     void SetMaterials(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
 
     void TriangulateAsync();
+    void TriangulateAsync(const TFunction<void()>& OnTriangulated);
     void SetStatesAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
     void SetCrossingsAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
     void SetMaterialsAsync(const FMQCStencil& Stencil, int32 X0, int32 X1, int32 Y0, int32 Y1);
 };
 
-FORCEINLINE FMQCMaterial FMQCGridChunk::GetVoxelMaterial(int32 X, int32 Y) const
+FORCEINLINE int32 FMQCGridChunk::GetVoxelIndex(int32 X, int32 Y) const
 {
     int32 VoxelX = X-Position.X;
     int32 VoxelY = Y-Position.Y;
@@ -245,7 +529,59 @@ FORCEINLINE FMQCMaterial FMQCGridChunk::GetVoxelMaterial(int32 X, int32 Y) const
     check(VoxelX < VoxelResolution);
     check(VoxelY < VoxelResolution);
 
-    const int32 VoxelIndex = VoxelX+VoxelY*VoxelResolution;
+    return VoxelX+VoxelY*VoxelStride;
+}
+
+FORCEINLINE const FMQCVoxel* FMQCGridChunk::GetVoxelData() const
+{
+    if (bCompressed.Load())
+    {
+        DecompressVoxels();
+    }
+
+    return Voxels.Num() > 0 ? Voxels.GetData() : EmptyVoxels;
+}
+
+FORCEINLINE const FMQCVoxel& FMQCGridChunk::GetVoxel(int32 VoxelIndex) const
+{
+    return GetVoxelData()[VoxelIndex];
+}
+
+FORCEINLINE const FMQCVoxelSnapshot* FMQCGridChunk::GetPublishedSnapshot() const
+{
+    const FMQCVoxelSnapshot* Snapshot = PublishedSnapshot.Load();
+    return (Snapshot || ! SnapshotEpochs) ? Snapshot : ResolvePublishedSnapshot();
+}
+
+FORCEINLINE const FMQCVoxel& FMQCGridChunk::GetPublishedVoxel(const FMQCVoxelSnapshot* Snapshot, int32 VoxelIndex) const
+{
+    if (Snapshot)
+    {
+        return Snapshot->GetVoxel(VoxelIndex);
+    }
+
+    // Snapshot maps never read working voxels, which may be
+    // edited or compressed concurrently
+    if (SnapshotEpochs)
+    {
+        checkSlow(EmptyVoxels);
+        return EmptyVoxels[VoxelIndex];
+    }
+
+    return GetVoxel(VoxelIndex);
+}
+
+FORCEINLINE const FMQCVoxel& FMQCGridChunk::GetPublishedVoxel(int32 VoxelIndex) const
+{
+    return GetPublishedVoxel(GetPublishedSnapshot(), VoxelIndex);
+}
 
-    return Voxels[VoxelIndex].GetMaterial();
+FORCEINLINE FMQCMaterial FMQCGridChunk::GetVoxelMaterial(int32 X, int32 Y) const
+{
+    return GetPublishedVoxel(GetVoxelIndex(X, Y)).GetMaterial();
+}
+
+FORCEINLINE uint8 FMQCGridChunk::GetVoxelState(int32 X, int32 Y) const
+{
+    return GetPublishedVoxel(GetVoxelIndex(X, Y)).voxelState;
 }
@@ -27,12 +27,27 @@
 
 #include "MQCGridSurface.h"
 #include "MQCMaterialUtility.h"
+#include "MarchingSquaresComplex.h"
 
 FMQCGridSurface::FMQCGridSurface()
+    : LODStep(1)
+    , LODBorderCell(MAX_int32, MAX_int32)
+    , SurfaceGeometryHash(0)
+    , ExtrudeGeometryHash(0)
+    , bSurfaceGeometryChanged(false)
+    , bExtrudeGeometryChanged(false)
+    , bSectionsExpanded(true)
 {
 }
 
 FMQCGridSurface::FMQCGridSurface(const FMQCSurfaceConfig& Config)
+    : LODStep(1)
+    , LODBorderCell(MAX_int32, MAX_int32)
+    , SurfaceGeometryHash(0)
+    , ExtrudeGeometryHash(0)
+    , bSurfaceGeometryChanged(false)
+    , bExtrudeGeometryChanged(false)
+    , bSectionsExpanded(true)
 {
     Configure(Config);
 }
@@ -55,12 +70,30 @@ void FMQCGridSurface::Configure(const FMQCSurfaceConfig& Config)
 
     bGenerateExtrusion = Config.bGenerateExtrusion;
     bExtrusionSurface  = !bGenerateExtrusion && Config.bExtrusionSurface;
+    bExtrudeWalls      = bGenerateExtrusion && Config.bExtrudeWalls;
+    bExtrudeBackFace   = bExtrudeWalls && Config.bExtrudeBackFace;
+
+    // Wall extrusion generates extrude geometry from edge lists on finalize
+    bGenerateExtrudeFaces = bGenerateExtrusion && ! bExtrudeWalls;
     ExtrusionHeight = (FMath::Abs(Config.ExtrusionHeight) > .01f) ? -FMath::Abs(Config.ExtrusionHeight) : -1.f;
 
     bRemapEdgeUVs = Config.bRemapEdgeUVs;
+
+    // Simplified edge configuration
+
+    bGenerateSimplifiedEdges  = bGenerateExtrusion && Config.bGenerateSimplifiedEdges;
+    SimplifiedEdgeToleranceSq = FMath::Square(FMath::Max(Config.SimplifiedEdgeTolerance, 0.f));
+
+    bCompactVertexFormat = Config.bCompactVertexFormat;
     MaterialType = Config.MaterialType;
 }
 
+void FMQCGridSurface::SetLODTransform(int32 InLODStep, const FIntPoint& InLODBorderCell)
+{
+    LODStep = FMath::Max(InLODStep, 1);
+    LODBorderCell = InLODBorderCell;
+}
+
 void FMQCGridSurface::Initialize()
 {
     Clear();
@@ -71,7 +104,7 @@ void FMQCGridSurface::ReserveGeometry()
 {
     // Reserve triangulation data containers
 
-    VertexMap.Reserve(VoxelCount*2);
+    VertexMap.Reserve(GetReserveCount()*2);
 
     cornersMinArr.SetNumZeroed(VoxelResolution + 1);
     cornersMaxArr.SetNumZeroed(VoxelResolution + 1);
@@ -87,12 +120,17 @@ void FMQCGridSurface::ReserveGeometry()
 
     // Reserve mesh data container
 
-    if (bGenerateExtrusion)
+    if (bGenerateExtrudeFaces)
     {
         ReserveGeometry(SurfaceMeshData);
         ReserveGeometry(ExtrudeMeshData);
     }
     else
+    if (bGenerateExtrusion)
+    {
+        ReserveGeometry(SurfaceMeshData);
+    }
+    else
     if (bExtrusionSurface)
     {
         ReserveGeometry(ExtrudeMeshData);
@@ -110,16 +148,40 @@ void FMQCGridSurface::CompactGeometry()
     // Shrink mesh data container
     CompactGeometry(SurfaceMeshData);
     CompactGeometry(ExtrudeMeshData);
+    // Convert to compact vertex format
+    if (bCompactVertexFormat)
+    {
+        CompactVertexFormat(SurfaceMeshData);
+
+        // Wall geometry has varying height and tangents
+        if (! bExtrudeWalls)
+        {
+            CompactVertexFormat(ExtrudeMeshData);
+        }
+
+        // Vertex materials are only read by triple index material
+        // faces of later added surface geometry
+        if (MaterialType != EMQCMaterialType::MT_TRIPLE_INDEX)
+        {
+            SurfaceMeshData.Materials.Empty();
+        }
+
+        ExtrudeMeshData.Materials.Empty();
+
+        bSectionsExpanded = ! (SurfaceMeshData.bCompact || ExtrudeMeshData.bCompact);
+    }
 }
 
 void FMQCGridSurface::ReserveGeometry(FMeshData& MeshData)
 {
-    MeshData.Section.Positions.Reserve(VoxelCount);
-    MeshData.Section.UVs.Reserve(VoxelCount);
-    MeshData.Section.Colors.Reserve(VoxelCount);
-    MeshData.Section.Tangents.Reserve(VoxelCount*2);
-    MeshData.Section.Indices.Reserve(VoxelCount*6);
-    MeshData.Materials.Reserve(VoxelCount);
+    const int32 ReserveCount = GetReserveCount();
+
+    MeshData.Section.Positions.Reserve(ReserveCount);
+    MeshData.Section.UVs.Reserve(ReserveCount);
+    MeshData.Section.Colors.Reserve(ReserveCount);
+    MeshData.Section.Tangents.Reserve(ReserveCount*2);
+    MeshData.Section.Indices.Reserve(ReserveCount*6);
+    MeshData.Materials.Reserve(ReserveCount);
 }
 
 void FMQCGridSurface::CompactGeometry(FMeshData& MeshData)
@@ -134,14 +196,69 @@ void FMQCGridSurface::CompactGeometry(FMeshData& MeshData)
 
 void FMQCGridSurface::Finalize()
 {
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_FinalizeSurface);
+    INC_DWORD_STAT_BY(STAT_MQC_VertexMapEntries, VertexMap.Num());
+
     if (bGenerateExtrusion)
     {
         GenerateEdgeListData();
+        GenerateEdgeSegmentTree();
+
+        if (bGenerateSimplifiedEdges)
+        {
+            GenerateSimplifiedEdgeListData();
+        }
+
+        if (bExtrudeWalls)
+        {
+            GenerateWallGeometry();
+        }
+
+        if (bExtrudeBackFace)
+        {
+            GenerateBackFaceGeometry();
+        }
     }
 
+    INC_DWORD_STAT_BY(STAT_MQC_VerticesEmitted, SurfaceMeshData.Section.Positions.Num() + ExtrudeMeshData.Section.Positions.Num());
+    INC_DWORD_STAT_BY(STAT_MQC_TrianglesEmitted, (SurfaceMeshData.Section.Indices.Num() + ExtrudeMeshData.Section.Indices.Num()) / 3);
+
+    UpdateGeometryHash();
     CompactGeometry();
 }
 
+void FMQCGridSurface::UpdateGeometryHash()
+{
+    const uint32 NewSurfaceHash = GetGeometryHash(SurfaceMeshData);
+    const uint32 NewExtrudeHash = GetGeometryHash(ExtrudeMeshData);
+
+    // Accumulate change flags until explicitly reset
+    bSurfaceGeometryChanged |= (NewSurfaceHash != SurfaceGeometryHash);
+    bExtrudeGeometryChanged |= (NewExtrudeHash != ExtrudeGeometryHash);
+
+    SurfaceGeometryHash = NewSurfaceHash;
+    ExtrudeGeometryHash = NewExtrudeHash;
+}
+
+uint32 FMQCGridSurface::GetGeometryHash(const FMeshData& MeshData)
+{
+    const FPMUMeshSection& Section(MeshData.Section);
+
+    // Empty geometry always hash to zero
+    if (Section.Positions.Num() < 1)
+    {
+        return 0;
+    }
+
+    uint32 Hash = 0;
+    Hash = FCrc::MemCrc32(Section.Positions.GetData(), Section.Positions.Num()*Section.Positions.GetTypeSize(), Hash);
+    Hash = FCrc::MemCrc32(Section.Indices.GetData(), Section.Indices.Num()*Section.Indices.GetTypeSize(), Hash);
+    Hash = FCrc::MemCrc32(Section.Tangents.GetData(), Section.Tangents.Num()*Section.Tangents.GetTypeSize(), Hash);
+    Hash = FCrc::MemCrc32(MeshData.Materials.GetData(), MeshData.Materials.Num()*MeshData.Materials.GetTypeSize(), Hash);
+
+    return Hash ? Hash : 1;
+}
+
 void FMQCGridSurface::Clear()
 {
     // Clear triangulation data
@@ -150,9 +267,189 @@ void FMQCGridSurface::Clear()
     cornersMaxArr.Empty();
     xEdgesMinArr.Empty();
     xEdgesMaxArr.Empty();
+    // Clear edge data
+    EdgeLinkLists.Empty();
+    EdgeSyncList.Reset();
+    EdgePointIndexList.Reset();
+    SimplifiedEdgePointIndexList.Reset();
+    EdgeSegmentTree.Reset();
     // Clear geometry data
-    GetSurfaceSection().Reset();
-    GetExtrudeSection().Reset();
+    ResetMeshData(SurfaceMeshData);
+    ResetMeshData(ExtrudeMeshData);
+    bSectionsExpanded = true;
+}
+
+void FMQCGridSurface::ReleaseMeshData()
+{
+    VertexMap.Empty();
+    cornersMinArr.Empty();
+    cornersMaxArr.Empty();
+    xEdgesMinArr.Empty();
+    xEdgesMaxArr.Empty();
+
+    ReleaseMeshData(SurfaceMeshData);
+    ReleaseMeshData(ExtrudeMeshData);
+    bSectionsExpanded = true;
+}
+
+void FMQCGridSurface::ReleaseMeshData(FMeshData& MeshData)
+{
+    // Quad filters are applied on geometry regeneration
+    MeshData.Section = FPMUMeshSection();
+    MeshData.Materials.Empty();
+    MeshData.MaterialSectionMap.Empty();
+    MeshData.MaterialIndexMap.Empty();
+    MeshData.CompactPositions.Empty();
+    MeshData.CompactColors.Empty();
+    MeshData.CompactIndices.Empty();
+    MeshData.bCompact = false;
+}
+
+void FMQCGridSurface::ResetMeshData(FMeshData& MeshData)
+{
+    MeshData.Section.Reset();
+    MeshData.Materials.Reset();
+    MeshData.CompactPositions.Empty();
+    MeshData.CompactColors.Empty();
+    MeshData.CompactIndices.Empty();
+    MeshData.bCompact = false;
+}
+
+void FMQCGridSurface::CompactVertexFormat(FMeshData& MeshData)
+{
+    FPMUMeshSection& Section(MeshData.Section);
+    const int32 VertexCount = Section.Positions.Num();
+
+    if (MeshData.bCompact || VertexCount < 1)
+    {
+        return;
+    }
+
+    // Positions height, UVs and tangents are reconstructed on expansion
+
+    MeshData.CompactPositions.SetNumUninitialized(VertexCount);
+
+    for (int32 i=0; i<VertexCount; ++i)
+    {
+        MeshData.CompactPositions[i] = FVector2D(Section.Positions[i]);
+    }
+
+    MeshData.CompactColors = MoveTemp(Section.Colors);
+
+    if (VertexCount <= (MAX_uint16+1))
+    {
+        MeshData.CompactIndices.SetNumUninitialized(Section.Indices.Num());
+
+        for (int32 i=0; i<Section.Indices.Num(); ++i)
+        {
+            MeshData.CompactIndices[i] = static_cast<uint16>(Section.Indices[i]);
+        }
+
+        Section.Indices.Empty();
+    }
+
+    Section.Positions.Empty();
+    Section.UVs.Empty();
+    Section.Colors.Empty();
+    Section.Tangents.Empty();
+
+    MeshData.bCompact = true;
+}
+
+void FMQCGridSurface::ExpandVertexFormat(FMeshData& MeshData, bool bIsExtrusion)
+{
+    if (! MeshData.bCompact)
+    {
+        return;
+    }
+
+    FPMUMeshSection& Section(MeshData.Section);
+    const int32 VertexCount = MeshData.CompactPositions.Num();
+
+    const float Height = bIsExtrusion ? ExtrusionHeight : 0.f;
+    const float FaceSign = bIsExtrusion ? -1.f : 1.f;
+    const FPackedNormal TangentX(FVector(1,0,0));
+    const FPackedNormal TangentZ(FVector4(0,0,FaceSign,FaceSign));
+
+    Section.Positions.SetNumUninitialized(VertexCount);
+    Section.UVs.SetNumUninitialized(VertexCount);
+    Section.Tangents.SetNumUninitialized(VertexCount*2);
+
+    for (int32 i=0; i<VertexCount; ++i)
+    {
+        const FVector2D& Point(MeshData.CompactPositions[i]);
+
+        Section.Positions[i] = FVector(Point, Height);
+        Section.UVs[i] = Point*MapSizeInv - MapSizeInv*.5f;
+        Section.Tangents[i*2  ] = TangentX.Vector.Packed;
+        Section.Tangents[i*2+1] = TangentZ.Vector.Packed;
+    }
+
+    Section.Colors = MeshData.CompactColors;
+
+    if (MeshData.CompactIndices.Num() > 0)
+    {
+        Section.Indices.SetNumUninitialized(MeshData.CompactIndices.Num());
+
+        for (int32 i=0; i<MeshData.CompactIndices.Num(); ++i)
+        {
+            Section.Indices[i] = MeshData.CompactIndices[i];
+        }
+    }
+}
+
+void FMQCGridSurface::ExpandGeometry() const
+{
+    if (bSectionsExpanded)
+    {
+        return;
+    }
+
+    FScopeLock ScopeLock(&ExpandLock);
+
+    if (bSectionsExpanded)
+    {
+        return;
+    }
+
+    // Expansion only restores redundant data of the finalized geometry,
+    // the surface is logically unchanged
+    FMQCGridSurface& MutableSurface(*const_cast<FMQCGridSurface*>(this));
+    MutableSurface.ExpandVertexFormat(MutableSurface.SurfaceMeshData, false);
+    MutableSurface.ExpandVertexFormat(MutableSurface.ExtrudeMeshData, true);
+
+    bSectionsExpanded = true;
+}
+
+void FMQCGridSurface::ReleaseCompactGeometry()
+{
+    ExpandGeometry();
+
+    FScopeLock ScopeLock(&ExpandLock);
+
+    ReleaseCompactData(SurfaceMeshData);
+    ReleaseCompactData(ExtrudeMeshData);
+}
+
+void FMQCGridSurface::ReleaseExpandedCompactGeometry()
+{
+    if (HasCompactGeometry())
+    {
+        return;
+    }
+
+    FScopeLock ScopeLock(&ExpandLock);
+
+    ReleaseCompactData(SurfaceMeshData);
+    ReleaseCompactData(ExtrudeMeshData);
+}
+
+void FMQCGridSurface::ReleaseCompactData(FMeshData& MeshData)
+{
+    MeshData.CompactPositions.Empty();
+    MeshData.CompactColors.Empty();
+    MeshData.CompactIndices.Empty();
+    MeshData.bCompact = false;
 }
 
 void FMQCGridSurface::GetMaterialSet(TSet<FMQCMaterialBlend>& MaterialSet) const
@@ -163,6 +460,84 @@ void FMQCGridSurface::GetMaterialSet(TSet<FMQCMaterialBlend>& MaterialSet) const
     }
 }
 
+SIZE_T FMQCGridSurface::GetSectionAllocatedSize(const FPMUMeshSection& Section)
+{
+    return Section.Positions.GetAllocatedSize()
+        + Section.UVs.GetAllocatedSize()
+        + Section.Colors.GetAllocatedSize()
+        + Section.Tangents.GetAllocatedSize()
+        + Section.Indices.GetAllocatedSize();
+}
+
+void FMQCGridSurface::GetMeshDataMemoryUsage(FMQCMemoryUsage& OutUsage, const FMeshData& MeshData)
+{
+    OutUsage.MeshSections += GetSectionAllocatedSize(MeshData.Section);
+    OutUsage.QuadFilters += MeshData.QuadFilterHashSet.GetAllocatedSize();
+    OutUsage.Materials += MeshData.Materials.GetAllocatedSize();
+
+    OutUsage.CompactGeometry += MeshData.CompactPositions.GetAllocatedSize();
+    OutUsage.CompactGeometry += MeshData.CompactColors.GetAllocatedSize();
+    OutUsage.CompactGeometry += MeshData.CompactIndices.GetAllocatedSize();
+
+    OutUsage.MaterialSectionMap += MeshData.MaterialSectionMap.GetAllocatedSize();
+
+    for (const auto& MaterialSectionPair : MeshData.MaterialSectionMap)
+    {
+        OutUsage.MaterialSectionMap += GetSectionAllocatedSize(MaterialSectionPair.Value);
+    }
+
+    OutUsage.MaterialIndexMap += MeshData.MaterialIndexMap.GetAllocatedSize();
+
+    for (const auto& MaterialIndexPair : MeshData.MaterialIndexMap)
+    {
+        OutUsage.MaterialIndexMap += MaterialIndexPair.Value.GetAllocatedSize();
+    }
+}
+
+void FMQCGridSurface::GetMemoryUsage(FMQCMemoryUsage& OutUsage) const
+{
+    OutUsage.Objects += sizeof(FMQCGridSurface);
+
+    // Triangulation data
+
+    OutUsage.TriangulationCache += cornersMinArr.GetAllocatedSize();
+    OutUsage.TriangulationCache += cornersMaxArr.GetAllocatedSize();
+    OutUsage.TriangulationCache += xEdgesMinArr.GetAllocatedSize();
+    OutUsage.TriangulationCache += xEdgesMaxArr.GetAllocatedSize();
+    OutUsage.VertexMap += VertexMap.GetAllocatedSize();
+
+    // Edge data
+
+    // Indirect array allocated size includes the list objects
+    OutUsage.EdgeLists += EdgeLinkLists.GetAllocatedSize();
+
+    for (const FEdgeLinkList& LinkList : EdgeLinkLists)
+    {
+        OutUsage.EdgeLists += LinkList.Num() * sizeof(FEdgeLink);
+    }
+
+    OutUsage.EdgeLists += EdgePointIndexList.GetAllocatedSize();
+    OutUsage.EdgeLists += SimplifiedEdgePointIndexList.GetAllocatedSize();
+
+    for (const FIndexArray& IndexList : EdgePointIndexList)
+    {
+        OutUsage.EdgeLists += IndexList.GetAllocatedSize();
+    }
+
+    for (const FIndexArray& IndexList : SimplifiedEdgePointIndexList)
+    {
+        OutUsage.EdgeLists += IndexList.GetAllocatedSize();
+    }
+
+    OutUsage.EdgeSync += EdgeSyncList.GetAllocatedSize();
+    OutUsage.EdgeSegmentTree += EdgeSegmentTree.GetAllocatedSize();
+
+    // Mesh data
+
+    GetMeshDataMemoryUsage(OutUsage, SurfaceMeshData);
+    GetMeshDataMemoryUsage(OutUsage, ExtrudeMeshData);
+}
+
 void FMQCGridSurface::AddVertex(const FVector2D& Point, const FMQCMaterial& Material, bool bIsExtrusion)
 {
     FVector2D UV(Point*MapSizeInv - MapSizeInv*.5f);
@@ -317,6 +692,8 @@ void FMQCGridSurface::GenerateEdgeListData()
         return;
     }
 
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_GenerateEdgeListData);
+
     EdgePointIndexList.Reset();
     EdgePointIndexList.SetNum(EdgeLinkLists.Num());
 
@@ -368,75 +745,441 @@ void FMQCGridSurface::GenerateEdgeListData(int32 EdgeListIndex)
     SyncData.TailHash = GetVertexHash(PointIndices.Last());
 }
 
-void FMQCGridSurface::GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList) const
+void FMQCGridSurface::GenerateEdgeSegmentTree()
 {
-    OutPointList.SetNum(EdgePointIndexList.Num());
+    TArray<FMQCEdgeSegmentTree::FSegment> Segments;
+
+    int32 SegmentCount = 0;
 
-    for (int32 li=0; li<EdgePointIndexList.Num(); ++li)
+    for (const FIndexArray& PointIndices : EdgePointIndexList)
     {
-        const FIndexArray& EdgePointIndices(EdgePointIndexList[li]);
-        TArray<FVector2D>& OutPoints(OutPointList[li].Points);
+        SegmentCount += FMath::Max(PointIndices.Num()-1, 0);
+    }
+
+    Segments.Reserve(SegmentCount);
 
-        OutPoints.SetNumUninitialized(EdgePointIndices.Num());
+    for (int32 ListId=0; ListId<EdgePointIndexList.Num(); ++ListId)
+    {
+        const FIndexArray& PointIndices(EdgePointIndexList[ListId]);
 
-        for (int32 i=0; i<EdgePointIndices.Num(); ++i)
+        for (int32 i=1; i<PointIndices.Num(); ++i)
         {
-            OutPoints[i] = GetPositionByIndex(EdgePointIndices[i]);
+            FMQCEdgeSegmentTree::FSegment Segment;
+            Segment.Point0 = GetPositionByIndex(PointIndices[i-1]);
+            Segment.Point1 = GetPositionByIndex(PointIndices[i]);
+            Segment.EdgeListIndex = ListId;
+            Segments.Emplace(Segment);
         }
     }
+
+    EdgeSegmentTree.Build(Segments);
 }
 
-void FMQCGridSurface::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex) const
+void FMQCGridSurface::GenerateSimplifiedEdgeListData()
 {
-    if (! EdgePointIndexList.IsValidIndex(EdgeListIndex))
+    SimplifiedEdgePointIndexList.Reset();
+    SimplifiedEdgePointIndexList.SetNum(EdgePointIndexList.Num());
+
+    for (int32 ListId=0; ListId<EdgePointIndexList.Num(); ++ListId)
     {
-        return;
+        const FIndexArray& PointIndices(EdgePointIndexList[ListId]);
+        FIndexArray& OutPointIndices(SimplifiedEdgePointIndexList[ListId]);
+
+        const int32 PointCount = PointIndices.Num();
+
+        if (PointCount < 3)
+        {
+            OutPointIndices = PointIndices;
+            continue;
+        }
+
+        OutPointIndices.Reset(PointCount);
+
+        // Head and tail points are always kept so edge list sync hashes
+        // remain valid for cross-chunk edge list connection
+
+        OutPointIndices.Emplace(PointIndices[0]);
+
+        // Closed edge list, split at the point furthest from head point
+        // to avoid simplifying against a degenerate segment
+
+        if (PointIndices[0] == PointIndices.Last())
+        {
+            const FVector2D HeadPoint(GetPositionByIndex(PointIndices[0]));
+
+            int32 SplitIndex = 1;
+            float SplitDistSq = -1.f;
+
+            for (int32 i=1; i<PointCount-1; ++i)
+            {
+                const float DistSq = FVector2D::DistSquared(HeadPoint, GetPositionByIndex(PointIndices[i]));
+
+                if (DistSq > SplitDistSq)
+                {
+                    SplitIndex = i;
+                    SplitDistSq = DistSq;
+                }
+            }
+
+            SimplifyEdgePoints(OutPointIndices, PointIndices, 0, SplitIndex);
+            SimplifyEdgePoints(OutPointIndices, PointIndices, SplitIndex, PointCount-1);
+        }
+        else
+        {
+            SimplifyEdgePoints(OutPointIndices, PointIndices, 0, PointCount-1);
+        }
+
+        OutPointIndices.Shrink();
     }
+}
+
+void FMQCGridSurface::SimplifyEdgePoints(FIndexArray& OutPointIndices, const FIndexArray& PointIndices, int32 First, int32 Last) const
+{
+    // Iterative Douglas-Peucker simplification over [First, Last].
+    // Appends kept points after First, including Last.
+
+    TArray<bool> KeepFlags;
+    TArray<TPair<int32, int32>, TInlineAllocator<32>> RangeStack;
 
-    const FIndexArray& Points(EdgePointIndexList[EdgeListIndex]);
+    KeepFlags.SetNumZeroed(Last-First+1);
+    KeepFlags.Last() = true;
 
-    OutPoints.Reserve(Points.Num());
+    RangeStack.Emplace(First, Last);
 
-    for (int32 i=1; i<Points.Num(); ++i)
+    while (RangeStack.Num() > 0)
     {
-        OutPoints.Emplace(GetPositionByIndex(Points[i]));
+        const TPair<int32, int32> Range(RangeStack.Pop(false));
+        const int32 RangeFirst = Range.Key;
+        const int32 RangeLast  = Range.Value;
+
+        if ((RangeLast-RangeFirst) < 2)
+        {
+            continue;
+        }
+
+        const FVector2D Point0(GetPositionByIndex(PointIndices[RangeFirst]));
+        const FVector2D Point1(GetPositionByIndex(PointIndices[RangeLast]));
+
+        int32 MaxIndex = -1;
+        float MaxDistSq = SimplifiedEdgeToleranceSq;
+
+        for (int32 i=RangeFirst+1; i<RangeLast; ++i)
+        {
+            const FVector2D Point(GetPositionByIndex(PointIndices[i]));
+            const FVector2D Closest(FMath::ClosestPointOnSegment2D(Point, Point0, Point1));
+            const float DistSq = FVector2D::DistSquared(Point, Closest);
+
+            if (DistSq > MaxDistSq)
+            {
+                MaxIndex = i;
+                MaxDistSq = DistSq;
+            }
+        }
+
+        if (MaxIndex >= 0)
+        {
+            KeepFlags[MaxIndex-First] = true;
+            RangeStack.Emplace(RangeFirst, MaxIndex);
+            RangeStack.Emplace(MaxIndex, RangeLast);
+        }
+    }
+
+    for (int32 i=1; i<KeepFlags.Num(); ++i)
+    {
+        if (KeepFlags[i])
+        {
+            OutPointIndices.Emplace(PointIndices[First+i]);
+        }
     }
 }
 
-void FMQCGridSurface::AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex) const
+void FMQCGridSurface::GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList, bool bSimplified) const
 {
-    check(EdgePointIndexList.IsValidIndex(EdgeListIndex));
+    const int32 ListCount = GetEdgePointListCount(bSimplified);
+
+    OutPointList.SetNum(ListCount);
 
-    if (! EdgePointIndexList.IsValidIndex(EdgeListIndex))
+    for (int32 li=0; li<ListCount; ++li)
     {
-        return;
+        const FMQCEdgePointView View(GetEdgePointView(li, bSimplified));
+        TArray<FVector2D>& OutPoints(OutPointList[li].Points);
+
+        OutPoints.SetNumUninitialized(View.Num());
+
+        for (int32 i=0; i<View.Num(); ++i)
+        {
+            OutPoints[i] = View.GetPoint(i);
+        }
     }
+}
+
+void FMQCGridSurface::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex, bool bSimplified) const
+{
+    const FMQCEdgePointView View(GetEdgePointView(EdgeListIndex, bSimplified));
+
+    OutPoints.Reserve(OutPoints.Num()+View.Num());
+
+    View.ForEachPoint([&OutPoints](const FVector2D& Point)
+    {
+        OutPoints.Emplace(Point);
+    }, 1);
+}
+
+void FMQCGridSurface::AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex, bool bSimplified) const
+{
+    check(GetEdgePointIndexList(bSimplified).IsValidIndex(EdgeListIndex));
 
-    const FIndexArray& Points(EdgePointIndexList[EdgeListIndex]);
+    const FMQCEdgePointView View(GetEdgePointView(EdgeListIndex, bSimplified));
 
-    if (Points.Num() < 1)
+    if (View.IsEmpty())
     {
         return;
     }
 
-    OutPoints.Reserve(OutPoints.Num()+Points.Num());
+    OutPoints.Reserve(OutPoints.Num()+View.Num());
 
     // Assign first position from current sync data
 
     if (OutPoints.Num() > 0)
     {
-        OutPoints.Last() = GetPositionByIndex(Points[0]);
+        OutPoints.Last() = View.GetPoint(0);
     }
     else
     {
-        OutPoints.Emplace(GetPositionByIndex(Points[0]));
+        OutPoints.Emplace(View.GetPoint(0));
     }
 
     // Assign the rest of the edge sync points
 
-    for (int32 i=1; i<Points.Num(); ++i)
+    View.ForEachPoint([&OutPoints](const FVector2D& Point)
+    {
+        OutPoints.Emplace(Point);
+    }, 1);
+}
+
+float FMQCGridSurface::GetSurfaceFrontSign() const
+{
+    const FPMUMeshSection& Section(SurfaceMeshData.Section);
+
+    // Find winding of front facing (+Z) surface triangles
+    for (int32 i=0; (i+2)<Section.Indices.Num(); i+=3)
+    {
+        const FVector2D A(Section.Positions[Section.Indices[i  ]]);
+        const FVector2D B(Section.Positions[Section.Indices[i+1]]);
+        const FVector2D C(Section.Positions[Section.Indices[i+2]]);
+        const float Cross = (B-A) ^ (C-A);
+
+        if (! FMath::IsNearlyZero(Cross))
+        {
+            return FMath::Sign(Cross);
+        }
+    }
+
+    return 1.f;
+}
+
+float FMQCGridSurface::GetEdgeInsideSign() const
+{
+    const FPMUMeshSection& Section(SurfaceMeshData.Section);
+
+    // Edges are always added in the same winding relative to their
+    // surface face, the side of the surface relative to edge direction
+    // is resolved once from the face of the first edge list segment
+
+    for (const FIndexArray& PointIndices : EdgePointIndexList)
+    {
+        if (PointIndices.Num() < 2)
+        {
+            continue;
+        }
+
+        const uint32 a = PointIndices[0];
+        const uint32 b = PointIndices[1];
+
+        for (int32 i=0; (i+2)<Section.Indices.Num(); i+=3)
+        {
+            const uint32* Face = &Section.Indices[i];
+
+            const bool bHasA = (Face[0] == a || Face[1] == a || Face[2] == a);
+            const bool bHasB = (Face[0] == b || Face[1] == b || Face[2] == b);
+
+            if (bHasA && bHasB)
+            {
+                const uint32 c = Face[0] ^ Face[1] ^ Face[2] ^ a ^ b;
+                const FVector2D PointA(Section.Positions[a]);
+                const FVector2D PointB(Section.Positions[b]);
+                const FVector2D PointC(Section.Positions[c]);
+
+                return ((PointB-PointA) ^ (PointC-PointA)) < 0.f ? -1.f : 1.f;
+            }
+        }
+
+        break;
+    }
+
+    return 1.f;
+}
+
+void FMQCGridSurface::GenerateWallGeometry()
+{
+    const FPMUMeshSection& SurfaceSection(SurfaceMeshData.Section);
+    FPMUMeshSection& WallSection(ExtrudeMeshData.Section);
+
+    const float FrontSign = GetSurfaceFrontSign();
+    const float InsideSign = GetEdgeInsideSign();
+
+    TArray<FVector2D> SegmentNormals;
+
+    for (const FIndexArray& PointIndices : EdgePointIndexList)
+    {
+        const int32 ListPointCount = PointIndices.Num();
+
+        if (ListPointCount < 2)
+        {
+            continue;
+        }
+
+        // Closed edge list shares head and tail wall vertices
+        const bool bClosed = PointIndices[0] == PointIndices.Last();
+        const int32 PointCount = bClosed ? ListPointCount-1 : ListPointCount;
+        const int32 SegmentCount = ListPointCount-1;
+
+        // Generate outward segment normals
+
+        SegmentNormals.SetNumUninitialized(SegmentCount);
+
+        for (int32 i=0; i<SegmentCount; ++i)
+        {
+            const FVector2D Point0(SurfaceSection.Positions[PointIndices[i  ]]);
+            const FVector2D Point1(SurfaceSection.Positions[PointIndices[i+1]]);
+            const FVector2D Direction((Point1-Point0).GetSafeNormal());
+
+            SegmentNormals[i] = (InsideSign > 0.f)
+                ? FVector2D( Direction.Y, -Direction.X)
+                : FVector2D(-Direction.Y,  Direction.X);
+        }
+
+        // Generate shared rim and base vertex pairs
+
+        const uint32 BaseIndex = WallSection.Positions.Num();
+        float U = 0.f;
+
+        for (int32 i=0; i<PointCount; ++i)
+        {
+            const uint32 SourceIndex = PointIndices[i];
+            const FVector2D Point(SurfaceSection.Positions[SourceIndex]);
+
+            FVector2D Normal(FVector2D::ZeroVector);
+
+            if (i > 0 || bClosed)
+            {
+                Normal += SegmentNormals[(i+SegmentCount-1) % SegmentCount];
+            }
+
+            if (i < SegmentCount)
+            {
+                Normal += SegmentNormals[i];
+            }
+
+            Normal = Normal.GetSafeNormal();
+
+            if (i > 0)
+            {
+                U += FVector2D::Distance(Point, FVector2D(SurfaceSection.Positions[PointIndices[i-1]]));
+            }
+
+            const FPackedNormal TangentX(FVector(-Normal.Y, Normal.X, 0.f));
+            const FPackedNormal TangentZ(FVector4(Normal.X, Normal.Y, 0.f, 1.f));
+            const FColor Color(SurfaceSection.Colors[SourceIndex]);
+            const FMQCMaterial& Material(SurfaceMeshData.Materials[SourceIndex]);
+
+            const FVector RimPosition(Point, 0.f);
+            const FVector BasePosition(Point, ExtrusionHeight);
+
+            WallSection.Positions.Emplace(RimPosition);
+            WallSection.Positions.Emplace(BasePosition);
+            WallSection.UVs.Emplace(U*MapSizeInv, 0.f);
+            WallSection.UVs.Emplace(U*MapSizeInv, 1.f);
+            WallSection.Colors.Emplace(Color);
+            WallSection.Colors.Emplace(Color);
+            WallSection.Tangents.Emplace(TangentX.Vector.Packed);
+            WallSection.Tangents.Emplace(TangentZ.Vector.Packed);
+            WallSection.Tangents.Emplace(TangentX.Vector.Packed);
+            WallSection.Tangents.Emplace(TangentZ.Vector.Packed);
+            WallSection.SectionLocalBox += RimPosition;
+            WallSection.SectionLocalBox += BasePosition;
+
+            ExtrudeMeshData.Materials.Emplace(Material);
+            ExtrudeMeshData.Materials.Emplace(Material);
+        }
+
+        // Generate wall quads facing segment normals
+
+        for (int32 i=0; i<SegmentCount; ++i)
+        {
+            const uint32 Rim0  = BaseIndex + i*2;
+            const uint32 Rim1  = BaseIndex + ((i+1) % PointCount)*2;
+            const uint32 Base0 = Rim0+1;
+            const uint32 Base1 = Rim1+1;
+
+            const FVector& P0(WallSection.Positions[Rim0]);
+            const FVector& P1(WallSection.Positions[Rim1]);
+            const FVector& P2(WallSection.Positions[Base1]);
+            const FVector FaceNormal(((P1-P0) ^ (P2-P0)) * FrontSign);
+            const FVector2D& SegmentNormal(SegmentNormals[i]);
+
+            if ((FaceNormal.X*SegmentNormal.X + FaceNormal.Y*SegmentNormal.Y) >= 0.f)
+            {
+                ExtrudeMeshData.AddFace(Rim0, Rim1, Base1);
+                ExtrudeMeshData.AddFace(Rim0, Base1, Base0);
+            }
+            else
+            {
+                ExtrudeMeshData.AddFace(Base1, Rim1, Rim0);
+                ExtrudeMeshData.AddFace(Base0, Base1, Rim0);
+            }
+        }
+    }
+}
+
+void FMQCGridSurface::GenerateBackFaceGeometry()
+{
+    const FPMUMeshSection& SurfaceSection(SurfaceMeshData.Section);
+    FPMUMeshSection& ExtrudeSection(ExtrudeMeshData.Section);
+
+    const uint32 BaseIndex = ExtrudeSection.Positions.Num();
+    const int32 VertexCount = SurfaceSection.Positions.Num();
+
+    const FPackedNormal TangentX(FVector(1,0,0));
+    const FPackedNormal TangentZ(FVector4(0,0,-1,-1));
+
+    // Duplicate surface vertices at extrusion height
+
+    for (int32 i=0; i<VertexCount; ++i)
+    {
+        const FVector Position(FVector2D(SurfaceSection.Positions[i]), ExtrusionHeight);
+
+        ExtrudeSection.Positions.Emplace(Position);
+        ExtrudeSection.UVs.Emplace(SurfaceSection.UVs[i]);
+        ExtrudeSection.Colors.Emplace(SurfaceSection.Colors[i]);
+        ExtrudeSection.Tangents.Emplace(TangentX.Vector.Packed);
+        ExtrudeSection.Tangents.Emplace(TangentZ.Vector.Packed);
+        ExtrudeSection.SectionLocalBox += Position;
+    }
+
+    ExtrudeMeshData.Materials.Append(SurfaceMeshData.Materials);
+
+    // Generate inversed surface faces
+
+    const TArray<uint32>& SurfaceIndices(SurfaceSection.Indices);
+
+    for (int32 i=0; (i+2)<SurfaceIndices.Num(); i+=3)
     {
-        OutPoints.Emplace(GetPositionByIndex(Points[i]));
+        ExtrudeMeshData.AddFace(
+            BaseIndex+SurfaceIndices[i+2],
+            BaseIndex+SurfaceIndices[i+1],
+            BaseIndex+SurfaceIndices[i  ]
+            );
     }
 }
 
@@ -458,7 +1201,7 @@ void FMQCGridSurface::AddQuadFace(uint32 a, uint32 b, uint32 c, uint32 d)
         }
 
         // Generate extrude
-        if (bGenerateExtrusion && ! ExtrudeMeshData.IsQuadFiltered(a))
+        if (bGenerateExtrudeFaces && ! ExtrudeMeshData.IsQuadFiltered(a))
         {
             ExtrudeMeshData.AddQuadInversed(a, b, c, d);
         }
@@ -481,7 +1224,7 @@ void FMQCGridSurface::AddTriangleEdgeFace(uint32 a, uint32 b, uint32 c)
         }
 
         // Generate extrude
-        if (bGenerateExtrusion)
+        if (bGenerateExtrudeFaces)
         {
             ExtrudeMeshData.AddFace(c, b, a);
         }
@@ -507,7 +1250,7 @@ void FMQCGridSurface::AddQuadEdgeFace(uint32 a, uint32 b, uint32 c, uint32 d)
         }
 
         // Generate extrude
-        if (bGenerateExtrusion)
+        if (bGenerateExtrudeFaces)
         {
             ExtrudeMeshData.AddFace(c, b, a);
             ExtrudeMeshData.AddFace(d, c, a);
@@ -537,7 +1280,7 @@ void FMQCGridSurface::AddPentagonEdgeFace(uint32 a, uint32 b, uint32 c, uint32 d
         }
 
         // Generate extrude
-        if (bGenerateExtrusion)
+        if (bGenerateExtrudeFaces)
         {
             ExtrudeMeshData.AddFace(c, b, a);
             ExtrudeMeshData.AddFace(d, c, a);
@@ -571,7 +1314,7 @@ void FMQCGridSurface::AddHexagonEdgeFace(uint32 a, uint32 b, uint32 c, uint32 d,
         }
 
         // Generate extrude
-        if (bGenerateExtrusion)
+        if (bGenerateExtrudeFaces)
         {
             ExtrudeMeshData.AddFace(c, b, a);
             ExtrudeMeshData.AddFace(d, c, a);
@@ -33,6 +33,7 @@
 #include "MQCVoxelTypes.h"
 #include "MQCGeometryTypes.h"
 #include "MQCMaterial.h"
+#include "MQCEdgeSegmentTree.h"
 #include "GULMathLibrary.h"
 
 class FMQCGridSurface
@@ -53,6 +54,13 @@ private:
         TMap<FMQCMaterialBlend, FPMUMeshSection> MaterialSectionMap;
         TMap<FMQCMaterialBlend, FIndexMap> MaterialIndexMap;
 
+        // Compact Geometry Data, section indices are kept
+        // as 32-bit indices if 16-bit indices are insufficient
+        TArray<FVector2D> CompactPositions;
+        TArray<FColor> CompactColors;
+        TArray<uint16> CompactIndices;
+        bool bCompact = false;
+
         // Geometry Generation
         FORCEINLINE void AddFace(uint32 a, uint32 b, uint32 c);
         FORCEINLINE void AddQuad(uint32 a, uint32 b, uint32 c, uint32 d);
@@ -114,15 +122,31 @@ private:
 
     bool bGenerateExtrusion;
     bool bExtrusionSurface;
+    bool bExtrudeWalls;
+    bool bExtrudeBackFace;
+    bool bGenerateExtrudeFaces;
     bool bRemapEdgeUVs;
+    bool bGenerateSimplifiedEdges;
+    bool bCompactVertexFormat;
 
 	int32 VoxelResolution;
     int32 VoxelCount;
     float MapSize;
     float MapSizeInv;
 	float ExtrusionHeight;
+    float SimplifiedEdgeToleranceSq;
     FIntPoint ChunkPosition;
 
+    int32 LODStep;
+    FIntPoint LODBorderCell;
+
+    // Geometry hashes of the last finalized triangulation and
+    // whether geometry changed since the last change reset
+    uint32 SurfaceGeometryHash;
+    uint32 ExtrudeGeometryHash;
+    bool bSurfaceGeometryChanged;
+    bool bExtrudeGeometryChanged;
+
     EMQCMaterialType MaterialType;
 
 	TArray<uint32> cornersMinArr;
@@ -145,6 +169,8 @@ private:
     TIndirectArray<FEdgeLinkList> EdgeLinkLists;
     TArray<FMQCEdgeSyncData> EdgeSyncList;
     TArray<FIndexArray> EdgePointIndexList;
+    TArray<FIndexArray> SimplifiedEdgePointIndexList;
+    FMQCEdgeSegmentTree EdgeSegmentTree;
 
     FMeshData SurfaceMeshData;
     FMeshData ExtrudeMeshData;
@@ -156,6 +182,33 @@ private:
     void ReserveGeometry(FMeshData& MeshData);
     void CompactGeometry(FMeshData& MeshData);
 
+    void UpdateGeometryHash();
+    static uint32 GetGeometryHash(const FMeshData& MeshData);
+
+    // Guards lazy expansion of compact geometry from const accessors.
+    // Compact geometry is kept after expansion until the geometry is
+    // reset or released by the editing thread after publishing, so
+    // concurrent readers of compact positions stay valid.
+    mutable FCriticalSection ExpandLock;
+    mutable TAtomic<bool> bSectionsExpanded;
+
+    void CompactVertexFormat(FMeshData& MeshData);
+    void ExpandVertexFormat(FMeshData& MeshData, bool bIsExtrusion);
+    static void ResetMeshData(FMeshData& MeshData);
+    static void ReleaseCompactData(FMeshData& MeshData);
+    static void ReleaseMeshData(FMeshData& MeshData);
+    static void GetMeshDataMemoryUsage(FMQCMemoryUsage& OutUsage, const FMeshData& MeshData);
+
+    FORCEINLINE const FMeshData& GetPositionMeshData() const
+    {
+        return !bExtrusionSurface ? SurfaceMeshData : ExtrudeMeshData;
+    }
+
+    FORCEINLINE int32 GetReserveCount() const
+    {
+        return FMath::Max(VoxelCount / (LODStep*LODStep), 1);
+    }
+
 public:
 
     FMQCGridSurface();
@@ -163,40 +216,125 @@ public:
     ~FMQCGridSurface();
 
     void Configure(const FMQCSurfaceConfig& Config);
+    void SetLODTransform(int32 InLODStep, const FIntPoint& InLODBorderCell);
     void Initialize();
 	void Finalize();
 	void Clear();
 
+    // Releases mesh buffers and triangulation caches, edge data, quad
+    // filters, geometry hashes and change flags are kept
+    void ReleaseMeshData();
+
     void GetMaterialSet(TSet<FMQCMaterialBlend>& MaterialSet) const;
 
-    void GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList) const;
-    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex) const;
-    void AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex) const;
+    // Memory Accounting
+
+    static SIZE_T GetSectionAllocatedSize(const FPMUMeshSection& Section);
+    void GetMemoryUsage(FMQCMemoryUsage& OutUsage) const;
+
+    FORCEINLINE SIZE_T GetAllocatedSize() const
+    {
+        FMQCMemoryUsage Usage;
+        GetMemoryUsage(Usage);
+        return Usage.GetTotal();
+    }
+
+    FORCEINLINE bool HasSurfaceGeometryChange() const
+    {
+        return bSurfaceGeometryChanged;
+    }
+
+    FORCEINLINE bool HasExtrudeGeometryChange() const
+    {
+        return bExtrudeGeometryChanged;
+    }
+
+    FORCEINLINE void ResetGeometryChange()
+    {
+        bSurfaceGeometryChanged = false;
+        bExtrudeGeometryChanged = false;
+    }
+
+    // Reports present geometry as changed regardless of geometry hash
+    FORCEINLINE void MarkGeometryChanged()
+    {
+        bSurfaceGeometryChanged |= (SurfaceGeometryHash != 0);
+        bExtrudeGeometryChanged |= (ExtrudeGeometryHash != 0);
+    }
+
+    void GetEdgePoints(TArray<FMQCEdgePointData>& OutPointList, bool bSimplified = false) const;
+    void GetEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex, bool bSimplified = false) const;
+    void AppendConnectedEdgePoints(TArray<FVector2D>& OutPoints, int32 EdgeListIndex, bool bSimplified = false) const;
+    FMQCEdgePointView GetEdgePointView(int32 EdgeListIndex, bool bSimplified = false) const;
+
+    FORCEINLINE int32 GetEdgePointListCount(bool bSimplified = false) const
+    {
+        return GetEdgePointIndexList(bSimplified).Num();
+    }
+
+    // Returns simplified edge point indices if available and requested,
+    // otherwise returns full resolution edge point indices
+    FORCEINLINE const TArray<FIndexArray>& GetEdgePointIndexList(bool bSimplified) const
+    {
+        return (bSimplified && bGenerateSimplifiedEdges)
+            ? SimplifiedEdgePointIndexList
+            : EdgePointIndexList;
+    }
+
+    FORCEINLINE const FMQCEdgeSegmentTree& GetEdgeSegmentTree() const
+    {
+        return EdgeSegmentTree;
+    }
 
     FORCEINLINE uint32 GetVertexCount() const
     {
-        return !bExtrusionSurface
-            ? SurfaceMeshData.Section.Positions.Num()
-            : ExtrudeMeshData.Section.Positions.Num();
+        const FMeshData& MeshData(GetPositionMeshData());
+
+        return MeshData.bCompact
+            ? MeshData.CompactPositions.Num()
+            : MeshData.Section.Positions.Num();
+    }
+
+    FORCEINLINE bool HasCompactGeometry() const
+    {
+        return ! bSectionsExpanded;
     }
 
+    // Expands compact geometry into full mesh sections, safe to call
+    // from any thread. Compact geometry is kept for position readers.
+    void ExpandGeometry() const;
+
+    // Expands compact geometry and releases compact data,
+    // required before geometry modification
+    void ReleaseCompactGeometry();
+
+    // Releases compact data of already expanded geometry, only called
+    // on the editing thread once no position readers are in flight
+    void ReleaseExpandedCompactGeometry();
+
+    // Mesh section accessors, expands compact geometry if required
+
     FORCEINLINE FPMUMeshSection& GetSurfaceSection()
     {
+        ExpandGeometry();
         return SurfaceMeshData.Section;
     }
 
     FORCEINLINE FPMUMeshSection& GetExtrudeSection()
     {
+        ExpandGeometry();
         return ExtrudeMeshData.Section;
     }
 
     FORCEINLINE const FPMUMeshSection& GetSurfaceSection() const
     {
+        ExpandGeometry();
         return SurfaceMeshData.Section;
     }
 
     FORCEINLINE const FPMUMeshSection& GetExtrudeSection() const
     {
+        ExpandGeometry();
         return ExtrudeMeshData.Section;
     }
 
@@ -302,6 +440,13 @@ private:
 
     void GenerateEdgeListData();
     void GenerateEdgeListData(int32 EdgeListIndex);
+    void GenerateEdgeSegmentTree();
+    void GenerateSimplifiedEdgeListData();
+    void GenerateWallGeometry();
+    void GenerateBackFaceGeometry();
+    float GetSurfaceFrontSign() const;
+    float GetEdgeInsideSign() const;
+    void SimplifyEdgePoints(FIndexArray& OutPointIndices, const FIndexArray& PointIndices, int32 First, int32 Last) const;
 
 	void AddQuadFace(uint32 a, uint32 b, uint32 c, uint32 d);
 	void AddTriangleEdgeFace(uint32 a, uint32 b, uint32 c);
@@ -313,6 +458,22 @@ private:
     void AddEdge(uint32 a, uint32 b);
     void AddMaterialFace(uint32 a, uint32 b, uint32 c);
 
+    FORCEINLINE float GetLODCoord(float Coord, int32 BorderCell) const
+    {
+        // Cells past the border cell are one voxel narrower, they only
+        // span up to the last chunk voxel when there is no chunk neighbour
+        return (Coord > BorderCell)
+            ? (BorderCell*LODStep + (Coord-BorderCell)*(LODStep-1))
+            : (Coord*LODStep);
+    }
+
+    FORCEINLINE FVector2D GetLODPoint(const FVector2D& Point) const
+    {
+        return (LODStep > 1)
+            ? FVector2D(GetLODCoord(Point.X, LODBorderCell.X), GetLODCoord(Point.Y, LODBorderCell.Y))
+            : Point;
+    }
+
     FORCEINLINE uint32 GetVertexHash(uint32 VertexIndex) const
     {
         return UGULMathLibrary::GetHash(GetPositionByIndex(VertexIndex));
@@ -338,9 +499,27 @@ private:
 
 FORCEINLINE FVector2D FMQCGridSurface::GetPositionByIndex(uint32 Index) const
 {
-    return !bExtrusionSurface
-        ? FVector2D(GetSurfaceSection().Positions[Index])
-        : FVector2D(GetExtrudeSection().Positions[Index]);
+    const FMeshData& MeshData(GetPositionMeshData());
+
+    return MeshData.bCompact
+        ? MeshData.CompactPositions[Index]
+        : FVector2D(MeshData.Section.Positions[Index]);
+}
+
+FORCEINLINE FMQCEdgePointView FMQCGridSurface::GetEdgePointView(int32 EdgeListIndex, bool bSimplified) const
+{
+    const TArray<FIndexArray>& PointIndexList(GetEdgePointIndexList(bSimplified));
+
+    if (! PointIndexList.IsValidIndex(EdgeListIndex))
+    {
+        return FMQCEdgePointView();
+    }
+
+    const FMeshData& MeshData(GetPositionMeshData());
+
+    return MeshData.bCompact
+        ? FMQCEdgePointView(PointIndexList[EdgeListIndex], MeshData.CompactPositions)
+        : FMQCEdgePointView(PointIndexList[EdgeListIndex], MeshData.Section.Positions);
 }
 
 FORCEINLINE int32 FMQCGridSurface::AppendEdgeSyncData(TArray<FMQCEdgeSyncData>& OutSyncData) const
@@ -385,7 +564,7 @@ inline uint32 FMQCGridSurface::AddVertexMapped(const FVector2D& Point, const FMQ
 
         AddVertex(Vertex, Material, bExtrusionSurface);
 
-        if (bGenerateExtrusion)
+        if (bGenerateExtrudeFaces)
         {
             AddVertex(Vertex, Material, true);
         }
@@ -416,28 +595,28 @@ FORCEINLINE void FMQCGridSurface::PrepareCacheForNextRow()
 
 FORCEINLINE void FMQCGridSurface::CacheFirstCorner(const FMQCVoxel& voxel)
 {
-    cornersMax[0] = AddVertexMapped(voxel.GetPosition(), voxel.Material);
+    cornersMax[0] = AddVertexMapped(GetLODPoint(voxel.GetPosition()), voxel.Material);
 }
 
 FORCEINLINE void FMQCGridSurface::CacheNextCorner(int32 i, const FMQCVoxel& voxel)
 {
-    cornersMax[i+1] = AddVertexMapped(voxel.GetPosition(), voxel.Material);
+    cornersMax[i+1] = AddVertexMapped(GetLODPoint(voxel.GetPosition()), voxel.Material);
 }
 
 FORCEINLINE void FMQCGridSurface::CacheEdgeX(int32 i, const FMQCVoxel& voxel, const FMQCMaterial& Material)
 {
-    xEdgesMax[i] = AddVertexMapped(voxel.GetXEdgePoint(), Material);
+    xEdgesMax[i] = AddVertexMapped(GetLODPoint(voxel.GetXEdgePoint()), Material);
 }
 
 FORCEINLINE void FMQCGridSurface::CacheEdgeY(const FMQCVoxel& voxel, const FMQCMaterial& Material)
 {
-    yEdgeMax = AddVertexMapped(voxel.GetYEdgePoint(), Material);
+    yEdgeMax = AddVertexMapped(GetLODPoint(voxel.GetYEdgePoint()), Material);
 }
 
 FORCEINLINE int32 FMQCGridSurface::CacheFeaturePoint(const FMQCFeaturePoint& f)
 {
     check(f.exists);
-    return AddVertexMapped(f.position, f.Material);
+    return AddVertexMapped(GetLODPoint(f.position), f.Material);
 }
 
 // -- Fill Functions
@@ -35,15 +35,39 @@
 #include "Mesh/Simplifier/PMUMeshSimplifier.h"
 
 #include "MQCGridChunk.h"
+#include "MQCEdgeSegmentTree.h"
+#include "MQCVoxelSnapshot.h"
 #include "MQCMaterialUtility.h"
+#include "GULMathLibrary.h"
+#include "MarchingSquaresComplex.h"
+
+#include "Async/Async.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/ThreadSafeCounter.h"
+#include "Misc/ScopeRWLock.h"
+#include "UObject/UObjectIterator.h"
 
 FMQCMap::FMQCMap()
     : VoxelResolution(8)
     , ChunkResolution(2)
+    , ClusterResolution(1)
     , MaxFeatureAngle(135.f)
     , MaxParallelAngle(8.f)
     , ExtrusionHeight(-1.f)
     , MaterialType(EMQCMaterialType::MT_COLOR)
+    , bHaloVoxels(false)
+    , bScheduleEditedChunks(false)
+    , bVoxelSnapshots(false)
+    , bSparseChunks(false)
+    , bStreamChunks(false)
+    , bCompressIdleChunks(false)
+    , bReleaseIdleChunkMeshes(false)
+    , IdleChunkSeconds(30.f)
+    , MaxChunksCompressedPerTick(8)
+    , ChunkPageResolution(1)
+    , ChunkPageDimension(0)
+    , Scheduler(*this)
+    , Streamer(*this)
 {
 }
 
@@ -59,64 +83,454 @@ FMQCMaterial FMQCMap::GetTypedMaterial(uint8 MaterialIndex, const FLinearColor&
 
 void FMQCMap::Triangulate()
 {
-    for (FMQCGridChunk* Chunk : Chunks)
+    if (Recorder)
+    {
+        Recorder->RecordTriangulate(false);
+    }
+
+    // All chunks are triangulated, drop queued scheduled chunks
+    Scheduler.CancelAll();
+
+    WaitForEdgeResolution();
+
+    for (int32 ChunkIndex : ChunkOrder)
     {
-        Chunk->Triangulate();
+        GetChunk(ChunkIndex).Triangulate();
     }
 
     ResolveChunkEdgeData();
+    BroadcastGeometryChanges();
 }
 
 void FMQCMap::TriangulateAsync()
 {
-    for (FMQCGridChunk* Chunk : Chunks)
+    if (Recorder)
+    {
+        Recorder->RecordTriangulate(true);
+    }
+
+    // All chunks are triangulated, drop queued scheduled chunks
+    Scheduler.CancelAll();
+
+    // Previous edge resolution reads chunk surfaces, wait for completion
+    WaitForEdgeResolution();
+
+    // Create state edge data promises. Chunk triangulation waits for
+    // published edge data futures, new futures are published once all
+    // chunk triangulation tasks have been dispatched.
+
+    const int32 StateCount = SurfaceStates.Num();
+
+    TArray<FEdgeDataPromiseRef> Promises;
+    TArray<TSharedFuture<void>> Futures;
+    Promises.Reserve(StateCount+1);
+    Futures.Reserve(StateCount+1);
+
+    EdgeSyncGroups.SetNum(StateCount+1, false);
+
+    for (int32 StateIndex=0; StateIndex<=StateCount; ++StateIndex)
+    {
+        FEdgeDataPromiseRef Promise(MakeShared<TPromise<void>, ESPMode::ThreadSafe>());
+        Futures.Emplace(Promise->GetFuture().Share());
+        Promises.Emplace(Promise);
+    }
+
+    FEdgeDataPromiseRef BroadcastPromise(MakeShared<TPromise<void>, ESPMode::ThreadSafe>());
+    EdgeDataBroadcastFuture = BroadcastPromise->GetFuture().Share();
+
+    // Dispatch chunk triangulation, the last triangulated chunk
+    // dispatches state edge data resolution
+
+    if (ChunkOrder.Num() > 0)
+    {
+        TSharedRef<FThreadSafeCounter, ESPMode::ThreadSafe> PendingChunkCount(
+            MakeShared<FThreadSafeCounter, ESPMode::ThreadSafe>(ChunkOrder.Num())
+            );
+
+        TFunction<void()> OnChunkTriangulated(
+            [this, Promises, BroadcastPromise, PendingChunkCount]()
+            {
+                if (PendingChunkCount->Decrement() == 0)
+                {
+                    ResolveChunkEdgeDataAsync(Promises, BroadcastPromise);
+                }
+            } );
+
+        for (int32 ChunkIndex : ChunkOrder)
+        {
+            GetChunk(ChunkIndex).TriangulateAsync(OnChunkTriangulated);
+        }
+    }
+    else
     {
-        Chunk->TriangulateAsync();
+        ResolveChunkEdgeDataAsync(Promises, BroadcastPromise);
     }
 
+    EdgeDataFutures = MoveTemp(Futures);
+
     bRequireFinalizeAsync = true;
 }
 
 void FMQCMap::WaitForAsyncTask()
 {
-    for (FMQCGridChunk* Chunk : Chunks)
+    for (int32 ChunkIndex : ChunkOrder)
     {
-        Chunk->WaitForAsyncTask();
+        GetChunk(ChunkIndex).WaitForAsyncTask();
     }
+
+    WaitForEdgeResolution();
 }
 
 void FMQCMap::FinalizeAsync()
 {
     if (bRequireFinalizeAsync)
     {
+        // Edge data is resolved asynchronously after chunk triangulation
         WaitForAsyncTask();
-        ResolveChunkEdgeData();
+        BroadcastGeometryChanges();
         bRequireFinalizeAsync = false;
     }
 }
 
+void FMQCMap::WaitForEdgeResolution()
+{
+    for (const TSharedFuture<void>& Future : EdgeDataFutures)
+    {
+        if (Future.IsValid())
+        {
+            Future.Wait();
+        }
+    }
+
+    if (EdgeDataBroadcastFuture.IsValid())
+    {
+        EdgeDataBroadcastFuture.Wait();
+    }
+}
+
+bool FMQCMap::IsEdgeResolutionComplete() const
+{
+    for (const TSharedFuture<void>& Future : EdgeDataFutures)
+    {
+        if (Future.IsValid() && ! Future.IsReady())
+        {
+            return false;
+        }
+    }
+
+    return ! EdgeDataBroadcastFuture.IsValid() || EdgeDataBroadcastFuture.IsReady();
+}
+
+TSharedFuture<void> FMQCMap::GetEdgeDataFuture(int32 StateIndex) const
+{
+    return EdgeDataFutures.IsValidIndex(StateIndex)
+        ? EdgeDataFutures[StateIndex]
+        : TSharedFuture<void>();
+}
+
+int32 FMQCMap::TickScheduledTriangulation(float BudgetMs)
+{
+    // Released chunk geometry read since the last tick is regenerated by
+    // scheduled triangulation, readers see released geometry until then
+
+    int32 RestoreIndex;
+
+    while (GeometryRestoreQueue.Dequeue(RestoreIndex))
+    {
+        const FMQCGridChunk* Chunk = FindChunk(RestoreIndex);
+
+        if (Chunk && Chunk->IsGeometryReleased())
+        {
+            Scheduler.RequestChunk(RestoreIndex);
+        }
+    }
+
+    // Hold dispatch while completed chunks wait for in-flight chunks,
+    // otherwise continuous dispatch could defer edge resolution indefinitely
+    const bool bDispatch = (ScheduledCompletedCount == 0);
+
+    ScheduledCompletedCount += Scheduler.Tick(BudgetMs, bDispatch);
+
+    // Edge resolution reads all chunk surfaces, which must
+    // not race in-flight chunk triangulation
+    if (ScheduledCompletedCount < 1 || Scheduler.GetInFlightCount() > 0)
+    {
+        return 0;
+    }
+
+    ResolveChunkEdgeData();
+    BroadcastGeometryChanges();
+
+    const int32 CompletedCount = ScheduledCompletedCount;
+    ScheduledCompletedCount = 0;
+
+    return CompletedCount;
+}
+
+void FMQCMap::BroadcastGeometryChanges()
+{
+    TArray<FMQCGeometryChange> Changes;
+
+    for (int32 ChunkIndex : ChunkOrder)
+    {
+        GetChunk(ChunkIndex).AppendGeometryChanges(Changes, ChunkIndex);
+    }
+
+    if (Changes.Num() > 0)
+    {
+        GeometryChangedEvent.Broadcast(Changes);
+    }
+
+    UpdateMemoryStats();
+}
+
+void FMQCMap::UpdateMemoryStats()
+{
+#if STATS
+    FMQCMemoryUsage Usage;
+    GetMemoryUsage(Usage);
+
+    auto UpdateStat = [](const FName& StatName, SIZE_T PrevSize, SIZE_T NewSize)
+    {
+        if (NewSize > PrevSize)
+        {
+            INC_MEMORY_STAT_BY_FName(StatName, NewSize-PrevSize);
+        }
+        else
+        if (NewSize < PrevSize)
+        {
+            DEC_MEMORY_STAT_BY_FName(StatName, PrevSize-NewSize);
+        }
+    };
+
+    const FMQCMemoryUsage& Prev(ReportedMemoryUsage);
+
+    UpdateStat(GET_STATFNAME(STAT_MQC_VoxelMemory),
+        Prev.Voxels + Prev.LODVoxels,
+        Usage.Voxels + Usage.LODVoxels);
+    UpdateStat(GET_STATFNAME(STAT_MQC_TriangulationCacheMemory),
+        Prev.TriangulationCache + Prev.VertexMap,
+        Usage.TriangulationCache + Usage.VertexMap);
+    UpdateStat(GET_STATFNAME(STAT_MQC_EdgeDataMemory),
+        Prev.EdgeLists + Prev.EdgeSegmentTree + Prev.EdgeSync,
+        Usage.EdgeLists + Usage.EdgeSegmentTree + Usage.EdgeSync);
+    UpdateStat(GET_STATFNAME(STAT_MQC_MeshSectionMemory),
+        Prev.MeshSections + Prev.CompactGeometry + Prev.QuadFilters,
+        Usage.MeshSections + Usage.CompactGeometry + Usage.QuadFilters);
+    UpdateStat(GET_STATFNAME(STAT_MQC_MaterialMemory),
+        Prev.Materials + Prev.MaterialSectionMap + Prev.MaterialIndexMap,
+        Usage.Materials + Usage.MaterialSectionMap + Usage.MaterialIndexMap);
+    UpdateStat(GET_STATFNAME(STAT_MQC_TotalMemory),
+        Prev.GetTotal(),
+        Usage.GetTotal());
+
+    ReportedMemoryUsage = Usage;
+#endif
+}
+
+void FMQCMap::GetMemoryUsage(FMQCMemoryUsage& OutUsage) const
+{
+    OutUsage.Objects += sizeof(FMQCMap);
+    OutUsage.Objects += ChunkPages.GetAllocatedSize();
+    OutUsage.Objects += ChunkOrder.GetAllocatedSize();
+    OutUsage.Objects += SurfaceStates.GetAllocatedSize();
+    OutUsage.Objects += ChunkTree.GetAllocatedSize();
+
+    OutUsage.Voxels += EmptyVoxels.GetAllocatedSize();
+    OutUsage.EdgeSync += EdgeSyncGroups.GetAllocatedSize();
+
+    if (SnapshotEpochs.IsValid())
+    {
+        OutUsage.Voxels += SnapshotEpochs->GetRetiredAllocatedSize();
+    }
+
+    for (const FStateEdgeSyncList& EdgeSyncGroup : EdgeSyncGroups)
+    {
+        OutUsage.EdgeSync += EdgeSyncGroup.GetAllocatedSize();
+
+        for (const FEdgeSyncList& EdgeSyncList : EdgeSyncGroup)
+        {
+            OutUsage.EdgeSync += EdgeSyncList.GetAllocatedSize();
+        }
+    }
+
+    // Created chunk objects are included through chunk usage,
+    // page entries outside the map chunk layout are unused
+
+    int32 PageEntryCount = 0;
+
+    for (const TAtomic<FMQCGridChunk*>& Page : ChunkPages)
+    {
+        if (Page.Load())
+        {
+            PageEntryCount += ChunkPageResolution * ChunkPageResolution;
+        }
+    }
+
+    OutUsage.Objects += (PageEntryCount - ChunkOrder.Num()) * sizeof(FMQCGridChunk);
+
+    for (int32 ChunkIndex : ChunkOrder)
+    {
+        GetChunk(ChunkIndex).GetMemoryUsage(OutUsage);
+    }
+}
+
+SIZE_T FMQCMap::GetAllocatedSize() const
+{
+    FMQCMemoryUsage Usage;
+    GetMemoryUsage(Usage);
+    return Usage.GetTotal();
+}
+
+void FMQCMap::DumpMemoryUsage(FOutputDevice& Ar, int32 TopChunkCount) const
+{
+    FMQCMemoryUsage Usage;
+    GetMemoryUsage(Usage);
+
+    Ar.Logf(TEXT("Map (Chunks: %d, VoxelResolution: %d) %s"), GetChunkCount(), VoxelResolution, *Usage.ToString());
+    Ar.Logf(TEXT("  Created Chunks: %d, Allocated Chunks: %d, Chunk Tree Nodes: %d, Leaves: %d"),
+        ChunkOrder.Num(),
+        GetAllocatedChunkCount(),
+        ChunkTree.GetNodeCount(),
+        ChunkTree.GetLeafCount()
+        );
+
+    FMQCCompressionStats CompressionStats;
+    GetCompressionStats(CompressionStats);
+
+    Ar.Logf(TEXT("  Compression %s"), *CompressionStats.ToString());
+
+    // Sort chunks by allocated size
+
+    TArray<TPair<SIZE_T, int32>> ChunkSizes;
+    ChunkSizes.Reserve(ChunkOrder.Num());
+
+    for (int32 ChunkIndex : ChunkOrder)
+    {
+        ChunkSizes.Emplace(GetChunk(ChunkIndex).GetAllocatedSize(), ChunkIndex);
+    }
+
+    ChunkSizes.Sort([](const TPair<SIZE_T, int32>& A, const TPair<SIZE_T, int32>& B)
+    {
+        return A.Key > B.Key;
+    } );
+
+    const int32 DumpCount = FMath::Min(TopChunkCount, ChunkSizes.Num());
+
+    for (int32 i=0; i<DumpCount; ++i)
+    {
+        const int32 ChunkIndex = ChunkSizes[i].Value;
+
+        FMQCMemoryUsage ChunkUsage;
+        GetChunk(ChunkIndex).GetMemoryUsage(ChunkUsage);
+
+        Ar.Logf(TEXT("  Chunk %d (%d, %d) %s"),
+            ChunkIndex,
+            ChunkIndex % ChunkResolution,
+            ChunkIndex / ChunkResolution,
+            *ChunkUsage.ToString()
+            );
+    }
+}
+
 void FMQCMap::ResolveChunkEdgeData()
 {
+    WaitForEdgeResolution();
+
     EdgeSyncGroups.SetNum(SurfaceStates.Num()+1, false);
 
+    TArray<int32> ResolveStates;
+
     for (int32 i=0; i<SurfaceStates.Num(); ++i)
     {
         if (SurfaceStates[i].bRemapEdgeUVs)
         {
-            ResolveChunkEdgeData(i+1);
+            ResolveStates.Emplace(i+1);
+        }
+    }
+
+    // State edge data resolution only reads chunk surfaces of the
+    // resolved state and writes to its own edge sync group
+
+    if (ResolveStates.Num() > 1)
+    {
+        ParallelFor(ResolveStates.Num(), [this, &ResolveStates](int32 i)
+        {
+            ResolveChunkEdgeData(ResolveStates[i]);
+        } );
+    }
+    else
+    if (ResolveStates.Num() > 0)
+    {
+        ResolveChunkEdgeData(ResolveStates[0]);
+    }
+}
+
+void FMQCMap::ResolveChunkEdgeDataAsync(const TArray<FEdgeDataPromiseRef>& Promises, const FEdgeDataPromiseRef& BroadcastPromise)
+{
+    check(Promises.Num() == SurfaceStates.Num()+1);
+
+    // State futures are fulfilled as soon as the state is resolved for
+    // worker-side waiting. The last resolved state broadcasts all states
+    // in order so listeners never receive concurrent broadcasts.
+
+    const int32 PromiseCount = Promises.Num();
+
+    TSharedRef<FThreadSafeCounter, ESPMode::ThreadSafe> PendingStateCount(
+        MakeShared<FThreadSafeCounter, ESPMode::ThreadSafe>(PromiseCount)
+        );
+
+    auto FulfillPromise = [this, PromiseCount, PendingStateCount, BroadcastPromise](int32 StateIndex, const FEdgeDataPromiseRef& Promise)
+    {
+        Promise->SetValue();
+
+        if (PendingStateCount->Decrement() == 0)
+        {
+            for (int32 i=0; i<PromiseCount; ++i)
+            {
+                EdgeDataReadyEvent.Broadcast(i);
+            }
+
+            BroadcastPromise->SetValue();
+        }
+    };
+
+    // No edge data on empty state
+    FulfillPromise(0, Promises[0]);
+
+    for (int32 StateIndex=1; StateIndex<Promises.Num(); ++StateIndex)
+    {
+        const FEdgeDataPromiseRef& Promise(Promises[StateIndex]);
+
+        if (SurfaceStates[StateIndex-1].bRemapEdgeUVs)
+        {
+            Async(
+                EAsyncExecution::TaskGraph,
+                [this, StateIndex, Promise, FulfillPromise]()
+                {
+                    ResolveChunkEdgeData(StateIndex);
+                    FulfillPromise(StateIndex, Promise);
+                } );
+        }
+        else
+        {
+            // Non-remapped state edge points are ready with chunk triangulation
+            FulfillPromise(StateIndex, Promise);
         }
     }
 }
 
 void FMQCMap::ResolveChunkEdgeData(int32 StateIndex)
 {
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_ResolveChunkEdgeData);
+
     TArray<FMQCEdgeSyncData> SyncCandidates;
     TArray<TDoubleLinkedList<FMQCEdgeSyncData>> EdgeSyncLists;
 
-    // Gather edge sync data from all chunks
-    for (int32 ChunkIndex=0; ChunkIndex<Chunks.Num(); ++ChunkIndex)
+    // Gather edge sync data from all created chunks
+    for (int32 ChunkIndex : ChunkOrder)
     {
-        FMQCGridChunk& Chunk(*Chunks[ChunkIndex]);
+        FMQCGridChunk& Chunk(GetChunk(ChunkIndex));
 
         // Get chunk edge sync data
         int32 SyncOffetIndex = Chunk.AppendEdgeSyncData(SyncCandidates, StateIndex);
@@ -213,10 +627,29 @@ void FMQCMap::InitializeSettings(const FMQCMapConfig& MapConfig)
 
     VoxelResolution = MapConfig.VoxelResolution;
     ChunkResolution = MapConfig.ChunkResolution;
+    ClusterResolution = FMath::Clamp(MapConfig.ClusterResolution, 1, ChunkResolution);
     MaxFeatureAngle = MapConfig.MaxFeatureAngle;
     MaxParallelAngle = MapConfig.MaxParallelAngle;
     ExtrusionHeight = MapConfig.ExtrusionHeight;
     MaterialType = MapConfig.MaterialType;
+    bHaloVoxels = MapConfig.bHaloVoxels;
+    bScheduleEditedChunks = MapConfig.bScheduleEditedChunks;
+    bStreamChunks = MapConfig.bStreamChunks;
+    bSparseChunks = MapConfig.bSparseChunks || bStreamChunks;
+    StreamingStoreDirectory = MapConfig.StreamingStoreDirectory;
+    StreamingStoreId = MapConfig.StreamingStoreId;
+    bCompressIdleChunks = MapConfig.bCompressIdleChunks;
+    bVoxelSnapshots = MapConfig.bVoxelSnapshots || bCompressIdleChunks;
+    bReleaseIdleChunkMeshes = MapConfig.bReleaseIdleChunkMeshes;
+    IdleChunkSeconds = FMath::Max(MapConfig.IdleChunkSeconds, 0.f);
+    MaxChunksCompressedPerTick = FMath::Max(MapConfig.MaxChunksCompressedPerTick, 1);
+
+    Scheduler.bAsync = MapConfig.bAsyncScheduledTriangulation;
+    Scheduler.MaxChunksInFlight = MapConfig.MaxScheduledChunksInFlight;
+    Streamer.StreamingRadius = MapConfig.StreamingRadius;
+    Streamer.MemoryBudget = static_cast<int64>(MapConfig.StreamingMemoryBudgetMB * 1024.f * 1024.f);
+    Streamer.bKeepEvictedMeshes = MapConfig.bKeepEvictedMeshes;
+    Streamer.MaxPendingLoads = FMath::Max(MapConfig.MaxPendingChunkLoads, 1);
     SurfaceStates = MapConfig.States;
 
     check(ChunkResolution > 0);
@@ -227,421 +660,2715 @@ void FMQCMap::InitializeSettings(const FMQCMapConfig& MapConfig)
 
     Clear();
 
-    Chunks.SetNumUninitialized(ChunkResolution * ChunkResolution);
+    if (bVoxelSnapshots)
+    {
+        SnapshotEpochs = MakeUnique<FMQCSnapshotEpochs>();
+    }
+
+    {
+        FWriteScopeLock TreeLock(ChunkTreeLock);
+        ChunkTree.Reset(ChunkResolution);
+    }
+
+    // Create shared empty voxel block of sparse chunks
 
-    for (int32 i=0; i<Chunks.Num(); ++i)
+    if (bSparseChunks)
     {
-        Chunks[i] = new FMQCGridChunk;
+        const int32 VoxelStride = bHaloVoxels ? VoxelResolution+1 : VoxelResolution;
+
+        EmptyVoxels.SetNumZeroed(VoxelStride * VoxelStride);
+
+        for (int32 y=0, i=0; y<VoxelStride; y++)
+        for (int32 x=0     ; x<VoxelStride; x++, i++)
+        {
+            EmptyVoxels[i].Set(x, y);
+        }
     }
+
+    // Create empty chunk page table. Power of two pages aligned to the
+    // chunk grid keep page-major Z-order equal to map chunk Z-order.
+
+    ChunkPageResolution = FMath::Min(8, static_cast<int32>(FMath::RoundUpToPowerOfTwo(ChunkResolution)));
+    ChunkPageDimension = (ChunkResolution + ChunkPageResolution - 1) / ChunkPageResolution;
+    ChunkPages.SetNum(ChunkPageDimension * ChunkPageDimension);
+}
+
+void FMQCMap::GetChunkConfig(FMQCChunkConfig& OutConfig, int32 ChunkX, int32 ChunkY) const
+{
+    OutConfig.States = SurfaceStates;
+    OutConfig.Position = FIntPoint(ChunkX * VoxelResolution, ChunkY * VoxelResolution);
+    OutConfig.MapSize = GetVoxelDimension();
+    OutConfig.VoxelResolution = VoxelResolution;
+    OutConfig.MaxFeatureAngle = MaxFeatureAngle;
+    OutConfig.MaxParallelAngle = MaxParallelAngle;
+    OutConfig.ExtrusionHeight = ExtrusionHeight;
+    OutConfig.MaterialType = MaterialType;
+    OutConfig.bHaloVoxels = bHaloVoxels;
+    OutConfig.SnapshotEpochs = SnapshotEpochs.Get();
+    OutConfig.EdgeDataFutures = &EdgeDataFutures;
+    OutConfig.GeometryRestoreQueue = &GeometryRestoreQueue;
+    OutConfig.EmptyVoxels = bSparseChunks ? EmptyVoxels.GetData() : nullptr;
 }
 
-void FMQCMap::InitializeChunk(int32 i, int32 x, int32 y)
+void FMQCMap::CreateChunkPage(int32 PageX, int32 PageY)
 {
-    check(Chunks.IsValidIndex(i));
+    MQC_LLM_SCOPE();
 
-    // Initialize chunk
+    const int32 PageIndex = PageX + PageY * ChunkPageDimension;
+    const int32 PageSize = ChunkPageResolution * ChunkPageResolution;
 
-    FIntPoint ChunkPosition(x * VoxelResolution, y * VoxelResolution);
+    check(ChunkPages.IsValidIndex(PageIndex));
+    check(ChunkPages[PageIndex].Load() == nullptr);
 
-    FMQCChunkConfig ChunkConfig;
-    ChunkConfig.States = SurfaceStates;
-    ChunkConfig.Position = ChunkPosition;
-    ChunkConfig.MapSize = GetVoxelDimension();
-    ChunkConfig.VoxelResolution = VoxelResolution;
-    ChunkConfig.MaxFeatureAngle = MaxFeatureAngle;
-    ChunkConfig.MaxParallelAngle = MaxParallelAngle;
-    ChunkConfig.ExtrusionHeight = ExtrusionHeight;
-    ChunkConfig.MaterialType = MaterialType;
+    // Edge data resolution iterates created chunks
+    WaitForEdgeResolution();
 
-    // Link chunk neighbours
+    // Configure page chunks within the map chunk layout,
+    // page slots are ordered by page local Z-order code
 
-    FMQCGridChunk& Chunk(*Chunks[i]);
+    FMQCGridChunk* Page = new FMQCGridChunk[PageSize];
+    TArray<int32> PageChunkIndices;
 
-    if (x > 0)
+    for (int32 Slot=0; Slot<PageSize; ++Slot)
     {
-        Chunks[i - 1]->SetNeighbourX(&Chunk);
+        int32 LocalX = 0;
+        int32 LocalY = 0;
+
+        for (int32 Bit=0; (1 << (Bit*2)) < PageSize; ++Bit)
+        {
+            LocalX |= ((Slot >> (Bit*2  )) & 1) << Bit;
+            LocalY |= ((Slot >> (Bit*2+1)) & 1) << Bit;
+        }
+
+        const int32 ChunkX = PageX * ChunkPageResolution + LocalX;
+        const int32 ChunkY = PageY * ChunkPageResolution + LocalY;
+
+        if (ChunkX < ChunkResolution && ChunkY < ChunkResolution)
+        {
+            FMQCChunkConfig ChunkConfig;
+            GetChunkConfig(ChunkConfig, ChunkX, ChunkY);
+            Page[Slot].Configure(ChunkConfig);
+
+            PageChunkIndices.Emplace(GetChunkIndex(ChunkX, ChunkY));
+        }
     }
 
-    if (y > 0)
+    // Insert page chunks into the traversal order, page chunks are
+    // contiguous in Z-order. Dense maps create pages in Z-order.
+
+    const uint32 PageCode = GetMortonCode(PageX * ChunkPageResolution, PageY * ChunkPageResolution);
+    int32 InsertIndex = ChunkOrder.Num();
+
+    while (InsertIndex > 0)
     {
-        Chunks[i - ChunkResolution]->SetNeighbourY(&Chunk);
+        const int32 PrevIndex = ChunkOrder[InsertIndex-1];
 
-        if (x > 0)
+        if (GetMortonCode(PrevIndex % ChunkResolution, PrevIndex / ChunkResolution) < PageCode)
         {
-            Chunks[i - ChunkResolution - 1]->SetNeighbourXY(&Chunk);
+            break;
         }
+
+        --InsertIndex;
     }
 
-    Chunk.Configure(ChunkConfig);
-}
+    ChunkOrder.Insert(PageChunkIndices, InsertIndex);
 
-void FMQCMap::InitializeChunks()
-{
-    check(Chunks.Num() == (ChunkResolution * ChunkResolution));
+    // Publish configured page to lock-free readers
+    ChunkPages[PageIndex].Store(Page);
+
+    // Created chunks are LOD 0, update seams against neighbours
+    // of a different LOD
 
-    for (int32 y=0, i=0; y<ChunkResolution; y++)
-    for (int32 x=0     ; x<ChunkResolution; x++, i++)
+    for (int32 ChunkIndex : PageChunkIndices)
     {
-        InitializeChunk(i, x, y);
+        UpdateChunkLODSeams(ChunkIndex % ChunkResolution, ChunkIndex / ChunkResolution);
     }
 }
 
-void FMQCMap::Initialize(const FMQCMapConfig& MapConfig)
+FMQCGridChunk& FMQCMap::CreateChunk(int32 ChunkX, int32 ChunkY)
 {
-    InitializeSettings(MapConfig);
-    InitializeChunks();
-}
+    const int32 ChunkIndex = GetChunkIndex(ChunkX, ChunkY);
 
-void FMQCMap::Clear()
-{
-    for (FMQCGridChunk* Chunk : Chunks)
+    if (FMQCGridChunk* Chunk = FindChunk(ChunkIndex))
     {
-        delete Chunk;
+        return *Chunk;
     }
 
-    Chunks.Empty();
+    CreateChunkPage(ChunkX / ChunkPageResolution, ChunkY / ChunkPageResolution);
+
+    return GetChunk(ChunkIndex);
 }
 
-void FMQCMap::ResetChunkStates(const TArray<int32>& ChunkIndices)
+void FMQCMap::LinkChunkNeighbours(int32 ChunkX, int32 ChunkY)
 {
-    for (int32 i : ChunkIndices)
+    const int32 i = GetChunkIndex(ChunkX, ChunkY);
+    FMQCGridChunk& Chunk(GetChunk(i));
+
+    if (ChunkX > 0)
+    {
+        GetChunk(i - 1).SetNeighbourX(&Chunk);
+    }
+
+    if (ChunkY > 0)
     {
-        if (Chunks.IsValidIndex(i))
+        GetChunk(i - ChunkResolution).SetNeighbourY(&Chunk);
+
+        if (ChunkX > 0)
         {
-            Chunks[i]->ResetVoxels();
+            GetChunk(i - ChunkResolution - 1).SetNeighbourXY(&Chunk);
         }
     }
 }
 
-void FMQCMap::ResetAllChunkStates()
+void FMQCMap::MarkChunkAccessed(int32 ChunkIndex) const
 {
-    for (FMQCGridChunk* Chunk : Chunks)
+    if (const FMQCGridChunk* Chunk = FindChunk(ChunkIndex))
     {
-        Chunk->ResetVoxels();
+        Chunk->MarkAccessed();
     }
 }
 
-void FMQCMap::AddGeometry(const TArray<FVector2D>& Points, const TArray<int32>& Indices, int32 ChunkIndex, int32 StateIndex, bool bExtrudeGeometry)
+void FMQCMap::AllocateChunk(int32 ChunkX, int32 ChunkY)
 {
-    const int32 PointCount = Points.Num();
-    const int32 IndexCount = Indices.Num();
-    const int32 TriangleCount = IndexCount / 3;
+    FMQCGridChunk& Chunk(CreateChunk(ChunkX, ChunkY));
 
-    if (PointCount < 3 || IndexCount < 3 || ! HasChunk(ChunkIndex))
+    if (Chunk.IsAllocated())
     {
         return;
     }
 
-    // Generate point materials
+    const int32 ChunkIndex = GetChunkIndex(ChunkX, ChunkY);
 
-    TArray<uint32> MappedVertexIndices;
-    MappedVertexIndices.SetNumUninitialized(PointCount);
+    // Surfaces are kept once created, released chunks only reallocate voxels
+    if (! Chunk.HasSurface(0))
+    {
+        FMQCChunkConfig ChunkConfig;
+        GetChunkConfig(ChunkConfig, ChunkX, ChunkY);
+        Chunk.AllocateSurfaces(ChunkConfig);
+    }
 
-    FMQCGridChunk& TargetChunk(GetChunk(ChunkIndex));
-    FVector2D ChunkOffset(TargetChunk.GetOffsetId());
+    Chunk.AllocateVoxels();
 
-    for (int32 i=0; i<PointCount; ++i)
+    if (bStreamChunks)
     {
-        const FVector2D& Position(Points[i]);
-        const FIntPoint Point = Position.IntPoint();
-        FMQCMaterial Material = GetVoxelMaterial(Point);
+        Streamer.RestoreChunk(ChunkIndex, Chunk);
+    }
+
+    Chunk.UpdateUniformState();
 
-        MappedVertexIndices[i] = TargetChunk.AddVertex(Position-ChunkOffset, Material, StateIndex, bExtrudeGeometry);
+    {
+        FWriteScopeLock TreeLock(ChunkTreeLock);
+        ChunkTree.SetChunkState(ChunkX, ChunkY, Chunk.IsUniformState(), Chunk.GetUniformState());
     }
 
-    for (int32 ti=0; ti<TriangleCount; ++ti)
+    // Link allocated neighbours only. Unallocated neighbours are empty and
+    // border chunks that have never been edited, their shared border cells
+    // have no geometry and are skipped as map border cells.
+
+    auto GetAllocatedChunk = [this](int32 X, int32 Y) -> FMQCGridChunk*
     {
-        const int32 i = ti*3;
-        const int32 a = MappedVertexIndices[Indices[i  ]];
-        const int32 b = MappedVertexIndices[Indices[i+1]];
-        const int32 c = MappedVertexIndices[Indices[i+2]];
+        if (X < 0 || Y < 0 || X >= ChunkResolution || Y >= ChunkResolution)
+        {
+            return nullptr;
+        }
 
-        TargetChunk.AddFace(a, b, c, StateIndex, bExtrudeGeometry);
+        FMQCGridChunk* Neighbour = FindChunk(GetChunkIndex(X, Y));
+        return (Neighbour && Neighbour->IsAllocated()) ? Neighbour : nullptr;
+    };
+
+    Chunk.SetNeighbourX(GetAllocatedChunk(ChunkX+1, ChunkY));
+    Chunk.SetNeighbourY(GetAllocatedChunk(ChunkX, ChunkY+1));
+    Chunk.SetNeighbourXY(GetAllocatedChunk(ChunkX+1, ChunkY+1));
+
+    // Neighbour links must not change during neighbour triangulation
+
+    if (FMQCGridChunk* Neighbour = GetAllocatedChunk(ChunkX-1, ChunkY))
+    {
+        Neighbour->WaitForAsyncTask();
+        Neighbour->SetNeighbourX(&Chunk);
     }
-}
 
-void FMQCMap::AddQuadFilter(const FIntPoint& Point, int32 StateIndex, bool bExtrudeGeometry)
-{
-    if (IsWithinDimension(Point.X, Point.Y))
+    if (FMQCGridChunk* Neighbour = GetAllocatedChunk(ChunkX, ChunkY-1))
     {
-        int32 ChunkIndex = GetChunkIndexByPoint(Point.X, Point.Y);
-        GetChunk(ChunkIndex).AddQuadFilter(Point, StateIndex, bExtrudeGeometry);
+        Neighbour->WaitForAsyncTask();
+        Neighbour->SetNeighbourY(&Chunk);
+    }
+
+    if (FMQCGridChunk* Neighbour = GetAllocatedChunk(ChunkX-1, ChunkY-1))
+    {
+        Neighbour->WaitForAsyncTask();
+        Neighbour->SetNeighbourXY(&Chunk);
     }
 }
 
-int32 FMQCMap::GetEdgePointListCount(int32 StateIndex) const
+FMQCGridChunk& FMQCMap::GetChunkForEdit(int32 ChunkIndex)
 {
-    return EdgeSyncGroups.IsValidIndex(StateIndex)
-        ? EdgeSyncGroups[StateIndex].Num()
-        : 0;
+    if (bSparseChunks)
+    {
+        const int32 ChunkX = ChunkIndex % ChunkResolution;
+        const int32 ChunkY = ChunkIndex / ChunkResolution;
+
+        // Edited chunks read upper neighbour voxels for border crossings,
+        // lower neighbours triangulate cells sharing edited border voxels.
+        // Every edited chunk is surrounded by allocated chunks.
+
+        for (int32 y=FMath::Max(ChunkY-1, 0); y<=FMath::Min(ChunkY+1, ChunkResolution-1); ++y)
+        for (int32 x=FMath::Max(ChunkX-1, 0); x<=FMath::Min(ChunkX+1, ChunkResolution-1); ++x)
+        {
+            AllocateChunk(x, y);
+        }
+
+        if (bStreamChunks)
+        {
+            Streamer.TouchChunk(ChunkIndex);
+        }
+    }
+
+    return GetChunk(ChunkIndex);
 }
 
-void FMQCMap::GetEdgePoints(TArray<FMQCEdgePointList>& OutPointList, int32 StateIndex) const
+void FMQCMap::MakeChunkResident(int32 ChunkIndex)
 {
-    // Invalid state, abort
-    if (! EdgeSyncGroups.IsValidIndex(StateIndex))
+    if (bSparseChunks && HasChunk(ChunkIndex))
+    {
+        AllocateChunk(ChunkIndex % ChunkResolution, ChunkIndex / ChunkResolution);
+    }
+}
+
+void FMQCMap::ReleaseExpandedCompactGeometry(int32 ChunkIndex)
+{
+    FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+
+    if (Chunk && Chunk->IsAsyncTaskComplete() && IsEdgeResolutionComplete())
+    {
+        Chunk->ReleaseExpandedCompactGeometry();
+    }
+}
+
+void FMQCMap::ReleaseChunk(int32 ChunkIndex, bool bReleaseGeometry)
+{
+    FMQCGridChunk* ChunkPtr = bSparseChunks ? FindChunk(ChunkIndex) : nullptr;
+
+    if (! ChunkPtr || ! ChunkPtr->IsAllocated())
     {
         return;
     }
 
-    const FStateEdgeSyncList& EdgeSyncs(EdgeSyncGroups[StateIndex]);
+    const int32 ChunkX = ChunkIndex % ChunkResolution;
+    const int32 ChunkY = ChunkIndex / ChunkResolution;
 
-    OutPointList.Reset();
-    OutPointList.SetNum(EdgeSyncs.Num(), true);
+    FMQCGridChunk& Chunk(*ChunkPtr);
+
+    Scheduler.CancelChunk(ChunkIndex);
 
-    for (int32 i=0; i<EdgeSyncs.Num(); ++i)
+    // Unlink lower neighbours linked to the released chunk
+
+    auto UnlinkNeighbour = [this](int32 X, int32 Y) -> FMQCGridChunk*
     {
-        const FEdgeSyncList& SyncList(EdgeSyncs[i]);
-        FMQCEdgePointList& Points(OutPointList[i]);
+        if (X < 0 || Y < 0)
+        {
+            return nullptr;
+        }
+
+        FMQCGridChunk* Neighbour = FindChunk(GetChunkIndex(X, Y));
 
-        // Generate connected edge point list
-        for (const FMQCEdgeSyncData& SyncData : SyncList)
+        if (Neighbour)
         {
-            const FMQCGridChunk& Chunk(GetChunk(SyncData.ChunkIndex));
-            Chunk.AppendConnectedEdgePoints(Points, StateIndex, SyncData.EdgeListIndex);
+            Neighbour->WaitForAsyncTask();
         }
+
+        return Neighbour;
+    };
+
+    if (FMQCGridChunk* Neighbour = UnlinkNeighbour(ChunkX-1, ChunkY))
+    {
+        Neighbour->SetNeighbourX(nullptr);
+    }
+
+    if (FMQCGridChunk* Neighbour = UnlinkNeighbour(ChunkX, ChunkY-1))
+    {
+        Neighbour->SetNeighbourY(nullptr);
+    }
+
+    if (FMQCGridChunk* Neighbour = UnlinkNeighbour(ChunkX-1, ChunkY-1))
+    {
+        Neighbour->SetNeighbourXY(nullptr);
     }
+
+    Chunk.WaitForAsyncTask();
+    Chunk.SetNeighbourX(nullptr);
+    Chunk.SetNeighbourY(nullptr);
+    Chunk.SetNeighbourXY(nullptr);
+    Chunk.ReleaseVoxels(bReleaseGeometry);
+
+    FWriteScopeLock TreeLock(ChunkTreeLock);
+    ChunkTree.SetChunkState(ChunkX, ChunkY, true, 0);
 }
 
-void FMQCMap::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex) const
+int32 FMQCMap::TickStreaming()
 {
-    // Invalid edge list index, abort
-    if (! EdgeSyncGroups.IsValidIndex(StateIndex) ||
-        ! EdgeSyncGroups[StateIndex].IsValidIndex(EdgeListIndex)
-        )
+    if (! bStreamChunks)
     {
-        return;
+        return 0;
     }
 
-    const FEdgeSyncList& SyncList(EdgeSyncGroups[StateIndex][EdgeListIndex]);
+    const int32 LastEvictedCount = Streamer.GetEvictedCount();
+    const int32 LoadedCount = Streamer.Tick();
 
-    // Generate connected edge points
-    for (const FMQCEdgeSyncData& SyncData : SyncList)
+    // Loaded chunks and lower neighbours linked to them are retriangulated
+    if (LoadedCount > 0)
     {
-        const FMQCGridChunk& Chunk(GetChunk(SyncData.ChunkIndex));
-        Chunk.AppendConnectedEdgePoints(OutPoints, StateIndex, SyncData.EdgeListIndex);
+        Scheduler.RequestEditedChunks(Streamer.GetLoadedChunks());
     }
-}
 
-void FMQCMap::GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex) const
-{
-    if (Chunks.IsValidIndex(ChunkIndex))
+    if (! Streamer.bKeepEvictedMeshes && Streamer.GetEvictedCount() != LastEvictedCount)
     {
-        GetChunk(ChunkIndex).GetEdgePoints(OutPointList, StateIndex);
+        BroadcastGeometryChanges();
     }
+
+    return LoadedCount;
 }
 
-FMQCMaterial FMQCMap::GetVoxelMaterial(const FIntPoint& Position) const
+int32 FMQCMap::TickChunkCompression()
 {
-    int32 X = FMath::Clamp(Position.X, 0, GetVoxelDimension()-1);
-    int32 Y = FMath::Clamp(Position.Y, 0, GetVoxelDimension()-1);
-    int32 ChunkIndex = GetChunkIndexByPoint(X, Y);
-    return GetChunk(ChunkIndex).GetVoxelMaterial(X, Y);
-}
+    // Chunks are read by map-wide async triangulation, abort.
+    // Working voxels are only released with published snapshots.
+    if (! bCompressIdleChunks || ! SnapshotEpochs.IsValid() || ChunkOrder.Num() < 1 || bRequireFinalizeAsync)
+    {
+        return 0;
+    }
 
-// ----------------------------------------------------------------------------
+    const uint64 Cycles = FPlatformTime::Cycles64();
+    const int32 ChunkCount = ChunkOrder.Num();
+    int32 CompressedCount = 0;
 
-// MAP SETTINGS FUNCTIONS
+    // Lower neighbours read chunk voxels during triangulation
 
-void UMQCMapRef::InitializeVoxelMap()
-{
-    VoxelMap.Initialize(MapConfig);
+    auto IsNeighbourTaskComplete = [this](int32 X, int32 Y)
+    {
+        const FMQCGridChunk* Neighbour = (X < 0 || Y < 0) ? nullptr : FindChunk(GetChunkIndex(X, Y));
+        return ! Neighbour || Neighbour->IsAsyncTaskComplete();
+    };
+
+    // Visit created chunks round robin in traversal order, idle
+    // chunks past the per tick limit are compressed on later ticks
+
+    for (int32 n=0; n<ChunkCount && CompressedCount<MaxChunksCompressedPerTick; ++n)
+    {
+        CompressionCursor = (CompressionCursor+1) % ChunkCount;
+
+        const int32 ChunkIndex = ChunkOrder[CompressionCursor];
+        const int32 ChunkX = ChunkIndex % ChunkResolution;
+        const int32 ChunkY = ChunkIndex / ChunkResolution;
+
+        FMQCGridChunk& Chunk(GetChunk(ChunkIndex));
+
+        if (! Chunk.IsAllocated() ||
+            Chunk.IsCompressed() ||
+            Chunk.GetIdleTime(Cycles) < IdleChunkSeconds ||
+            Scheduler.IsChunkScheduled(ChunkIndex)
+            )
+        {
+            continue;
+        }
+
+        if (! Chunk.IsAsyncTaskComplete() ||
+            ! IsNeighbourTaskComplete(ChunkX-1, ChunkY) ||
+            ! IsNeighbourTaskComplete(ChunkX, ChunkY-1) ||
+            ! IsNeighbourTaskComplete(ChunkX-1, ChunkY-1)
+            )
+        {
+            continue;
+        }
+
+        if (Chunk.CompressVoxels(bReleaseIdleChunkMeshes))
+        {
+            ++CompressedCount;
+        }
+        else
+        {
+            // Incompressible voxels, retry once the chunk is idle again
+            Chunk.MarkAccessed();
+        }
+    }
+
+    INC_DWORD_STAT_BY(STAT_MQC_ChunksCompressed, CompressedCount);
+
+    if (CompressedCount > 0)
+    {
+        UpdateMemoryStats();
+    }
+
+    return CompressedCount;
 }
 
-// TRIANGULATION FUNCTIONS
+void FMQCMap::GetCompressionStats(FMQCCompressionStats& OutStats) const
+{
+    for (int32 ChunkIndex : ChunkOrder)
+    {
+        GetChunk(ChunkIndex).GetCompressionStats(OutStats);
+    }
+}
 
-void UMQCMapRef::ClearVoxelMap()
+int32 FMQCMap::GetAllocatedChunkCount() const
 {
-    VoxelMap.Clear();
+    int32 AllocatedCount = 0;
+
+    for (int32 ChunkIndex : ChunkOrder)
+    {
+        if (GetChunk(ChunkIndex).IsAllocated())
+        {
+            ++AllocatedCount;
+        }
+    }
+
+    return AllocatedCount;
 }
 
-void UMQCMapRef::Triangulate()
+void FMQCMap::UpdateChunkRegions(const TArray<int32>& ChunkIndices)
 {
-    VoxelMap.Triangulate();
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        if (FMQCGridChunk* ChunkPtr = FindChunk(ChunkIndex))
+        {
+            FMQCGridChunk& Chunk(*ChunkPtr);
+            Chunk.UpdateUniformState();
+
+            FWriteScopeLock TreeLock(ChunkTreeLock);
+
+            ChunkTree.SetChunkState(
+                ChunkIndex % ChunkResolution,
+                ChunkIndex / ChunkResolution,
+                Chunk.IsUniformState(),
+                Chunk.GetUniformState()
+                );
+        }
+    }
 }
 
-void UMQCMapRef::TriangulateAsync()
+void FMQCMap::GetChunkRegions(TArray<FMQCChunkRegion>& OutRegions, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax) const
 {
-    VoxelMap.TriangulateAsync();
+    const FIntPoint ChunkMin(
+        FMath::Max(BoundsMin.X, 0) / VoxelResolution,
+        FMath::Max(BoundsMin.Y, 0) / VoxelResolution
+        );
+    const FIntPoint ChunkMax(BoundsMax / VoxelResolution);
+
+    FReadScopeLock TreeLock(ChunkTreeLock);
+    ChunkTree.GetRegions(OutRegions, ChunkMin, ChunkMax);
 }
 
-void UMQCMapRef::WaitForAsyncTask()
+void FMQCMap::InitializeChunks()
 {
-    VoxelMap.WaitForAsyncTask();
+    check(ChunkPages.Num() == (ChunkPageDimension * ChunkPageDimension));
+
+    // Sparse chunk objects are created once allocated
+    if (! bSparseChunks)
+    {
+        // Create all chunk pages in Z-order
+
+        TArray<int32> PageOrder;
+        PageOrder.SetNumUninitialized(ChunkPages.Num());
+
+        for (int32 i=0; i<PageOrder.Num(); ++i)
+        {
+            PageOrder[i] = i;
+        }
+
+        PageOrder.Sort([this](int32 A, int32 B)
+        {
+            return GetMortonCode(A % ChunkPageDimension, A / ChunkPageDimension) <
+                   GetMortonCode(B % ChunkPageDimension, B / ChunkPageDimension);
+        } );
+
+        for (int32 PageIndex : PageOrder)
+        {
+            CreateChunkPage(PageIndex % ChunkPageDimension, PageIndex / ChunkPageDimension);
+        }
+
+        // Link chunk neighbours
+
+        for (int32 y=0; y<ChunkResolution; y++)
+        for (int32 x=0; x<ChunkResolution; x++)
+        {
+            LinkChunkNeighbours(x, y);
+        }
+    }
+
+    Scheduler.Reset();
+    ScheduledCompletedCount = 0;
+    Streamer.Reset(StreamingStoreDirectory, StreamingStoreId);
 }
 
-void UMQCMapRef::FinalizeAsync()
+void FMQCMap::Initialize(const FMQCMapConfig& MapConfig)
 {
-    VoxelMap.FinalizeAsync();
+    MQC_LLM_SCOPE();
+
+    InitializeSettings(MapConfig);
+    InitializeChunks();
+    UpdateMemoryStats();
 }
 
-void UMQCMapRef::ResetChunkStates(const TArray<int32>& ChunkIndices)
+void FMQCMap::Clear()
 {
-    if (IsInitialized())
+    WaitForAsyncTask();
+    EdgeDataFutures.Empty();
+    EdgeDataBroadcastFuture = TSharedFuture<void>();
+    GeometryRestoreQueue.Empty();
+
+    for (TAtomic<FMQCGridChunk*>& Page : ChunkPages)
     {
-        VoxelMap.ResetChunkStates(ChunkIndices);
+        delete[] Page.Exchange(nullptr);
+    }
+
+    ChunkPages.Empty();
+    ChunkOrder.Empty();
+    EdgeSyncGroups.Empty();
+    EmptyVoxels.Empty();
+
+    {
+        FWriteScopeLock TreeLock(ChunkTreeLock);
+        ChunkTree.Reset(0);
     }
+    Scheduler.Reset();
+    ScheduledCompletedCount = 0;
+    Streamer.Reset();
+    CompressionCursor = 0;
+
+    // Chunks release their published snapshots, release retired snapshots
+    SnapshotEpochs.Reset();
+
+    UpdateMemoryStats();
 }
 
-void UMQCMapRef::ResetAllChunkStates()
+void FMQCMap::ResetChunkStates(const TArray<int32>& ChunkIndices)
 {
-    if (IsInitialized())
+    if (Recorder)
     {
-        VoxelMap.ResetAllChunkStates();
+        Recorder->RecordResetChunkStates(ChunkIndices);
     }
-}
 
-// CHUNK & SECTION FUNCTIONS
+    for (int32 i : ChunkIndices)
+    {
+        if (FMQCGridChunk* Chunk = FindChunk(i))
+        {
+            Chunk->ResetVoxels();
+        }
+    }
 
-FVector UMQCMapRef::GetChunkPosition(int32 ChunkIndex) const
-{
-    return HasChunk(ChunkIndex)
-        ? FVector(VoxelMap.GetChunk(ChunkIndex).GetOffsetId(), 0.f)
-        : FVector(ForceInitToZero);
+    UpdateChunkRegions(ChunkIndices);
 }
 
-FPMUMeshSectionRef UMQCMapRef::GetSurfaceSection(int32 ChunkIndex, int32 StateIndex)
+void FMQCMap::ResetAllChunkStates()
 {
-    if (HasChunk(ChunkIndex))
+    if (Recorder)
     {
-        FMQCGridChunk& Chunk(VoxelMap.GetChunk(ChunkIndex));
-        return FPMUMeshSectionRef(*Chunk.GetSurfaceSection(StateIndex));
+        Recorder->RecordResetAllChunkStates();
     }
-    else
+
+    for (int32 ChunkIndex : ChunkOrder)
     {
-        return FPMUMeshSectionRef();
+        GetChunk(ChunkIndex).ResetVoxels();
     }
+
+    FWriteScopeLock TreeLock(ChunkTreeLock);
+    ChunkTree.Reset(ChunkResolution);
 }
 
-FPMUMeshSectionRef UMQCMapRef::GetExtrudeSection(int32 ChunkIndex, int32 StateIndex)
+void FMQCMap::GetClusterChunkIndices(TArray<int32>& OutChunkIndices, int32 ClusterIndex) const
 {
-    if (HasChunk(ChunkIndex))
+    const int32 ClusterDimension = GetClusterDimension();
+
+    if (ClusterIndex < 0 || ClusterIndex >= GetClusterCount())
     {
-        FMQCGridChunk& Chunk(VoxelMap.GetChunk(ChunkIndex));
-        return FPMUMeshSectionRef(*Chunk.GetExtrudeSection(StateIndex));
+        return;
     }
-    else
+
+    const int32 ChunkMinX = (ClusterIndex % ClusterDimension) * ClusterResolution;
+    const int32 ChunkMinY = (ClusterIndex / ClusterDimension) * ClusterResolution;
+    const int32 ChunkMaxX = FMath::Min(ChunkMinX+ClusterResolution, ChunkResolution);
+    const int32 ChunkMaxY = FMath::Min(ChunkMinY+ClusterResolution, ChunkResolution);
+
+    for (int32 y=ChunkMinY; y<ChunkMaxY; ++y)
+    for (int32 x=ChunkMinX; x<ChunkMaxX; ++x)
     {
-        return FPMUMeshSectionRef();
+        OutChunkIndices.Emplace(GetChunkIndex(x, y));
     }
 }
 
-void UMQCMapRef::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex)
+int32 FMQCMap::GetMaxLODLevel() const
 {
-    if (IsInitialized())
+    return FMQCGridChunk::GetMaxLODLevel(VoxelResolution);
+}
+
+int32 FMQCMap::GetChunkLOD(int32 ChunkIndex) const
+{
+    const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+    return Chunk ? Chunk->GetLODLevel() : 0;
+}
+
+int32 FMQCMap::GetChunkLODByCoord(int32 ChunkX, int32 ChunkY) const
+{
+    const bool bValidCoord = (
+        ChunkX >= 0 && ChunkX < ChunkResolution &&
+        ChunkY >= 0 && ChunkY < ChunkResolution
+        );
+
+    return bValidCoord
+        ? GetChunkLOD(GetChunkIndex(ChunkX, ChunkY))
+        : 0;
+}
+
+void FMQCMap::UpdateChunkLODSeams(int32 ChunkX, int32 ChunkY)
+{
+    if (ChunkX < 0 || ChunkX >= ChunkResolution ||
+        ChunkY < 0 || ChunkY >= ChunkResolution)
+    {
+        return;
+    }
+
+    FMQCGridChunk* ChunkPtr = FindChunk(GetChunkIndex(ChunkX, ChunkY));
+
+    // Chunks without chunk object are LOD 0
+    if (! ChunkPtr)
     {
-        VoxelMap.GetEdgePoints(OutPoints, StateIndex, EdgeListIndex);
+        return;
     }
+
+    FMQCGridChunk& Chunk(*ChunkPtr);
+    const int32 LODLevel = Chunk.GetLODLevel();
+
+    // Shared chunk borders use the lower detail level of both chunks
+
+    Chunk.SetLOD(
+        LODLevel,
+        FMath::Max(LODLevel, GetChunkLODByCoord(ChunkX-1, ChunkY  )),
+        FMath::Max(LODLevel, GetChunkLODByCoord(ChunkX  , ChunkY-1)),
+        FMath::Max(LODLevel, GetChunkLODByCoord(ChunkX+1, ChunkY  )),
+        FMath::Max(LODLevel, GetChunkLODByCoord(ChunkX  , ChunkY+1))
+        );
 }
 
-void UMQCMapRef::GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex)
+void FMQCMap::SetChunkLOD(int32 ChunkIndex, int32 LODLevel)
 {
-    if (IsInitialized())
+    if (! HasChunk(ChunkIndex))
+    {
+        return;
+    }
+
+    const int32 TargetLOD = FMath::Clamp(LODLevel, 0, GetMaxLODLevel());
+
+    // Chunks without chunk object are LOD 0
+    if (GetChunkLOD(ChunkIndex) == TargetLOD)
     {
-        VoxelMap.GetEdgePointsByChunkSurface(OutPointList, ChunkIndex, StateIndex);
+        return;
     }
+
+    FMQCGridChunk& Chunk(CreateChunk(ChunkIndex % ChunkResolution, ChunkIndex / ChunkResolution));
+
+    Chunk.SetLOD(TargetLOD, TargetLOD, TargetLOD, TargetLOD, TargetLOD);
+
+    // Update chunk and neighbour chunk borders,
+    // chunks require re-triangulation to apply changes
+
+    const int32 ChunkX = ChunkIndex % ChunkResolution;
+    const int32 ChunkY = ChunkIndex / ChunkResolution;
+
+    UpdateChunkLODSeams(ChunkX  , ChunkY  );
+    UpdateChunkLODSeams(ChunkX-1, ChunkY  );
+    UpdateChunkLODSeams(ChunkX+1, ChunkY  );
+    UpdateChunkLODSeams(ChunkX  , ChunkY-1);
+    UpdateChunkLODSeams(ChunkX  , ChunkY+1);
 }
 
-void UMQCMapRef::AddQuadFilters(const TArray<FIntPoint>& Points, int32 StateIndex, bool bExtrudeGeometry)
+void FMQCMap::SetChunkLODs(const TArray<int32>& LODLevels)
 {
-    if (IsInitialized() && HasState(StateIndex))
+    const int32 MaxLODLevel = GetMaxLODLevel();
+    const int32 ChunkCount = FMath::Min(LODLevels.Num(), GetChunkCount());
+
+    // Chunk objects are only created for chunks not at LOD 0
+
+    for (int32 i=0; i<ChunkCount; ++i)
     {
-        for (const FIntPoint& Point : Points)
+        const int32 LODLevel = FMath::Clamp(LODLevels[i], 0, MaxLODLevel);
+
+        if (LODLevel != GetChunkLOD(i))
         {
-            VoxelMap.AddQuadFilter(Point, StateIndex, bExtrudeGeometry);
+            FMQCGridChunk& Chunk(CreateChunk(i % ChunkResolution, i / ChunkResolution));
+            Chunk.SetLOD(LODLevel, LODLevel, LODLevel, LODLevel, LODLevel);
         }
     }
+
+    for (int32 ChunkIndex : ChunkOrder)
+    {
+        UpdateChunkLODSeams(ChunkIndex % ChunkResolution, ChunkIndex / ChunkResolution);
+    }
 }
 
-void UMQCMapRef::AddQuadFiltersByBounds(const FIntPoint& BoundsMin, const FIntPoint& BoundsMax, int32 StateIndex, bool bExtrudeGeometry)
+void FMQCMap::AddGeometry(const TArray<FVector2D>& Points, const TArray<int32>& Indices, int32 ChunkIndex, int32 StateIndex, bool bExtrudeGeometry)
 {
-    if (IsInitialized() && HasState(StateIndex))
+    const int32 PointCount = Points.Num();
+    const int32 IndexCount = Indices.Num();
+    const int32 TriangleCount = IndexCount / 3;
+
+    FMQCGridChunk* TargetChunkPtr = FindChunk(ChunkIndex);
+
+    // Chunks without chunk object have no surfaces
+    if (PointCount < 3 || IndexCount < 3 || ! TargetChunkPtr)
     {
-        FIntPoint ClampedMin;
-        FIntPoint ClampedMax;
+        return;
+    }
 
-        ClampedMin.X = FMath::Clamp(BoundsMin.X, 0, GetVoxelDimension()-1);
-        ClampedMin.Y = FMath::Clamp(BoundsMin.Y, 0, GetVoxelDimension()-1);
-        ClampedMax.X = FMath::Clamp(BoundsMax.X, ClampedMin.X, GetVoxelDimension()-1);
-        ClampedMax.Y = FMath::Clamp(BoundsMax.Y, ClampedMin.Y, GetVoxelDimension()-1);
+    // Generate point materials
 
-        FIntPoint Point;
+    TArray<FIntPoint> MaterialPoints;
+    TArray<FMQCMaterial> Materials;
 
-        for (int32 y=ClampedMin.Y; y<=ClampedMax.Y; ++y)
-        for (int32 x=ClampedMin.X; x<=ClampedMax.X; ++x)
-        {
-            Point.X = x;
-            Point.Y = y;
-            VoxelMap.AddQuadFilter(Point, StateIndex, bExtrudeGeometry);
-        }
+    MaterialPoints.SetNumUninitialized(PointCount);
+
+    for (int32 i=0; i<PointCount; ++i)
+    {
+        MaterialPoints[i] = Points[i].IntPoint();
     }
-}
 
-// MAP ACTOR
+    GetVoxelMaterials(Materials, MaterialPoints);
 
-AMQCMap::AMQCMap()
-    : MapRef(nullptr)
-{
-    PrimaryActorTick.bCanEverTick = true;
+    // Add mapped vertices
+
+    TArray<uint32> MappedVertexIndices;
+    MappedVertexIndices.SetNumUninitialized(PointCount);
+
+    FMQCGridChunk& TargetChunk(*TargetChunkPtr);
+    FVector2D ChunkOffset(TargetChunk.GetOffsetId());
+
+    for (int32 i=0; i<PointCount; ++i)
+    {
+        MappedVertexIndices[i] = TargetChunk.AddVertex(Points[i]-ChunkOffset, Materials[i], StateIndex, bExtrudeGeometry);
+    }
+
+    for (int32 ti=0; ti<TriangleCount; ++ti)
+    {
+        const int32 i = ti*3;
+        const int32 a = MappedVertexIndices[Indices[i  ]];
+        const int32 b = MappedVertexIndices[Indices[i+1]];
+        const int32 c = MappedVertexIndices[Indices[i+2]];
+
+        TargetChunk.AddFace(a, b, c, StateIndex, bExtrudeGeometry);
+    }
+}
+
+void FMQCMap::AddQuadFilter(const FIntPoint& Point, int32 StateIndex, bool bExtrudeGeometry)
+{
+    if (IsWithinDimension(Point.X, Point.Y))
+    {
+        int32 ChunkIndex = GetChunkIndexByPoint(Point.X, Point.Y);
+
+        if (FMQCGridChunk* Chunk = FindChunk(ChunkIndex))
+        {
+            Chunk->AddQuadFilter(Point, StateIndex, bExtrudeGeometry);
+        }
+    }
+}
+
+int32 FMQCMap::GetEdgePointListCount(int32 StateIndex) const
+{
+    return EdgeSyncGroups.IsValidIndex(StateIndex)
+        ? EdgeSyncGroups[StateIndex].Num()
+        : 0;
+}
+
+void FMQCMap::GetEdgePoints(TArray<FMQCEdgePointList>& OutPointList, int32 StateIndex, bool bSimplified) const
+{
+    // Invalid state, abort
+    if (! EdgeSyncGroups.IsValidIndex(StateIndex))
+    {
+        return;
+    }
+
+    const int32 ListCount = EdgeSyncGroups[StateIndex].Num();
+
+    OutPointList.Reset();
+    OutPointList.SetNum(ListCount, true);
+
+    for (int32 i=0; i<ListCount; ++i)
+    {
+        GetEdgePoints(OutPointList[i], StateIndex, i, bSimplified);
+    }
+}
+
+void FMQCMap::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified) const
+{
+    FMQCConnectedEdgePointView View;
+
+    if (GetEdgePointView(View, StateIndex, EdgeListIndex, bSimplified))
+    {
+        OutPoints.Reserve(OutPoints.Num()+View.Num());
+
+        View.ForEachPoint([&OutPoints](const FVector2D& Point)
+        {
+            OutPoints.Emplace(Point);
+        } );
+    }
+}
+
+void FMQCMap::GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex, bool bSimplified) const
+{
+    if (const FMQCGridChunk* Chunk = FindChunk(ChunkIndex))
+    {
+        Chunk->GetEdgePoints(OutPointList, StateIndex, bSimplified);
+    }
+}
+
+const FPMUMeshSection* FMQCMap::GetSurfaceSection(int32 ChunkIndex, int32 StateIndex) const
+{
+    const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+    return Chunk ? Chunk->GetSurfaceSection(StateIndex) : nullptr;
+}
+
+const FPMUMeshSection* FMQCMap::GetExtrudeSection(int32 ChunkIndex, int32 StateIndex) const
+{
+    const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+    return Chunk ? Chunk->GetExtrudeSection(StateIndex) : nullptr;
+}
+
+bool FMQCMap::GetEdgePointView(FMQCConnectedEdgePointView& OutView, int32 StateIndex, int32 EdgeListIndex, bool bSimplified) const
+{
+    OutView.Reset();
+
+    // Invalid edge list index, abort
+    if (! EdgeSyncGroups.IsValidIndex(StateIndex) ||
+        ! EdgeSyncGroups[StateIndex].IsValidIndex(EdgeListIndex)
+        )
+    {
+        return false;
+    }
+
+    const FEdgeSyncList& SyncList(EdgeSyncGroups[StateIndex][EdgeListIndex]);
+
+    OutView.Views.Reserve(SyncList.Num());
+
+    // Gather connected chunk edge point views
+    for (const FMQCEdgeSyncData& SyncData : SyncList)
+    {
+        const FMQCGridChunk& Chunk(GetChunk(SyncData.ChunkIndex));
+        const FMQCEdgePointView View(Chunk.GetEdgePointView(StateIndex, SyncData.EdgeListIndex, bSimplified));
+
+        if (! View.IsEmpty())
+        {
+            OutView.Views.Emplace(View);
+        }
+    }
+
+    return OutView.Views.Num() > 0;
+}
+
+int32 FMQCMap::GetEdgePointViewsByChunkSurface(TArray<FMQCEdgePointView>& OutViews, int32 ChunkIndex, int32 StateIndex, bool bSimplified) const
+{
+    const FMQCGridChunk* ChunkPtr = FindChunk(ChunkIndex);
+
+    if (! ChunkPtr)
+    {
+        return 0;
+    }
+
+    const FMQCGridChunk& Chunk(*ChunkPtr);
+    const int32 ListCount = Chunk.GetEdgePointListCount(StateIndex, bSimplified);
+
+    OutViews.Reserve(OutViews.Num()+ListCount);
+
+    for (int32 i=0; i<ListCount; ++i)
+    {
+        OutViews.Emplace(Chunk.GetEdgePointView(StateIndex, i, bSimplified));
+    }
+
+    return ListCount;
+}
+
+FMQCMaterial FMQCMap::GetVoxelMaterial(const FIntPoint& Position) const
+{
+    FMQCSnapshotReadScope ReadScope(SnapshotEpochs.Get());
+
+    int32 X = FMath::Clamp(Position.X, 0, GetVoxelDimension()-1);
+    int32 Y = FMath::Clamp(Position.Y, 0, GetVoxelDimension()-1);
+    MarkChunkAccessed(GetChunkIndexByPoint(X, Y));
+    return GetVoxel(X, Y).GetMaterial();
+}
+
+uint8 FMQCMap::GetVoxelState(const FIntPoint& Position) const
+{
+    FMQCSnapshotReadScope ReadScope(SnapshotEpochs.Get());
+
+    int32 X = FMath::Clamp(Position.X, 0, GetVoxelDimension()-1);
+    int32 Y = FMath::Clamp(Position.Y, 0, GetVoxelDimension()-1);
+    MarkChunkAccessed(GetChunkIndexByPoint(X, Y));
+    return GetVoxel(X, Y).voxelState;
+}
+
+void FMQCMap::GenerateVoxelQueries(TArray<FVoxelQuery>& OutQueries, TArray<int32>& OutBinOffsets, const TArray<FIntPoint>& Positions) const
+{
+    const int32 QueryCount = Positions.Num();
+    const int32 ChunkCount = GetChunkCount();
+    const int32 MaxPoint = GetVoxelDimension()-1;
+    const int32 VoxelStride = bHaloVoxels ? VoxelResolution+1 : VoxelResolution;
+
+    TArray<FVoxelQuery> Queries;
+    TArray<int32> QueryChunkIndices;
+
+    Queries.SetNumUninitialized(QueryCount);
+    QueryChunkIndices.SetNumUninitialized(QueryCount);
+    OutBinOffsets.Reset();
+    OutBinOffsets.SetNumZeroed(ChunkCount+1);
+
+    // Find query chunk and voxel indices, count queries per chunk
+
+    for (int32 i=0; i<QueryCount; ++i)
+    {
+        const FIntPoint& Position(Positions[i]);
+        int32 X = FMath::Clamp(Position.X, 0, MaxPoint);
+        int32 Y = FMath::Clamp(Position.Y, 0, MaxPoint);
+        int32 ChunkIndex = GetChunkIndexByPoint(X, Y);
+
+        // Chunk voxel index, chunks without chunk object
+        // read the shared empty voxel block
+
+        Queries[i].QueryIndex = i;
+        Queries[i].VoxelIndex = (X % VoxelResolution) + (Y % VoxelResolution) * VoxelStride;
+        QueryChunkIndices[i] = ChunkIndex;
+
+        ++OutBinOffsets[ChunkIndex+1];
+    }
+
+    // Convert counts to chunk bin offsets
+
+    for (int32 i=1; i<=ChunkCount; ++i)
+    {
+        OutBinOffsets[i] += OutBinOffsets[i-1];
+    }
+
+    // Scatter queries into chunk bins
+
+    TArray<int32> BinCursors(OutBinOffsets.GetData(), ChunkCount);
+
+    OutQueries.SetNumUninitialized(QueryCount);
+
+    for (int32 i=0; i<QueryCount; ++i)
+    {
+        OutQueries[BinCursors[QueryChunkIndices[i]]++] = Queries[i];
+    }
+
+    // Sort each chunk bin by voxel index to read voxels in memory order
+
+    for (int32 i=0; i<ChunkCount; ++i)
+    {
+        const int32 BinStart = OutBinOffsets[i];
+        const int32 BinCount = OutBinOffsets[i+1]-BinStart;
+
+        if (BinCount > 1)
+        {
+            Sort(
+                OutQueries.GetData()+BinStart,
+                BinCount,
+                [](const FVoxelQuery& A, const FVoxelQuery& B)
+                {
+                    return A.VoxelIndex < B.VoxelIndex;
+                } );
+        }
+    }
+}
+
+template<typename FVoxelFunc>
+void FMQCMap::ForEachVoxelQuery(const TArray<FIntPoint>& Positions, bool bParallel, FVoxelFunc&& VoxelFunc) const
+{
+    TArray<FVoxelQuery> Queries;
+    TArray<int32> BinOffsets;
+    TArray<int32> QueryChunks;
+
+    GenerateVoxelQueries(Queries, BinOffsets, Positions);
+
+    // Pin published voxel snapshots for all chunk bins
+    FMQCSnapshotReadScope ReadScope(SnapshotEpochs.Get());
+
+    // Gather chunks with at least one query
+
+    for (int32 i=0; i<GetChunkCount(); ++i)
+    {
+        if (BinOffsets[i+1] > BinOffsets[i])
+        {
+            QueryChunks.Emplace(i);
+        }
+    }
+
+    auto QueryChunk = [this, &Queries, &BinOffsets, &QueryChunks, &VoxelFunc](int32 i)
+    {
+        const int32 ChunkIndex = QueryChunks[i];
+        const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+
+        if (! Chunk)
+        {
+            for (int32 qi=BinOffsets[ChunkIndex]; qi<BinOffsets[ChunkIndex+1]; ++qi)
+            {
+                const FVoxelQuery& Query(Queries[qi]);
+                VoxelFunc(Query.QueryIndex, EmptyVoxels[Query.VoxelIndex]);
+            }
+            return;
+        }
+
+        Chunk->MarkAccessed();
+
+        const FMQCVoxelSnapshot* Snapshot = Chunk->GetPublishedSnapshot();
+
+        for (int32 qi=BinOffsets[ChunkIndex]; qi<BinOffsets[ChunkIndex+1]; ++qi)
+        {
+            const FVoxelQuery& Query(Queries[qi]);
+            VoxelFunc(Query.QueryIndex, Chunk->GetPublishedVoxel(Snapshot, Query.VoxelIndex));
+        }
+    };
+
+    // Each query writes to its own output slot, chunk bins are safe to
+    // be processed concurrently
+
+    if (bParallel && QueryChunks.Num() > 1)
+    {
+        ParallelFor(QueryChunks.Num(), QueryChunk);
+    }
+    else
+    {
+        for (int32 i=0; i<QueryChunks.Num(); ++i)
+        {
+            QueryChunk(i);
+        }
+    }
+}
+
+void FMQCMap::GetVoxelMaterials(TArray<FMQCMaterial>& OutMaterials, const TArray<FIntPoint>& Positions, bool bParallel) const
+{
+    OutMaterials.SetNumUninitialized(Positions.Num());
+
+    if (GetChunkCount() < 1)
+    {
+        for (FMQCMaterial& Material : OutMaterials)
+        {
+            Material = FMQCMaterial(ForceInitToZero);
+        }
+        return;
+    }
+
+    FMQCMaterial* MaterialData = OutMaterials.GetData();
+
+    ForEachVoxelQuery(
+        Positions,
+        bParallel,
+        [MaterialData](int32 QueryIndex, const FMQCVoxel& Voxel)
+        {
+            MaterialData[QueryIndex] = Voxel.GetMaterial();
+        } );
+}
+
+void FMQCMap::GetVoxelStates(TArray<uint8>& OutStates, const TArray<FIntPoint>& Positions, bool bParallel) const
+{
+    OutStates.SetNumZeroed(Positions.Num());
+
+    if (GetChunkCount() < 1)
+    {
+        return;
+    }
+
+    uint8* StateData = OutStates.GetData();
+
+    ForEachVoxelQuery(
+        Positions,
+        bParallel,
+        [StateData](int32 QueryIndex, const FMQCVoxel& Voxel)
+        {
+            StateData[QueryIndex] = Voxel.voxelState;
+        } );
+}
+
+const FMQCVoxel& FMQCMap::GetVoxel(int32 X, int32 Y) const
+{
+    if (const FMQCGridChunk* Chunk = FindChunk(GetChunkIndexByPoint(X, Y)))
+    {
+        return Chunk->GetPublishedVoxel(Chunk->GetVoxelIndex(X, Y));
+    }
+
+    // Chunks without chunk object read the shared empty voxel block
+    const int32 VoxelStride = bHaloVoxels ? VoxelResolution+1 : VoxelResolution;
+    return EmptyVoxels[(X % VoxelResolution) + (Y % VoxelResolution) * VoxelStride];
+}
+
+void FMQCMap::InitializeCell(FMQCCell& OutCell) const
+{
+    OutCell.i = 0;
+    OutCell.sharpFeatureLimit = FMath::Cos(FMath::DegreesToRadians(MaxFeatureAngle));
+    OutCell.parallelLimit     = FMath::Cos(FMath::DegreesToRadians(MaxParallelAngle));
+}
+
+void FMQCMap::GetCell(FMQCCell& OutCell, int32 X, int32 Y) const
+{
+    OutCell.a = GetVoxel(X  , Y  );
+    OutCell.b = GetVoxel(X+1, Y  );
+    OutCell.c = GetVoxel(X  , Y+1);
+    OutCell.d = GetVoxel(X+1, Y+1);
+
+    // Convert chunk space voxel positions to map space
+    OutCell.a.Position = FIntPoint(X  , Y  );
+    OutCell.b.Position = FIntPoint(X+1, Y  );
+    OutCell.c.Position = FIntPoint(X  , Y+1);
+    OutCell.d.Position = FIntPoint(X+1, Y+1);
+}
+
+void FMQCMap::GetChunkIndices(TArray<int32>& OutChunkIndices, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax) const
+{
+    int32 ChunkMinX = FMath::Max(BoundsMin.X/VoxelResolution, 0);
+    int32 ChunkMaxX = FMath::Min(BoundsMax.X/VoxelResolution, ChunkResolution-1);
+
+    int32 ChunkMinY = FMath::Max(BoundsMin.Y/VoxelResolution, 0);
+    int32 ChunkMaxY = FMath::Min(BoundsMax.Y/VoxelResolution, ChunkResolution-1);
+
+    for (int32 y=ChunkMinY; y<=ChunkMaxY; ++y)
+    for (int32 x=ChunkMinX; x<=ChunkMaxX; ++x)
+    {
+        OutChunkIndices.Emplace(GetChunkIndex(x, y));
+    }
+}
+
+void FMQCMap::GetContourChunkIndices(TArray<int32>& OutChunkIndices, const FIntPoint& BoundsMin, const FIntPoint& BoundsMax) const
+{
+    const int32 ChunkMinX = FMath::Max(BoundsMin.X/VoxelResolution, 0);
+    const int32 ChunkMaxX = FMath::Min(BoundsMax.X/VoxelResolution, ChunkResolution-1);
+
+    const int32 ChunkMinY = FMath::Max(BoundsMin.Y/VoxelResolution, 0);
+    const int32 ChunkMaxY = FMath::Min(BoundsMax.Y/VoxelResolution, ChunkResolution-1);
+
+    TArray<FMQCChunkRegion> Regions;
+
+    {
+        FReadScopeLock TreeLock(ChunkTreeLock);
+        ChunkTree.GetRegions(Regions, FIntPoint(ChunkMinX, ChunkMinY), FIntPoint(ChunkMaxX, ChunkMaxY));
+    }
+
+    for (const FMQCChunkRegion& Region : Regions)
+    {
+        const int32 MinX = FMath::Max(Region.Min.X, ChunkMinX);
+        const int32 MinY = FMath::Max(Region.Min.Y, ChunkMinY);
+        const int32 MaxX = FMath::Min(Region.Min.X+Region.Size-1, ChunkMaxX);
+        const int32 MaxY = FMath::Min(Region.Min.Y+Region.Size-1, ChunkMaxY);
+
+        if (! Region.bUniform)
+        {
+            OutChunkIndices.Emplace(GetChunkIndex(MinX, MinY));
+            continue;
+        }
+
+        // Uniform region chunks have no contour within the region, only
+        // max border chunks triangulate cells shared with other regions
+
+        const int32 BorderX = Region.Min.X+Region.Size-1;
+        const int32 BorderY = Region.Min.Y+Region.Size-1;
+
+        if (BorderX <= MaxX)
+        {
+            for (int32 y=MinY; y<=MaxY; ++y)
+            {
+                OutChunkIndices.Emplace(GetChunkIndex(BorderX, y));
+            }
+        }
+
+        if (BorderY <= MaxY)
+        {
+            const int32 RowMaxX = (BorderX <= MaxX) ? MaxX-1 : MaxX;
+
+            for (int32 x=MinX; x<=RowMaxX; ++x)
+            {
+                OutChunkIndices.Emplace(GetChunkIndex(x, BorderY));
+            }
+        }
+    }
+}
+
+uint32 FMQCMap::GetMortonCode(uint32 X, uint32 Y)
+{
+    // Interleave lower 16 bits of X and Y, X on even bits
+
+    auto SpreadBits = [](uint32 V)
+    {
+        V &= 0x0000FFFF;
+        V = (V | (V << 8)) & 0x00FF00FF;
+        V = (V | (V << 4)) & 0x0F0F0F0F;
+        V = (V | (V << 2)) & 0x33333333;
+        V = (V | (V << 1)) & 0x55555555;
+        return V;
+    };
+
+    return SpreadBits(X) | (SpreadBits(Y) << 1);
+}
+
+bool FMQCMap::ClipRay(const FVector2D& Origin, const FVector2D& Direction, const FVector2D& BoundsMin, const FVector2D& BoundsMax, float& MinTime, float& MaxTime)
+{
+    for (int32 Axis=0; Axis<2; ++Axis)
+    {
+        const float O = Origin[Axis];
+        const float D = Direction[Axis];
+
+        if (FMath::IsNearlyZero(D))
+        {
+            // Parallel ray outside of bounds slab, no intersection
+            if (O < BoundsMin[Axis] || O > BoundsMax[Axis])
+            {
+                return false;
+            }
+        }
+        else
+        {
+            float t0 = (BoundsMin[Axis]-O) / D;
+            float t1 = (BoundsMax[Axis]-O) / D;
+
+            if (t0 > t1)
+            {
+                Swap(t0, t1);
+            }
+
+            MinTime = FMath::Max(MinTime, t0);
+            MaxTime = FMath::Min(MaxTime, t1);
+
+            if (MinTime > MaxTime)
+            {
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+float FMQCMap::GetRayExitTime(const FVector2D& Origin, const FVector2D& Direction, const FVector2D& BoundsMin, const FVector2D& BoundsMax)
+{
+    float ExitTime = BIG_NUMBER;
+
+    for (int32 Axis=0; Axis<2; ++Axis)
+    {
+        const float D = Direction[Axis];
+
+        if (D > KINDA_SMALL_NUMBER)
+        {
+            ExitTime = FMath::Min(ExitTime, (BoundsMax[Axis]-Origin[Axis]) / D);
+        }
+        else
+        if (D < -KINDA_SMALL_NUMBER)
+        {
+            ExitTime = FMath::Min(ExitTime, (BoundsMin[Axis]-Origin[Axis]) / D);
+        }
+    }
+
+    return ExitTime;
+}
+
+bool FMQCMap::Raycast(FMQCRaycastHit& OutHit, const FVector2D& Start, const FVector2D& End) const
+{
+    FMQCSnapshotReadScope ReadScope(SnapshotEpochs.Get());
+    FReadScopeLock TreeLock(ChunkTreeLock);
+
+    const float StepBias = 1e-4f;
+    const int32 CellDimension = GetVoxelDimension()-1;
+
+    OutHit = FMQCRaycastHit();
+
+    if (GetChunkCount() < 1 || CellDimension < 1)
+    {
+        return false;
+    }
+
+    const FVector2D Delta(End-Start);
+    const float RayLength = Delta.Size();
+
+    // Zero length ray, abort
+    if (RayLength < KINDA_SMALL_NUMBER)
+    {
+        return false;
+    }
+
+    const FVector2D Direction(Delta/RayLength);
+
+    // Clip ray to map cell bounds
+
+    float MinTime = 0.f;
+    float MaxTime = RayLength;
+
+    if (! ClipRay(Start, Direction, FVector2D::ZeroVector, FVector2D(CellDimension, CellDimension), MinTime, MaxTime))
+    {
+        return false;
+    }
+
+    FMQCCell Cell;
+    InitializeCell(Cell);
+
+    float Time = MinTime;
+    int32 AccessedChunkIndex = INDEX_NONE;
+
+    // Walk grid cells along the ray
+
+    while (Time <= MaxTime)
+    {
+        const FVector2D Point(Start + Direction*(Time+StepBias));
+        const int32 X = FMath::Clamp(FMath::FloorToInt(Point.X), 0, CellDimension-1);
+        const int32 Y = FMath::Clamp(FMath::FloorToInt(Point.Y), 0, CellDimension-1);
+
+        const int32 ChunkIndex = GetChunkIndexByPoint(X, Y);
+        const FMQCChunkRegion Region(ChunkTree.FindRegion(X/VoxelResolution, Y/VoxelResolution));
+
+        // Uniform region interior has no contour, skip the whole region interior
+
+        if (Region.bUniform)
+        {
+            const FIntPoint RegionOffset(Region.Min * VoxelResolution);
+            const int32 RegionCells = Region.Size*VoxelResolution - 1;
+
+            if ((X-RegionOffset.X) < RegionCells &&
+                (Y-RegionOffset.Y) < RegionCells)
+            {
+                const FVector2D InteriorMin(RegionOffset);
+                const FVector2D InteriorMax(RegionOffset + FIntPoint(RegionCells, RegionCells));
+                const float ExitTime = GetRayExitTime(Start, Direction, InteriorMin, InteriorMax);
+                Time = FMath::Max(ExitTime, Time+StepBias);
+                continue;
+            }
+        }
+
+        const FVector2D CellMin(X, Y);
+        const FVector2D CellMax(X+1, Y+1);
+        const float ExitTime = FMath::Max(GetRayExitTime(Start, Direction, CellMin, CellMax), Time+StepBias);
+
+        GetCell(Cell, X, Y);
+
+        if (ChunkIndex != AccessedChunkIndex)
+        {
+            MarkChunkAccessed(ChunkIndex);
+            AccessedChunkIndex = ChunkIndex;
+        }
+
+        const uint8 StateA = Cell.a.voxelState;
+
+        // Mixed cell, intersect ray with cell contour
+
+        if (Cell.b.voxelState != StateA ||
+            Cell.c.voxelState != StateA ||
+            Cell.d.voxelState != StateA)
+        {
+            float HitTime;
+            FVector2D HitNormal;
+            uint8 HitState;
+
+            if (Cell.IntersectContour(Start, Direction, Time, FMath::Min(ExitTime, MaxTime), HitTime, HitNormal, HitState))
+            {
+                OutHit.bHit = true;
+                OutHit.Location = Start + Direction*HitTime;
+                OutHit.Normal = HitNormal;
+                OutHit.Distance = HitTime;
+                OutHit.State = HitState;
+                OutHit.ChunkIndex = ChunkIndex;
+                return true;
+            }
+        }
+
+        Time = ExitTime;
+    }
+
+    return false;
+}
+
+void FMQCMap::Raycasts(TArray<FMQCRaycastHit>& OutHits, const TArray<FVector2D>& Starts, const TArray<FVector2D>& Ends, bool bParallel) const
+{
+    const int32 RayCount = FMath::Min(Starts.Num(), Ends.Num());
+
+    OutHits.SetNum(RayCount);
+
+    FMQCRaycastHit* HitData = OutHits.GetData();
+
+    auto CastRay = [this, HitData, &Starts, &Ends](int32 i)
+    {
+        Raycast(HitData[i], Starts[i], Ends[i]);
+    };
+
+    if (bParallel && RayCount > 1)
+    {
+        ParallelFor(RayCount, CastRay);
+    }
+    else
+    {
+        for (int32 i=0; i<RayCount; ++i)
+        {
+            CastRay(i);
+        }
+    }
+}
+
+bool FMQCMap::FindNearestEdge(FMQCEdgeQueryResult& OutResult, const FVector2D& Point, int32 StateIndex, float MaxDistance) const
+{
+    OutResult = FMQCEdgeQueryResult();
+
+    if (! HasState(StateIndex))
+    {
+        return false;
+    }
+
+    // Gather candidate chunks, limited by max distance if specified
+
+    struct FCandidate
+    {
+        int32 ChunkIndex;
+        float DistanceSq;
+    };
+
+    TArray<int32> ChunkIndices;
+    TArray<FCandidate> Candidates;
+
+    float BestDistanceSq = BIG_NUMBER;
+
+    if (MaxDistance >= 0.f)
+    {
+        // Expand min bounds by one voxel to include previous chunk gap cells
+        const FIntPoint BoundsMin(FMath::FloorToInt(Point.X-MaxDistance)-1, FMath::FloorToInt(Point.Y-MaxDistance)-1);
+        const FIntPoint BoundsMax(FMath::CeilToInt(Point.X+MaxDistance), FMath::CeilToInt(Point.Y+MaxDistance));
+        GetContourChunkIndices(ChunkIndices, BoundsMin, BoundsMax);
+        BestDistanceSq = FMath::Square(MaxDistance)+KINDA_SMALL_NUMBER;
+    }
+    else
+    {
+        const int32 MaxPoint = GetVoxelDimension()-1;
+        GetContourChunkIndices(ChunkIndices, FIntPoint(0, 0), FIntPoint(MaxPoint, MaxPoint));
+    }
+
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+        const FMQCEdgeSegmentTree* Tree = Chunk ? Chunk->GetEdgeSegmentTree(StateIndex) : nullptr;
+
+        if (Tree && ! Tree->IsEmpty())
+        {
+            const FBox2D Bounds(Tree->GetBounds());
+            const float DistanceSq = Bounds.ComputeSquaredDistanceToPoint(Point);
+
+            if (DistanceSq < BestDistanceSq)
+            {
+                Candidates.Emplace(FCandidate { ChunkIndex, DistanceSq });
+            }
+        }
+    }
+
+    // Visit nearest chunks first to prune the rest with the best distance
+
+    Candidates.Sort([](const FCandidate& A, const FCandidate& B)
+    {
+        return A.DistanceSq < B.DistanceSq;
+    } );
+
+    FMQCEdgeSegmentNearest Nearest;
+    int32 NearestChunkIndex = -1;
+
+    for (const FCandidate& Candidate : Candidates)
+    {
+        if (Candidate.DistanceSq >= BestDistanceSq)
+        {
+            break;
+        }
+
+        const FMQCEdgeSegmentTree& Tree(*GetChunk(Candidate.ChunkIndex).GetEdgeSegmentTree(StateIndex));
+
+        if (Tree.FindNearest(Nearest, Point, BestDistanceSq))
+        {
+            BestDistanceSq = Nearest.DistanceSq;
+            NearestChunkIndex = Candidate.ChunkIndex;
+            OutResult.Location = Nearest.Location;
+
+            const FMQCEdgeSegmentTree::FSegment& Segment(Tree.GetSegment(Nearest.SegmentIndex));
+            OutResult.Segment.Point0 = Segment.Point0;
+            OutResult.Segment.Point1 = Segment.Point1;
+            OutResult.Segment.EdgeListIndex = Segment.EdgeListIndex;
+        }
+    }
+
+    if (NearestChunkIndex >= 0)
+    {
+        OutResult.bFound = true;
+        OutResult.Distance = FMath::Sqrt(BestDistanceSq);
+        OutResult.Segment.ChunkIndex = NearestChunkIndex;
+    }
+
+    return OutResult.bFound;
+}
+
+void FMQCMap::FindEdgesWithinRadius(TArray<FMQCEdgeSegment>& OutSegments, const FVector2D& Center, float Radius, int32 StateIndex) const
+{
+    if (! HasState(StateIndex) || Radius < 0.f)
+    {
+        return;
+    }
+
+    // Expand min bounds by one voxel to include previous chunk gap cells
+    const FIntPoint BoundsMin(FMath::FloorToInt(Center.X-Radius)-1, FMath::FloorToInt(Center.Y-Radius)-1);
+    const FIntPoint BoundsMax(FMath::CeilToInt(Center.X+Radius), FMath::CeilToInt(Center.Y+Radius));
+
+    TArray<int32> ChunkIndices;
+    TArray<int32> SegmentIndices;
+
+    GetContourChunkIndices(ChunkIndices, BoundsMin, BoundsMax);
+
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        const FMQCGridChunk* Chunk = FindChunk(ChunkIndex);
+        const FMQCEdgeSegmentTree* Tree = Chunk ? Chunk->GetEdgeSegmentTree(StateIndex) : nullptr;
+
+        if (! Tree || Tree->IsEmpty())
+        {
+            continue;
+        }
+
+        SegmentIndices.Reset();
+        Tree->FindWithinRadius(SegmentIndices, Center, Radius);
+
+        for (int32 SegmentIndex : SegmentIndices)
+        {
+            const FMQCEdgeSegmentTree::FSegment& Segment(Tree->GetSegment(SegmentIndex));
+
+            FMQCEdgeSegment OutSegment;
+            OutSegment.Point0 = Segment.Point0;
+            OutSegment.Point1 = Segment.Point1;
+            OutSegment.ChunkIndex = ChunkIndex;
+            OutSegment.EdgeListIndex = Segment.EdgeListIndex;
+            OutSegments.Emplace(OutSegment);
+        }
+    }
+}
+
+uint8 FMQCMap::GetStateAt(const FVector2D& Point) const
+{
+    FMQCSnapshotReadScope ReadScope(SnapshotEpochs.Get());
+
+    const int32 CellDimension = GetVoxelDimension()-1;
+
+    if (GetChunkCount() < 1 || CellDimension < 1)
+    {
+        return 0;
+    }
+
+    const int32 X = FMath::Clamp(FMath::FloorToInt(Point.X), 0, CellDimension-1);
+    const int32 Y = FMath::Clamp(FMath::FloorToInt(Point.Y), 0, CellDimension-1);
+
+    FMQCCell Cell;
+    InitializeCell(Cell);
+    GetCell(Cell, X, Y);
+
+    MarkChunkAccessed(GetChunkIndexByPoint(X, Y));
+
+    const FMQCVoxel* Corners[4] = { &Cell.a, &Cell.b, &Cell.c, &Cell.d };
+
+    // Sort corners by distance to the query point
+
+    Sort(Corners, 4, [&Point](const FMQCVoxel& A, const FMQCVoxel& B)
+    {
+        return FVector2D::DistSquared(A.GetPosition(), Point) < FVector2D::DistSquared(B.GetPosition(), Point);
+    } );
+
+    // Find the nearest corner reachable without crossing the cell contour
+
+    for (const FMQCVoxel* Corner : Corners)
+    {
+        float HitTime;
+        FVector2D HitNormal;
+        uint8 HitState;
+
+        const FVector2D ToCorner(Corner->GetPosition()-Point);
+
+        if (! Cell.IntersectContour(Point, ToCorner, 0.f, 1.f, HitTime, HitNormal, HitState))
+        {
+            return Corner->voxelState;
+        }
+    }
+
+    return Corners[0]->voxelState;
+}
+
+// ----------------------------------------------------------------------------
+
+// MAP SETTINGS FUNCTIONS
+
+void UMQCMapRef::InitializeVoxelMap()
+{
+    VoxelMap.Initialize(MapConfig);
+    VoxelMap.OnGeometryChanged().RemoveAll(this);
+    VoxelMap.OnGeometryChanged().AddUObject(this, &UMQCMapRef::BroadcastGeometryChanges);
+    VoxelMap.OnEdgeDataReady().RemoveAll(this);
+    VoxelMap.OnEdgeDataReady().AddUObject(this, &UMQCMapRef::BroadcastEdgeDataReady);
+}
+
+void UMQCMapRef::BroadcastGeometryChanges(const TArray<FMQCGeometryChange>& Changes)
+{
+    OnGeometryChanged.Broadcast(Changes);
+}
+
+void UMQCMapRef::BroadcastEdgeDataReady(int32 StateIndex)
+{
+    // Edge data is resolved on worker threads, broadcast on the game thread
+
+    TWeakObjectPtr<UMQCMapRef> MapRef(this);
+
+    AsyncTask(ENamedThreads::GameThread, [MapRef, StateIndex]()
+    {
+        if (MapRef.IsValid())
+        {
+            MapRef->OnEdgeDataReady.Broadcast(StateIndex);
+        }
+    } );
+}
+
+// MEMORY FUNCTIONS
+
+void UMQCMapRef::GetResourceSizeEx(FResourceSizeEx& CumulativeResourceSize)
+{
+    Super::GetResourceSizeEx(CumulativeResourceSize);
+
+    if (IsInitialized())
+    {
+        VoxelMap.WaitForAsyncTask();
+        CumulativeResourceSize.AddDedicatedSystemMemoryBytes(VoxelMap.GetAllocatedSize());
+    }
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice GMQCDumpChunkMemoryCommand(
+    TEXT("MQC.DumpChunkMemory"),
+    TEXT("Dumps memory usage of initialized voxel maps and their N largest chunks. Usage: MQC.DumpChunkMemory [N=10]"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            int32 TopChunkCount = 10;
+
+            if (Args.Num() > 0)
+            {
+                TopChunkCount = FMath::Max(0, FCString::Atoi(*Args[0]));
+            }
+
+            for (TObjectIterator<UMQCMapRef> It; It; ++It)
+            {
+                UMQCMapRef* MapRef = *It;
+
+                if (! MapRef->IsInitialized())
+                {
+                    continue;
+                }
+
+                FMQCMap& Map(MapRef->GetMap());
+                Map.WaitForAsyncTask();
+
+                Ar.Logf(TEXT("%s"), *MapRef->GetPathName());
+                Map.DumpMemoryUsage(Ar, TopChunkCount);
+            }
+        } )
+    );
+
+// TRIANGULATION FUNCTIONS
+
+void UMQCMapRef::ClearVoxelMap()
+{
+    VoxelMap.Clear();
+}
+
+void UMQCMapRef::Triangulate()
+{
+    VoxelMap.Triangulate();
+}
+
+void UMQCMapRef::TriangulateAsync()
+{
+    VoxelMap.TriangulateAsync();
+}
+
+void UMQCMapRef::WaitForAsyncTask()
+{
+    VoxelMap.WaitForAsyncTask();
+}
+
+void UMQCMapRef::FinalizeAsync()
+{
+    VoxelMap.FinalizeAsync();
+}
+
+void UMQCMapRef::ResetChunkStates(const TArray<int32>& ChunkIndices)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.ResetChunkStates(ChunkIndices);
+    }
+}
+
+void UMQCMapRef::ResetAllChunkStates()
+{
+    if (IsInitialized())
+    {
+        VoxelMap.ResetAllChunkStates();
+    }
+}
+
+// RECORDING FUNCTIONS
+
+bool UMQCMapRef::StartStencilRecording()
+{
+    if (! StencilRecorder.IsValid())
+    {
+        StencilRecorder = MakeUnique<FMQCStencilRecorder>();
+    }
+
+    // Finish pending triangulation so recorded ops start from settled geometry
+    VoxelMap.WaitForAsyncTask();
+
+    if (! StencilRecorder->Start(MapConfig, VoxelMap))
+    {
+        return false;
+    }
+
+    VoxelMap.SetRecorder(StencilRecorder.Get());
+
+    return true;
+}
+
+bool UMQCMapRef::StopStencilRecording(const FString& Filename)
+{
+    if (! IsStencilRecording())
+    {
+        return false;
+    }
+
+    VoxelMap.SetRecorder(nullptr);
+    StencilRecorder->Stop(VoxelMap);
+
+    UE_LOG(LogMQC, Log, TEXT("UMQCMapRef::StopStencilRecording() Recorded %d ops (%d bytes)"),
+        StencilRecorder->GetOpCount(),
+        StencilRecorder->GetData().Num());
+
+    return StencilRecorder->SaveToFile(Filename);
+}
+
+bool UMQCMapRef::IsStencilRecording() const
+{
+    return StencilRecorder.IsValid() && StencilRecorder->IsRecording();
+}
+
+// SCHEDULED TRIANGULATION FUNCTIONS
+
+void UMQCMapRef::SetTriangulationFocusPoints(const TArray<FVector2D>& FocusPoints)
+{
+    VoxelMap.GetScheduler().SetFocusPoints(FocusPoints);
+}
+
+void UMQCMapRef::RequestChunkTriangulation(const TArray<int32>& ChunkIndices)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.GetScheduler().RequestChunks(ChunkIndices);
+    }
+}
+
+void UMQCMapRef::RequestChunkTriangulationWithPriority(int32 ChunkIndex, float Priority)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.GetScheduler().RequestChunk(ChunkIndex, Priority);
+    }
+}
+
+void UMQCMapRef::CancelChunkTriangulation(const TArray<int32>& ChunkIndices)
+{
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        VoxelMap.GetScheduler().CancelChunk(ChunkIndex);
+    }
+}
+
+void UMQCMapRef::CancelAllChunkTriangulation()
+{
+    VoxelMap.GetScheduler().CancelAll();
+}
+
+int32 UMQCMapRef::TickScheduledTriangulation(float BudgetMs)
+{
+    return IsInitialized() ? VoxelMap.TickScheduledTriangulation(BudgetMs) : 0;
+}
+
+bool UMQCMapRef::HasScheduledTriangulation() const
+{
+    return IsInitialized() && VoxelMap.GetScheduler().HasPendingWork();
+}
+
+// STREAMING FUNCTIONS
+
+void UMQCMapRef::SetStreamingFocusPoints(const TArray<FVector2D>& FocusPoints)
+{
+    VoxelMap.GetStreamer().SetFocusPoints(FocusPoints);
+}
+
+int32 UMQCMapRef::TickStreaming()
+{
+    return IsInitialized() ? VoxelMap.TickStreaming() : 0;
+}
+
+void UMQCMapRef::FlushStreamedChunks()
+{
+    if (IsInitialized() && VoxelMap.IsStreamChunks())
+    {
+        VoxelMap.GetStreamer().FlushResidentChunks();
+    }
+}
+
+int32 UMQCMapRef::GetResidentChunkCount() const
+{
+    return IsInitialized() ? VoxelMap.GetStreamer().GetResidentCount() : 0;
+}
+
+int32 UMQCMapRef::GetEvictedChunkCount() const
+{
+    return IsInitialized() ? VoxelMap.GetStreamer().GetEvictedCount() : 0;
+}
+
+// COMPRESSION FUNCTIONS
+
+int32 UMQCMapRef::TickChunkCompression()
+{
+    return IsInitialized() ? VoxelMap.TickChunkCompression() : 0;
+}
+
+int32 UMQCMapRef::GetCompressedChunkCount() const
+{
+    FMQCCompressionStats Stats;
+    VoxelMap.GetCompressionStats(Stats);
+    return Stats.CompressedChunks;
+}
+
+float UMQCMapRef::GetChunkCompressionRatio() const
+{
+    FMQCCompressionStats Stats;
+    VoxelMap.GetCompressionStats(Stats);
+    return Stats.GetCompressionRatio();
+}
+
+float UMQCMapRef::GetAverageChunkDecompressionTime() const
+{
+    FMQCCompressionStats Stats;
+    VoxelMap.GetCompressionStats(Stats);
+    return static_cast<float>(Stats.GetAverageDecompressionTime() * 1000.0);
+}
+
+// CHUNK & SECTION FUNCTIONS
+
+FVector UMQCMapRef::GetChunkPosition(int32 ChunkIndex) const
+{
+    return HasChunk(ChunkIndex)
+        ? FVector(VoxelMap.GetChunkOffset(ChunkIndex), 0.f)
+        : FVector(ForceInitToZero);
+}
+
+int32 UMQCMapRef::GetMaxLODLevel() const
+{
+    return IsInitialized() ? VoxelMap.GetMaxLODLevel() : 0;
+}
+
+int32 UMQCMapRef::GetChunkLOD(int32 ChunkIndex) const
+{
+    return IsInitialized() ? VoxelMap.GetChunkLOD(ChunkIndex) : 0;
+}
+
+void UMQCMapRef::SetChunkLOD(int32 ChunkIndex, int32 LODLevel)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.SetChunkLOD(ChunkIndex, LODLevel);
+    }
+}
+
+void UMQCMapRef::SetChunkLODs(const TArray<int32>& LODLevels)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.SetChunkLODs(LODLevels);
+    }
+}
+
+FPMUMeshSectionRef UMQCMapRef::GetSurfaceSection(int32 ChunkIndex, int32 StateIndex)
+{
+    if (FMQCGridChunk* Chunk = VoxelMap.FindChunk(ChunkIndex))
+    {
+        return FPMUMeshSectionRef(*Chunk->GetSurfaceSection(StateIndex));
+    }
+    else
+    {
+        return FPMUMeshSectionRef();
+    }
+}
+
+FPMUMeshSectionRef UMQCMapRef::GetExtrudeSection(int32 ChunkIndex, int32 StateIndex)
+{
+    if (FMQCGridChunk* Chunk = VoxelMap.FindChunk(ChunkIndex))
+    {
+        return FPMUMeshSectionRef(*Chunk->GetExtrudeSection(StateIndex));
+    }
+    else
+    {
+        return FPMUMeshSectionRef();
+    }
+}
+
+void UMQCMapRef::GetEdgePoints(TArray<FVector2D>& OutPoints, int32 StateIndex, int32 EdgeListIndex, bool bSimplified)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.GetEdgePoints(OutPoints, StateIndex, EdgeListIndex, bSimplified);
+    }
+}
+
+void UMQCMapRef::GetEdgePointsByChunkSurface(TArray<FMQCEdgePointData>& OutPointList, int32 ChunkIndex, int32 StateIndex, bool bSimplified)
+{
+    if (IsInitialized())
+    {
+        VoxelMap.GetEdgePointsByChunkSurface(OutPointList, ChunkIndex, StateIndex, bSimplified);
+    }
+}
+
+void UMQCMapRef::GetVoxelStates(TArray<uint8>& OutStates, const TArray<FIntPoint>& Positions, bool bParallel) const
+{
+    if (IsInitialized())
+    {
+        VoxelMap.GetVoxelStates(OutStates, Positions, bParallel);
+    }
+    else
+    {
+        OutStates.SetNumZeroed(Positions.Num());
+    }
+}
+
+bool UMQCMapRef::Raycast(FMQCRaycastHit& OutHit, FVector2D Start, FVector2D End) const
+{
+    if (IsInitialized())
+    {
+        return VoxelMap.Raycast(OutHit, Start, End);
+    }
+    else
+    {
+        OutHit = FMQCRaycastHit();
+        return false;
+    }
+}
+
+void UMQCMapRef::Raycasts(TArray<FMQCRaycastHit>& OutHits, const TArray<FVector2D>& Starts, const TArray<FVector2D>& Ends, bool bParallel) const
+{
+    if (IsInitialized())
+    {
+        VoxelMap.Raycasts(OutHits, Starts, Ends, bParallel);
+    }
+    else
+    {
+        OutHits.Reset();
+    }
+}
+
+bool UMQCMapRef::HasLineOfSight(FVector2D Start, FVector2D End) const
+{
+    return ! IsInitialized() || VoxelMap.HasLineOfSight(Start, End);
+}
+
+bool UMQCMapRef::FindNearestEdge(FMQCEdgeQueryResult& OutResult, FVector2D Point, int32 StateIndex, float MaxDistance) const
+{
+    if (IsInitialized())
+    {
+        return VoxelMap.FindNearestEdge(OutResult, Point, StateIndex, MaxDistance);
+    }
+    else
+    {
+        OutResult = FMQCEdgeQueryResult();
+        return false;
+    }
+}
+
+void UMQCMapRef::FindEdgesWithinRadius(TArray<FMQCEdgeSegment>& OutSegments, FVector2D Center, float Radius, int32 StateIndex) const
+{
+    if (IsInitialized())
+    {
+        VoxelMap.FindEdgesWithinRadius(OutSegments, Center, Radius, StateIndex);
+    }
+}
+
+uint8 UMQCMapRef::GetStateAt(FVector2D Point) const
+{
+    return IsInitialized() ? VoxelMap.GetStateAt(Point) : 0;
+}
+
+bool UMQCMapRef::IsPointInState(FVector2D Point, int32 StateIndex) const
+{
+    return IsInitialized() && VoxelMap.IsPointInState(Point, StateIndex);
+}
+
+void UMQCMapRef::AddQuadFilters(const TArray<FIntPoint>& Points, int32 StateIndex, bool bExtrudeGeometry)
+{
+    if (IsInitialized() && HasState(StateIndex))
+    {
+        for (const FIntPoint& Point : Points)
+        {
+            VoxelMap.AddQuadFilter(Point, StateIndex, bExtrudeGeometry);
+        }
+    }
+}
+
+void UMQCMapRef::AddQuadFiltersByBounds(const FIntPoint& BoundsMin, const FIntPoint& BoundsMax, int32 StateIndex, bool bExtrudeGeometry)
+{
+    if (IsInitialized() && HasState(StateIndex))
+    {
+        FIntPoint ClampedMin;
+        FIntPoint ClampedMax;
+
+        ClampedMin.X = FMath::Clamp(BoundsMin.X, 0, GetVoxelDimension()-1);
+        ClampedMin.Y = FMath::Clamp(BoundsMin.Y, 0, GetVoxelDimension()-1);
+        ClampedMax.X = FMath::Clamp(BoundsMax.X, ClampedMin.X, GetVoxelDimension()-1);
+        ClampedMax.Y = FMath::Clamp(BoundsMax.Y, ClampedMin.Y, GetVoxelDimension()-1);
+
+        FIntPoint Point;
+
+        for (int32 y=ClampedMin.Y; y<=ClampedMax.Y; ++y)
+        for (int32 x=ClampedMin.X; x<=ClampedMax.X; ++x)
+        {
+            Point.X = x;
+            Point.Y = y;
+            VoxelMap.AddQuadFilter(Point, StateIndex, bExtrudeGeometry);
+        }
+    }
+}
+
+// MAP ACTOR
+
+AMQCMap::AMQCMap()
+    : MapRef(nullptr)
+{
+    PrimaryActorTick.bCanEverTick = true;
+    PrimaryActorTick.bStartWithTickEnabled = false;
 
     RootComponent = CreateDefaultSubobject<USceneComponent>("Root");
 
-    MeshAnchor = CreateDefaultSubobject<USceneComponent>("MeshAnchor");
-    MeshAnchor->SetupAttachment(RootComponent);
+    MeshAnchor = CreateDefaultSubobject<USceneComponent>("MeshAnchor");
+    MeshAnchor->SetupAttachment(RootComponent);
+
+#if WITH_EDITOR
+    // Add editor sprite component
+    auto* SpriteComponent = CreateEditorOnlyDefaultSubobject<UBillboardComponent>(TEXT("Sprite"));
+    if (SpriteComponent)
+    {
+        static ConstructorHelpers::FObjectFinder<UTexture2D> SpriteFinder(TEXT("/Engine/EditorResources/S_Terrain"));
+        SpriteComponent->Sprite = SpriteFinder.Object;
+        SpriteComponent->RelativeScale3D = FVector(0.5f, 0.5f, 0.5f);
+        SpriteComponent->bHiddenInGame = true;
+        SpriteComponent->bIsScreenSizeScaled = true;
+        SpriteComponent->SetupAttachment(RootComponent);
+        SpriteComponent->bReceivesDecals = false;
+    }
+#endif
+}
+
+AMQCMap::~AMQCMap()
+{
+}
+
+void AMQCMap::Tick(float DeltaSeconds)
+{
+    Super::Tick(DeltaSeconds);
+
+    FlushRenderStateUpdates();
+}
+
+bool AMQCMap::ShouldTickIfViewportsOnly() const
+{
+    // Pending render state updates are flushed on tick,
+    // which is also required for maps edited in the editor
+    return true;
+}
+
+void AMQCMap::OnMapGeometryChanged(const TArray<FMQCGeometryChange>& Changes)
+{
+    const bool bClusterMode = IsClusterMode();
+
+    ++GeometryChangeSerial;
+
+    for (const FMQCGeometryChange& Change : Changes)
+    {
+        ChangedSurfaces.Emplace(FIntPoint(Change.ChunkIndex, Change.StateIndex), GeometryChangeSerial);
+
+        const int32 MeshIndex = bClusterMode
+            ? MapRef->GetMap().GetClusterIndex(Change.ChunkIndex)
+            : Change.ChunkIndex;
+
+        MarkSurfaceGeometryDirty(MeshIndex, Change.StateIndex);
+    }
+}
+
+uint32 AMQCMap::ConsumeSurfaceChanges(int32 StateIndex, int32 MaterialKey)
+{
+    uint32& ConsumedSerial(ConsumedSurfaceChanges.FindOrAdd(FIntPoint(StateIndex, MaterialKey)));
+    const uint32 LastChangeSerial = ConsumedSerial;
+    ConsumedSerial = GeometryChangeSerial;
+    return LastChangeSerial;
+}
+
+bool AMQCMap::HasSurfaceChanged(int32 ChunkIndex, int32 StateIndex, uint32 LastChangeSerial) const
+{
+    const uint32* ChangeSerialPtr = ChangedSurfaces.Find(FIntPoint(ChunkIndex, StateIndex));
+    return ChangeSerialPtr && *ChangeSerialPtr > LastChangeSerial;
+}
+
+int32 AMQCMap::GetMaterialKey(const FMQCMaterialBlend& MaterialBlend)
+{
+    // Pack material blend into a unique surface mesh material key
+    return (
+        (MaterialBlend.Index0      ) |
+        (MaterialBlend.Index1 <<  8) |
+        (MaterialBlend.Index2 << 16) |
+        (MaterialBlend.Kind   << 24)
+        );
+}
+
+void AMQCMap::MarkRenderStateDirty(int32 MeshIndex)
+{
+    RenderDirtyMeshes.Emplace(MeshIndex);
+    SetActorTickEnabled(true);
+}
+
+void AMQCMap::FlushRenderStateUpdates()
+{
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_FlushRenderState);
+
+    for (int32 MeshIndex : RenderDirtyMeshes)
+    {
+        if (SurfaceMeshComponents.IsValidIndex(MeshIndex))
+        {
+            UPMUMeshComponent* Mesh = SurfaceMeshComponents[MeshIndex];
+
+            if (IsValid(Mesh))
+            {
+                Mesh->UpdateRenderState();
+            }
+        }
+    }
+
+    RenderDirtyMeshes.Reset();
+
+    SetActorTickEnabled(false);
+}
+
+bool AMQCMap::IsClusterMode() const
+{
+    return HasValidMap() && MapRef->GetMap().GetClusterResolution() > 1;
+}
+
+int32 AMQCMap::GetSurfaceMeshCount() const
+{
+    if (! HasValidMap())
+    {
+        return 0;
+    }
+
+    const FMQCMap& Map(MapRef->GetMap());
+    return IsClusterMode() ? Map.GetClusterCount() : Map.GetChunkCount();
+}
+
+FBox2D AMQCMap::GetSurfaceMeshBounds(int32 MeshIndex) const
+{
+    const FMQCMap& Map(MapRef->GetMap());
+
+    TArray<int32> ChunkIndices;
+
+    if (IsClusterMode())
+    {
+        Map.GetClusterChunkIndices(ChunkIndices, MeshIndex);
+    }
+    else
+    if (Map.HasChunk(MeshIndex))
+    {
+        ChunkIndices.Emplace(MeshIndex);
+    }
+
+    // Mesh borders shared with neighbour chunks lie on
+    // the neighbour chunk first voxel row and column
+
+    const int32 VoxelResolution = Map.GetVoxelResolution();
+    const int32 MapBorder = Map.GetVoxelDimension()-1;
+
+    FIntPoint BoundsMin(MAX_int32, MAX_int32);
+    FIntPoint BoundsMax(0, 0);
+
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        const FIntPoint ChunkMin(Map.GetChunkOffset(ChunkIndex));
+        BoundsMin = BoundsMin.ComponentMin(ChunkMin);
+        BoundsMax = BoundsMax.ComponentMax(ChunkMin+FIntPoint(VoxelResolution, VoxelResolution));
+    }
+
+    BoundsMax.X = FMath::Min(BoundsMax.X, MapBorder);
+    BoundsMax.Y = FMath::Min(BoundsMax.Y, MapBorder);
+
+    return (ChunkIndices.Num() > 0)
+        ? FBox2D(FVector2D(BoundsMin), FVector2D(BoundsMax))
+        : FBox2D(ForceInit);
+}
+
+FMQCMeshCluster& AMQCMap::GetOrAddMeshCluster(int32 ClusterIndex, int32 StateIndex, int32 MaterialKey)
+{
+    const FIntVector ClusterKey(ClusterIndex, StateIndex, MaterialKey);
+
+    if (const int32* ClusterIdPtr = MeshClusterMap.Find(ClusterKey))
+    {
+        return MeshClusters[*ClusterIdPtr];
+    }
+
+    const int32 ClusterId = MeshClusters.Add(new FMQCMeshCluster);
+    MeshClusterMap.Emplace(ClusterKey, ClusterId);
+
+    return MeshClusters[ClusterId];
+}
+
+void AMQCMap::GenerateClusterMesh(
+    TFunctionRef<const FPMUMeshSection*(int32)> GetChunkSection,
+    int32 StateIndex,
+    int32 MaterialKey,
+    UMaterialInterface* Material,
+    bool bChangedOnly,
+    uint32 LastChangeSerial
+    )
+{
+    FMQCMap& Map(MapRef->GetMap());
+
+    InitializeMeshComponents(SurfaceMeshComponents);
+
+    // Group changed chunks by cluster, chunks without
+    // chunk object have no geometry to publish
+
+    TMap<int32, TArray<int32>> ClusterChunkMap;
+
+    for (int32 ChunkIndex : Map.GetChunkTraversalOrder())
+    {
+        if (bChangedOnly && ! HasSurfaceChanged(ChunkIndex, StateIndex, LastChangeSerial))
+        {
+            continue;
+        }
+
+        ClusterChunkMap.FindOrAdd(Map.GetClusterIndex(ChunkIndex)).Emplace(ChunkIndex);
+    }
+
+    // Update cluster sections
+
+    TArray<int32> ClusterChunkIndices;
+
+    for (const auto& ClusterChunkPair : ClusterChunkMap)
+    {
+        const int32 ClusterIndex = ClusterChunkPair.Key;
+        const TArray<int32>& ChangedChunkIndices(ClusterChunkPair.Value);
+
+        FMQCMeshCluster& Cluster(GetOrAddMeshCluster(ClusterIndex, StateIndex, MaterialKey));
+
+        ClusterChunkIndices.Reset();
+        Map.GetClusterChunkIndices(ClusterChunkIndices, ClusterIndex);
+
+        // Rebuild whole cluster if cluster layout is invalid or section
+        // geometry has been modified externally (e.g. mesh simplification)
+
+        bool bRequireRebuild = (Cluster.ChunkIndices != ClusterChunkIndices);
+
+        if (! bRequireRebuild)
+        {
+            const FIntPoint& LastVertexRange(Cluster.VertexRanges.Last());
+            const FIntPoint& LastIndexRange(Cluster.IndexRanges.Last());
+
+            bRequireRebuild = (
+                Cluster.Section.Positions.Num() != (LastVertexRange.X+LastVertexRange.Y) ||
+                Cluster.Section.Indices.Num() != (LastIndexRange.X+LastIndexRange.Y)
+                );
+        }
+
+        // Update changed chunk sub-ranges in place, rebuild
+        // cluster if any chunk geometry size has changed
+
+        if (! bRequireRebuild)
+        {
+            for (int32 ChunkIndex : ChangedChunkIndices)
+            {
+                const int32 ChunkSlot = Cluster.ChunkIndices.Find(ChunkIndex);
+
+                if (! UpdateMeshClusterRange(Cluster, ChunkSlot, GetChunkSection(ChunkIndex)))
+                {
+                    bRequireRebuild = true;
+                    break;
+                }
+            }
+        }
+
+        if (bRequireRebuild)
+        {
+            Cluster.ChunkIndices = ClusterChunkIndices;
+            RebuildMeshCluster(Cluster, GetChunkSection);
+        }
+
+        // Publish cluster section
+
+        UPMUMeshComponent* Mesh = GetSurfaceMesh(ClusterIndex);
+
+        if (! IsValid(Mesh))
+        {
+            continue;
+        }
+
+        if (Cluster.SectionIndex < 0)
+        {
+            if (! Cluster.Section.HasGeometry())
+            {
+                continue;
+            }
+
+            FPMUMeshSectionRef SectionRef(Cluster.Section);
+
+            Cluster.SectionIndex = (MaterialKey < 0)
+                ? Mesh->CreateNewSection(SectionRef, MGI_SURFACE)
+                : Mesh->CreateNewSection(SectionRef);
+        }
+
+        if (Material)
+        {
+            Mesh->SetMaterial(Cluster.SectionIndex, Material);
+        }
+
+        MarkRenderStateDirty(ClusterIndex);
+        RegisterSurfaceSection(ClusterIndex, Cluster.SectionIndex, StateIndex);
+
+        // Cluster section geometry is copied from chunk sections,
+        // which discards normals and simplification of the cluster
+        MarkSurfaceGeometryDirty(ClusterIndex, StateIndex);
+    }
+}
+
+void AMQCMap::RebuildMeshCluster(FMQCMeshCluster& Cluster, TFunctionRef<const FPMUMeshSection*(int32)> GetChunkSection)
+{
+    FPMUMeshSection& Section(Cluster.Section);
+    const int32 ChunkSlotCount = Cluster.ChunkIndices.Num();
+
+    Section.Positions.Reset();
+    Section.UVs.Reset();
+    Section.Colors.Reset();
+    Section.Tangents.Reset();
+    Section.Indices.Reset();
+    Section.SectionLocalBox = FBox(ForceInit);
+
+    Cluster.VertexRanges.SetNumUninitialized(ChunkSlotCount);
+    Cluster.IndexRanges.SetNumUninitialized(ChunkSlotCount);
+    Cluster.ChunkBounds.Init(FBox(ForceInit), ChunkSlotCount);
+
+    for (int32 ChunkSlot=0; ChunkSlot<ChunkSlotCount; ++ChunkSlot)
+    {
+        const FPMUMeshSection* SourceSection = GetChunkSection(Cluster.ChunkIndices[ChunkSlot]);
+        const int32 VertexOffset = Section.Positions.Num();
+        const int32 IndexOffset = Section.Indices.Num();
+
+        if (SourceSection)
+        {
+            Section.Positions.Append(SourceSection->Positions);
+            Section.UVs.Append(SourceSection->UVs);
+            Section.Colors.Append(SourceSection->Colors);
+            Section.Tangents.Append(SourceSection->Tangents);
+
+            Section.Indices.Reserve(IndexOffset+SourceSection->Indices.Num());
+
+            for (uint32 Index : SourceSection->Indices)
+            {
+                Section.Indices.Emplace(Index+VertexOffset);
+            }
+
+            if (SourceSection->Positions.Num() > 0)
+            {
+                Cluster.ChunkBounds[ChunkSlot] = SourceSection->SectionLocalBox;
+                Section.SectionLocalBox += SourceSection->SectionLocalBox;
+            }
+        }
+
+        Cluster.VertexRanges[ChunkSlot] = FIntPoint(VertexOffset, Section.Positions.Num()-VertexOffset);
+        Cluster.IndexRanges[ChunkSlot] = FIntPoint(IndexOffset, Section.Indices.Num()-IndexOffset);
+    }
+}
+
+template<typename ElementType>
+static bool CopyMeshClusterAttribute(TArray<ElementType>& Dst, const TArray<ElementType>& Src, int32 Offset, int32 Count, int32 Stride)
+{
+    // Attribute absent on both source and destination
+    if (Src.Num() == 0 && Dst.Num() == 0)
+    {
+        return true;
+    }
+
+    if (Src.Num() != Count*Stride || Dst.Num() < (Offset+Count)*Stride)
+    {
+        return false;
+    }
+
+    FMemory::Memcpy(Dst.GetData()+Offset*Stride, Src.GetData(), Src.Num()*sizeof(ElementType));
+
+    return true;
+}
+
+bool AMQCMap::UpdateMeshClusterRange(FMQCMeshCluster& Cluster, int32 ChunkSlot, const FPMUMeshSection* SourceSection)
+{
+    if (! Cluster.VertexRanges.IsValidIndex(ChunkSlot))
+    {
+        return false;
+    }
+
+    const FIntPoint& VertexRange(Cluster.VertexRanges[ChunkSlot]);
+    const FIntPoint& IndexRange(Cluster.IndexRanges[ChunkSlot]);
+    const int32 VertexCount = SourceSection ? SourceSection->Positions.Num() : 0;
+    const int32 IndexCount = SourceSection ? SourceSection->Indices.Num() : 0;
+
+    // Geometry size changed, sub-range could not be updated in place
+    if (VertexCount != VertexRange.Y || IndexCount != IndexRange.Y)
+    {
+        return false;
+    }
+
+    if (VertexCount < 1)
+    {
+        return true;
+    }
+
+    FPMUMeshSection& Section(Cluster.Section);
+
+    const bool bCopied = (
+        CopyMeshClusterAttribute(Section.Positions, SourceSection->Positions, VertexRange.X, VertexCount, 1) &&
+        CopyMeshClusterAttribute(Section.UVs, SourceSection->UVs, VertexRange.X, VertexCount, 1) &&
+        CopyMeshClusterAttribute(Section.Colors, SourceSection->Colors, VertexRange.X, VertexCount, 1) &&
+        CopyMeshClusterAttribute(Section.Tangents, SourceSection->Tangents, VertexRange.X, VertexCount, 2)
+        );
+
+    if (! bCopied)
+    {
+        return false;
+    }
+
+    for (int32 i=0; i<IndexCount; ++i)
+    {
+        Section.Indices[IndexRange.X+i] = SourceSection->Indices[i]+VertexRange.X;
+    }
+
+    // Recalculate cluster bounds from chunk bounds,
+    // chunk geometry may have shrunk within its sub-range
+
+    Cluster.ChunkBounds[ChunkSlot] = SourceSection->SectionLocalBox;
+    Section.SectionLocalBox = FBox(ForceInit);
+
+    for (const FBox& ChunkBox : Cluster.ChunkBounds)
+    {
+        if (ChunkBox.IsValid)
+        {
+            Section.SectionLocalBox += ChunkBox;
+        }
+    }
+
+    return true;
+}
+
+void AMQCMap::InitializeMeshComponents(TArray<UPMUMeshComponent*>& MeshComponents)
+{
+    if (HasValidMap())
+    {
+        MeshComponents.SetNumZeroed(GetSurfaceMeshCount());
+    }
+}
+
+UPMUMeshComponent* AMQCMap::GetOrAddMeshComponent(TArray<UPMUMeshComponent*>& MeshComponents, int32 MeshIndex)
+{
+    UPMUMeshComponent* MeshComponent = nullptr;
+
+    if (MeshComponents.IsValidIndex(MeshIndex))
+    {
+        MeshComponent = MeshComponents[MeshIndex];
+
+        if (! IsValid(MeshComponent))
+        {
+            FName MeshName(*FString::Printf(TEXT("MaterialMesh_%d"), MeshIndex));
+            MeshComponent = NewObject<UPMUMeshComponent>(this, MeshName);
+            MeshComponent->bEditableWhenInherited = true;
+            MeshComponent->SetupAttachment(MeshAnchor);
+            MeshComponent->RegisterComponent();
+            MeshComponents[MeshIndex] = MeshComponent;
+        }
+    }
+
+    return IsValid(MeshComponent) ? MeshComponent : nullptr;
+}
+
+UPMUMeshComponent* AMQCMap::GetSurfaceMesh(int32 MeshIndex)
+{
+    return GetOrAddMeshComponent(SurfaceMeshComponents, MeshIndex);
+}
+
+void AMQCMap::RegisterSurfaceSection(int32 MeshIndex, int32 SectionIndex, int32 StateIndex)
+{
+    SurfaceSectionStates.Emplace(FIntPoint(MeshIndex, SectionIndex), StateIndex);
+}
+
+void AMQCMap::PublishChunkSection(
+    UPMUMeshComponent* Mesh,
+    int32 ChunkIndex,
+    int32 StateIndex,
+    int32 MaterialKey,
+    FPMUMeshSection* SourceSection,
+    UMaterialInterface* Material
+    )
+{
+    if (! IsValid(Mesh))
+    {
+        return;
+    }
+
+    const FIntVector SectionKey(ChunkIndex, StateIndex, MaterialKey);
+    FMQCChunkMeshSection& ChunkSection(ChunkMeshSections.FindOrAdd(SectionKey));
+
+    // Mesh section references a replaced or removed chunk section,
+    // clear the previous mesh section before publishing
+
+    if (ChunkSection.SectionIndex >= 0 && ChunkSection.SourceSection != SourceSection)
+    {
+        Mesh->ClearMeshSection(ChunkSection.SectionIndex);
+        SurfaceSectionStates.Remove(FIntPoint(ChunkIndex, ChunkSection.SectionIndex));
+        ChunkSection.SectionIndex = -1;
+    }
+
+    ChunkSection.SourceSection = SourceSection;
+
+    if (ChunkSection.SectionIndex < 0 && SourceSection)
+    {
+        FPMUMeshSectionRef SectionRef(*SourceSection);
+
+        ChunkSection.SectionIndex = (MaterialKey < 0)
+            ? Mesh->CreateNewSection(SectionRef, MGI_SURFACE)
+            : Mesh->CreateNewSection(SectionRef);
+
+        RegisterSurfaceSection(ChunkIndex, ChunkSection.SectionIndex, StateIndex);
+    }
+
+    if (ChunkSection.SectionIndex >= 0 && Material)
+    {
+        Mesh->SetMaterial(ChunkSection.SectionIndex, Material);
+    }
+
+    MarkRenderStateDirty(ChunkIndex);
+}
+
+void AMQCMap::MarkSurfaceGeometryDirty(int32 MeshIndex, int32 StateIndex)
+{
+    const FIntPoint SurfaceId(MeshIndex, StateIndex);
+    NormalDirtySurfaces.Emplace(SurfaceId);
+    SimplifyDirtySurfaces.Emplace(SurfaceId);
+}
+
+void AMQCMap::GetSurfaceSectionRefs(TArray<FPMUMeshSectionRef>& OutSectionRefs, TArray<FIntPoint>& OutSectionIds, int32 StateIndex, const TSet<FIntPoint>* SurfaceFilter)
+{
+    const int32 MeshCount = GetSurfaceMeshCount();
+
+    InitializeMeshComponents(SurfaceMeshComponents);
+
+    // Find mesh sections
+    for (int32 MeshIndex=0; MeshIndex<MeshCount; ++MeshIndex)
+    {
+        if (SurfaceFilter && ! SurfaceFilter->Contains(FIntPoint(MeshIndex, StateIndex)))
+        {
+            continue;
+        }
+
+        UPMUMeshComponent* Mesh = GetSurfaceMesh(MeshIndex);
+
+        if (! IsValid(Mesh))
+        {
+            continue;
+        }
+
+        TArray<int32> SectionIndices;
+        Mesh->GetAllNonEmptySectionIndices(SectionIndices);
+
+        for (int32 SectionIndex : SectionIndices)
+        {
+            const int32* SectionStatePtr = SurfaceSectionStates.Find(FIntPoint(MeshIndex, SectionIndex));
+
+            if (! SectionStatePtr || *SectionStatePtr != StateIndex)
+            {
+                continue;
+            }
+
+            FPMUMeshSectionRef SectionRef(Mesh->GetSectionRef(SectionIndex));
+            FPMUMeshSection* SectionPtr(SectionRef.SectionPtr);
 
-#if WITH_EDITOR
-    // Add editor sprite component
-    auto* SpriteComponent = CreateEditorOnlyDefaultSubobject<UBillboardComponent>(TEXT("Sprite"));
-    if (SpriteComponent)
-    {
-        static ConstructorHelpers::FObjectFinder<UTexture2D> SpriteFinder(TEXT("/Engine/EditorResources/S_Terrain"));
-        SpriteComponent->Sprite = SpriteFinder.Object;
-        SpriteComponent->RelativeScale3D = FVector(0.5f, 0.5f, 0.5f);
-        SpriteComponent->bHiddenInGame = true;
-        SpriteComponent->bIsScreenSizeScaled = true;
-        SpriteComponent->SetupAttachment(RootComponent);
-        SpriteComponent->bReceivesDecals = false;
+            if (SectionPtr && SectionPtr->HasGeometry())
+            {
+                OutSectionRefs.Emplace(SectionRef);
+                OutSectionIds.Emplace(MeshIndex, SectionIndex);
+            }
+        }
     }
-#endif
 }
 
-AMQCMap::~AMQCMap()
+void AMQCMap::CalculateSectionNormal(FPMUMeshSection& Section, TArray<FVector>& Normals)
 {
-}
+    const TArray<uint32>& Indices(Section.Indices);
+    const TArray<FVector>& Positions(Section.Positions);
+    TArray<uint32>& Tangents(Section.Tangents);
 
-void AMQCMap::InitializeMeshComponents(TArray<UPMUMeshComponent*>& MeshComponents)
-{
-    if (HasValidMap())
-    {
-        MeshComponents.SetNumZeroed(MapRef->GetChunkCount());
-    }
-}
+    const int32 VCount = Positions.Num();
+    const int32 TCount = Indices.Num() / 3;
 
-UPMUMeshComponent* AMQCMap::GetOrAddMeshComponent(TArray<UPMUMeshComponent*>& MeshComponents, int32 MeshIndex)
-{
-    UPMUMeshComponent* MeshComponent = nullptr;
+    check(Tangents.Num() >= VCount*2);
 
-    if (MeshComponents.IsValidIndex(MeshIndex))
+    Normals.Reset();
+    Normals.SetNumZeroed(VCount, false);
+
+    const VectorRegister SafeLengthSq = VectorSetFloat1(SMALL_NUMBER);
+
+    // Accumulate normalized face normals
+
+    for (int32 ti=0; ti<TCount; ++ti)
     {
-        MeshComponent = MeshComponents[MeshIndex];
+        const uint32* TriIndices = &Indices[ti*3];
 
-        if (! IsValid(MeshComponent))
+        const int32 vi0 = TriIndices[0];
+        const int32 vi1 = TriIndices[1];
+        const int32 vi2 = TriIndices[2];
+
+        const VectorRegister Pos0 = VectorLoadFloat3(&Positions[vi0]);
+        const VectorRegister Pos1 = VectorLoadFloat3(&Positions[vi1]);
+        const VectorRegister Pos2 = VectorLoadFloat3(&Positions[vi2]);
+
+        const VectorRegister Edge21 = VectorSubtract(Pos1, Pos2);
+        const VectorRegister Edge20 = VectorSubtract(Pos0, Pos2);
+        const VectorRegister Cross  = VectorCross(Edge21, Edge20);
+        const VectorRegister LengthSq = VectorDot3(Cross, Cross);
+
+        // Skip degenerate triangle
+        if (! VectorAnyGreaterThan(LengthSq, SafeLengthSq))
         {
-            FName MeshName(*FString::Printf(TEXT("MaterialMesh_%d"), MeshIndex));
-            MeshComponent = NewObject<UPMUMeshComponent>(this, MeshName);
-            MeshComponent->bEditableWhenInherited = true;
-            MeshComponent->SetupAttachment(MeshAnchor);
-            MeshComponent->RegisterComponent();
-            MeshComponents[MeshIndex] = MeshComponent;
+            continue;
         }
+
+        const VectorRegister TriNormal = VectorMultiply(Cross, VectorReciprocalSqrtAccurate(LengthSq));
+
+        VectorStoreFloat3(VectorAdd(VectorLoadFloat3(&Normals[vi0]), TriNormal), &Normals[vi0]);
+        VectorStoreFloat3(VectorAdd(VectorLoadFloat3(&Normals[vi1]), TriNormal), &Normals[vi1]);
+        VectorStoreFloat3(VectorAdd(VectorLoadFloat3(&Normals[vi2]), TriNormal), &Normals[vi2]);
     }
 
-    return IsValid(MeshComponent) ? MeshComponent : nullptr;
-}
+    // Pack vertex normals
 
-UPMUMeshComponent* AMQCMap::GetSurfaceMesh(int32 MeshIndex)
-{
-    return GetOrAddMeshComponent(SurfaceMeshComponents, MeshIndex);
+    for (int32 vi=0; vi<VCount; ++vi)
+    {
+        FVector4 Normal(Normals[vi].GetSafeNormal(), 1.f);
+        FPackedNormal PackedNormal(Normal);
+
+        Tangents[vi*2+1] = PackedNormal.Vector.Packed;
+    }
 }
 
 void AMQCMap::Initialize()
@@ -663,6 +3390,35 @@ void AMQCMap::Initialize()
     MapRef->MapConfig = MapConfig;
     MapRef->InitializeVoxelMap();
 
+    // Destroy surface meshes and clusters of the previous map,
+    // their sections and layout are invalid for the new map
+
+    for (UPMUMeshComponent* Mesh : SurfaceMeshComponents)
+    {
+        if (IsValid(Mesh))
+        {
+            Mesh->DestroyComponent();
+        }
+    }
+
+    SurfaceMeshComponents.Reset();
+    MeshClusters.Reset();
+    MeshClusterMap.Reset();
+    ChunkMeshSections.Reset();
+    RenderDirtyMeshes.Reset();
+
+    // Reset surface section tracking of the previous map
+    ChangedSurfaces.Reset();
+    ConsumedSurfaceChanges.Reset();
+    NormalDirtySurfaces.Reset();
+    SimplifyDirtySurfaces.Reset();
+    SurfaceSectionStates.Reset();
+
+    // Listen to map geometry changes
+    FMQCGeometryChangedEvent& GeometryChangedEvent(MapRef->GetMap().OnGeometryChanged());
+    GeometryChangedEvent.RemoveAll(this);
+    GeometryChangedEvent.AddUObject(this, &AMQCMap::OnMapGeometryChanged);
+
     // Set mesh anchor offset
     MeshAnchor->SetRelativeLocation(FVector(-MapRef->GetCenter(), 0.f));
 }
@@ -690,39 +3446,114 @@ void AMQCMap::Triangulate(bool bAsync, bool bWaitForAsyncToFinish)
     }
 }
 
-void AMQCMap::GenerateMapMesh()
+int32 AMQCMap::TickStreaming(bool bGenerateMesh)
+{
+    if (! HasValidMap())
+    {
+        return 0;
+    }
+
+    const int32 LastEvictedCount = MapRef->GetEvictedChunkCount();
+    const int32 LoadedCount = MapRef->TickStreaming();
+
+    // Update meshes cleared by chunk eviction
+    if (bGenerateMesh && MapRef->GetEvictedChunkCount() != LastEvictedCount)
+    {
+        GenerateMapMesh(true);
+    }
+
+    return LoadedCount;
+}
+
+int32 AMQCMap::TickScheduledTriangulation(float BudgetMs, bool bGenerateMesh)
+{
+    if (! HasValidMap())
+    {
+        return 0;
+    }
+
+    const int32 CompletedCount = MapRef->TickScheduledTriangulation(BudgetMs);
+
+    if (bGenerateMesh && CompletedCount > 0)
+    {
+        GenerateMapMesh(true);
+    }
+
+    return CompletedCount;
+}
+
+void AMQCMap::GenerateMapMesh(bool bChangedOnly)
 {
     if (! HasValidMap())
     {
         return;
     }
 
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_PublishMesh);
+
     FMQCMap& Map(MapRef->GetMap());
     const int32 StateCount = Map.GetStateCount();
-    const int32 ChunkCount = Map.GetChunkCount();
 
     InitializeMeshComponents(SurfaceMeshComponents);
 
-    for (int32 ChunkIndex=0; ChunkIndex<ChunkCount; ++ChunkIndex)
+    const uint32 LastChangeSerial = ConsumeSurfaceChanges(1, -1);
+
+    if (IsClusterMode())
     {
-        const int32 StateIndex = 1;
+        GenerateClusterMesh(
+            [&Map](int32 ChunkIndex) -> const FPMUMeshSection*
+            {
+                const FMQCGridChunk* Chunk = Map.FindChunk(ChunkIndex);
+                return Chunk ? Chunk->GetSurfaceSection(1) : nullptr;
+            },
+            1,
+            -1,
+            nullptr,
+            bChangedOnly,
+            LastChangeSerial
+            );
 
-        FMQCGridChunk& Chunk(Map.GetChunk(ChunkIndex));
-        FPMUMeshSectionRef SurfaceRef(*Chunk.GetSurfaceSection(StateIndex));
-        FPMUMeshSectionRef ExtrudeRef(*Chunk.GetExtrudeSection(StateIndex));
+        // Cluster sections copy expanded chunk sections,
+        // drop the compact duplicates
 
-        //UPMUMeshComponent* Mesh;
-        UPMUMeshComponent* Mesh = GetSurfaceMesh(ChunkIndex);
-        //FName MeshName(*FString::Printf(TEXT("SurfaceMesh_%d"), ChunkIndex));
+        for (int32 ChunkIndex : Map.GetChunkTraversalOrder())
+        {
+            Map.ReleaseExpandedCompactGeometry(ChunkIndex);
+        }
+    }
+    else
+    {
+        for (int32 ChunkIndex : Map.GetChunkTraversalOrder())
+        {
+            const int32 StateIndex = 1;
+
+            if (bChangedOnly && ! HasSurfaceChanged(ChunkIndex, StateIndex, LastChangeSerial))
+            {
+                continue;
+            }
+
+            FMQCGridChunk& Chunk(Map.GetChunk(ChunkIndex));
+
+            //UPMUMeshComponent* Mesh;
+            UPMUMeshComponent* Mesh = GetSurfaceMesh(ChunkIndex);
+            //FName MeshName(*FString::Printf(TEXT("SurfaceMesh_%d"), ChunkIndex));
 
-        //Mesh = NewObject<UPMUMeshComponent>(this, MeshName);
-        //Mesh->bEditableWhenInherited = true;
-        //Mesh->SetupAttachment(MeshAnchor);
-        //Mesh->RegisterComponent();
+            //Mesh = NewObject<UPMUMeshComponent>(this, MeshName);
+            //Mesh->bEditableWhenInherited = true;
+            //Mesh->SetupAttachment(MeshAnchor);
+            //Mesh->RegisterComponent();
 
-        Mesh->CreateNewSection(SurfaceRef, MGI_SURFACE);
-        //Mesh->CreateNewSection(ExtrudeRef, MGI_EXTRUDE);
-        Mesh->UpdateRenderState();
+            PublishChunkSection(Mesh, ChunkIndex, StateIndex, -1, Chunk.GetSurfaceSection(StateIndex), nullptr);
+            //Mesh->CreateNewSection(ExtrudeRef, MGI_EXTRUDE);
+
+            // Published section is expanded, drop the compact duplicate
+            Map.ReleaseExpandedCompactGeometry(ChunkIndex);
+        }
+    }
+
+    if (bAutoCalculateMeshNormal)
+    {
+        CalculateMeshNormal(1, true);
     }
 }
 
@@ -732,7 +3563,8 @@ void AMQCMap::GenerateMaterialMesh(
     uint8 MaterialIndex1,
     uint8 MaterialIndex2,
     bool bUseTripleIndex,
-    UMaterialInterface* Material
+    UMaterialInterface* Material,
+    bool bChangedOnly
     )
 {
     if (! HasValidMap())
@@ -740,6 +3572,8 @@ void AMQCMap::GenerateMaterialMesh(
         return;
     }
 
+    MQC_SCOPE_CYCLE_COUNTER(STAT_MQC_PublishMesh);
+
     // Generate material blend identifier
 
     FMQCMaterialBlend MaterialBlend;
@@ -785,27 +3619,51 @@ void AMQCMap::GenerateMaterialMesh(
     }
 
     FMQCMap& Map(MapRef->GetMap());
-    const int32 ChunkCount = Map.GetChunkCount();
 
     InitializeMeshComponents(SurfaceMeshComponents);
 
-    for (int32 ChunkIndex=0; ChunkIndex<ChunkCount; ++ChunkIndex)
+    const int32 MaterialKey = GetMaterialKey(MaterialBlend);
+    const uint32 LastChangeSerial = ConsumeSurfaceChanges(StateIndex, MaterialKey);
+
+    if (IsClusterMode())
+    {
+        GenerateClusterMesh(
+            [&Map, &MaterialBlend, StateIndex](int32 ChunkIndex) -> const FPMUMeshSection*
+            {
+                FMQCGridChunk* Chunk = Map.FindChunk(ChunkIndex);
+                return Chunk ? Chunk->GetSurfaceMaterialSection(StateIndex, MaterialBlend) : nullptr;
+            },
+            StateIndex,
+            MaterialKey,
+            Material,
+            bChangedOnly,
+            LastChangeSerial
+            );
+    }
+    else
     {
-        UPMUMeshComponent* MeshComponent = GetOrAddMeshComponent(SurfaceMeshComponents, ChunkIndex);
+        for (int32 ChunkIndex : Map.GetChunkTraversalOrder())
+        {
+            if (bChangedOnly && ! HasSurfaceChanged(ChunkIndex, StateIndex, LastChangeSerial))
+            {
+                continue;
+            }
 
-        FMQCGridChunk& Chunk(Map.GetChunk(ChunkIndex));
-        FPMUMeshSection* SectionPtr;
+            UPMUMeshComponent* MeshComponent = GetOrAddMeshComponent(SurfaceMeshComponents, ChunkIndex);
 
-        SectionPtr = Chunk.GetSurfaceMaterialSection(StateIndex, MaterialBlend);
+            FMQCGridChunk& Chunk(Map.GetChunk(ChunkIndex));
+            FPMUMeshSection* SectionPtr;
 
-        if (SectionPtr)
-        {
-            FPMUMeshSectionRef SectionRef(*SectionPtr);
-            int32 SectionIndex = MeshComponent->CreateNewSection(SectionRef);
-            MeshComponent->SetMaterial(SectionIndex, Material);
-            MeshComponent->UpdateRenderState();
+            SectionPtr = Chunk.GetSurfaceMaterialSection(StateIndex, MaterialBlend);
+
+            PublishChunkSection(MeshComponent, ChunkIndex, StateIndex, MaterialKey, SectionPtr, Material);
         }
     }
+
+    if (bAutoCalculateMeshNormal)
+    {
+        CalculateMeshNormal(StateIndex, true);
+    }
 }
 
 void AMQCMap::ApplyHeightMap(
@@ -878,134 +3736,296 @@ void AMQCMap::ApplyHeightMap(
 #endif
 }
 
-void AMQCMap::CalculateMeshNormal(int32 StateIndex)
+void AMQCMap::CalculateMeshNormal(int32 StateIndex, bool bDirtyOnly)
 {
     if (! HasValidMap())
     {
         return;
     }
 
-    FMQCMap& Map(MapRef->GetMap());
+    if (bDirtyOnly && NormalDirtySurfaces.Num() < 1)
+    {
+        return;
+    }
+
     TArray<FPMUMeshSectionRef> SectionRefs;
-    const int32 ChunkCount = Map.GetChunkCount();
+    TArray<FIntPoint> SectionIds;
+    GetSurfaceSectionRefs(SectionRefs, SectionIds, StateIndex, bDirtyOnly ? &NormalDirtySurfaces : nullptr);
 
-    InitializeMeshComponents(SurfaceMeshComponents);
+    // Surfaces with published sections are up to date after this pass
+    for (const FIntPoint& SectionId : SectionIds)
+    {
+        NormalDirtySurfaces.Remove(FIntPoint(SectionId.X, StateIndex));
+    }
 
-    // Find mesh sections
-    for (int32 ChunkIndex=0; ChunkIndex<ChunkCount; ++ChunkIndex)
+    const int32 SectionCount = SectionRefs.Num();
+
+    if (SectionCount < 1)
     {
-        UPMUMeshComponent* Mesh = GetSurfaceMesh(ChunkIndex);
+        return;
+    }
 
-        if (! IsValid(Mesh))
+    // Distribute sections over tasks, each task owns a scratch buffer
+
+    const int32 TaskCount = FMath::Min(FTaskGraphInterface::Get().GetNumWorkerThreads()+1, SectionCount);
+    const int32 SectionsPerTask = FMath::DivideAndRoundUp(SectionCount, TaskCount);
+
+    if (NormalScratchBuffers.Num() < TaskCount)
+    {
+        NormalScratchBuffers.SetNum(TaskCount);
+    }
+
+    ParallelFor(TaskCount, [&](int32 TaskIndex)
+    {
+        TArray<FVector>& Normals(NormalScratchBuffers[TaskIndex]);
+
+        const int32 SectionStart = TaskIndex * SectionsPerTask;
+        const int32 SectionEnd = FMath::Min(SectionStart+SectionsPerTask, SectionCount);
+
+        for (int32 i=SectionStart; i<SectionEnd; ++i)
         {
-            continue;
+            check(SectionRefs[i].HasValidSection());
+            CalculateSectionNormal(*SectionRefs[i].SectionPtr, Normals);
         }
+    } );
+}
 
-        TArray<int32> SectionIndices;
-        Mesh->GetAllNonEmptySectionIndices(SectionIndices);
+void AMQCMap::AppendSectionVertex(FPMUMeshSection& Dst, const FPMUMeshSection& Src, int32 VertexIndex)
+{
+    Dst.Positions.Emplace(Src.Positions[VertexIndex]);
 
-        for (int32 SectionIndex : SectionIndices)
+    if (Src.UVs.Num() > 0)
+    {
+        Dst.UVs.Emplace(Src.UVs[VertexIndex]);
+    }
+
+    if (Src.Colors.Num() > 0)
+    {
+        Dst.Colors.Emplace(Src.Colors[VertexIndex]);
+    }
+
+    if (Src.Tangents.Num() > 0)
+    {
+        Dst.Tangents.Emplace(Src.Tangents[VertexIndex*2  ]);
+        Dst.Tangents.Emplace(Src.Tangents[VertexIndex*2+1]);
+    }
+}
+
+bool AMQCMap::SimplifySectionInterior(FPMUMeshSection& Section, const FBox2D& Bounds, const FPMUMeshSimplifierOptions& Options)
+{
+    const TArray<FVector>& Positions(Section.Positions);
+    const TArray<uint32>& Indices(Section.Indices);
+
+    const int32 VCount = Positions.Num();
+    const int32 TCount = Indices.Num() / 3;
+
+    // Find mesh border vertices, borders are shared with neighbour meshes
+
+    TBitArray<> BorderFlags(false, VCount);
+
+    for (int32 vi=0; vi<VCount; ++vi)
+    {
+        const FVector& Position(Positions[vi]);
+
+        BorderFlags[vi] = (
+            FMath::IsNearlyEqual(Position.X, Bounds.Min.X) ||
+            FMath::IsNearlyEqual(Position.Y, Bounds.Min.Y) ||
+            FMath::IsNearlyEqual(Position.X, Bounds.Max.X) ||
+            FMath::IsNearlyEqual(Position.Y, Bounds.Max.Y)
+            );
+    }
+
+    // Split triangles into border strip and interior section,
+    // border strip triangles are excluded from simplification and
+    // every border strip triangle vertex is locked
+
+    TArray<int32> BorderTriangles;
+    TArray<int32> InteriorVertexMap;
+    TBitArray<> LockedFlags(false, VCount);
+    FPMUMeshSection Interior;
+
+    InteriorVertexMap.Init(INDEX_NONE, VCount);
+
+    for (int32 ti=0; ti<TCount; ++ti)
+    {
+        const uint32* TriIndices = &Indices[ti*3];
+
+        if (BorderFlags[TriIndices[0]] || BorderFlags[TriIndices[1]] || BorderFlags[TriIndices[2]])
         {
-            FPMUMeshSectionRef SectionRef(Mesh->GetSectionRef(SectionIndex));
-            FPMUMeshSection* SectionPtr(SectionRef.SectionPtr);
+            BorderTriangles.Emplace(ti);
+            LockedFlags[TriIndices[0]] = true;
+            LockedFlags[TriIndices[1]] = true;
+            LockedFlags[TriIndices[2]] = true;
+        }
+    }
 
-            if (SectionPtr && SectionPtr->HasGeometry())
+    for (int32 ti=0; ti<TCount; ++ti)
+    {
+        const uint32* TriIndices = &Indices[ti*3];
+
+        if (BorderFlags[TriIndices[0]] || BorderFlags[TriIndices[1]] || BorderFlags[TriIndices[2]])
+        {
+            continue;
+        }
+
+        for (int32 i=0; i<3; ++i)
+        {
+            int32& InteriorIndex(InteriorVertexMap[TriIndices[i]]);
+
+            if (InteriorIndex == INDEX_NONE)
             {
-                SectionRefs.Emplace(SectionRef);
+                InteriorIndex = Interior.Positions.Num();
+                AppendSectionVertex(Interior, Section, TriIndices[i]);
             }
+
+            Interior.Indices.Emplace(InteriorIndex);
         }
     }
 
-    for (FPMUMeshSectionRef& SectionRef : SectionRefs)
+    if (Interior.Indices.Num() < 1)
     {
-        check(SectionRef.HasValidSection());
-        check(SectionRef.SectionPtr->HasGeometry());
+        return false;
+    }
 
-        FPMUMeshSection& Section(*SectionRef.SectionPtr);
+    FPMUMeshSectionRef InteriorRef(Interior);
+    FPMUMeshSimplifier::SimplifyMeshSection(InteriorRef, Options);
 
-        TArray<uint32>& Indices(Section.Indices);
-        TArray<FVector>& Positions(Section.Positions);
-        TArray<uint32>& Tangents(Section.Tangents);
-        TArray<FVector> Normals;
+    // Map simplified interior vertices by position
 
-        const int32 VCount = Positions.Num();
-        const int32 TCount = Indices.Num() / 3;
+    TMap<uint32, int32> InteriorHashMap;
+    InteriorHashMap.Reserve(Interior.Positions.Num());
 
-        Normals.SetNumZeroed(VCount);
+    for (int32 vi=0; vi<Interior.Positions.Num(); ++vi)
+    {
+        InteriorHashMap.Emplace(UGULMathLibrary::GetHash(FVector2D(Interior.Positions[vi])), vi);
+    }
 
-        for (int32 ti=0; ti<TCount; ++ti)
-        {
-            int32 i0 = ti*3;
-            int32 i1 = i0+1;
-            int32 i2 = i0+2;
+    // Locked vertices shared with the interior must remain at their exact
+    // position, the simplifier has no per vertex locks. Keep the source
+    // section if simplification moved or removed any locked vertex.
 
-            int32 vi0 = Indices[i0];
-            int32 vi1 = Indices[i1];
-            int32 vi2 = Indices[i2];
+    TArray<int32> BorderVertexMap;
+    BorderVertexMap.Init(INDEX_NONE, VCount);
 
-            const FVector& Pos0(Positions[vi0]);
-            const FVector& Pos1(Positions[vi1]);
-            const FVector& Pos2(Positions[vi2]);
+    for (int32 vi=0; vi<VCount; ++vi)
+    {
+        if (LockedFlags[vi] && InteriorVertexMap[vi] != INDEX_NONE)
+        {
+            const int32* InteriorIndexPtr = InteriorHashMap.Find(UGULMathLibrary::GetHash(FVector2D(Positions[vi])));
 
-            const FVector Edge21 = Pos1 - Pos2;
-            const FVector Edge20 = Pos0 - Pos2;
-            const FVector TriNormal = (Edge21 ^ Edge20).GetSafeNormal();
+            if (! InteriorIndexPtr)
+            {
+                return false;
+            }
 
-            Normals[vi0] += TriNormal;
-            Normals[vi1] += TriNormal;
-            Normals[vi2] += TriNormal;
+            BorderVertexMap[vi] = *InteriorIndexPtr;
         }
+    }
+
+    // Append border strip to the simplified interior, locked vertices
+    // shared with the interior reuse the interior vertex at their position
 
-        for (int32 vi=0; vi<VCount; ++vi)
+    FPMUMeshSection Output(MoveTemp(Interior));
+
+    for (int32 ti : BorderTriangles)
+    {
+        const uint32* TriIndices = &Indices[ti*3];
+        uint32 OutIndices[3];
+
+        for (int32 i=0; i<3; ++i)
         {
-            FVector4 Normal(Normals[vi].GetSafeNormal(), 1.f);
-            FPackedNormal PackedNormal(Normal);
+            const int32 vi = TriIndices[i];
+            int32& OutIndex(BorderVertexMap[vi]);
+
+            if (OutIndex == INDEX_NONE)
+            {
+                OutIndex = Output.Positions.Num();
+                AppendSectionVertex(Output, Section, vi);
+            }
 
-            Tangents[vi*2+1] = PackedNormal.Vector.Packed;
+            OutIndices[i] = OutIndex;
         }
+
+        Output.Indices.Emplace(OutIndices[0]);
+        Output.Indices.Emplace(OutIndices[1]);
+        Output.Indices.Emplace(OutIndices[2]);
     }
+
+    Section.Positions = MoveTemp(Output.Positions);
+    Section.UVs = MoveTemp(Output.UVs);
+    Section.Colors = MoveTemp(Output.Colors);
+    Section.Tangents = MoveTemp(Output.Tangents);
+    Section.Indices = MoveTemp(Output.Indices);
+    Section.SectionLocalBox = FBox(Section.Positions);
+
+    return true;
 }
 
-void AMQCMap::SimplifyMesh(int32 StateIndex, FPMUMeshSimplifierOptions Options)
+void AMQCMap::SimplifyMesh(int32 StateIndex, FPMUMeshSimplifierOptions Options, bool bDirtyOnly)
 {
     if (! HasValidMap())
     {
         return;
     }
 
-    FMQCMap& Map(MapRef->GetMap());
+    if (bDirtyOnly && SimplifyDirtySurfaces.Num() < 1)
+    {
+        return;
+    }
+
     TArray<FPMUMeshSectionRef> SectionRefs;
-    const int32 ChunkCount = Map.GetChunkCount();
+    TArray<FIntPoint> SectionIds;
 
-    InitializeMeshComponents(SurfaceMeshComponents);
+    GetSurfaceSectionRefs(SectionRefs, SectionIds, StateIndex, bDirtyOnly ? &SimplifyDirtySurfaces : nullptr);
 
-    // Find mesh sections
-    for (int32 ChunkIndex=0; ChunkIndex<ChunkCount; ++ChunkIndex)
+    for (const FIntPoint& SectionId : SectionIds)
     {
-        UPMUMeshComponent* Mesh = GetSurfaceMesh(ChunkIndex);
+        SimplifyDirtySurfaces.Remove(FIntPoint(SectionId.X, StateIndex));
+    }
 
-        if (! IsValid(Mesh))
-        {
-            continue;
-        }
+    const int32 SectionCount = SectionRefs.Num();
 
-        TArray<int32> SectionIndices;
-        Mesh->GetAllNonEmptySectionIndices(SectionIndices);
+    if (SectionCount < 1)
+    {
+        return;
+    }
 
-        for (int32 SectionIndex : SectionIndices)
-        {
-            FPMUMeshSectionRef SectionRef(Mesh->GetSectionRef(SectionIndex));
-            FPMUMeshSection* SectionPtr(SectionRef.SectionPtr);
+    // Generate mesh border bounds
 
-            if (SectionPtr && SectionPtr->HasGeometry())
-            {
-                SectionRefs.Emplace(SectionRef);
-            }
+    TArray<FBox2D> SectionBounds;
+    SectionBounds.SetNumUninitialized(SectionCount);
+
+    for (int32 i=0; i<SectionCount; ++i)
+    {
+        SectionBounds[i] = GetSurfaceMeshBounds(SectionIds[i].X);
+    }
+
+    // Simplify section interiors in parallel, border vertices
+    // are locked to keep mesh seams watertight
+
+    TArray<bool> SimplifiedFlags;
+    SimplifiedFlags.SetNumZeroed(SectionCount);
+
+    ParallelFor(SectionCount, [&](int32 i)
+    {
+        check(SectionRefs[i].HasValidSection());
+        SimplifiedFlags[i] = SimplifySectionInterior(*SectionRefs[i].SectionPtr, SectionBounds[i], Options);
+    } );
+
+    // Publish simplified sections, simplified sections
+    // also require normal recalculation
+
+    for (int32 i=0; i<SectionCount; ++i)
+    {
+        if (SimplifiedFlags[i])
+        {
+            MarkRenderStateDirty(SectionIds[i].X);
+            NormalDirtySurfaces.Emplace(FIntPoint(SectionIds[i].X, StateIndex));
         }
     }
 
-    for (FPMUMeshSectionRef& SectionRef : SectionRefs)
+    if (bAutoCalculateMeshNormal)
     {
-        FPMUMeshSimplifier::SimplifyMeshSection(SectionRef, Options);
+        CalculateMeshNormal(StateIndex, true);
     }
 }
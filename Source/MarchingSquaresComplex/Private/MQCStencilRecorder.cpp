@@ -0,0 +1,501 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "MQCStencilRecorder.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/PlatformProcess.h"
+#include "HAL/PlatformTime.h"
+#include "Misc/FileHelper.h"
+#include "Serialization/MemoryReader.h"
+
+#include "MarchingSquaresComplex.h"
+#include "MQCMap.h"
+#include "MQCGridChunk.h"
+#include "Stencils/MQCStencilBox.h"
+#include "Stencils/MQCStencilCircle.h"
+#include "Stencils/MQCStencilSquare.h"
+#include "Stencils/MQCStencilTri.h"
+
+const uint32 FMQCStencilRecorder::StreamMagic = 0x5243514D; // "MQCR"
+const int32 FMQCStencilRecorder::StreamVersion = 3;
+
+// Recorder
+
+FMQCStencilRecorder::FMQCStencilRecorder()
+    : Writer(Data)
+    , StartTime(0.0)
+    , OpCount(0)
+    , bRecording(false)
+{
+}
+
+bool FMQCStencilRecorder::Start(const FMQCMapConfig& MapConfig, FMQCMap& Map)
+{
+    // Evicted chunk voxels are not resident, abort
+    if (Map.GetStreamer().GetEvictedCount() > 0)
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCStencilRecorder::Start() ABORTED - Map has evicted chunks"));
+        return false;
+    }
+
+    Data.Reset();
+    Writer.Seek(0);
+
+    uint32 Magic = StreamMagic;
+    int32 Version = StreamVersion;
+    FMQCMapConfig Config(MapConfig);
+
+    Writer << Magic;
+    Writer << Version;
+    FMQCMapConfig::StaticStruct()->SerializeBin(Writer, &Config);
+
+    // Write chunk voxels at recording start
+
+    Map.WaitForAsyncTask();
+
+    int32 ChunkCount = Map.GetChunkCount();
+    Writer << ChunkCount;
+
+    for (int32 ChunkIndex=0; ChunkIndex<ChunkCount; ++ChunkIndex)
+    {
+        FMQCGridChunk* Chunk = Map.FindChunk(ChunkIndex);
+        bool bAllocated = Chunk && Chunk->IsAllocated();
+
+        Writer << bAllocated;
+
+        if (bAllocated)
+        {
+            Chunk->SerializeVoxels(Writer);
+        }
+    }
+
+    StartTime = FPlatformTime::Seconds();
+    OpCount = 0;
+    bRecording = true;
+
+    return true;
+}
+
+void FMQCStencilRecorder::Stop(FMQCMap& Map)
+{
+    if (! bRecording)
+    {
+        return;
+    }
+
+    Map.WaitForAsyncTask();
+
+    uint32 Checksum = FMQCStencilReplay::GetMeshChecksum(Map);
+
+    WriteOpHeader(EMQCStencilOpType::OP_END);
+    Writer << Checksum;
+
+    bRecording = false;
+}
+
+bool FMQCStencilRecorder::SaveToFile(const FString& Filename) const
+{
+    return FFileHelper::SaveArrayToFile(Data, *Filename);
+}
+
+void FMQCStencilRecorder::WriteOpHeader(EMQCStencilOpType OpType)
+{
+    uint8 OpTypeValue = static_cast<uint8>(OpType);
+    double OpTime = FPlatformTime::Seconds() - StartTime;
+
+    Writer << OpTypeValue;
+    Writer << OpTime;
+
+    ++OpCount;
+}
+
+void FMQCStencilRecorder::RecordEdit(EMQCStencilOpType OpType, FMQCStencil& Stencil, const FVector2D& Center)
+{
+    // Stencil type without recordable settings, skip recording
+    if (! bRecording || Stencil.GetType() == EMQCStencilType::ST_NONE)
+    {
+        return;
+    }
+
+    uint8 StencilType = static_cast<uint8>(Stencil.GetType());
+    FVector2D OpCenter(Center);
+
+    WriteOpHeader(OpType);
+    Writer << StencilType;
+    Writer << OpCenter;
+    Stencil.SerializeSettings(Writer);
+}
+
+void FMQCStencilRecorder::RecordEditMap(FMQCStencil& Stencil, const FVector2D& Center)
+{
+    RecordEdit(EMQCStencilOpType::OP_EDIT_MAP, Stencil, Center);
+}
+
+void FMQCStencilRecorder::RecordEditMaterial(FMQCStencil& Stencil, const FVector2D& Center)
+{
+    RecordEdit(EMQCStencilOpType::OP_EDIT_MATERIAL, Stencil, Center);
+}
+
+void FMQCStencilRecorder::RecordTriangulate(bool bAsync)
+{
+    if (bRecording)
+    {
+        WriteOpHeader(bAsync
+            ? EMQCStencilOpType::OP_TRIANGULATE_ASYNC
+            : EMQCStencilOpType::OP_TRIANGULATE
+            );
+    }
+}
+
+void FMQCStencilRecorder::RecordResetChunkStates(const TArray<int32>& ChunkIndices)
+{
+    if (bRecording)
+    {
+        TArray<int32> Indices(ChunkIndices);
+
+        WriteOpHeader(EMQCStencilOpType::OP_RESET_CHUNK_STATES);
+        Writer << Indices;
+    }
+}
+
+void FMQCStencilRecorder::RecordResetAllChunkStates()
+{
+    if (bRecording)
+    {
+        WriteOpHeader(EMQCStencilOpType::OP_RESET_ALL_CHUNK_STATES);
+    }
+}
+
+// Replay
+
+FString FMQCStencilReplayResult::ToString() const
+{
+    return FString::Printf(
+        TEXT("Valid: %d, Edits: %d, Triangulations: %d, Recorded: %.3fs, Replay: %.3fs, Triangulation: %.3fs, Checksum: %08x/%08x (%s)"),
+        bValidStream ? 1 : 0,
+        EditCount,
+        TriangulateCount,
+        RecordedSeconds,
+        ReplaySeconds,
+        TriangulateSeconds,
+        RecordedChecksum,
+        ReplayChecksum,
+        IsChecksumMatch() ? TEXT("Match") : TEXT("Mismatch")
+        );
+}
+
+TUniquePtr<FMQCStencil> FMQCStencilReplay::CreateStencil(EMQCStencilType StencilType)
+{
+    switch (StencilType)
+    {
+        case EMQCStencilType::ST_SQUARE:
+            return MakeUnique<FMQCStencilSquare>();
+
+        case EMQCStencilType::ST_CIRCLE:
+            return MakeUnique<FMQCStencilCircle>();
+
+        case EMQCStencilType::ST_BOX:
+            return MakeUnique<FMQCStencilBox>();
+
+        case EMQCStencilType::ST_TRI:
+            return MakeUnique<FMQCStencilTri>();
+    }
+
+    return nullptr;
+}
+
+bool FMQCStencilReplay::Replay(FMQCMap& Map, const TArray<uint8>& Data, FMQCStencilReplayResult& OutResult, bool bOriginalTiming)
+{
+    OutResult = FMQCStencilReplayResult();
+
+    FMemoryReader Reader(Data);
+
+    uint32 Magic = 0;
+    int32 Version = 0;
+
+    Reader << Magic;
+    Reader << Version;
+
+    // Invalid stream header, abort
+    if (Reader.IsError() ||
+        Magic != FMQCStencilRecorder::StreamMagic ||
+        Version != FMQCStencilRecorder::StreamVersion
+        )
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::Replay() ABORTED - Invalid stream header"));
+        return false;
+    }
+
+    FMQCMapConfig MapConfig;
+    FMQCMapConfig::StaticStruct()->SerializeBin(Reader, &MapConfig);
+
+    Map.Clear();
+    Map.Initialize(MapConfig);
+
+    // Restore chunk voxels at recording start
+
+    int32 ChunkCount = 0;
+    Reader << ChunkCount;
+
+    // Chunk layout does not match recorded config, abort
+    if (Reader.IsError() || ChunkCount != Map.GetChunkCount())
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::Replay() ABORTED - Invalid chunk voxel data"));
+        return false;
+    }
+
+    TArray<int32> AllocatedChunks;
+
+    for (int32 ChunkIndex=0; ChunkIndex<ChunkCount && ! Reader.IsError(); ++ChunkIndex)
+    {
+        bool bAllocated = false;
+        Reader << bAllocated;
+
+        if (bAllocated)
+        {
+            Map.GetChunkForEdit(ChunkIndex).SerializeVoxels(Reader);
+            AllocatedChunks.Emplace(ChunkIndex);
+        }
+    }
+
+    if (Reader.IsError())
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::Replay() ABORTED - Invalid chunk voxel data"));
+        return false;
+    }
+
+    Map.UpdateChunkRegions(AllocatedChunks);
+    Map.Triangulate();
+
+    TMap<uint8, TUniquePtr<FMQCStencil>> Stencils;
+
+    const double ReplayStartTime = FPlatformTime::Seconds();
+
+    while (! Reader.AtEnd() && ! Reader.IsError())
+    {
+        uint8 OpTypeValue;
+        double OpTime;
+
+        Reader << OpTypeValue;
+        Reader << OpTime;
+
+        if (bOriginalTiming)
+        {
+            const double Delay = OpTime - (FPlatformTime::Seconds()-ReplayStartTime);
+
+            if (Delay > 0.0)
+            {
+                FPlatformProcess::Sleep(Delay);
+            }
+        }
+
+        OutResult.RecordedSeconds = OpTime;
+
+        switch (static_cast<EMQCStencilOpType>(OpTypeValue))
+        {
+            case EMQCStencilOpType::OP_EDIT_MAP:
+            case EMQCStencilOpType::OP_EDIT_MATERIAL:
+            {
+                uint8 StencilType;
+                FVector2D Center;
+
+                Reader << StencilType;
+                Reader << Center;
+
+                TUniquePtr<FMQCStencil>& Stencil(Stencils.FindOrAdd(StencilType));
+
+                if (! Stencil.IsValid())
+                {
+                    Stencil = CreateStencil(static_cast<EMQCStencilType>(StencilType));
+                }
+
+                // Unknown stencil type, abort
+                if (! Stencil.IsValid())
+                {
+                    UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::Replay() ABORTED - Unknown stencil type (%d)"), StencilType);
+                    return false;
+                }
+
+                Stencil->SerializeSettings(Reader);
+
+                if (OpTypeValue == static_cast<uint8>(EMQCStencilOpType::OP_EDIT_MAP))
+                {
+                    Stencil->EditMap(Map, Center);
+                }
+                else
+                {
+                    Stencil->EditMaterial(Map, Center);
+                }
+
+                ++OutResult.EditCount;
+            }
+            break;
+
+            case EMQCStencilOpType::OP_TRIANGULATE:
+            case EMQCStencilOpType::OP_TRIANGULATE_ASYNC:
+            {
+                const double TriangulateStartTime = FPlatformTime::Seconds();
+
+                if (OpTypeValue == static_cast<uint8>(EMQCStencilOpType::OP_TRIANGULATE))
+                {
+                    Map.Triangulate();
+                }
+                else
+                {
+                    Map.TriangulateAsync();
+                }
+
+                OutResult.TriangulateSeconds += FPlatformTime::Seconds() - TriangulateStartTime;
+                ++OutResult.TriangulateCount;
+            }
+            break;
+
+            case EMQCStencilOpType::OP_RESET_CHUNK_STATES:
+            {
+                TArray<int32> ChunkIndices;
+                Reader << ChunkIndices;
+                Map.ResetChunkStates(ChunkIndices);
+            }
+            break;
+
+            case EMQCStencilOpType::OP_RESET_ALL_CHUNK_STATES:
+            {
+                Map.ResetAllChunkStates();
+            }
+            break;
+
+            case EMQCStencilOpType::OP_END:
+            {
+                Reader << OutResult.RecordedChecksum;
+
+                Map.WaitForAsyncTask();
+
+                OutResult.ReplaySeconds = FPlatformTime::Seconds() - ReplayStartTime;
+                OutResult.ReplayChecksum = GetMeshChecksum(Map);
+                OutResult.bValidStream = ! Reader.IsError();
+
+                return OutResult.bValidStream;
+            }
+
+            default:
+            {
+                UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::Replay() ABORTED - Unknown op type (%d)"), OpTypeValue);
+                return false;
+            }
+        }
+    }
+
+    // Stream ended without end op (unfinished recording)
+    UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::Replay() ABORTED - Truncated stream"));
+
+    return false;
+}
+
+bool FMQCStencilReplay::ReplayFile(const FString& Filename, FMQCStencilReplayResult& OutResult, bool bOriginalTiming)
+{
+    TArray<uint8> Data;
+
+    if (! FFileHelper::LoadFileToArray(Data, *Filename))
+    {
+        UE_LOG(LogMQC, Warning, TEXT("FMQCStencilReplay::ReplayFile() ABORTED - Unable to load '%s'"), *Filename);
+        return false;
+    }
+
+    FMQCMap Map;
+    return Replay(Map, Data, OutResult, bOriginalTiming);
+}
+
+uint32 FMQCStencilReplay::GetMeshChecksum(const FMQCMap& Map)
+{
+    uint32 Crc = 0;
+
+    auto HashArray = [&Crc](const auto& Array)
+    {
+        Crc = FCrc::MemCrc32(Array.GetData(), Array.Num() * Array.GetTypeSize(), Crc);
+    };
+
+    // Hash non-empty sections only so the checksum does not
+    // depend on which chunks have a chunk object created
+
+    auto HashSection = [&Crc, &HashArray](const FPMUMeshSection* Section, int32 SectionKey)
+    {
+        if (! Section || Section->Indices.Num() < 1)
+        {
+            return;
+        }
+
+        int32 VertexCount = Section->Positions.Num();
+        int32 IndexCount = Section->Indices.Num();
+
+        Crc = FCrc::MemCrc32(&SectionKey, sizeof(SectionKey), Crc);
+        Crc = FCrc::MemCrc32(&VertexCount, sizeof(VertexCount), Crc);
+        Crc = FCrc::MemCrc32(&IndexCount, sizeof(IndexCount), Crc);
+
+        HashArray(Section->Positions);
+        HashArray(Section->UVs);
+        HashArray(Section->Colors);
+        HashArray(Section->Tangents);
+        HashArray(Section->Indices);
+    };
+
+    const int32 StateCount = Map.GetStateCount();
+
+    for (int32 ChunkIndex : Map.GetChunkTraversalOrder())
+    {
+        for (int32 StateIndex=1; StateIndex<=StateCount; ++StateIndex)
+        {
+            const int32 SectionKey = (ChunkIndex * (StateCount+1) + StateIndex) * 2;
+            HashSection(Map.GetSurfaceSection(ChunkIndex, StateIndex), SectionKey);
+            HashSection(Map.GetExtrudeSection(ChunkIndex, StateIndex), SectionKey+1);
+        }
+    }
+
+    return Crc;
+}
+
+// Console Commands
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice GMQCReplayStencilRecordingCommand(
+    TEXT("MQC.ReplayStencilRecording"),
+    TEXT("Replays a recorded stencil stream against a fresh map and verifies the mesh checksum. Usage: MQC.ReplayStencilRecording <File> [Timed]"),
+    FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateStatic(
+        [](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+        {
+            if (Args.Num() < 1)
+            {
+                Ar.Logf(TEXT("Usage: MQC.ReplayStencilRecording <File> [Timed]"));
+                return;
+            }
+
+            const bool bOriginalTiming = Args.Num() > 1 && Args[1].Equals(TEXT("Timed"), ESearchCase::IgnoreCase);
+
+            FMQCStencilReplayResult Result;
+            FMQCStencilReplay::ReplayFile(Args[0], Result, bOriginalTiming);
+
+            Ar.Logf(TEXT("%s %s"), *Args[0], *Result.ToString());
+        } )
+    );
@@ -0,0 +1,390 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "MQCTriangulationScheduler.h"
+#include "Async/TaskGraphInterfaces.h"
+#include "HAL/PlatformTime.h"
+
+#include "MQCMap.h"
+#include "MQCGridChunk.h"
+
+FMQCTriangulationScheduler::FMQCTriangulationScheduler(FMQCMap& InMap)
+    : Map(InMap)
+    , QueuedCount(0)
+    , AverageChunkTimeMs(0.0)
+{
+}
+
+void FMQCTriangulationScheduler::Reset()
+{
+    ChunkStates.Reset();
+    ChunkStates.SetNum(Map.GetChunkCount());
+    Queue.Reset();
+    InFlightChunks.Reset();
+    QueuedCount = 0;
+    AverageChunkTimeMs = 0.0;
+}
+
+float FMQCTriangulationScheduler::GetFocusPriority(int32 ChunkIndex) const
+{
+    if (FocusPoints.Num() < 1)
+    {
+        return 0.f;
+    }
+
+    const int32 ChunkResolution = Map.GetChunkResolution();
+    const float VoxelResolution = Map.GetVoxelResolution();
+
+    const FVector2D ChunkCenter(
+        ((ChunkIndex % ChunkResolution) + .5f) * VoxelResolution,
+        ((ChunkIndex / ChunkResolution) + .5f) * VoxelResolution
+        );
+
+    float MinDistSq = BIG_NUMBER;
+
+    for (const FVector2D& FocusPoint : FocusPoints)
+    {
+        MinDistSq = FMath::Min(MinDistSq, FVector2D::DistSquared(ChunkCenter, FocusPoint));
+    }
+
+    return FMath::Sqrt(MinDistSq);
+}
+
+void FMQCTriangulationScheduler::Enqueue(int32 ChunkIndex, float Priority, bool bExplicitPriority)
+{
+    FChunkState& State(ChunkStates[ChunkIndex]);
+
+    switch (State.Status)
+    {
+        // Chunk in flight, requeue once the running triangulation completes
+        case EChunkStatus::CS_IN_FLIGHT:
+        case EChunkStatus::CS_IN_FLIGHT_REQUEUED:
+            State.Status = EChunkStatus::CS_IN_FLIGHT_REQUEUED;
+            State.Priority = Priority;
+            State.bExplicitPriority = bExplicitPriority;
+            return;
+
+        // Chunk already queued with the same priority, coalesce request
+        case EChunkStatus::CS_QUEUED:
+            if (State.Priority == Priority)
+            {
+                State.bExplicitPriority = bExplicitPriority;
+                return;
+            }
+            break;
+
+        case EChunkStatus::CS_IDLE:
+            ++QueuedCount;
+            break;
+    }
+
+    State.Status = EChunkStatus::CS_QUEUED;
+    State.Priority = Priority;
+    State.bExplicitPriority = bExplicitPriority;
+    ++State.Serial;
+
+    Queue.HeapPush({ Priority, ChunkIndex, State.Serial });
+
+    // Too many stale queue entries, rebuild queue
+    if (Queue.Num() > (QueuedCount*2 + 64))
+    {
+        RebuildQueue();
+    }
+}
+
+bool FMQCTriangulationScheduler::Dequeue(int32& OutChunkIndex)
+{
+    while (Queue.Num() > 0)
+    {
+        FQueueEntry Entry;
+        Queue.HeapPop(Entry, false);
+
+        FChunkState& State(ChunkStates[Entry.ChunkIndex]);
+
+        // Skip stale entry
+        if (State.Status != EChunkStatus::CS_QUEUED || State.Serial != Entry.Serial)
+        {
+            continue;
+        }
+
+        State.Status = EChunkStatus::CS_IDLE;
+        --QueuedCount;
+
+        OutChunkIndex = Entry.ChunkIndex;
+        return true;
+    }
+
+    return false;
+}
+
+void FMQCTriangulationScheduler::RebuildQueue()
+{
+    Queue.Reset(QueuedCount);
+
+    for (int32 i=0; i<ChunkStates.Num(); ++i)
+    {
+        const FChunkState& State(ChunkStates[i]);
+
+        if (State.Status == EChunkStatus::CS_QUEUED)
+        {
+            Queue.Add({ State.Priority, i, State.Serial });
+        }
+    }
+
+    Queue.Heapify();
+}
+
+void FMQCTriangulationScheduler::UpdateAverageChunkTime(double ChunkTimeMs)
+{
+    AverageChunkTimeMs = (AverageChunkTimeMs > 0.0)
+        ? FMath::Lerp(AverageChunkTimeMs, ChunkTimeMs, .1)
+        : ChunkTimeMs;
+}
+
+void FMQCTriangulationScheduler::SetFocusPoints(const TArray<FVector2D>& InFocusPoints)
+{
+    FocusPoints = InFocusPoints;
+
+    // Update focus priorities and reorder queue
+
+    for (int32 i=0; i<ChunkStates.Num(); ++i)
+    {
+        FChunkState& State(ChunkStates[i]);
+
+        if (! State.bExplicitPriority)
+        {
+            State.Priority = GetFocusPriority(i);
+        }
+    }
+
+    RebuildQueue();
+}
+
+void FMQCTriangulationScheduler::RequestChunk(int32 ChunkIndex)
+{
+    if (ChunkStates.IsValidIndex(ChunkIndex))
+    {
+        Enqueue(ChunkIndex, GetFocusPriority(ChunkIndex), false);
+    }
+}
+
+void FMQCTriangulationScheduler::RequestChunk(int32 ChunkIndex, float Priority)
+{
+    if (ChunkStates.IsValidIndex(ChunkIndex))
+    {
+        Enqueue(ChunkIndex, Priority, true);
+    }
+}
+
+void FMQCTriangulationScheduler::RequestChunks(const TArray<int32>& ChunkIndices)
+{
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        RequestChunk(ChunkIndex);
+    }
+}
+
+void FMQCTriangulationScheduler::RequestEditedChunks(const TArray<int32>& ChunkIndices)
+{
+    const int32 ChunkResolution = Map.GetChunkResolution();
+
+    for (int32 ChunkIndex : ChunkIndices)
+    {
+        if (! ChunkStates.IsValidIndex(ChunkIndex))
+        {
+            continue;
+        }
+
+        const int32 ChunkX = ChunkIndex % ChunkResolution;
+        const int32 ChunkY = ChunkIndex / ChunkResolution;
+
+        RequestChunk(ChunkIndex);
+
+        if (ChunkX > 0)
+        {
+            RequestChunk(ChunkIndex-1);
+        }
+
+        if (ChunkY > 0)
+        {
+            RequestChunk(ChunkIndex-ChunkResolution);
+        }
+
+        if (ChunkX > 0 && ChunkY > 0)
+        {
+            RequestChunk(ChunkIndex-ChunkResolution-1);
+        }
+    }
+}
+
+void FMQCTriangulationScheduler::CancelChunk(int32 ChunkIndex)
+{
+    if (! ChunkStates.IsValidIndex(ChunkIndex))
+    {
+        return;
+    }
+
+    FChunkState& State(ChunkStates[ChunkIndex]);
+
+    if (State.Status == EChunkStatus::CS_QUEUED)
+    {
+        State.Status = EChunkStatus::CS_IDLE;
+        ++State.Serial;
+        --QueuedCount;
+    }
+    else
+    if (State.Status == EChunkStatus::CS_IN_FLIGHT_REQUEUED)
+    {
+        State.Status = EChunkStatus::CS_IN_FLIGHT;
+    }
+}
+
+void FMQCTriangulationScheduler::CancelAll()
+{
+    for (FChunkState& State : ChunkStates)
+    {
+        if (State.Status == EChunkStatus::CS_QUEUED)
+        {
+            State.Status = EChunkStatus::CS_IDLE;
+            ++State.Serial;
+        }
+        else
+        if (State.Status == EChunkStatus::CS_IN_FLIGHT_REQUEUED)
+        {
+            State.Status = EChunkStatus::CS_IN_FLIGHT;
+        }
+    }
+
+    Queue.Reset();
+    QueuedCount = 0;
+}
+
+int32 FMQCTriangulationScheduler::CollectCompletedChunks()
+{
+    int32 CompletedCount = 0;
+
+    for (int32 i=InFlightChunks.Num()-1; i>=0; --i)
+    {
+        const int32 ChunkIndex = InFlightChunks[i];
+        const FMQCGridChunk& Chunk(Map.GetChunk(ChunkIndex));
+
+        if (! Chunk.IsAsyncTaskComplete())
+        {
+            continue;
+        }
+
+        UpdateAverageChunkTime(Chunk.GetLastTriangulationTime() * 1000.0);
+        InFlightChunks.RemoveAtSwap(i, 1, false);
+        ++CompletedCount;
+
+        FChunkState& State(ChunkStates[ChunkIndex]);
+        const bool bRequeue = (State.Status == EChunkStatus::CS_IN_FLIGHT_REQUEUED);
+
+        State.Status = EChunkStatus::CS_IDLE;
+
+        if (bRequeue)
+        {
+            Enqueue(ChunkIndex, State.Priority, State.bExplicitPriority);
+        }
+    }
+
+    return CompletedCount;
+}
+
+int32 FMQCTriangulationScheduler::Tick(float BudgetMs, bool bDispatch)
+{
+    const double StartTime = FPlatformTime::Seconds();
+
+    int32 CompletedCount = CollectCompletedChunks();
+    int32 ChunkIndex;
+
+    if (! bDispatch)
+    {
+        return CompletedCount;
+    }
+
+    if (bAsync)
+    {
+        const int32 MaxInFlight = (MaxChunksInFlight > 0)
+            ? MaxChunksInFlight
+            : FMath::Max(1, FTaskGraphInterface::Get().GetNumWorkerThreads());
+
+        // Dispatch at least one chunk per tick, further chunks are
+        // dispatched while estimated task time fits within the budget
+
+        double DispatchedMs = 0.0;
+
+        while (InFlightChunks.Num() < MaxInFlight &&
+               (DispatchedMs <= 0.0 || (DispatchedMs + AverageChunkTimeMs) <= BudgetMs) &&
+               Dequeue(ChunkIndex)
+               )
+        {
+            FMQCGridChunk* Chunk = Map.FindChunk(ChunkIndex);
+
+            // Chunks without chunk object have no geometry
+            if (! Chunk)
+            {
+                continue;
+            }
+
+            Chunk->TriangulateAsync();
+
+            ChunkStates[ChunkIndex].Status = EChunkStatus::CS_IN_FLIGHT;
+            InFlightChunks.Emplace(ChunkIndex);
+
+            DispatchedMs += FMath::Max(AverageChunkTimeMs, KINDA_SMALL_NUMBER);
+        }
+    }
+    else
+    {
+        // Triangulate at least one chunk per tick, further chunks are
+        // triangulated while estimated completion time fits within the budget
+
+        int32 ProcessedCount = 0;
+
+        while ((ProcessedCount < 1 || ((FPlatformTime::Seconds()-StartTime) * 1000.0 + AverageChunkTimeMs) <= BudgetMs) &&
+               Dequeue(ChunkIndex)
+               )
+        {
+            FMQCGridChunk* Chunk = Map.FindChunk(ChunkIndex);
+
+            if (! Chunk)
+            {
+                continue;
+            }
+
+            Chunk->Triangulate();
+
+            UpdateAverageChunkTime(Chunk->GetLastTriangulationTime() * 1000.0);
+            ++ProcessedCount;
+        }
+
+        CompletedCount += ProcessedCount;
+    }
+
+    return CompletedCount;
+}
@@ -0,0 +1,164 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "MQCVoxelSnapshot.h"
+#include "HAL/PlatformProcess.h"
+#include "Misc/ScopeLock.h"
+
+SIZE_T FMQCVoxelSnapshot::GetAllocatedSize(bool bExcludeSharedBlocks) const
+{
+    SIZE_T AllocatedSize = sizeof(FMQCVoxelSnapshot) + Blocks.GetAllocatedSize();
+
+    for (const FBlockRef& Block : Blocks)
+    {
+        if (! bExcludeSharedBlocks || Block.IsUnique())
+        {
+            AllocatedSize += Block->GetAllocatedSize();
+        }
+    }
+
+    return AllocatedSize;
+}
+
+FMQCSnapshotEpochs::FMQCSnapshotEpochs()
+{
+    // Epoch zero marks a free reader slot
+    GlobalEpoch.Store(1);
+
+    for (int32 i=0; i<MaxReaderSlots; ++i)
+    {
+        ReaderEpochs[i].Store(0);
+    }
+}
+
+FMQCSnapshotEpochs::~FMQCSnapshotEpochs()
+{
+    for (FMQCVoxelSnapshot* Snapshot : RetiredSnapshots)
+    {
+        delete Snapshot;
+    }
+}
+
+int32 FMQCSnapshotEpochs::EnterRead()
+{
+    // Claim free reader slot, wait for slot release if all slots are taken
+
+    for (;;)
+    {
+        for (int32 i=0; i<MaxReaderSlots; ++i)
+        {
+            uint64 FreeEpoch = 0;
+
+            if (ReaderEpochs[i].Load(EMemoryOrder::Relaxed) == 0 &&
+                ReaderEpochs[i].CompareExchange(FreeEpoch, GlobalEpoch.Load()))
+            {
+                return i;
+            }
+        }
+
+        FPlatformProcess::Yield();
+    }
+}
+
+void FMQCSnapshotEpochs::ExitRead(int32 ReaderSlot)
+{
+    check(ReaderSlot >= 0 && ReaderSlot < MaxReaderSlots);
+    ReaderEpochs[ReaderSlot].Store(0);
+}
+
+uint64 FMQCSnapshotEpochs::GetMinReaderEpoch() const
+{
+    uint64 MinEpoch = MAX_uint64;
+
+    for (int32 i=0; i<MaxReaderSlots; ++i)
+    {
+        const uint64 ReaderEpoch = ReaderEpochs[i].Load();
+
+        if (ReaderEpoch != 0)
+        {
+            MinEpoch = FMath::Min(MinEpoch, ReaderEpoch);
+        }
+    }
+
+    return MinEpoch;
+}
+
+void FMQCSnapshotEpochs::Retire(FMQCVoxelSnapshot* Snapshot)
+{
+    if (Snapshot)
+    {
+        // Readers that might still hold the snapshot announced an epoch
+        // no later than the epoch before the increment
+
+        Snapshot->RetireEpoch = GlobalEpoch++;
+
+        FScopeLock Lock(&RetiredLock);
+        RetiredSnapshots.Emplace(Snapshot);
+    }
+
+    Reclaim();
+}
+
+int32 FMQCSnapshotEpochs::Reclaim()
+{
+    FScopeLock Lock(&RetiredLock);
+
+    if (RetiredSnapshots.Num() < 1)
+    {
+        return 0;
+    }
+
+    const uint64 MinReaderEpoch = GetMinReaderEpoch();
+    int32 ReclaimCount = 0;
+
+    for (int32 i=RetiredSnapshots.Num()-1; i>=0; --i)
+    {
+        if (RetiredSnapshots[i]->RetireEpoch < MinReaderEpoch)
+        {
+            delete RetiredSnapshots[i];
+            RetiredSnapshots.RemoveAtSwap(i, 1, false);
+            ++ReclaimCount;
+        }
+    }
+
+    return ReclaimCount;
+}
+
+SIZE_T FMQCSnapshotEpochs::GetRetiredAllocatedSize()
+{
+    FScopeLock Lock(&RetiredLock);
+
+    SIZE_T AllocatedSize = RetiredSnapshots.GetAllocatedSize();
+
+    // Blocks shared with published snapshots are accounted by their chunks
+    for (const FMQCVoxelSnapshot* Snapshot : RetiredSnapshots)
+    {
+        AllocatedSize += Snapshot->GetAllocatedSize(true);
+    }
+
+    return AllocatedSize;
+}
@@ -0,0 +1,121 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/CriticalSection.h"
+#include "Templates/Atomic.h"
+#include "MQCVoxel.h"
+
+// Immutable published copy of chunk voxels.
+//
+// Voxels are published in blocks of voxel rows. Blocks without edited
+// rows are shared with the previous snapshot, publishing an edit only
+// copies the blocks covering the edited rows.
+struct FMQCVoxelSnapshot
+{
+    typedef TSharedRef<const TArray<FMQCVoxel>, ESPMode::ThreadSafe> FBlockRef;
+
+    enum { BlockRows = 8 };
+
+    TArray<FBlockRef> Blocks;
+    int32 BlockSize = 0;
+    uint64 Version = 0;
+    uint64 RetireEpoch = 0;
+
+    FORCEINLINE const FMQCVoxel& GetVoxel(int32 VoxelIndex) const
+    {
+        return Blocks[VoxelIndex / BlockSize].Get()[VoxelIndex % BlockSize];
+    }
+
+    // Allocated size, shared blocks are excluded if specified
+    SIZE_T GetAllocatedSize(bool bExcludeSharedBlocks = false) const;
+};
+
+// Epoch based reclamation of retired voxel snapshots.
+//
+// Readers announce the current global epoch in a reader slot before
+// loading published snapshot pointers and clear the slot once done.
+// Writers publish a new snapshot, retire the replaced snapshot with the
+// current epoch and advance the global epoch. Retired snapshots are
+// reclaimed once every active reader announced a later epoch, readers
+// never lock and never observe a snapshot being modified or freed.
+class FMQCSnapshotEpochs
+{
+    enum { MaxReaderSlots = 64 };
+
+    TAtomic<uint64> GlobalEpoch;
+    TAtomic<uint64> ReaderEpochs[MaxReaderSlots];
+
+    FCriticalSection RetiredLock;
+    TArray<FMQCVoxelSnapshot*> RetiredSnapshots;
+
+    uint64 GetMinReaderEpoch() const;
+
+public:
+
+    FMQCSnapshotEpochs();
+    ~FMQCSnapshotEpochs();
+
+    // Announces a reader, returns the claimed reader slot
+    int32 EnterRead();
+    void ExitRead(int32 ReaderSlot);
+
+    // Retires a replaced snapshot and reclaims expired snapshots
+    void Retire(FMQCVoxelSnapshot* Snapshot);
+    int32 Reclaim();
+
+    SIZE_T GetRetiredAllocatedSize();
+};
+
+// Pins published voxel snapshots for the lifetime of the scope,
+// a null epoch manager makes the scope a no-op
+class FMQCSnapshotReadScope
+{
+    FMQCSnapshotEpochs* Epochs;
+    int32 ReaderSlot;
+
+public:
+
+    FORCEINLINE explicit FMQCSnapshotReadScope(FMQCSnapshotEpochs* InEpochs)
+        : Epochs(InEpochs)
+        , ReaderSlot(InEpochs ? InEpochs->EnterRead() : INDEX_NONE)
+    {
+    }
+
+    FORCEINLINE ~FMQCSnapshotReadScope()
+    {
+        if (Epochs)
+        {
+            Epochs->ExitRead(ReaderSlot);
+        }
+    }
+
+    FMQCSnapshotReadScope(const FMQCSnapshotReadScope&) = delete;
+    FMQCSnapshotReadScope& operator=(const FMQCSnapshotReadScope&) = delete;
+};
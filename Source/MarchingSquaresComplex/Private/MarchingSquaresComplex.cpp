@@ -50,6 +50,42 @@ public:
 
 DEFINE_LOG_CATEGORY(LogMQC);
 DEFINE_LOG_CATEGORY(UntMQC);
+
+DEFINE_STAT(STAT_MQC_SetStates);
+DEFINE_STAT(STAT_MQC_SetCrossings);
+DEFINE_STAT(STAT_MQC_SetMaterials);
+DEFINE_STAT(STAT_MQC_TriangulateChunk);
+DEFINE_STAT(STAT_MQC_TriangulateCellRows);
+DEFINE_STAT(STAT_MQC_TriangulateGapRow);
+DEFINE_STAT(STAT_MQC_TriangulateLOD);
+DEFINE_STAT(STAT_MQC_FinalizeSurface);
+DEFINE_STAT(STAT_MQC_GenerateEdgeListData);
+DEFINE_STAT(STAT_MQC_ResolveChunkEdgeData);
+DEFINE_STAT(STAT_MQC_PublishMesh);
+DEFINE_STAT(STAT_MQC_FlushRenderState);
+DEFINE_STAT(STAT_MQC_CompressChunk);
+DEFINE_STAT(STAT_MQC_DecompressChunk);
+
+DEFINE_STAT(STAT_MQC_ChunksEdited);
+DEFINE_STAT(STAT_MQC_ChunksTriangulated);
+DEFINE_STAT(STAT_MQC_CellsTriangulated);
+DEFINE_STAT(STAT_MQC_VerticesEmitted);
+DEFINE_STAT(STAT_MQC_TrianglesEmitted);
+DEFINE_STAT(STAT_MQC_VertexMapEntries);
+DEFINE_STAT(STAT_MQC_ChunksCompressed);
+DEFINE_STAT(STAT_MQC_ChunksDecompressed);
+
+DEFINE_STAT(STAT_MQC_VoxelMemory);
+DEFINE_STAT(STAT_MQC_TriangulationCacheMemory);
+DEFINE_STAT(STAT_MQC_EdgeDataMemory);
+DEFINE_STAT(STAT_MQC_MeshSectionMemory);
+DEFINE_STAT(STAT_MQC_MaterialMemory);
+DEFINE_STAT(STAT_MQC_TotalMemory);
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER && ENGINE_MAJOR_VERSION >= 5
+LLM_DEFINE_TAG(MarchingSquaresComplex);
+#endif
+
 IMPLEMENT_MODULE(FMarchingSquaresComplex, MarchingSquaresComplex)
 
 #undef LOCTEXT_NAMESPACE
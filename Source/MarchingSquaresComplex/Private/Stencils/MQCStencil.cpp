@@ -27,6 +27,7 @@
 
 #include "MQCStencil.h"
 #include "MQCGridChunk.h"
+#include "MQCStencilRecorder.h"
 #include "MQCVoxel.h"
 
 void FMQCStencil::ValidateNormalX(FMQCVoxel& xMin, const FMQCVoxel& xMax)
@@ -104,7 +105,7 @@ void FMQCStencil::GetChunks(TArray<FMQCGridChunk*>& Chunks, FMQCMap& Map, const
 
     for (int32 i : ChunkIndices)
     {
-        Chunks.Emplace(&Map.GetChunk(i));
+        Chunks.Emplace(&Map.GetChunkForEdit(i));
     }
 }
 
@@ -431,6 +432,18 @@ void FMQCStencil::Initialize(const FMQCMap& VoxelMap)
     MaterialType = VoxelMap.GetMaterialType();
 }
 
+void FMQCStencil::SerializeSettings(FArchive& Ar)
+{
+    uint8 BlendType = static_cast<uint8>(MaterialBlendSetting);
+
+    Ar << FillTypeSetting;
+    Ar << MaterialSetting;
+    Ar << BlendType;
+    Ar << bEnableAsync;
+
+    MaterialBlendSetting = static_cast<EMQCMaterialBlendType>(BlendType);
+}
+
 void FMQCStencil::EditMap(FMQCMap& Map, const FVector2D& center)
 {
     const int32 VoxelResolution = Map.GetVoxelResolution();
@@ -440,12 +453,25 @@ void FMQCStencil::EditMap(FMQCMap& Map, const FVector2D& center)
     TArray<FMQCGridChunk*> Chunks;
 
     Initialize(Map);
+
+    if (FMQCStencilRecorder* Recorder = Map.GetRecorder())
+    {
+        Recorder->RecordEditMap(*this, center);
+    }
+
     SetCenter(center.X, center.Y);
     GetChunkIndices(ChunkIndices, VoxelResolution, ChunkResolution);
     GetChunks(Chunks, Map, ChunkIndices);
 
     SetVoxels(Chunks);
     SetCrossings(Chunks);
+
+    Map.UpdateChunkRegions(ChunkIndices);
+
+    if (Map.IsScheduleEditedChunks())
+    {
+        Map.GetScheduler().RequestEditedChunks(ChunkIndices);
+    }
 }
 
 void FMQCStencil::EditMaterial(FMQCMap& Map, const FVector2D& center)
@@ -457,11 +483,22 @@ void FMQCStencil::EditMaterial(FMQCMap& Map, const FVector2D& center)
     TArray<FMQCGridChunk*> Chunks;
 
     Initialize(Map);
+
+    if (FMQCStencilRecorder* Recorder = Map.GetRecorder())
+    {
+        Recorder->RecordEditMaterial(*this, center);
+    }
+
     SetCenter(center.X, center.Y);
     GetChunkIndices(ChunkIndices, VoxelResolution, ChunkResolution);
     GetChunks(Chunks, Map, ChunkIndices);
 
     SetMaterials(Chunks);
+
+    if (Map.IsScheduleEditedChunks())
+    {
+        Map.GetScheduler().RequestEditedChunks(ChunkIndices);
+    }
 }
 
 void FMQCStencil::SetVoxels(FMQCGridChunk& Chunk)
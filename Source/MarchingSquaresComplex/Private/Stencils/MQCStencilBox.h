@@ -118,6 +118,24 @@ public:
             SetBounds(BoundsSetting);
         }
     }
+
+    virtual EMQCStencilType GetType() const override
+    {
+        return EMQCStencilType::ST_BOX;
+    }
+
+    virtual void SerializeSettings(FArchive& Ar) override
+    {
+        FMQCStencil::SerializeSettings(Ar);
+
+        FBox2D Bounds(bounds);
+        Ar << Bounds;
+
+        if (Ar.IsLoading())
+        {
+            SetBounds(Bounds);
+        }
+    }
 };
 
 UCLASS(BlueprintType)
@@ -54,6 +54,17 @@ public:
     virtual void Initialize(const FMQCMap& VoxelMap) override;
     virtual void ApplyVoxel(FMQCVoxel& Voxel, const FIntPoint& ChunkOffset) const override;
     virtual void ApplyMaterial(FMQCVoxel& Voxel, const FIntPoint& ChunkOffset) const override;
+
+    virtual EMQCStencilType GetType() const override
+    {
+        return EMQCStencilType::ST_CIRCLE;
+    }
+
+    virtual void SerializeSettings(FArchive& Ar) override
+    {
+        FMQCStencilSquare::SerializeSettings(Ar);
+        Ar << MaterialBlendRadiusSetting;
+    }
 };
 
 UCLASS(BlueprintType)
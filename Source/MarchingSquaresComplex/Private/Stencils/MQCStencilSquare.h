@@ -79,6 +79,17 @@ public:
 
     virtual void Initialize(const FMQCMap& VoxelMap) override;
     virtual void ApplyVoxel(FMQCVoxel& Voxel, const FIntPoint& ChunkOffset) const override;
+
+    virtual EMQCStencilType GetType() const override
+    {
+        return EMQCStencilType::ST_SQUARE;
+    }
+
+    virtual void SerializeSettings(FArchive& Ar) override
+    {
+        FMQCStencil::SerializeSettings(Ar);
+        Ar << RadiusSetting;
+    }
 };
 
 UCLASS()
@@ -186,6 +186,29 @@ public:
         Nrm[1].Set(-Nrm12.Y, Nrm12.X);
         Nrm[2].Set(-Nrm20.Y, Nrm20.X);
     }
+
+    virtual EMQCStencilType GetType() const override
+    {
+        return EMQCStencilType::ST_TRI;
+    }
+
+    virtual void SerializeSettings(FArchive& Ar) override
+    {
+        FMQCStencil::SerializeSettings(Ar);
+
+        FVector Positions[3];
+
+        for (int32 i=0; i<3; ++i)
+        {
+            Positions[i] = Offsets[i] + FVector(Shift, 0.f);
+            Ar << Positions[i];
+        }
+
+        if (Ar.IsLoading())
+        {
+            SetPositions(Positions[0], Positions[1], Positions[2]);
+        }
+    }
 };
 
 UCLASS()
@@ -0,0 +1,479 @@
+////////////////////////////////////////////////////////////////////////////////
+//
+// MIT License
+// 
+// Copyright (c) 2018-2019 Nuraga Wiswakarma
+// 
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// 
+// The above copyright notice and this permission notice shall be included in
+// all copies or substantial portions of the Software.
+// 
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+// THE SOFTWARE.
+//
+////////////////////////////////////////////////////////////////////////////////
+// 
+
+#include "CoreMinimal.h"
+#include "Misc/AutomationTest.h"
+#include "Misc/CommandLine.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Parse.h"
+#include "Misc/Paths.h"
+#include "HAL/PlatformTime.h"
+
+#include "MarchingSquaresComplex.h"
+#include "MQCMap.h"
+#include "MQCGridChunk.h"
+#include "Stencils/MQCStencilCircle.h"
+#include "Stencils/MQCStencilSquare.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+// Headless triangulation benchmark suite.
+//
+// Run with:
+//   UE4Editor-Cmd <Project> -ExecCmds="Automation RunTests MarchingSquaresComplex.Benchmark;Quit" -unattended -nullrhi
+//
+// Optional parameters:
+//   -MQCBenchmarkIterations=<N>  Timed iterations per case (default 5)
+//   -MQCBenchmarkOutput=<Path>   Result file (default <Saved>/Benchmarks/MQCBenchmark.json)
+//
+// Results are written as a JSON document with one record per case using a
+// fixed key order, and each record is also logged as a single line
+// prefixed with "MQCBenchmark".
+
+namespace MQCBenchmark
+{
+    struct FCaseConfig
+    {
+        int32 VoxelResolution;
+        int32 ChunkResolution;
+        EMQCMaterialType MaterialType;
+        const TCHAR* Stencil;
+        float Radius;
+    };
+
+    struct FCaseResult
+    {
+        FString Operation;
+        FCaseConfig Config;
+        int32 Iterations;
+        double TotalMs;
+        double MinMs;
+        double MaxMs;
+        int64 Triangles;
+        double TrianglesPerSecond;
+        uint64 PeakMapMemory;
+        int64 MapMemoryDelta;
+    };
+
+    static const TCHAR* GetMaterialTypeName(EMQCMaterialType MaterialType)
+    {
+        switch (MaterialType)
+        {
+            case EMQCMaterialType::MT_COLOR:        return TEXT("MT_COLOR");
+            case EMQCMaterialType::MT_SINGLE_INDEX: return TEXT("MT_SINGLE_INDEX");
+            case EMQCMaterialType::MT_DOUBLE_INDEX: return TEXT("MT_DOUBLE_INDEX");
+            case EMQCMaterialType::MT_TRIPLE_INDEX: return TEXT("MT_TRIPLE_INDEX");
+        }
+        return TEXT("MT_UNKNOWN");
+    }
+
+    static FMQCMapConfig CreateMapConfig(const FCaseConfig& Config)
+    {
+        FMQCMapConfig MapConfig;
+        MapConfig.VoxelResolution = Config.VoxelResolution;
+        MapConfig.ChunkResolution = Config.ChunkResolution;
+        MapConfig.MaterialType = Config.MaterialType;
+
+        // Extruded state with edge UV remapping and a plain surface state
+
+        FMQCSurfaceState ExtrudeState;
+        ExtrudeState.bGenerateExtrusion = true;
+        ExtrudeState.bRemapEdgeUVs = true;
+
+        FMQCSurfaceState SurfaceState;
+
+        MapConfig.States.Emplace(ExtrudeState);
+        MapConfig.States.Emplace(SurfaceState);
+
+        return MapConfig;
+    }
+
+    static int64 GetTriangleCount(const FMQCMap& Map)
+    {
+        int64 Triangles = 0;
+
+        for (int32 ChunkIndex : Map.GetChunkTraversalOrder())
+        {
+            for (int32 StateIndex=1; StateIndex<=Map.GetStateCount(); ++StateIndex)
+            {
+                const FPMUMeshSection* SurfaceSection = Map.GetSurfaceSection(ChunkIndex, StateIndex);
+                const FPMUMeshSection* ExtrudeSection = Map.GetExtrudeSection(ChunkIndex, StateIndex);
+
+                Triangles += SurfaceSection ? SurfaceSection->Indices.Num()/3 : 0;
+                Triangles += ExtrudeSection ? ExtrudeSection->Indices.Num()/3 : 0;
+            }
+        }
+
+        return Triangles;
+    }
+
+    static void EditMap(FMQCMap& Map, const TCHAR* Stencil, float Radius, const FVector2D& Center, uint8 FillType)
+    {
+        if (FCString::Strcmp(Stencil, TEXT("Square")) == 0)
+        {
+            FMQCStencilSquare Square;
+            Square.RadiusSetting = Radius;
+            Square.FillTypeSetting = FillType;
+            Square.MaterialSetting = Map.GetTypedMaterial(FillType, FLinearColor::White);
+            Square.MaterialBlendSetting = EMQCMaterialBlendType::MBT_DEFAULT;
+            Square.EditMap(Map, Center);
+        }
+        else
+        {
+            FMQCStencilCircle Circle;
+            Circle.RadiusSetting = Radius;
+            Circle.MaterialBlendRadiusSetting = 1.f;
+            Circle.FillTypeSetting = FillType;
+            Circle.MaterialSetting = Map.GetTypedMaterial(FillType, FLinearColor::White);
+            Circle.MaterialBlendSetting = EMQCMaterialBlendType::MBT_DEFAULT;
+            Circle.EditMap(Map, Center);
+        }
+    }
+
+    // Deterministic edit center for the specified iteration
+    static FVector2D GetEditCenter(const FMQCMap& Map, int32 Iteration)
+    {
+        FRandomStream Random(0x4D5143 + Iteration);
+        const float Dimension = Map.GetVoxelDimension();
+        return FVector2D(Random.FRandRange(0.f, Dimension), Random.FRandRange(0.f, Dimension));
+    }
+
+    // Fill map with a fixed pattern of overlapping circles
+    static void FillMap(FMQCMap& Map)
+    {
+        const int32 EditCount = FMath::Max(8, Map.GetChunkCount());
+        const float Radius = FMath::Max(2.f, Map.GetVoxelResolution() * .75f);
+
+        for (int32 i=0; i<EditCount; ++i)
+        {
+            EditMap(Map, TEXT("Circle"), Radius, GetEditCenter(Map, -1-i), (i % 2) + 1);
+        }
+    }
+
+    static void GetEditChunks(TArray<FMQCGridChunk*>& OutChunks, FMQCMap& Map, const FVector2D& Center, float Radius)
+    {
+        // Include preceding chunks whose border cells share the edited voxels
+
+        const int32 Extent = FMath::CeilToInt(Radius) + 1;
+        const FIntPoint Point(FMath::RoundToInt(Center.X), FMath::RoundToInt(Center.Y));
+
+        Map.GetChunks(OutChunks, Point-FIntPoint(Extent+1, Extent+1), Point+FIntPoint(Extent, Extent));
+    }
+
+    // Map allocated memory, async tasks are completed before sampling
+    static uint64 GetMapMemory(FMQCMap& Map)
+    {
+        Map.WaitForAsyncTask();
+
+        FMQCMemoryUsage Usage;
+        Map.GetMemoryUsage(Usage);
+        return Usage.GetTotal();
+    }
+
+    class FRunner
+    {
+        int32 Iterations;
+        TArray<FCaseResult> Results;
+
+    public:
+
+        FRunner(int32 InIterations)
+            : Iterations(InIterations)
+        {
+        }
+
+        FORCEINLINE const TArray<FCaseResult>& GetResults() const
+        {
+            return Results;
+        }
+
+        // Runs setup and the timed function for each iteration,
+        // triangle count is sampled from the map after the last iteration.
+        // Map memory is sampled after each setup and timed function call
+        // outside the timed scope, the case reports its high-water mark.
+        void Run(
+            const TCHAR* Operation,
+            const FCaseConfig& Config,
+            FMQCMap& Map,
+            TFunctionRef<void(int32)> SetupFunc,
+            TFunctionRef<void(int32)> TimedFunc,
+            bool bCountTriangles = true
+            )
+        {
+            const uint64 MapMemoryStart = GetMapMemory(Map);
+            uint64 MapMemory = MapMemoryStart;
+            uint64 PeakMapMemory = MapMemoryStart;
+
+            double TotalMs = 0.0;
+            double MinMs = TNumericLimits<double>::Max();
+            double MaxMs = 0.0;
+
+            for (int32 i=0; i<Iterations; ++i)
+            {
+                SetupFunc(i);
+
+                PeakMapMemory = FMath::Max(PeakMapMemory, GetMapMemory(Map));
+
+                const double StartTime = FPlatformTime::Seconds();
+                TimedFunc(i);
+                const double ElapsedMs = (FPlatformTime::Seconds()-StartTime) * 1000.0;
+
+                MapMemory = GetMapMemory(Map);
+                PeakMapMemory = FMath::Max(PeakMapMemory, MapMemory);
+
+                TotalMs += ElapsedMs;
+                MinMs = FMath::Min(MinMs, ElapsedMs);
+                MaxMs = FMath::Max(MaxMs, ElapsedMs);
+            }
+
+            FCaseResult Result;
+            Result.Operation = Operation;
+            Result.Config = Config;
+            Result.Iterations = Iterations;
+            Result.TotalMs = TotalMs;
+            Result.MinMs = MinMs;
+            Result.MaxMs = MaxMs;
+            Result.Triangles = bCountTriangles ? GetTriangleCount(Map) : 0;
+            Result.TrianglesPerSecond = (TotalMs > 0.0)
+                ? (Result.Triangles * Iterations) / (TotalMs / 1000.0)
+                : 0.0;
+            Result.PeakMapMemory = PeakMapMemory;
+            Result.MapMemoryDelta = (int64) MapMemory - (int64) MapMemoryStart;
+
+            Results.Emplace(Result);
+
+            UE_LOG(LogMQC, Display, TEXT("MQCBenchmark %s"), *ToJson(Result));
+        }
+
+        static FString ToJson(const FCaseResult& Result)
+        {
+            const double AvgMs = Result.Iterations > 0 ? Result.TotalMs / Result.Iterations : 0.0;
+
+            return FString::Printf(
+                TEXT("{\"operation\":\"%s\",\"voxel_resolution\":%d,\"chunk_resolution\":%d,\"material_type\":\"%s\",\"stencil\":\"%s\",\"radius\":%.2f,")
+                TEXT("\"iterations\":%d,\"total_ms\":%.4f,\"avg_ms\":%.4f,\"min_ms\":%.4f,\"max_ms\":%.4f,")
+                TEXT("\"triangles\":%lld,\"triangles_per_second\":%.1f,\"peak_map_memory\":%llu,\"map_memory_delta\":%lld}"),
+                *Result.Operation,
+                Result.Config.VoxelResolution,
+                Result.Config.ChunkResolution,
+                GetMaterialTypeName(Result.Config.MaterialType),
+                Result.Config.Stencil,
+                Result.Config.Radius,
+                Result.Iterations,
+                Result.TotalMs,
+                AvgMs,
+                Result.MinMs,
+                Result.MaxMs,
+                Result.Triangles,
+                Result.TrianglesPerSecond,
+                Result.PeakMapMemory,
+                Result.MapMemoryDelta
+                );
+        }
+
+        FString ToJson() const
+        {
+            FString Output(TEXT("{\n  \"schema\": 2,\n  \"results\": [\n"));
+
+            for (int32 i=0; i<Results.Num(); ++i)
+            {
+                Output += TEXT("    ");
+                Output += ToJson(Results[i]);
+                Output += (i < Results.Num()-1) ? TEXT(",\n") : TEXT("\n");
+            }
+
+            Output += TEXT("  ]\n}\n");
+
+            return Output;
+        }
+    };
+
+    static void RunMapCases(FRunner& Runner, const FCaseConfig& Config)
+    {
+        const FMQCMapConfig MapConfig(CreateMapConfig(Config));
+
+        FMQCMap Map;
+
+        // Initialize
+
+        Runner.Run(TEXT("Initialize"), Config, Map,
+            [&](int32) { Map.Clear(); },
+            [&](int32) { Map.Initialize(MapConfig); },
+            false
+            );
+
+        FillMap(Map);
+        Map.Triangulate();
+
+        // Full triangulation
+
+        Runner.Run(TEXT("Triangulate"), Config, Map,
+            [&](int32) {},
+            [&](int32) { Map.Triangulate(); }
+            );
+
+        Runner.Run(TEXT("TriangulateAsync"), Config, Map,
+            [&](int32) {},
+            [&](int32) { Map.TriangulateAsync(); Map.FinalizeAsync(); }
+            );
+
+        Runner.Run(TEXT("ResolveChunkEdgeData"), Config, Map,
+            [&](int32) {},
+            [&](int32) { Map.ResolveChunkEdgeData(); }
+            );
+    }
+
+    static void RunStencilCases(FRunner& Runner, const FCaseConfig& Config)
+    {
+        const FMQCMapConfig MapConfig(CreateMapConfig(Config));
+
+        FMQCMap Map;
+        Map.Initialize(MapConfig);
+        FillMap(Map);
+        Map.Triangulate();
+
+        TArray<FMQCGridChunk*> EditChunks;
+
+        // Stencil edit, alternates fill type so every edit changes voxels
+
+        Runner.Run(TEXT("EditMap"), Config, Map,
+            [&](int32) {},
+            [&](int32 i) { EditMap(Map, Config.Stencil, Config.Radius, GetEditCenter(Map, i), (i % 2) + 1); },
+            false
+            );
+
+        // Partial triangulation of chunks affected by an edit
+
+        auto SetupPartial = [&](int32 i)
+        {
+            const FVector2D Center(GetEditCenter(Map, i));
+            EditMap(Map, Config.Stencil, Config.Radius, Center, (i % 2) + 1);
+            EditChunks.Reset();
+            GetEditChunks(EditChunks, Map, Center, Config.Radius);
+        };
+
+        Runner.Run(TEXT("TriangulatePartial"), Config, Map,
+            SetupPartial,
+            [&](int32)
+            {
+                for (FMQCGridChunk* Chunk : EditChunks)
+                {
+                    Chunk->Triangulate();
+                }
+                Map.ResolveChunkEdgeData();
+            } );
+
+        Runner.Run(TEXT("TriangulateAsyncPartial"), Config, Map,
+            SetupPartial,
+            [&](int32)
+            {
+                for (FMQCGridChunk* Chunk : EditChunks)
+                {
+                    Chunk->TriangulateAsync();
+                }
+                for (FMQCGridChunk* Chunk : EditChunks)
+                {
+                    Chunk->WaitForAsyncTask();
+                }
+                Map.ResolveChunkEdgeData();
+            } );
+    }
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+    FMQCBenchmarkTest,
+    "MarchingSquaresComplex.Benchmark",
+    EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::PerfFilter
+    )
+
+bool FMQCBenchmarkTest::RunTest(const FString& Parameters)
+{
+    using namespace MQCBenchmark;
+
+    int32 Iterations = 5;
+    FParse::Value(FCommandLine::Get(), TEXT("MQCBenchmarkIterations="), Iterations);
+    Iterations = FMath::Max(1, Iterations);
+
+    FString OutputPath(FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Benchmarks"), TEXT("MQCBenchmark.json")));
+    FParse::Value(FCommandLine::Get(), TEXT("MQCBenchmarkOutput="), OutputPath);
+
+    FRunner Runner(Iterations);
+
+    // Map resolutions
+
+    const FIntPoint Resolutions[] = {
+        FIntPoint(16, 4),
+        FIntPoint(32, 4),
+        FIntPoint(32, 8),
+        FIntPoint(64, 8)
+        };
+
+    for (const FIntPoint& Resolution : Resolutions)
+    {
+        RunMapCases(Runner, { Resolution.X, Resolution.Y, EMQCMaterialType::MT_COLOR, TEXT("None"), 0.f });
+    }
+
+    // Material types
+
+    const EMQCMaterialType MaterialTypes[] = {
+        EMQCMaterialType::MT_SINGLE_INDEX,
+        EMQCMaterialType::MT_DOUBLE_INDEX,
+        EMQCMaterialType::MT_TRIPLE_INDEX
+        };
+
+    for (EMQCMaterialType MaterialType : MaterialTypes)
+    {
+        RunMapCases(Runner, { 32, 4, MaterialType, TEXT("None"), 0.f });
+    }
+
+    // Stencil edits
+
+    const TCHAR* Stencils[] = { TEXT("Circle"), TEXT("Square") };
+    const float Radii[] = { 2.f, 8.f, 32.f };
+
+    for (EMQCMaterialType MaterialType : { EMQCMaterialType::MT_COLOR, EMQCMaterialType::MT_TRIPLE_INDEX })
+    for (const TCHAR* Stencil : Stencils)
+    for (float Radius : Radii)
+    {
+        RunStencilCases(Runner, { 32, 8, MaterialType, Stencil, Radius });
+    }
+
+    // Write results
+
+    if (FFileHelper::SaveStringToFile(Runner.ToJson(), *OutputPath))
+    {
+        AddInfo(FString::Printf(TEXT("MQCBenchmark results written to %s"), *OutputPath));
+    }
+    else
+    {
+        AddError(FString::Printf(TEXT("Failed to write MQCBenchmark results to %s"), *OutputPath));
+    }
+
+    return true;
+}
+
+#endif // WITH_DEV_AUTOMATION_TESTS
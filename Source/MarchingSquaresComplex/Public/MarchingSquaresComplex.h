@@ -28,6 +28,11 @@
 #pragma once
 
 #include "ModuleManager.h"
+#include "Runtime/Launch/Resources/Version.h"
+
+#if ENGINE_MAJOR_VERSION > 4 || ENGINE_MINOR_VERSION >= 25
+#include "ProfilingDebugging/CpuProfilerTrace.h"
+#endif
 
 class IMarchingSquaresComplex : public IModuleInterface
 {
@@ -52,3 +57,61 @@ public:
 DECLARE_LOG_CATEGORY_EXTERN(LogMQC, Verbose, All);
 DECLARE_LOG_CATEGORY_EXTERN(UntMQC, Verbose, All);
 DECLARE_STATS_GROUP(TEXT("MarchingSquaresComplex"), STATGROUP_MarchingSquaresComplex, STATCAT_Advanced);
+
+// Stage cycle counters
+
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Set States"), STAT_MQC_SetStates, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Set Crossings"), STAT_MQC_SetCrossings, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Set Materials"), STAT_MQC_SetMaterials, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Triangulate Chunk"), STAT_MQC_TriangulateChunk, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Triangulate Cell Rows"), STAT_MQC_TriangulateCellRows, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Triangulate Gap Row"), STAT_MQC_TriangulateGapRow, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Triangulate LOD"), STAT_MQC_TriangulateLOD, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Finalize Surface"), STAT_MQC_FinalizeSurface, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Generate Edge List Data"), STAT_MQC_GenerateEdgeListData, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Resolve Chunk Edge Data"), STAT_MQC_ResolveChunkEdgeData, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Publish Mesh"), STAT_MQC_PublishMesh, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Flush Render State"), STAT_MQC_FlushRenderState, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Compress Chunk"), STAT_MQC_CompressChunk, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_CYCLE_STAT_EXTERN(TEXT("Decompress Chunk"), STAT_MQC_DecompressChunk, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+
+// Per frame counters
+
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Chunks Edited"), STAT_MQC_ChunksEdited, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Chunks Triangulated"), STAT_MQC_ChunksTriangulated, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Cells Triangulated"), STAT_MQC_CellsTriangulated, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vertices Emitted"), STAT_MQC_VerticesEmitted, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Triangles Emitted"), STAT_MQC_TrianglesEmitted, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Vertex Map Entries"), STAT_MQC_VertexMapEntries, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Chunks Compressed"), STAT_MQC_ChunksCompressed, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_DWORD_COUNTER_STAT_EXTERN(TEXT("Chunks Decompressed"), STAT_MQC_ChunksDecompressed, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+
+// Memory stats, updated after map initialization and triangulation
+
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Voxel Memory"), STAT_MQC_VoxelMemory, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Triangulation Cache Memory"), STAT_MQC_TriangulationCacheMemory, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Edge Data Memory"), STAT_MQC_EdgeDataMemory, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Mesh Section Memory"), STAT_MQC_MeshSectionMemory, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Material Memory"), STAT_MQC_MaterialMemory, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+DECLARE_MEMORY_STAT_EXTERN(TEXT("Total Memory"), STAT_MQC_TotalMemory, STATGROUP_MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+
+// Low level memory tracker tag, engines without plugin defined tags
+// only report map memory through stats and object resource sizes
+
+#if ENABLE_LOW_LEVEL_MEM_TRACKER && ENGINE_MAJOR_VERSION >= 5
+    LLM_DECLARE_TAG_API(MarchingSquaresComplex, MARCHINGSQUARESCOMPLEX_API);
+    #define MQC_LLM_SCOPE() LLM_SCOPE_BYTAG(MarchingSquaresComplex)
+#else
+    #define MQC_LLM_SCOPE()
+#endif
+
+// Scoped stage timer, uses the cycle counter if stats are enabled
+// and falls back to a named cpu trace scope otherwise
+
+#if STATS
+    #define MQC_SCOPE_CYCLE_COUNTER(Stat) SCOPE_CYCLE_COUNTER(Stat)
+#elif defined(TRACE_CPUPROFILER_EVENT_SCOPE)
+    #define MQC_SCOPE_CYCLE_COUNTER(Stat) TRACE_CPUPROFILER_EVENT_SCOPE(Stat)
+#else
+    #define MQC_SCOPE_CYCLE_COUNTER(Stat)
+#endif